@@ -2,6 +2,7 @@
 // Licensed under the MIT license.
 
 #include <algorithm>
+#include <limits>
 #include <mscclpp/concurrency_device.hpp>
 #include <mscclpp/core.hpp>
 #include <mscclpp/executor.hpp>
@@ -57,8 +58,7 @@ struct ncclComm {
   std::vector<std::shared_ptr<mscclpp::Connection>> connections;
   std::vector<std::shared_ptr<mscclpp::SmDevice2DeviceSemaphore>> smSemaphores;
   std::shared_ptr<mscclpp::Executor> executor;
-  std::shared_ptr<mscclpp::ExecutionPlan> allReducePacketIPPlan, allReducePacketOPPlan, allReduceIPPlan,
-      allReduceOPPlan;
+  std::shared_ptr<mscclpp::PlanRegistry> planRegistry;
 
   std::unordered_map<channelKey, ChannelInfo> channelInInfos;
   std::unordered_map<channelKey, ChannelInfo> channelOutInfos;
@@ -69,6 +69,9 @@ struct ncclComm {
   size_t smallMessageSizeBoundary, largeMessageSizeBoundary;
   uint32_t numScratchBuff;
   uint32_t buffFlag;
+
+  // Reductions created by ncclRedOpCreatePreMulSum and the data type they were created for, by their ncclRedOp_t
+  std::unordered_map<int, std::pair<mscclpp::Reduction, ncclDataType_t>> userRedOps;
 };
 
 static size_t ncclTypeSize(ncclDataType_t type) {
@@ -194,6 +197,32 @@ static std::shared_ptr<mscclpp::DeviceHandle<mscclpp::SmChannel>> setupSmChannel
   return ptr;
 }
 
+static ncclResult_t getReduction(ncclComm_t comm, ncclRedOp_t op, ncclDataType_t datatype,
+                                 mscclpp::Reduction& reduction) {
+  switch (op) {
+    case ncclSum:
+      reduction = {mscclpp::ReduceOp::SUM};
+      return ncclSuccess;
+    case ncclProd:
+      reduction = {mscclpp::ReduceOp::PROD};
+      return ncclSuccess;
+    case ncclMax:
+      reduction = {mscclpp::ReduceOp::MAX};
+      return ncclSuccess;
+    case ncclMin:
+      reduction = {mscclpp::ReduceOp::MIN};
+      return ncclSuccess;
+    case ncclAvg:
+      reduction = {mscclpp::ReduceOp::AVG};
+      return ncclSuccess;
+    default:
+      auto it = comm->userRedOps.find(op);
+      if (it == comm->userRedOps.end() || it->second.second != datatype) return ncclInvalidArgument;
+      reduction = it->second.first;
+      return ncclSuccess;
+  }
+}
+
 static ncclResult_t ncclAllReduceFallback(const void* sendbuff, void* recvbuff, size_t count, ncclDataType_t datatype,
                                           ncclRedOp_t, ncclComm_t comm, cudaStream_t stream) {
   // Checking if the parameters are valids
@@ -342,18 +371,6 @@ NCCL_API ncclResult_t ncclCommInitRank(ncclComm_t* comm, int nranks, ncclUniqueI
       setupRemoteMemories(commPtr->comm, rank, commPtr->scratchBuff.get(), SCRATCH_SIZE, mscclpp::Transport::CudaIpc);
   commPtr->executor = std::make_shared<mscclpp::Executor>(mscclppComm);
 
-  if (getenv("ALLREDUCEPKT_IP_JSON_FILE"))
-    commPtr->allReducePacketIPPlan = std::make_shared<mscclpp::ExecutionPlan>(
-        mscclpp::ExecutionPlan("allreduce_packet", getenv("ALLREDUCEPKT_IP_JSON_FILE")));
-  if (getenv("ALLREDUCEPKT_OP_JSON_FILE"))
-    commPtr->allReducePacketOPPlan = std::make_shared<mscclpp::ExecutionPlan>(
-        mscclpp::ExecutionPlan("allreduce_packet", getenv("ALLREDUCEPKT_OP_JSON_FILE")));
-  if (getenv("ALLREDUCE_IP_JSON_FILE"))
-    commPtr->allReduceIPPlan =
-        std::make_shared<mscclpp::ExecutionPlan>(mscclpp::ExecutionPlan("allreduce", getenv("ALLREDUCE_IP_JSON_FILE")));
-  if (getenv("ALLREDUCE_OP_JSON_FILE"))
-    commPtr->allReduceOPPlan =
-        std::make_shared<mscclpp::ExecutionPlan>(mscclpp::ExecutionPlan("allreduce", getenv("ALLREDUCE_OP_JSON_FILE")));
   if (getenv("ALLREDUCE_SMALL_MSG_BOUNDARY"))
     commPtr->smallMessageSizeBoundary = parseSize(getenv("ALLREDUCE_SMALL_MSG_BOUNDARY"));
   else
@@ -365,6 +382,21 @@ NCCL_API ncclResult_t ncclCommInitRank(ncclComm_t* comm, int nranks, ncclUniqueI
 
   if (commPtr->smallMessageSizeBoundary > commPtr->largeMessageSizeBoundary) return ncclInvalidArgument;
 
+  commPtr->planRegistry = std::make_shared<mscclpp::PlanRegistry>();
+  if (getenv("MSCCLPP_EXECUTION_PLAN_DIR")) commPtr->planRegistry->loadDirectory(getenv("MSCCLPP_EXECUTION_PLAN_DIR"));
+  // Plans given one by one are registered for the size ranges set by the boundaries.
+  auto registerAllReducePlan = [&](const char* env, const std::string& name, bool inPlace, size_t minSize,
+                                   size_t maxSize) {
+    if (getenv(env) == nullptr) return;
+    mscclpp::PlanInfo info = {"allreduce", "", inPlace, nranks, minSize, maxSize};
+    commPtr->planRegistry->registerPlan(std::make_shared<mscclpp::ExecutionPlan>(name, getenv(env)), info);
+  };
+  size_t packetEnd = commPtr->largeMessageSizeBoundary + 1;
+  registerAllReducePlan("ALLREDUCEPKT_IP_JSON_FILE", "allreduce_packet", true, 0, packetEnd);
+  registerAllReducePlan("ALLREDUCEPKT_OP_JSON_FILE", "allreduce_packet", false, 0, packetEnd);
+  registerAllReducePlan("ALLREDUCE_IP_JSON_FILE", "allreduce", true, packetEnd, std::numeric_limits<size_t>::max());
+  registerAllReducePlan("ALLREDUCE_OP_JSON_FILE", "allreduce", false, packetEnd, std::numeric_limits<size_t>::max());
+
   *comm = commPtr;
   return ncclSuccess;
 }
@@ -447,14 +479,50 @@ NCCL_API ncclResult_t ncclCommUserRank(const ncclComm_t comm, int* rank) {
   return ncclSuccess;
 }
 
-NCCL_API ncclResult_t ncclRedOpCreatePreMulSum(ncclRedOp_t*, void*, ncclDataType_t, ncclScalarResidence_t, ncclComm_t) {
-  // TODO: implement this function
-  return ncclInternalError;
+NCCL_API ncclResult_t ncclRedOpCreatePreMulSum(ncclRedOp_t* op, void* scalar, ncclDataType_t datatype,
+                                               ncclScalarResidence_t residence, ncclComm_t comm) {
+  if (op == nullptr || scalar == nullptr || comm == nullptr) return ncclInvalidArgument;
+  mscclpp::Reduction reduction = {mscclpp::ReduceOp::PREMUL_SUM};
+  switch (datatype) {
+    case ncclFloat16:
+      reduction.scalar = residence == ncclScalarHostImmediate ? __half2float(*(half*)scalar) : 1;
+      break;
+    case ncclFloat32:
+      reduction.scalar = residence == ncclScalarHostImmediate ? *(float*)scalar : 1;
+      break;
+    case ncclFloat64:
+      reduction.scalar = residence == ncclScalarHostImmediate ? *(double*)scalar : 1;
+      break;
+    case ncclBfloat16:
+      reduction.scalar = residence == ncclScalarHostImmediate ? __bfloat162float(*(__bfloat16*)scalar) : 1;
+      break;
+    case ncclInt32:
+      reduction.scalar = residence == ncclScalarHostImmediate ? *(int32_t*)scalar : 1;
+      break;
+    case ncclUint32:
+      reduction.scalar = residence == ncclScalarHostImmediate ? *(uint32_t*)scalar : 1;
+      break;
+    default:
+      return ncclInvalidArgument;
+  }
+  // A device scalar is read by each collective when it scales its output, so it may change between collectives.
+  if (residence == ncclScalarDevice) {
+    reduction.deviceScalar = scalar;
+  }
+
+  int id = ncclNumOps;
+  while (comm->userRedOps.count(id) != 0) {
+    if (id == ncclMaxRedOp) return ncclInternalError;
+    id++;
+  }
+  comm->userRedOps[id] = {reduction, datatype};
+  *op = (ncclRedOp_t)id;
+  return ncclSuccess;
 }
 
-NCCL_API ncclResult_t ncclRedOpDestroy(ncclRedOp_t, ncclComm_t) {
-  // TODO: implement this function
-  return ncclInternalError;
+NCCL_API ncclResult_t ncclRedOpDestroy(ncclRedOp_t op, ncclComm_t comm) {
+  if (comm == nullptr || comm->userRedOps.erase(op) == 0) return ncclInvalidArgument;
+  return ncclSuccess;
 }
 
 NCCL_API ncclResult_t ncclReduce(const void*, void*, size_t, ncclDataType_t, ncclRedOp_t, int, ncclComm_t,
@@ -479,40 +547,44 @@ NCCL_API ncclResult_t ncclAllReduce(const void* sendbuff, void* recvbuff, size_t
   if (sendbuff == nullptr || recvbuff == nullptr || count == 0 || ncclTypeSize(datatype) == 0 || comm == nullptr)
     return ncclInvalidArgument;
 
+  mscclpp::Reduction reduction;
+  if (getReduction(comm, reductionOperation, datatype, reduction) != ncclSuccess) return ncclInvalidArgument;
+  if (reduction.op == mscclpp::ReduceOp::AVG && (datatype == ncclInt32 || datatype == ncclUint32))
+    return ncclInvalidArgument;
+
   // Declarating variables
   size_t bytes = count * ncclTypeSize(datatype);
   int rank = comm->comm->bootstrap()->getRank();
 
-  if (bytes < comm->smallMessageSizeBoundary) {
+  // The fallback kernels only sum, other reductions need an execution plan
+  bool sum = reduction.op == mscclpp::ReduceOp::SUM;
+  if (sum && bytes < comm->smallMessageSizeBoundary) {
     return ncclAllReduceFallback(sendbuff, recvbuff, count, datatype, reductionOperation, comm, stream);
   } else {
-    std::shared_ptr<mscclpp::ExecutionPlan> plan;
-    if (bytes <= comm->largeMessageSizeBoundary)
-      plan = (sendbuff == recvbuff) ? comm->allReducePacketIPPlan : comm->allReducePacketOPPlan;
-    else {
-      plan = (sendbuff == recvbuff) ? comm->allReduceIPPlan : comm->allReduceOPPlan;
-    }
-
-    if (plan == nullptr)
+    std::shared_ptr<mscclpp::ExecutionPlan> plan =
+        comm->planRegistry->select({"allreduce", bytes, sendbuff == recvbuff, comm->comm->bootstrap()->getNranks()});
+    if (plan == nullptr) {
+      if (!sum) return ncclInvalidArgument;
       return ncclAllReduceFallback(sendbuff, recvbuff, count, datatype, reductionOperation, comm, stream);
+    }
 
     switch (datatype) {
       case ncclFloat16:
         comm->executor->execute(rank, (half*)sendbuff, (half*)recvbuff, bytes, bytes, mscclpp::DataType::FLOAT16, *plan,
-                                stream, mscclpp::PacketType::LL8);
+                                stream, mscclpp::PacketType::LL8, reduction);
         break;
       case ncclFloat32:
         comm->executor->execute(rank, (float*)sendbuff, (float*)recvbuff, bytes, bytes, mscclpp::DataType::FLOAT32,
-                                *plan, stream, mscclpp::PacketType::LL8);
+                                *plan, stream, mscclpp::PacketType::LL8, reduction);
         break;
       case ncclBfloat16:
         comm->executor->execute(rank, (__bfloat16*)sendbuff, (__bfloat16*)recvbuff, bytes, bytes,
-                                mscclpp::DataType::BFLOAT16, *plan, stream, mscclpp::PacketType::LL8);
+                                mscclpp::DataType::BFLOAT16, *plan, stream, mscclpp::PacketType::LL8, reduction);
         break;
       case ncclInt32:
       case ncclUint32:
         comm->executor->execute(rank, (int*)sendbuff, (int*)recvbuff, bytes, bytes, mscclpp::DataType::UINT32, *plan,
-                                stream, mscclpp::PacketType::LL8);
+                                stream, mscclpp::PacketType::LL8, reduction);
         break;
       default:
         return ncclInvalidArgument;
@@ -663,6 +663,20 @@ class Communicator {
   /// to the connection.
   NonblockingFuture<std::shared_ptr<Connection>> connectOnSetup(int remoteRank, int tag, EndpointConfig localConfig);
 
+  /// Connect to a remote rank on setup, or reuse a connection made by an earlier call with the same arguments.
+  ///
+  /// Like @ref connectOnSetup(), but connections are pooled by remote rank, tag and endpoint configuration. A pooled
+  /// connection is destroyed with its last holder. The remote rank must call this function with the same tag as well,
+  /// and the next @ref setup() reuses the pooled connection if both sides still hold it, or connects again in a setup
+  /// round of its own.
+  ///
+  /// @param remoteRank The rank of the remote process.
+  /// @param tag The tag of the connection for identifying it.
+  /// @param localConfig The configuration for the local endpoint.
+  /// @return NonblockingFuture<std::shared_ptr<Connection>> A non-blocking future of shared pointer to the connection.
+  NonblockingFuture<std::shared_ptr<Connection>> sharedConnectOnSetup(int remoteRank, int tag,
+                                                                      EndpointConfig localConfig);
+
   /// Get the remote rank a connection is connected to.
   ///
   /// @param connection The connection to get the remote rank for.
@@ -684,7 +698,8 @@ class Communicator {
   ///
   /// This includes previous calls of @ref sendMemoryOnSetup(), @ref recvMemoryOnSetup(), @ref connectOnSetup(), and
   /// @ref onSetup(). It is allowed to call this function multiple times, where the n-th call will only setup objects
-  /// that have been registered after the (n-1)-th call.
+  /// that have been registered after the (n-1)-th call. Objects registered by the setup of others are set up in a
+  /// further round of the same call.
   void setup();
 
  private:
@@ -4,9 +4,13 @@
 #ifndef MSCCLPP_EXECUTOR_HPP_
 #define MSCCLPP_EXECUTOR_HPP_
 
+#include <chrono>
+#include <future>
 #include <memory>
 #include <mscclpp/core.hpp>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace mscclpp {
 
@@ -23,27 +27,442 @@ enum class PacketType {
   LL16,
 };
 
+/// Operator the reduce operations of a plan combine data with.
+enum class ReduceOp {
+  SUM,
+  PROD,
+  MAX,
+  MIN,
+  /// Sum of the data of the ranks multiplied by 1 / the number of ranks of the plan. Only for floating point data
+  /// types.
+  AVG,
+  /// Sum of the data of the ranks multiplied by Reduction::scalar.
+  PREMUL_SUM,
+};
+
+/// Reduction of an execution. The reduce operations of a plan sum the data for AVG and PREMUL_SUM, and the reduce that
+/// completes each chunk of the output, marked `"final": true` in the plan, multiplies its result by the factor. Plans
+/// of reducing collectives (allreduce, reducescatter and reduce) without such marks reject AVG and PREMUL_SUM. The
+/// factor must be the same on all ranks.
+struct Reduction {
+  ReduceOp op = ReduceOp::SUM;
+  /// Factor of PREMUL_SUM, converted to the data type of the execution.
+  double scalar = 1;
+  /// Device memory holding the factor of PREMUL_SUM as a value of the data type of the execution, read instead of
+  /// scalar in stream order when the kernel starts. Only for executions on the GPU.
+  const void* deviceScalar = nullptr;
+};
+
+/// Counters of the host-side work done by an Executor.
+struct ExecutorStats {
+  /// Number of executions that uploaded device plans to the GPU.
+  uint64_t planUploads;
+  /// Number of executions that reused a context whose device plans were already up to date.
+  uint64_t planUploadsSkipped;
+  /// Total number of device plan bytes uploaded.
+  uint64_t planBytesUploaded;
+  /// Bytes of the scratch buffers the executor allocated, and of those held by an execution context. Contexts borrow
+  /// their scratch buffer from a pool shared by all contexts executed on the same stream, in power-of-two sizes.
+  uint64_t scratchBytesReserved;
+  uint64_t scratchBytesInUse;
+  /// Executions that found an existing context for their buffers and plan, and executions that set one up.
+  uint64_t contextHits;
+  uint64_t contextMisses;
+  /// Contexts torn down to meet the budgets of ExecutorConfig, or because a PlanRegistry replaced their plan.
+  uint64_t contextEvictions;
+};
+
+/// A problem found by ExecutionPlan::verify.
+struct PlanIssue {
+  enum class Severity {
+    /// The plan runs, but likely not as intended.
+    Warning,
+    /// The plan would fail, hang, corrupt memory or produce wrong results.
+    Error,
+  };
+  Severity severity;
+  /// The rank, threadblock and operation index the issue is about, or -1 if it is not about a specific one.
+  int rank;
+  int threadblock;
+  int operation;
+  std::string message;
+};
+
+/// What ExecutionPlan::optimize changed, summed over all ranks.
+struct PlanOptimizationStats {
+  /// Number of operations before and after the optimization.
+  uint64_t operationsBefore;
+  uint64_t operationsAfter;
+  /// Number of barriers removed because no operation after them depends on one before them.
+  uint64_t barriersRemoved;
+  /// Number of signals and flushes fused into a preceding put on proxy channels.
+  uint64_t putsFused;
+  /// Number of copies merged into a preceding copy of the adjacent chunks.
+  uint64_t copiesMerged;
+};
+
+/// Hardware model of ExecutionPlan::simulate. Bandwidths are in GB/s and times in microseconds.
+struct SimulationConfig {
+  /// Ranks r and s are on the same node if r / nRanksPerNode == s / nRanksPerNode.
+  int nRanksPerNode = 8;
+  /// Throughput of the memory accesses of a single threadblock, counting both the bytes read and written.
+  double threadblockBandwidth = 80;
+  /// Local memory bandwidth of a GPU, shared by its threadblocks.
+  double memoryBandwidth = 1500;
+  /// Bandwidth and latency of the link between two GPUs of the same node.
+  double intraNodeBandwidth = 150;
+  double intraNodeLatency = 1;
+  /// Bandwidth and latency of the network between two GPUs of different nodes.
+  double interNodeBandwidth = 25;
+  double interNodeLatency = 5;
+  /// Time the proxy takes to pick up a request of a proxy channel.
+  double proxyLatency = 2;
+  /// Time a threadblock spends on any operation besides its transfers, e.g. a barrier.
+  double operationOverhead = 0.1;
+  /// Compute the link utilization timeline, SimulatedLink::utilization.
+  bool timeline = true;
+  /// Length of the intervals of the timeline. Longer intervals are used if the timeline would otherwise have more than
+  /// maxTimelineIntervals intervals.
+  double timelineInterval = 1;
+  size_t maxTimelineIntervals = 10000;
+};
+
+/// Utilization of a link over the simulated execution.
+struct SimulatedLink {
+  /// Sending and receiving ranks. The local memory of a rank is a link with src == dst.
+  int src;
+  int dst;
+  /// "intra-node" or "inter-node" for links between ranks, "memory" for local memory. SM and proxy channels between
+  /// two ranks share the same link.
+  std::string type;
+  double bandwidth;
+  uint64_t bytes;
+  /// Fraction of the bandwidth used in each interval of SimulationResult::timelineInterval microseconds, empty if
+  /// SimulationConfig::timeline is false.
+  std::vector<double> utilization;
+};
+
+/// Outcome of ExecutionPlan::simulate.
+struct SimulationResult {
+  /// Time from the start of the kernel until the last threadblock of any rank is done, in microseconds.
+  double completionTime;
+  /// Completion time of each rank, indexed by rank.
+  std::vector<double> rankCompletionTimes;
+  /// True if some threadblocks wait for signals that never come. Times then stop at the last event.
+  bool deadlocked;
+  /// Length of the intervals of the timeline, at least SimulationConfig::timelineInterval.
+  double timelineInterval;
+  std::vector<SimulatedLink> links;
+};
+
 class ExecutionPlan {
  public:
   ExecutionPlan(const std::string& name, const std::string& planPath);
   ~ExecutionPlan() = default;
 
- private:
+  /// Load the plan for @p rank, or for all ranks if @p rank is -1, ahead of the first execution. Loading a single rank
+  /// only keeps the data of that rank and of the ranks it is connected to.
+  void load(int rank = -1) const;
+
+  /// Write the plan in the compiled binary format to @p outputPath. A compiled plan can be passed as `planPath` to
+  /// construct an ExecutionPlan and is loaded without any JSON parsing.
+  void compile(const std::string& outputPath) const;
+
+  /// Statically check the plan for a message of @p inputSize and @p outputSize bytes on every rank: signals and waits
+  /// must match on each channel and must not deadlock, operations must stay within the input, output and scratch
+  /// buffers and only use channels of their threadblock, `deps` must be enforced by barriers, signals and waits,
+  /// and threadblocks of a rank must not write the same bytes concurrently. The check runs on a separate copy of the
+  /// plan and does not change this object.
+  /// @return The issues found, empty if the plan is valid.
+  std::vector<PlanIssue> verify(size_t inputSize, size_t outputSize) const;
+
+  /// Rewrite the operations of the plan into an equivalent, shorter form: a put followed by a signal (and a flush) on
+  /// the same proxy channels becomes a put-with-signal(-and-flush), copies of adjacent chunks are merged, and barriers
+  /// are removed when no operation after them accesses memory written or read before them, follows a wait, or
+  /// releases data with a signal. The plan is loaded for all ranks first, so optimize large plans offline and load
+  /// the compiled result. Must be called before the plan is executed.
+  /// @return The number of operations removed by each rewrite.
+  PlanOptimizationStats optimize() const;
+
+  /// Predict the execution of the plan for a message of @p inputSize and @p outputSize bytes on every rank with a
+  /// discrete-event simulation on the host. Threadblocks run their operations in order: waits block until the
+  /// matching signal arrives, proxy channel requests run in order behind the threadblock, and concurrent transfers
+  /// share the bandwidth of their links. Like verify, the simulation runs on a separate copy of the plan.
+  SimulationResult simulate(size_t inputSize, size_t outputSize, const SimulationConfig& config = {}) const;
+
+  /// Execute the plan on the host for a message of @p inputSize and @p outputSize bytes on every rank, with
+  /// @p inputs[r] and @p outputs[r] the buffers of rank r. The ranks are threads of this process and every threadblock
+  /// of a rank runs its operations on its own thread, with semaphores and packets synchronizing them as on the GPU.
+  /// Reductions use @p reduction with the arithmetic of @p dataType and round 16-bit floating point results like the
+  /// device, so the result is the one the plan computes on GPUs and serves as a reference to test them. AVG divides by
+  /// the number of ranks of the plan. Like verify, the execution uses a separate copy of the plan.
+  /// Throws if an operation would access memory outside of the buffers or if the plan deadlocks.
+  void executeOnHost(const std::vector<void*>& inputs, const std::vector<void*>& outputs, size_t inputSize,
+                     size_t outputSize, DataType dataType, const Reduction& reduction = {}) const;
+
+  /// Version of the plan file this plan was loaded from: 0 for a plan constructed from it, and increasing with every
+  /// reload of the file by a PlanRegistry in this process, see PlanRegistry::reload.
+  uint64_t version() const;
+
+  /// Implementation of the plan, only defined inside the library.
   struct Impl;
+
+ private:
   std::shared_ptr<Impl> impl_;
 
   friend class Executor;
+  friend class PlanRegistry;
+};
+
+/// Where an execution plan applies. PlanRegistry selects the plan of a collective call with it.
+struct PlanInfo {
+  /// Name of the collective, e.g. "allreduce".
+  std::string collective;
+  /// "Simple" or "LL".
+  std::string protocol;
+  bool inPlace;
+  int worldSize;
+  /// The plan is selected for messages of at least @p minMessageSize and less than @p maxMessageSize bytes.
+  size_t minMessageSize;
+  size_t maxMessageSize;
+};
+
+/// A collective call to find a plan for in a PlanRegistry.
+struct CollectiveDescriptor {
+  std::string collective;
+  /// Size of the message in bytes, in the same unit as the size ranges of the registered plans.
+  size_t messageSize;
+  bool inPlace;
+  /// Number of ranks, or 0 to let the Executor fill in the size of its communicator.
+  int worldSize = 0;
+  /// Only select plans of this protocol, or any protocol if empty.
+  std::string protocol = "";
+};
+
+/// Plans indexed by collective, protocol, in-place flag, world size and message size range.
+///
+/// When the size ranges of several plans for the same collective overlap, the plan with the narrowest range is
+/// selected, and the most recently registered one among plans with the same width. Selection takes O(log n) time in
+/// the number of plans for the collective, and the plan of a whole power-of-two size class is resolved once when
+/// plans are registered.
+///
+/// Plan files can be updated while the registry is in use. reload() loads and verifies the new version of a file in the
+/// background and stages it, and commitReloads() swaps all staged plans in at once: select() returns the new versions
+/// from then on, while executions that already selected a plan finish with it. The contexts an Executor set up for
+/// replaced versions are torn down at its next context setup, once their last kernel is done. select() may run
+/// concurrently with reloads and commits.
+class PlanRegistry {
+ public:
+  PlanRegistry();
+  PlanRegistry(const PlanRegistry&) = delete;
+  PlanRegistry& operator=(const PlanRegistry&) = delete;
+  ~PlanRegistry();
+
+  /// Register the JSON plans (`*.json`) in @p path, in file name order. Their PlanInfo is read from the plan:
+  /// `collective`, `protocol`, `inplace`, the number of `gpus`, and the optional `min_message_size` and
+  /// `max_message_size` (all sizes if absent).
+  /// @return The number of plans registered.
+  size_t loadDirectory(const std::string& path);
+
+  /// Register the JSON plan at @p planPath with the PlanInfo read from it, see loadDirectory.
+  std::shared_ptr<ExecutionPlan> registerPlan(const std::string& planPath);
+
+  /// Register @p plan for @p info.
+  void registerPlan(std::shared_ptr<ExecutionPlan> plan, const PlanInfo& info);
+
+  /// Select the plan for @p collective.
+  /// @return The plan, or nullptr if no registered plan applies.
+  std::shared_ptr<ExecutionPlan> select(const CollectiveDescriptor& collective) const;
+
+  /// The registered plans and their PlanInfo, in registration order.
+  std::vector<std::pair<std::shared_ptr<ExecutionPlan>, PlanInfo>> plans() const;
+
+  /// Load the JSON plan at @p planPath again on a background thread, verify it for a message size in its range and
+  /// stage it for commitReloads(), replacing a version of the same file staged before. A file that is not registered
+  /// yet is registered when it is committed. If @p rank is not -1, only the data of that rank is loaded, see
+  /// ExecutionPlan::load.
+  /// @return A future ready with the version of the staged plan, or holding the exception thrown while loading or
+  /// verifying it, in which case nothing is staged.
+  std::shared_future<uint64_t> reload(const std::string& planPath, int rank = -1);
+
+  /// Reload the JSON plans created or modified in the directory @p path, checking their modification times every
+  /// @p interval, see reload(). Replaces the directory watched before.
+  void watchDirectory(const std::string& path, std::chrono::milliseconds interval = std::chrono::seconds(1),
+                      int rank = -1);
+  void stopWatching();
+
+  /// Swap the staged plans in. Executors set up and tear down contexts collectively, so all ranks must select the same
+  /// versions: call this at the same point of the sequence of executions on all ranks, with no execution of a plan of
+  /// the registry in flight on other threads. With @p bootstrap the call is collective, and the ranks only commit if
+  /// they all staged the same files with the same contents. Otherwise they keep their staged plans for a later call.
+  /// @return The number of plans swapped in.
+  size_t commitReloads(std::shared_ptr<Bootstrap> bootstrap = nullptr);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/// Collective algorithms generateExecutionPlan can emit.
+enum class PlanAlgorithm {
+  /// Allreduce as a ring reduce-scatter followed by a ring allgather.
+  RingAllReduce,
+  /// Allreduce over two binary trees in which most ranks are a leaf in one and an inner node in the other. Each tree
+  /// reduces half of the data to its root and broadcasts it back, with the chunks pipelined through the tree.
+  DoubleBinaryTreeAllReduce,
+  /// Recursive vector halving reduce-scatter followed by recursive doubling allgather (Rabenseifner). With a world
+  /// size that is not a power of two, the extra ranks first fold their data into a partner.
+  HalvingDoublingAllReduce,
+  /// Ring reduce-scatter within each node, ring allreduce across the ranks with the same local rank on every node,
+  /// and ring allgather within each node.
+  HierarchicalAllReduce,
+  RingAllGather,
+  /// Allgather in ceil(log2(worldSize)) steps, each sending twice as many blocks as the previous one.
+  BruckAllGather,
+  /// Ring allgather across the ranks with the same local rank on every node, then ring allgather within each node.
+  HierarchicalAllGather,
+  /// Alltoall in worldSize - 1 steps, in step s sending to rank + s and receiving from rank - s.
+  PairwiseAllToAll,
+};
+
+/// What generateExecutionPlan emits.
+struct PlanGeneratorConfig {
+  PlanAlgorithm algorithm;
+  int worldSize;
+  /// Ranks r and s are on the same node if r / nRanksPerNode == s / nRanksPerNode, and use SM channels. Ranks on
+  /// different nodes use proxy channels. 0 puts all ranks on one node.
+  int nRanksPerNode = 0;
+  /// Number of chunks the data of each rank is split into. Independent chunks run on separate threadblocks, and the
+  /// chunks of DoubleBinaryTreeAllReduce are pipelined through the trees.
+  int nChunks = 1;
+  /// "Simple" or "LL".
+  std::string protocol = "Simple";
+  bool inPlace = false;
+  int nThreadsPerBlock = 1024;
+  /// Name of the plan, the snake case name of the algorithm if empty.
+  std::string name = "";
+};
+
+/// Generate the JSON execution plan described by @p config. The plan reads and writes equal chunks of the buffers,
+/// so the message size must be divisible by the number of chunks of the input and output.
+std::string generateExecutionPlan(const PlanGeneratorConfig& config);
+
+/// Write the plan generated for @p config to @p outputPath, in the compiled format of ExecutionPlan::compile if
+/// @p compiled.
+void writeExecutionPlan(const PlanGeneratorConfig& config, const std::string& outputPath, bool compiled = false);
+
+/// Options of an Executor.
+struct ExecutorConfig {
+  /// Largest number of bytes of each block of a message that a single kernel processes, or 0 for no limit. A block is
+  /// the data of a rank in an allgather or reduce-scatter, of a peer in an alltoall, and the whole message otherwise.
+  /// Larger messages run the plan once per tile of at most this many bytes of every block, with the tiles queued back
+  /// to back on the stream, so the scratch buffer only holds two tiles instead of growing with the message.
+  size_t tileSize = 0;
+  /// Budgets of the execution contexts, 0 for no limit. The executor sets up a context per pair of buffers and plan,
+  /// holding connections, memory registrations, a scratch buffer, device plans and possibly a proxy thread. When a new
+  /// context exceeds a budget, the least recently used contexts are torn down. Context setup and eviction are
+  /// collective, so all ranks must use the same budgets.
+  size_t maxContexts = 0;
+  /// Device memory of the scratch buffers and device plans of the contexts.
+  size_t maxContextBytes = 0;
+  /// Proxy threads of the contexts. Only contexts of plans with proxy channels run one.
+  size_t maxProxyThreads = 0;
+};
+
+/// Resources the execution context of a plan holds on a rank, see Executor::explain.
+struct ExecutionFootprint {
+  int rank;
+  /// Connections to the peers of the rank, by name of their transport (see TransportNames). Connections are pooled by
+  /// the communicator, so contexts of plans with the same peers share them.
+  std::unordered_map<std::string, size_t> connections;
+  /// Local buffers the context registers, and memories of peers it receives.
+  size_t registeredMemories;
+  size_t remoteMemories;
+  size_t smSemaphores;
+  size_t proxySemaphores;
+  size_t smChannels;
+  size_t proxyChannels;
+  /// 1 if the plan has proxy channels on the rank, in which case the context runs a proxy thread.
+  size_t proxyThreads;
+  int threadblocks;
+  int threadsPerBlock;
+  /// Dynamic shared memory of each threadblock in bytes, without NPKit events.
+  size_t sharedMemPerBlock;
+  /// Size of the scratch buffer, and of the power-of-two buffer the executor reserves for it.
+  size_t scratchBufferSize;
+  size_t scratchBytesReserved;
+  /// Kernels launched per execution: 1, or the number of tiles of a message larger than ExecutorConfig::tileSize.
+  size_t tiles;
+  /// Device memory of the device plans, including those of the tiles.
+  size_t devicePlanBytes;
+  /// Device memory counted against ExecutorConfig::maxContextBytes: the reserved scratch buffer and the device plans.
+  /// Contexts executed on the same stream share scratch buffers of the same size class.
+  size_t contextBytes;
+};
+
+/// Buffers and plan of an execution to set up ahead of time, see Executor::prepare, or to run in a group, see
+/// Executor::executeGroup.
+struct ExecutionDescriptor {
+  void* sendbuff;
+  void* recvbuff;
+  size_t sendBuffSize;
+  size_t recvBuffSize;
+  std::shared_ptr<ExecutionPlan> plan;
 };
 
 class Executor {
  public:
-  Executor(std::shared_ptr<Communicator> comm);
+  Executor(std::shared_ptr<Communicator> comm, const ExecutorConfig& config = {});
   Executor(const Executor&) = delete;
   Executor& operator=(const Executor&) = delete;
   ~Executor();
 
+  /// Execute @p plan on the buffers. May be called from several threads at once: executions of buffers and plans that
+  /// were executed before only contend with executions of the same ones. Setting up the context of new buffers is
+  /// collective, so all ranks must execute new buffers and plans in the same order, e.g. from a single thread or with
+  /// prepare(). LL packets use a sequence of flags per stream, so all ranks must run the same executions on each
+  /// stream in the same order. The reduce operations of the plan apply @p reduction, see Reduction. AVG divides by the
+  /// number of ranks of the plan.
   void execute(int rank, void* sendbuff, void* recvBuff, size_t sendBuffSize, size_t recvBuffSize, DataType dataType,
-               const ExecutionPlan& plan, cudaStream_t stream, PacketType packetType = PacketType::LL16);
+               const ExecutionPlan& plan, cudaStream_t stream, PacketType packetType = PacketType::LL16,
+               const Reduction& reduction = {});
+
+  /// Execute the plan that @p registry selects for @p collective, see PlanRegistry::select.
+  /// @return false if no plan applies, in which case nothing is launched.
+  bool execute(int rank, void* sendbuff, void* recvBuff, size_t sendBuffSize, size_t recvBuffSize, DataType dataType,
+               const PlanRegistry& registry, const CollectiveDescriptor& collective, cudaStream_t stream,
+               PacketType packetType = PacketType::LL16, const Reduction& reduction = {});
+
+  /// Set up the execution contexts of @p executions on a background thread, so that their first execute() does not
+  /// wait for connections, memory registrations, semaphores and proxy threads to be created. Context setup is
+  /// collective, so all ranks must prepare the same executions in the same order relative to their execute() calls.
+  /// An execute() of an execution being prepared waits for its preparation instead of setting it up again, one that
+  /// needs a new context sets it up after the preparations requested before it, and one of an existing context does not
+  /// wait. With budgets in ExecutorConfig, a preparation may evict any context, so every execute() waits for the
+  /// preparations requested before it.
+  /// @return A future per execution, ready when its context is set up or holding the exception that setting it up
+  /// threw.
+  std::vector<std::shared_future<void>> prepare(int rank, const std::vector<ExecutionDescriptor>& executions,
+                                                cudaStream_t stream);
+
+  /// Execute @p executions in a single kernel launch. The threadblocks of their plans are merged into one device plan,
+  /// each running on the buffers of its execution, which saves the launch and host overhead of executing many small
+  /// messages one by one. The executions of a group run concurrently, so the i-th execution of a group gets a context
+  /// and a scratch buffer of its own, apart from those of execute() for i > 0. Grouping the same executions again
+  /// reuses the merged plan. Throws an Error if an execution runs in tiles, see ExecutorConfig::tileSize, or if the
+  /// merged plan fails validation. The budgets of ExecutorConfig must leave room for the contexts of a whole group.
+  /// All ranks must group the same executions in the same order. All executions apply @p reduction.
+  void executeGroup(int rank, const std::vector<ExecutionDescriptor>& executions, DataType dataType,
+                    cudaStream_t stream, PacketType packetType = PacketType::LL16, const Reduction& reduction = {});
+
+  ExecutorStats stats() const;
+
+  /// Compute the resources the context of @p plan would hold on @p rank for a message of @p sendBuffSize and
+  /// @p recvBuffSize bytes, in buffers of the same sizes, with @p config. This runs the planning half of the context
+  /// setup of execute() on the host only: no device, peer or communicator is needed, so plans can be sized offline.
+  /// Ranks r and s are on the same node if r / nRanksPerNode == s / nRanksPerNode.
+  static ExecutionFootprint explain(int rank, size_t sendBuffSize, size_t recvBuffSize, const ExecutionPlan& plan,
+                                    int nRanksPerNode = 8, const ExecutorConfig& config = {});
 
  private:
   struct Impl;
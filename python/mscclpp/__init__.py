@@ -23,6 +23,14 @@ from ._mscclpp import (
     DataType,
     Executor,
     ExecutionPlan,
+    PlanRegistry,
+    PlanInfo,
+    CollectiveDescriptor,
+    SimulationConfig,
+    PlanAlgorithm,
+    PlanGeneratorConfig,
+    generate_execution_plan,
+    write_execution_plan,
     PacketType,
     version,
     is_nvls_supported,
@@ -2,8 +2,11 @@
 // Licensed under the MIT license.
 
 #include <nanobind/nanobind.h>
+#include <nanobind/stl/pair.h>
 #include <nanobind/stl/shared_ptr.h>
 #include <nanobind/stl/string.h>
+#include <nanobind/stl/unordered_map.h>
+#include <nanobind/stl/vector.h>
 
 #include <mscclpp/executor.hpp>
 #include <mscclpp/gpu.hpp>
@@ -21,18 +24,264 @@ void register_executor(nb::module_& m) {
 
   nb::enum_<PacketType>(m, "PacketType").value("LL8", PacketType::LL8).value("LL16", PacketType::LL16);
 
+  nb::enum_<ReduceOp>(m, "ReduceOp")
+      .value("sum", ReduceOp::SUM)
+      .value("prod", ReduceOp::PROD)
+      .value("max", ReduceOp::MAX)
+      .value("min", ReduceOp::MIN)
+      .value("avg", ReduceOp::AVG)
+      .value("premul_sum", ReduceOp::PREMUL_SUM);
+
+  nb::class_<Reduction>(m, "Reduction")
+      .def(nb::init<>())
+      .def(
+          "__init__",
+          [](Reduction* self, ReduceOp op, double scalar, uintptr_t deviceScalar) {
+            new (self) Reduction{op, scalar, (const void*)deviceScalar};
+          },
+          nb::arg("op"), nb::arg("scalar") = 1.0, nb::arg("deviceScalar") = 0)
+      .def_rw("op", &Reduction::op)
+      .def_rw("scalar", &Reduction::scalar)
+      .def_prop_rw(
+          "device_scalar", [](const Reduction& self) { return (uintptr_t)self.deviceScalar; },
+          [](Reduction& self, uintptr_t deviceScalar) { self.deviceScalar = (const void*)deviceScalar; });
+
+  nb::class_<ExecutorStats>(m, "ExecutorStats")
+      .def_ro("plan_uploads", &ExecutorStats::planUploads)
+      .def_ro("plan_uploads_skipped", &ExecutorStats::planUploadsSkipped)
+      .def_ro("plan_bytes_uploaded", &ExecutorStats::planBytesUploaded)
+      .def_ro("scratch_bytes_reserved", &ExecutorStats::scratchBytesReserved)
+      .def_ro("scratch_bytes_in_use", &ExecutorStats::scratchBytesInUse)
+      .def_ro("context_hits", &ExecutorStats::contextHits)
+      .def_ro("context_misses", &ExecutorStats::contextMisses)
+      .def_ro("context_evictions", &ExecutorStats::contextEvictions);
+
+  nb::class_<PlanIssue> planIssue(m, "PlanIssue");
+  nb::enum_<PlanIssue::Severity>(planIssue, "Severity")
+      .value("Warning", PlanIssue::Severity::Warning)
+      .value("Error", PlanIssue::Severity::Error);
+  planIssue.def_ro("severity", &PlanIssue::severity)
+      .def_ro("rank", &PlanIssue::rank)
+      .def_ro("threadblock", &PlanIssue::threadblock)
+      .def_ro("operation", &PlanIssue::operation)
+      .def_ro("message", &PlanIssue::message);
+
+  nb::class_<PlanOptimizationStats>(m, "PlanOptimizationStats")
+      .def_ro("operations_before", &PlanOptimizationStats::operationsBefore)
+      .def_ro("operations_after", &PlanOptimizationStats::operationsAfter)
+      .def_ro("barriers_removed", &PlanOptimizationStats::barriersRemoved)
+      .def_ro("puts_fused", &PlanOptimizationStats::putsFused)
+      .def_ro("copies_merged", &PlanOptimizationStats::copiesMerged);
+
+  nb::class_<SimulationConfig>(m, "SimulationConfig")
+      .def(nb::init<>())
+      .def_rw("n_ranks_per_node", &SimulationConfig::nRanksPerNode)
+      .def_rw("threadblock_bandwidth", &SimulationConfig::threadblockBandwidth)
+      .def_rw("memory_bandwidth", &SimulationConfig::memoryBandwidth)
+      .def_rw("intra_node_bandwidth", &SimulationConfig::intraNodeBandwidth)
+      .def_rw("intra_node_latency", &SimulationConfig::intraNodeLatency)
+      .def_rw("inter_node_bandwidth", &SimulationConfig::interNodeBandwidth)
+      .def_rw("inter_node_latency", &SimulationConfig::interNodeLatency)
+      .def_rw("proxy_latency", &SimulationConfig::proxyLatency)
+      .def_rw("operation_overhead", &SimulationConfig::operationOverhead)
+      .def_rw("timeline", &SimulationConfig::timeline)
+      .def_rw("timeline_interval", &SimulationConfig::timelineInterval)
+      .def_rw("max_timeline_intervals", &SimulationConfig::maxTimelineIntervals);
+
+  nb::class_<SimulatedLink>(m, "SimulatedLink")
+      .def_ro("src", &SimulatedLink::src)
+      .def_ro("dst", &SimulatedLink::dst)
+      .def_ro("type", &SimulatedLink::type)
+      .def_ro("bandwidth", &SimulatedLink::bandwidth)
+      .def_ro("bytes", &SimulatedLink::bytes)
+      .def_ro("utilization", &SimulatedLink::utilization);
+
+  nb::class_<SimulationResult>(m, "SimulationResult")
+      .def_ro("completion_time", &SimulationResult::completionTime)
+      .def_ro("rank_completion_times", &SimulationResult::rankCompletionTimes)
+      .def_ro("deadlocked", &SimulationResult::deadlocked)
+      .def_ro("timeline_interval", &SimulationResult::timelineInterval)
+      .def_ro("links", &SimulationResult::links);
+
   nb::class_<ExecutionPlan>(m, "ExecutionPlan")
-      .def(nb::init<const std::string, const std::string>(), nb::arg("name"), nb::arg("planPath"));
+      .def(nb::init<const std::string, const std::string>(), nb::arg("name"), nb::arg("planPath"))
+      .def("load", &ExecutionPlan::load, nb::arg("rank") = -1)
+      .def("version", &ExecutionPlan::version)
+      .def("compile", &ExecutionPlan::compile, nb::arg("outputPath"))
+      .def("verify", &ExecutionPlan::verify, nb::arg("inputSize"), nb::arg("outputSize"))
+      .def("optimize", &ExecutionPlan::optimize)
+      .def("simulate", &ExecutionPlan::simulate, nb::arg("inputSize"), nb::arg("outputSize"),
+           nb::arg("config") = SimulationConfig())
+      .def(
+          "execute_on_host",
+          [](const ExecutionPlan* self, const std::vector<uintptr_t>& inputs, const std::vector<uintptr_t>& outputs,
+             size_t inputSize, size_t outputSize, DataType dataType, const Reduction& reduction) {
+            std::vector<void*> inputPointers, outputPointers;
+            for (uintptr_t input : inputs) inputPointers.push_back(reinterpret_cast<void*>(input));
+            for (uintptr_t output : outputs) outputPointers.push_back(reinterpret_cast<void*>(output));
+            nb::gil_scoped_release release;
+            self->executeOnHost(inputPointers, outputPointers, inputSize, outputSize, dataType, reduction);
+          },
+          nb::arg("inputs"), nb::arg("outputs"), nb::arg("inputSize"), nb::arg("outputSize"), nb::arg("dataType"),
+          nb::arg("reduction") = Reduction());
+
+  nb::class_<PlanInfo>(m, "PlanInfo")
+      .def(nb::init<>())
+      .def_rw("collective", &PlanInfo::collective)
+      .def_rw("protocol", &PlanInfo::protocol)
+      .def_rw("in_place", &PlanInfo::inPlace)
+      .def_rw("world_size", &PlanInfo::worldSize)
+      .def_rw("min_message_size", &PlanInfo::minMessageSize)
+      .def_rw("max_message_size", &PlanInfo::maxMessageSize);
+
+  nb::class_<CollectiveDescriptor>(m, "CollectiveDescriptor")
+      .def(nb::init<>())
+      .def_rw("collective", &CollectiveDescriptor::collective)
+      .def_rw("message_size", &CollectiveDescriptor::messageSize)
+      .def_rw("in_place", &CollectiveDescriptor::inPlace)
+      .def_rw("world_size", &CollectiveDescriptor::worldSize)
+      .def_rw("protocol", &CollectiveDescriptor::protocol);
+
+  nb::class_<std::shared_future<uint64_t>>(m, "PlanReloadFuture")
+      .def("ready",
+           [](const std::shared_future<uint64_t>& self) {
+             return self.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+           })
+      .def("wait", [](const std::shared_future<uint64_t>& self) { return self.get(); },
+           nb::call_guard<nb::gil_scoped_release>());
+
+  nb::class_<PlanRegistry>(m, "PlanRegistry")
+      .def(nb::init<>())
+      .def("load_directory", &PlanRegistry::loadDirectory, nb::arg("path"))
+      .def("register_plan", nb::overload_cast<const std::string&>(&PlanRegistry::registerPlan), nb::arg("planPath"))
+      .def("register_plan",
+           nb::overload_cast<std::shared_ptr<ExecutionPlan>, const PlanInfo&>(&PlanRegistry::registerPlan),
+           nb::arg("plan"), nb::arg("info"))
+      .def("select", &PlanRegistry::select, nb::arg("collective"))
+      .def("plans", &PlanRegistry::plans)
+      .def("reload", &PlanRegistry::reload, nb::arg("planPath"), nb::arg("rank") = -1)
+      .def(
+          "watch_directory",
+          [](PlanRegistry* self, const std::string& path, int intervalMs, int rank) {
+            self->watchDirectory(path, std::chrono::milliseconds(intervalMs), rank);
+          },
+          nb::arg("path"), nb::arg("intervalMs") = 1000, nb::arg("rank") = -1)
+      .def("stop_watching", &PlanRegistry::stopWatching, nb::call_guard<nb::gil_scoped_release>())
+      .def("commit_reloads", &PlanRegistry::commitReloads, nb::arg("bootstrap") = nullptr,
+           nb::call_guard<nb::gil_scoped_release>());
+
+  nb::enum_<PlanAlgorithm>(m, "PlanAlgorithm")
+      .value("ring_allreduce", PlanAlgorithm::RingAllReduce)
+      .value("double_binary_tree_allreduce", PlanAlgorithm::DoubleBinaryTreeAllReduce)
+      .value("halving_doubling_allreduce", PlanAlgorithm::HalvingDoublingAllReduce)
+      .value("hierarchical_allreduce", PlanAlgorithm::HierarchicalAllReduce)
+      .value("ring_allgather", PlanAlgorithm::RingAllGather)
+      .value("bruck_allgather", PlanAlgorithm::BruckAllGather)
+      .value("hierarchical_allgather", PlanAlgorithm::HierarchicalAllGather)
+      .value("pairwise_alltoall", PlanAlgorithm::PairwiseAllToAll);
+
+  nb::class_<PlanGeneratorConfig>(m, "PlanGeneratorConfig")
+      .def(nb::init<>())
+      .def_rw("algorithm", &PlanGeneratorConfig::algorithm)
+      .def_rw("world_size", &PlanGeneratorConfig::worldSize)
+      .def_rw("n_ranks_per_node", &PlanGeneratorConfig::nRanksPerNode)
+      .def_rw("n_chunks", &PlanGeneratorConfig::nChunks)
+      .def_rw("protocol", &PlanGeneratorConfig::protocol)
+      .def_rw("in_place", &PlanGeneratorConfig::inPlace)
+      .def_rw("n_threads_per_block", &PlanGeneratorConfig::nThreadsPerBlock)
+      .def_rw("name", &PlanGeneratorConfig::name);
+
+  m.def("generate_execution_plan", &generateExecutionPlan, nb::arg("config"));
+  m.def("write_execution_plan", &writeExecutionPlan, nb::arg("config"), nb::arg("outputPath"),
+        nb::arg("compiled") = false);
+
+  nb::class_<ExecutorConfig>(m, "ExecutorConfig")
+      .def(nb::init<>())
+      .def_rw("tile_size", &ExecutorConfig::tileSize)
+      .def_rw("max_contexts", &ExecutorConfig::maxContexts)
+      .def_rw("max_context_bytes", &ExecutorConfig::maxContextBytes)
+      .def_rw("max_proxy_threads", &ExecutorConfig::maxProxyThreads);
+
+  nb::class_<ExecutionFootprint>(m, "ExecutionFootprint")
+      .def_ro("rank", &ExecutionFootprint::rank)
+      .def_ro("connections", &ExecutionFootprint::connections)
+      .def_ro("registered_memories", &ExecutionFootprint::registeredMemories)
+      .def_ro("remote_memories", &ExecutionFootprint::remoteMemories)
+      .def_ro("sm_semaphores", &ExecutionFootprint::smSemaphores)
+      .def_ro("proxy_semaphores", &ExecutionFootprint::proxySemaphores)
+      .def_ro("sm_channels", &ExecutionFootprint::smChannels)
+      .def_ro("proxy_channels", &ExecutionFootprint::proxyChannels)
+      .def_ro("proxy_threads", &ExecutionFootprint::proxyThreads)
+      .def_ro("threadblocks", &ExecutionFootprint::threadblocks)
+      .def_ro("threads_per_block", &ExecutionFootprint::threadsPerBlock)
+      .def_ro("shared_mem_per_block", &ExecutionFootprint::sharedMemPerBlock)
+      .def_ro("scratch_buffer_size", &ExecutionFootprint::scratchBufferSize)
+      .def_ro("scratch_bytes_reserved", &ExecutionFootprint::scratchBytesReserved)
+      .def_ro("tiles", &ExecutionFootprint::tiles)
+      .def_ro("device_plan_bytes", &ExecutionFootprint::devicePlanBytes)
+      .def_ro("context_bytes", &ExecutionFootprint::contextBytes);
+
+  nb::class_<ExecutionDescriptor>(m, "ExecutionDescriptor")
+      .def(
+          "__init__",
+          [](ExecutionDescriptor* self, uintptr_t sendbuff, uintptr_t recvBuff, size_t sendBuffSize,
+             size_t recvBuffSize, std::shared_ptr<ExecutionPlan> plan) {
+            new (self) ExecutionDescriptor{reinterpret_cast<void*>(sendbuff), reinterpret_cast<void*>(recvBuff),
+                                           sendBuffSize, recvBuffSize, plan};
+          },
+          nb::arg("sendbuff"), nb::arg("recvBuff"), nb::arg("sendBuffSize"), nb::arg("recvBuffSize"), nb::arg("plan"))
+      .def_rw("send_buff_size", &ExecutionDescriptor::sendBuffSize)
+      .def_rw("recv_buff_size", &ExecutionDescriptor::recvBuffSize)
+      .def_rw("plan", &ExecutionDescriptor::plan);
+
+  nb::class_<std::shared_future<void>>(m, "PreparationFuture")
+      .def("ready",
+           [](const std::shared_future<void>& self) {
+             return self.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+           })
+      .def("wait", [](const std::shared_future<void>& self) { self.get(); }, nb::call_guard<nb::gil_scoped_release>());
 
   nb::class_<Executor>(m, "Executor")
-      .def(nb::init<std::shared_ptr<Communicator>>(), nb::arg("comm"))
+      .def(nb::init<std::shared_ptr<Communicator>, const ExecutorConfig&>(), nb::arg("comm"),
+           nb::arg("config") = ExecutorConfig())
       .def(
           "execute",
           [](Executor* self, int rank, uintptr_t sendbuff, uintptr_t recvBuff, size_t sendBuffSize, size_t recvBuffSize,
-             DataType dataType, const ExecutionPlan& plan, uintptr_t stream, PacketType packetType) {
+             DataType dataType, const ExecutionPlan& plan, uintptr_t stream, PacketType packetType,
+             const Reduction& reduction) {
             self->execute(rank, reinterpret_cast<void*>(sendbuff), reinterpret_cast<void*>(recvBuff), sendBuffSize,
-                          recvBuffSize, dataType, plan, (cudaStream_t)stream, packetType);
+                          recvBuffSize, dataType, plan, (cudaStream_t)stream, packetType, reduction);
           },
           nb::arg("rank"), nb::arg("sendbuff"), nb::arg("recvBuff"), nb::arg("sendBuffSize"), nb::arg("recvBuffSize"),
-          nb::arg("dataType"), nb::arg("plan"), nb::arg("stream"), nb::arg("packetType") = PacketType::LL16);
+          nb::arg("dataType"), nb::arg("plan"), nb::arg("stream"), nb::arg("packetType") = PacketType::LL16,
+          nb::arg("reduction") = Reduction())
+      .def(
+          "execute",
+          [](Executor* self, int rank, uintptr_t sendbuff, uintptr_t recvBuff, size_t sendBuffSize, size_t recvBuffSize,
+             DataType dataType, const PlanRegistry& registry, const CollectiveDescriptor& collective, uintptr_t stream,
+             PacketType packetType, const Reduction& reduction) {
+            return self->execute(rank, reinterpret_cast<void*>(sendbuff), reinterpret_cast<void*>(recvBuff),
+                                 sendBuffSize, recvBuffSize, dataType, registry, collective, (cudaStream_t)stream,
+                                 packetType, reduction);
+          },
+          nb::arg("rank"), nb::arg("sendbuff"), nb::arg("recvBuff"), nb::arg("sendBuffSize"), nb::arg("recvBuffSize"),
+          nb::arg("dataType"), nb::arg("registry"), nb::arg("collective"), nb::arg("stream"),
+          nb::arg("packetType") = PacketType::LL16, nb::arg("reduction") = Reduction())
+      .def(
+          "prepare",
+          [](Executor* self, int rank, const std::vector<ExecutionDescriptor>& executions, uintptr_t stream) {
+            return self->prepare(rank, executions, (cudaStream_t)stream);
+          },
+          nb::arg("rank"), nb::arg("executions"), nb::arg("stream"))
+      .def(
+          "execute_group",
+          [](Executor* self, int rank, const std::vector<ExecutionDescriptor>& executions, DataType dataType,
+             uintptr_t stream, PacketType packetType, const Reduction& reduction) {
+            self->executeGroup(rank, executions, dataType, (cudaStream_t)stream, packetType, reduction);
+          },
+          nb::arg("rank"), nb::arg("executions"), nb::arg("dataType"), nb::arg("stream"),
+          nb::arg("packetType") = PacketType::LL16, nb::arg("reduction") = Reduction())
+      .def("stats", &Executor::stats)
+      .def_static("explain", &Executor::explain, nb::arg("rank"), nb::arg("sendBuffSize"), nb::arg("recvBuffSize"),
+                  nb::arg("plan"), nb::arg("nRanksPerNode") = 8, nb::arg("config") = ExecutorConfig());
 }
@@ -3,13 +3,90 @@
 
 #include "communicator.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 #include "api.h"
 #include "debug.h"
 
 namespace mscclpp {
 
+// Tag of the batches of SetupBootstrap, and the next one for their data
+static constexpr int SetupBatchTag = std::numeric_limits<int>::max() - 1;
+
+SetupBootstrap::SetupBootstrap(std::shared_ptr<Bootstrap> bootstrap) : bootstrap_(bootstrap), batching_(false) {}
+
+int SetupBootstrap::getRank() { return bootstrap_->getRank(); }
+
+int SetupBootstrap::getNranks() { return bootstrap_->getNranks(); }
+
+int SetupBootstrap::getNranksPerNode() { return bootstrap_->getNranksPerNode(); }
+
+void SetupBootstrap::send(void* data, int size, int peer, int tag) {
+  std::vector<char>& batch = batches_[peer];
+  size_t pos = batch.size();
+  batch.resize(pos + 2 * sizeof(int) + size);
+  std::memcpy(batch.data() + pos, &tag, sizeof(int));
+  std::memcpy(batch.data() + pos + sizeof(int), &size, sizeof(int));
+  std::memcpy(batch.data() + pos + 2 * sizeof(int), data, size);
+  if (!batching_) {
+    flush(peer);
+  }
+}
+
+void SetupBootstrap::recv(void* data, int size, int peer, int tag) {
+  std::deque<std::vector<char>>& messages = received_[{peer, tag}];
+  while (messages.empty()) {
+    receiveBatch(peer);
+  }
+  if (messages.front().size() != (size_t)size) {
+    throw Error("Setup message of " + std::to_string(messages.front().size()) + " bytes received from rank " +
+                    std::to_string(peer) + " with tag " + std::to_string(tag) + " where " + std::to_string(size) +
+                    " bytes were expected",
+                ErrorCode::InternalError);
+  }
+  std::memcpy(data, messages.front().data(), size);
+  messages.pop_front();
+}
+
+void SetupBootstrap::allGather(void* allData, int size) { bootstrap_->allGather(allData, size); }
+
+void SetupBootstrap::barrier() { bootstrap_->barrier(); }
+
+void SetupBootstrap::beginBatch() { batching_ = true; }
+
+void SetupBootstrap::endBatch() {
+  for (auto& [peer, _] : batches_) {
+    flush(peer);
+  }
+  batches_.clear();
+  batching_ = false;
+}
+
+void SetupBootstrap::flush(int peer) {
+  std::vector<char>& batch = batches_[peer];
+  if (batch.empty()) return;
+  bootstrap_->send(batch, peer, SetupBatchTag);
+  batch.clear();
+}
+
+void SetupBootstrap::receiveBatch(int peer) {
+  std::vector<char> batch;
+  bootstrap_->recv(batch, peer, SetupBatchTag);
+  size_t pos = 0;
+  while (pos < batch.size()) {
+    int tag, size;
+    std::memcpy(&tag, batch.data() + pos, sizeof(int));
+    std::memcpy(&size, batch.data() + pos + sizeof(int), sizeof(int));
+    pos += 2 * sizeof(int);
+    received_[{peer, tag}].emplace_back(batch.begin() + pos, batch.begin() + pos + size);
+    pos += size;
+  }
+}
+
 Communicator::Impl::Impl(std::shared_ptr<Bootstrap> bootstrap, std::shared_ptr<Context> context)
-    : bootstrap_(bootstrap) {
+    : bootstrap_(bootstrap), setupBootstrap_(std::make_shared<SetupBootstrap>(bootstrap)) {
   if (!context) {
     context_ = std::make_shared<Context>();
   } else {
@@ -68,12 +145,16 @@ MSCCLPP_API_CPP NonblockingFuture<RegisteredMemory> Communicator::recvMemoryOnSe
 }
 
 struct Communicator::Impl::Connector : public Setuppable {
-  Connector(Communicator& comm, Communicator::Impl& commImpl_, int remoteRank, int tag, EndpointConfig localConfig)
+  Connector(Communicator& comm, Communicator::Impl& commImpl_, int remoteRank, int tag, EndpointConfig localConfig,
+            bool shared = false)
       : comm_(comm),
         commImpl_(commImpl_),
         remoteRank_(remoteRank),
         tag_(tag),
-        localEndpoint_(comm.context()->createEndpoint(localConfig)) {}
+        localEndpoint_(comm.context()->createEndpoint(localConfig)),
+        shared_(shared),
+        sharedKey_(remoteRank, tag, localConfig.transport, localConfig.ibMaxCqSize, localConfig.ibMaxCqPollNum,
+                   localConfig.ibMaxSendWr, localConfig.ibMaxWrPerSend) {}
 
   void beginSetup(std::shared_ptr<Bootstrap> bootstrap) override {
     bootstrap->send(localEndpoint_.serialize(), remoteRank_, tag_);
@@ -85,6 +166,9 @@ struct Communicator::Impl::Connector : public Setuppable {
     auto remoteEndpoint = Endpoint::deserialize(data);
     auto connection = comm_.context()->connect(localEndpoint_, remoteEndpoint);
     commImpl_.connectionInfos_[connection.get()] = {remoteRank_, tag_};
+    if (shared_) {
+      commImpl_.sharedConnections_[sharedKey_] = {{}, connection, generation_};
+    }
     connectionPromise_.set_value(connection);
     INFO(MSCCLPP_INIT, "Connection %d -> %d created (%s)", comm_.bootstrap()->getRank(), remoteRank_,
          connection->getTransportName().c_str());
@@ -96,6 +180,59 @@ struct Communicator::Impl::Connector : public Setuppable {
   int remoteRank_;
   int tag_;
   Endpoint localEndpoint_;
+  bool shared_;
+  SharedConnectionKey sharedKey_;
+  uint64_t generation_ = 0;
+};
+
+// Decides with the remote rank whether to reuse a pooled connection: both sides send whether they still hold it and its
+// generation, and connect again in the next setup round unless both hold the same one.
+struct Communicator::Impl::SharedConnector : public Setuppable {
+  struct State {
+    uint64_t generation;
+    bool held;
+  };
+
+  SharedConnector(Communicator& comm, Communicator::Impl& commImpl, int remoteRank, int tag, EndpointConfig localConfig,
+                  SharedConnectionKey key, std::shared_ptr<Connection> held, uint64_t generation)
+      : comm_(comm),
+        commImpl_(commImpl),
+        remoteRank_(remoteRank),
+        tag_(tag),
+        localConfig_(localConfig),
+        key_(key),
+        held_(held),
+        generation_(generation) {}
+
+  void beginSetup(std::shared_ptr<Bootstrap> bootstrap) override {
+    State state = {generation_, held_ != nullptr};
+    bootstrap->send(&state, sizeof(state), remoteRank_, tag_);
+  }
+
+  void endSetup(std::shared_ptr<Bootstrap> bootstrap) override {
+    State remote;
+    bootstrap->recv(&remote, sizeof(remote), remoteRank_, tag_);
+    if (held_ && remote.held && remote.generation == generation_) {
+      commImpl_.sharedConnections_[key_] = {{}, held_, generation_};
+      connectionPromise_.set_value(held_);
+      return;
+    }
+    auto connector = std::make_shared<Communicator::Impl::Connector>(comm_, commImpl_, remoteRank_, tag_, localConfig_,
+                                                                     /*shared=*/true);
+    connector->connectionPromise_ = std::move(connectionPromise_);
+    connector->generation_ = std::max(generation_, remote.generation) + 1;
+    comm_.onSetup(connector);
+  }
+
+  std::promise<std::shared_ptr<Connection>> connectionPromise_;
+  Communicator& comm_;
+  Communicator::Impl& commImpl_;
+  int remoteRank_;
+  int tag_;
+  EndpointConfig localConfig_;
+  SharedConnectionKey key_;
+  std::shared_ptr<Connection> held_;
+  uint64_t generation_;
 };
 
 MSCCLPP_API_CPP NonblockingFuture<std::shared_ptr<Connection>> Communicator::connectOnSetup(
@@ -105,6 +242,35 @@ MSCCLPP_API_CPP NonblockingFuture<std::shared_ptr<Connection>> Communicator::con
   return NonblockingFuture<std::shared_ptr<Connection>>(connector->connectionPromise_.get_future());
 }
 
+MSCCLPP_API_CPP NonblockingFuture<std::shared_ptr<Connection>> Communicator::sharedConnectOnSetup(
+    int remoteRank, int tag, EndpointConfig localConfig) {
+  SharedConnectionKey key(remoteRank, tag, localConfig.transport, localConfig.ibMaxCqSize, localConfig.ibMaxCqPollNum,
+                          localConfig.ibMaxSendWr, localConfig.ibMaxWrPerSend);
+  for (auto it = pimpl_->sharedConnections_.begin(); it != pimpl_->sharedConnections_.end();) {
+    if (!it->second.pending.valid() && it->second.connection.expired()) {
+      it = pimpl_->sharedConnections_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  std::shared_ptr<Connection> held;
+  uint64_t generation = 0;
+  auto it = pimpl_->sharedConnections_.find(key);
+  if (it != pimpl_->sharedConnections_.end()) {
+    if (it->second.pending.valid()) {
+      return NonblockingFuture<std::shared_ptr<Connection>>(std::shared_future(it->second.pending));
+    }
+    held = it->second.connection.lock();
+    generation = it->second.generation;
+  }
+  auto connector = std::make_shared<Communicator::Impl::SharedConnector>(*this, *pimpl_, remoteRank, tag, localConfig,
+                                                                         key, held, generation);
+  std::shared_future<std::shared_ptr<Connection>> future = connector->connectionPromise_.get_future().share();
+  pimpl_->sharedConnections_[key] = {future, held, generation};
+  onSetup(connector);
+  return NonblockingFuture<std::shared_ptr<Connection>>(std::move(future));
+}
+
 MSCCLPP_API_CPP int Communicator::remoteRankOf(const Connection& connection) {
   return pimpl_->connectionInfos_.at(&connection).remoteRank;
 }
@@ -118,13 +284,19 @@ MSCCLPP_API_CPP void Communicator::onSetup(std::shared_ptr<Setuppable> setuppabl
 }
 
 MSCCLPP_API_CPP void Communicator::setup() {
-  for (auto& setuppable : pimpl_->toSetup_) {
-    setuppable->beginSetup(pimpl_->bootstrap_);
-  }
-  for (auto& setuppable : pimpl_->toSetup_) {
-    setuppable->endSetup(pimpl_->bootstrap_);
+  // Setuppables may register others during endSetup, which are set up in a round of their own.
+  while (!pimpl_->toSetup_.empty()) {
+    std::vector<std::shared_ptr<Setuppable>> toSetup = std::move(pimpl_->toSetup_);
+    pimpl_->toSetup_.clear();
+    pimpl_->setupBootstrap_->beginBatch();
+    for (auto& setuppable : toSetup) {
+      setuppable->beginSetup(pimpl_->setupBootstrap_);
+    }
+    pimpl_->setupBootstrap_->endBatch();
+    for (auto& setuppable : toSetup) {
+      setuppable->endSetup(pimpl_->setupBootstrap_);
+    }
   }
-  pimpl_->toSetup_.clear();
 }
 
 }  // namespace mscclpp
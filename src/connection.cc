@@ -133,6 +133,7 @@ void IBConnection::write(RegisteredMemory dst, uint64_t dstOffset, RegisteredMem
   auto dstMrInfo = dstTransportInfo.ibMrInfo;
   auto srcMr = srcTransportInfo.ibMr;
 
+  std::lock_guard<std::mutex> lock(mutex_);
   qp->stageSend(srcMr, dstMrInfo, (uint32_t)size, /*wrId=*/0, /*srcOffset=*/srcOffset, /*dstOffset=*/dstOffset,
                 /*signaled=*/true);
 
@@ -154,6 +155,7 @@ void IBConnection::updateAndSync(RegisteredMemory dst, uint64_t dstOffset, uint6
   uint64_t oldValue = *src;
   *src = newValue;
 
+  std::lock_guard<std::mutex> lock(mutex_);
   qp->stageAtomicAdd(dstTransportInfo_.ibMr, dstMrInfo, /*wrId=*/0, dstOffset, newValue - oldValue, /*signaled=*/true);
 
   qp->postSend();
@@ -162,6 +164,7 @@ void IBConnection::updateAndSync(RegisteredMemory dst, uint64_t dstOffset, uint6
 }
 
 void IBConnection::flush(int64_t timeoutUsec) {
+  std::lock_guard<std::mutex> lock(mutex_);
   Timer timer;
   while (qp->getNumCqItems()) {
     int wcNum = qp->pollCq();
@@ -0,0 +1,130 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "execution_group.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mscclpp/errors.hpp>
+#include <string>
+
+#include "operation_encoding.hpp"
+
+namespace mscclpp {
+
+namespace {
+
+size_t align(size_t size) { return (size + 15) / 16 * 16; }
+
+// Channel tables the kernel indexes with the input and the output channel indexes of `op`, NONE if it does not.
+std::pair<ChannelType, ChannelType> getChannelOperands(const Operation& op) {
+  switch (op.type) {
+    case OperationType::WAIT:
+      return {op.channelType, ChannelType::NONE};
+    case OperationType::GET:
+    case OperationType::READ_REDUCE_COPY:
+      return {ChannelType::SM, ChannelType::NONE};
+    case OperationType::READ_REDUCE_COPY_SEND:
+      return {ChannelType::SM, ChannelType::SM};
+    case OperationType::SIGNAL:
+    case OperationType::PUT:
+    case OperationType::PUT_WITH_SIGNAL:
+    case OperationType::PUT_WITH_SIGNAL_AND_FLUSH:
+    case OperationType::PUT_PACKET:
+      return {ChannelType::NONE, op.channelType};
+    case OperationType::FLUSH:
+      return {ChannelType::NONE, ChannelType::PROXY};
+    case OperationType::REDUCE_SEND:
+    case OperationType::REDUCE_SEND_PACKET:
+      return {ChannelType::NONE, ChannelType::SM};
+    default:
+      return {ChannelType::NONE, ChannelType::NONE};
+  }
+}
+
+void checkChannelIndexes(const DeviceExecutionPlan& header, const char* operations, size_t part,
+                         size_t threadblock) {
+  auto check = [&](ChannelType channelType, const uint8_t* indexes, int count) {
+    if (channelType == ChannelType::NONE) {
+      return;
+    }
+    int nChannels = channelType == ChannelType::SM ? header.nSmChannels : header.nProxyChannels;
+    for (int i = 0; i < count; i++) {
+      if (indexes[i] >= nChannels) {
+        throw Error("Execution " + std::to_string(part) + " of the group uses channel " + std::to_string(indexes[i]) +
+                        " of threadblock " + std::to_string(threadblock) + ", which has " +
+                        std::to_string(nChannels) + " channels of its type",
+                    ErrorCode::ExecutorError);
+      }
+    }
+  };
+  const uint8_t* data = (const uint8_t*)operations;
+  for (uint32_t i = 0; i < header.nOperations; i++) {
+    Operation op = {};
+    data += decodeOperation(data, op);
+    auto [inputs, outputs] = getChannelOperands(op);
+    check(inputs, op.inputChannelIndexes, op.nInputs);
+    check(outputs, op.outputChannelIndexes, op.nOutputs);
+  }
+}
+
+}  // namespace
+
+std::vector<char> mergeDeviceExecutionPlans(const std::vector<ExecutionGroupPart>& parts) {
+  for (size_t i = 0; i < parts.size(); i++) {
+    const DeviceExecutionArgs& args = parts[i].args;
+    for (size_t j = 0; j < i; j++) {
+      const DeviceExecutionArgs& other = parts[j].args;
+      const char* begin = (const char*)args.scratch;
+      const char* otherBegin = (const char*)other.scratch;
+      if (begin < otherBegin + other.scratchSize && otherBegin < begin + args.scratchSize) {
+        throw Error("Executions " + std::to_string(j) + " and " + std::to_string(i) +
+                        " of the group use overlapping scratch buffers",
+                    ErrorCode::ExecutorError);
+      }
+    }
+  }
+
+  size_t nThreadblocks = 0;
+  for (const ExecutionGroupPart& part : parts) {
+    nThreadblocks += part.nThreadblocks;
+  }
+  size_t headersSize = align(nThreadblocks * sizeof(DeviceExecutionPlan));
+  size_t size = headersSize + parts.size() * sizeof(DeviceExecutionArgs);
+  // Offset of the tables of each part in the merged buffer
+  std::vector<size_t> bodyOffsets;
+  for (const ExecutionGroupPart& part : parts) {
+    bodyOffsets.push_back(size);
+    size += align(part.size - align(part.nThreadblocks * sizeof(DeviceExecutionPlan)));
+  }
+
+  std::vector<char> buffer(size);
+  size_t threadblock = 0;
+  for (size_t i = 0; i < parts.size(); i++) {
+    const ExecutionGroupPart& part = parts[i];
+    size_t partHeadersSize = align(part.nThreadblocks * sizeof(DeviceExecutionPlan));
+    size_t argsOffset = headersSize + i * sizeof(DeviceExecutionArgs);
+    std::memcpy(buffer.data() + argsOffset, &part.args, sizeof(DeviceExecutionArgs));
+    std::memcpy(buffer.data() + bodyOffsets[i], part.buffer + partHeadersSize, part.size - partHeadersSize);
+    for (size_t j = 0; j < part.nThreadblocks; j++) {
+      DeviceExecutionPlan header;
+      std::memcpy(&header, part.buffer + j * sizeof(DeviceExecutionPlan), sizeof(DeviceExecutionPlan));
+      if (header.smChannelsOffset < partHeadersSize || header.smChannelsOffset + header.channelsSize > part.size ||
+          header.operationsOffset < partHeadersSize || header.operationsOffset + header.operationsSize > part.size) {
+        throw Error("Threadblock " + std::to_string(j) + " of execution " + std::to_string(i) +
+                        " of the group has tables out of its device plan",
+                    ErrorCode::ExecutorError);
+      }
+      checkChannelIndexes(header, part.buffer + header.operationsOffset, i, j);
+      size_t shift = bodyOffsets[i] - partHeadersSize;
+      header.smChannelsOffset += shift;
+      header.proxyChannelsOffset += shift;
+      header.operationsOffset += shift;
+      header.argsOffset = argsOffset;
+      std::memcpy(buffer.data() + threadblock++ * sizeof(DeviceExecutionPlan), &header, sizeof(DeviceExecutionPlan));
+    }
+  }
+  return buffer;
+}
+
+}  // namespace mscclpp
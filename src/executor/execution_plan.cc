@@ -3,10 +3,26 @@
 
 #include "execution_plan.hpp"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
 #include <fstream>
+#include <functional>
+#include <limits>
+#include <numeric>
 #include <set>
 
+#include "debug.h"
+#include "execution_plan_analysis.hpp"
+#include "execution_plan_file.hpp"
+
 namespace {
 template <typename T, typename Predicate>
 std::vector<T> filter(const std::vector<T>& vec, Predicate pred) {
@@ -57,6 +73,20 @@ auto getOpType = [](const std::string& str) {
   }
 };
 
+bool isReduce(mscclpp::OperationType type) {
+  switch (type) {
+    case mscclpp::OperationType::REDUCE:
+    case mscclpp::OperationType::REDUCE_SEND:
+    case mscclpp::OperationType::READ_REDUCE_COPY:
+    case mscclpp::OperationType::READ_REDUCE_COPY_SEND:
+    case mscclpp::OperationType::REDUCE_PACKET:
+    case mscclpp::OperationType::REDUCE_SEND_PACKET:
+      return true;
+    default:
+      return false;
+  }
+}
+
 auto convertToBufferType = [](const std::string& str) {
   if (str == "i") {
     return mscclpp::BufferType::INPUT;
@@ -81,13 +111,159 @@ auto convertToChannelType = [](const std::string& str) {
   }
 };
 
+// Parser callback that streams a JSON plan and only keeps what `rank` needs: its own gpu entry, and the channels of
+// the gpus that have a channel to `rank`. The threadblocks of other gpus are dropped as soon as they are reached, so
+// memory does not grow with the number of ranks. Relies on "id" preceding "threadblocks" in each gpu object, which is
+// what the plan generator emits; otherwise the threadblocks are kept until the end of the gpu object.
+class RankFilter {
+ public:
+  RankFilter(int rank) : rank_(rank) {}
+
+  bool operator()(int depth, nlohmann::json::parse_event_t event, nlohmann::json& parsed) {
+    using event_t = nlohmann::json::parse_event_t;
+    // depth 1: plan keys, depth 2: gpu objects, depth 3: gpu keys
+    if (depth == 1 && event == event_t::key) {
+      inGpus_ = parsed == "gpus";
+    }
+    if (!inGpus_) {
+      return true;
+    }
+    if (depth == 2 && event == event_t::object_end) {
+      nGpus_++;
+    }
+    // Operations of the dropped threadblocks are still parsed, which tells whether any rank marks final reduces
+    if (event == event_t::key) {
+      inFinal_ = parsed == "final";
+    } else if (event == event_t::value && inFinal_) {
+      marksFinalReduces_ |= parsed == true;
+      inFinal_ = false;
+    }
+    if (depth == 2 && event == event_t::object_start) {
+      gpuId_ = -1;
+    } else if (depth == 3 && event == event_t::key) {
+      gpuKey_ = parsed.get<std::string>();
+      if (gpuKey_ == "threadblocks" && gpuId_ >= 0 && gpuId_ != rank_) {
+        return false;
+      }
+    } else if (depth == 3 && event == event_t::value && gpuKey_ == "id") {
+      gpuId_ = parsed.get<int>();
+    } else if (depth == 2 && event == event_t::object_end && gpuId_ != rank_) {
+      if (!parsed.contains("channels")) {
+        return false;
+      }
+      for (const auto& channel : parsed["channels"]) {
+        for (const auto& peer : channel["connectedTo"]) {
+          if (peer == rank_) {
+            parsed.erase("threadblocks");
+            return true;
+          }
+        }
+      }
+      return false;
+    }
+    return true;
+  }
+
+  int nGpus() const { return nGpus_; }
+  bool marksFinalReduces() const { return marksFinalReduces_; }
+
+ private:
+  int rank_;
+  bool inGpus_ = false;
+  int gpuId_ = -1;
+  std::string gpuKey_;
+  int nGpus_ = 0;
+  bool inFinal_ = false;
+  bool marksFinalReduces_ = false;
+};
+
+// Parser callback that only keeps the top-level fields of a plan and counts the gpus, dropping their content.
+class GpuCounter {
+ public:
+  bool operator()(int depth, nlohmann::json::parse_event_t event, nlohmann::json& parsed) {
+    using event_t = nlohmann::json::parse_event_t;
+    if (depth == 1 && event == event_t::key) {
+      inGpus_ = parsed == "gpus";
+    }
+    if (!inGpus_) {
+      return true;
+    }
+    if (depth == 3 && event == event_t::key) {
+      return false;
+    }
+    if (depth == 2 && event == event_t::object_end) {
+      nGpus_++;
+      return false;
+    }
+    return true;
+  }
+
+  int nGpus() const { return nGpus_; }
+
+ private:
+  bool inGpus_ = false;
+  int nGpus_ = 0;
+};
+
+// Plans generated before the key was renamed spell it "colletive".
+std::string getCollective(const nlohmann::json& plan) {
+  return plan.value("collective", plan.value("colletive", std::string()));
+}
+
+// Returns the path of the compiled copy of a JSON plan in the directory given by MSCCLPP_EXECUTION_PLAN_CACHE_DIR, or
+// an empty string if the cache is disabled. The path is keyed on the plan name and the source file's path, size and
+// modification time so that an edited plan is recompiled. The name is only kept in the file name with the characters
+// other than alphanumerics, '-' and '_' replaced, so that it cannot leave the cache directory.
+std::string getCompiledPlanCachePath(const std::string& name, const std::string& planPath) {
+  const char* cacheDir = getenv("MSCCLPP_EXECUTION_PLAN_CACHE_DIR");
+  if (cacheDir == nullptr || cacheDir[0] == '\0') {
+    return "";
+  }
+  struct stat st;
+  if (stat(planPath.c_str(), &st) != 0) {
+    return "";
+  }
+  std::string key = name + ":" + planPath + ":" + std::to_string(st.st_size) + ":" +
+                    std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+  char hash[17];
+  std::snprintf(hash, sizeof(hash), "%016" PRIx64, mscclpp::planFileChecksum(key.data(), key.size()));
+  std::string prefix = name;
+  for (char& c : prefix) {
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_') {
+      c = '_';
+    }
+  }
+  return std::string(cacheDir) + "/" + prefix + "-" + hash + ".mscclpp.plan";
+}
+
+// Take the lock file that lets a single process write a cached compiled plan. A lock left by a process that died while
+// writing is taken over after a minute; the plan is renamed into place, so a second writer is harmless.
+bool lockCompiledPlanCache(const std::string& lockPath) {
+  int fd = open(lockPath.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+  struct stat st;
+  if (fd < 0 && errno == EEXIST && stat(lockPath.c_str(), &st) == 0 && std::time(nullptr) - st.st_mtime > 60) {
+    unlink(lockPath.c_str());
+    fd = open(lockPath.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+  }
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+  return true;
+}
+
 }  // namespace
 
 namespace mscclpp {
 using json = nlohmann::json;
 
 ExecutionPlan::Impl::Impl(const std::string name, const std::string planPath)
-    : name(name), planPath(planPath), isUsingPacket(false) {}
+    : name(name),
+      planPath(planPath),
+      worldSize(0),
+      isUsingPacket(false),
+      marksFinalReduces(false),
+      isAllRanksLoaded(false) {}
 
 std::vector<ChannelInfo> ExecutionPlan::Impl::getChannelInfos(int rank, ChannelType channelType) const {
   auto pred = [channelType](const ChannelInfo& info) { return info.channelType == channelType; };
@@ -149,19 +325,99 @@ std::vector<BufferType> ExecutionPlan::Impl::getConnectedBufferTypes(int rank) c
   return std::vector<BufferType>(bufferTypes.begin(), bufferTypes.end());
 }
 size_t ExecutionPlan::Impl::getScratchBufferSize(int rank, size_t inputSize, size_t outputSize) const {
-  size_t sizePerRank;
-  if (this->inputChunks.at(rank) != 0)
-    sizePerRank = inputSize / this->inputChunks.at(rank);
-  else if (this->outputChunks.at(rank) != 0)
-    sizePerRank = outputSize / this->outputChunks.at(rank);
-  else
+  // The sizes may be those of the whole allocations of the buffers, which need not hold the number of blocks the plan
+  // expects, so take the largest chunk either buffer allows.
+  size_t sizePerChunk = 0;
+  if (this->inputChunks.at(rank) != 0) {
+    sizePerChunk = (inputSize + this->inputChunks.at(rank) - 1) / this->inputChunks.at(rank);
+  }
+  if (this->outputChunks.at(rank) != 0) {
+    sizePerChunk =
+        std::max(sizePerChunk, (outputSize + this->outputChunks.at(rank) - 1) / this->outputChunks.at(rank));
+  }
+  if (this->inputChunks.at(rank) == 0 && this->outputChunks.at(rank) == 0) {
     throw mscclpp::Error("Output or Input chunks must be greater than 0", mscclpp::ErrorCode::ExecutorError);
+  }
 
   if (this->isUsingPacket) {
-    return sizePerRank * this->scratchChunks.at(rank) * 2 /* data + flag*/ * 2 /*double buffer*/;
+    return sizePerChunk * this->scratchChunks.at(rank) * 2 /* data + flag*/ * 2 /*double buffer*/;
   }
-  return sizePerRank * this->scratchChunks.at(rank);
+  return sizePerChunk * this->scratchChunks.at(rank);
 }
+
+uint32_t ExecutionPlan::Impl::getChunksPerBlock(int rank) const {
+  uint32_t nInputChunks = this->inputChunks.at(rank);
+  uint32_t nOutputChunks = this->outputChunks.at(rank);
+  if (nInputChunks == 0 && nOutputChunks == 0) {
+    throw mscclpp::Error("Output or Input chunks must be greater than 0", mscclpp::ErrorCode::ExecutorError);
+  }
+  if (this->collective == "alltoall") {
+    uint32_t nChunks = nInputChunks != 0 ? nInputChunks : nOutputChunks;
+    if (this->worldSize <= 0 || nChunks % this->worldSize != 0) {
+      throw mscclpp::Error("Chunks of an alltoall plan must be a multiple of the number of ranks",
+                           mscclpp::ErrorCode::ExecutorError);
+    }
+    return nChunks / this->worldSize;
+  }
+  if (nInputChunks == 0 || nOutputChunks == 0) {
+    return std::max(nInputChunks, nOutputChunks);
+  }
+  return std::min(nInputChunks, nOutputChunks);
+}
+
+ChunkLayout ExecutionPlan::Impl::calcChunkLayout(int rank, size_t inputSize, size_t outputSize) const {
+  uint32_t nChunks = this->getChunksPerBlock(rank);
+  uint32_t nInputChunks = this->inputChunks.at(rank);
+  uint32_t nOutputChunks = this->outputChunks.at(rank);
+  // A rank may pass a buffer it does not use with size 0, e.g. the input of a broadcast on ranks other than the root.
+  bool hasInput = nInputChunks != 0 && inputSize != 0;
+  bool hasOutput = nOutputChunks != 0 && outputSize != 0;
+  if (hasInput && hasOutput && inputSize / nInputChunks != outputSize / nOutputChunks) {
+    throw mscclpp::Error("Size per chunks inconsistent", mscclpp::ErrorCode::ExecutorError);
+  }
+  // Derive the block size from the buffer holding fewer blocks, which is exact when the other one holds several.
+  if (hasInput && (!hasOutput || nInputChunks <= nOutputChunks)) {
+    return {inputSize * nChunks / nInputChunks, nChunks};
+  }
+  if (hasOutput) {
+    return {outputSize * nChunks / nOutputChunks, nChunks};
+  }
+  return {0, nChunks};
+}
+
+size_t ExecutionPlan::Impl::getTileSize(int rank, size_t maxTileSize, uint32_t alignment) const {
+  // Tiles must split into the chunk groups of calcChunkOffsets, and full tiles into equal chunks.
+  size_t unit = alignment * std::lcm(this->getChunksPerBlock(rank), std::max(this->chunkGroups.at(rank), 1u));
+  if (maxTileSize < unit) {
+    throw Error("Tile size must be at least " + std::to_string(unit) + " bytes for plan " + this->name,
+                ErrorCode::InvalidUsage);
+  }
+  return maxTileSize / unit * unit;
+}
+
+std::vector<ExecutionTile> ExecutionPlan::Impl::getTiles(int rank, size_t inputSize, size_t outputSize,
+                                                         size_t maxTileSize) const {
+  ChunkLayout layout = this->calcChunkLayout(rank, inputSize, outputSize);
+  size_t tileSize = this->getTileSize(rank, maxTileSize);
+  if (layout.blockSize <= tileSize) {
+    return {ExecutionTile{}};
+  }
+  if (inputSize % layout.blockSize != 0 || outputSize % layout.blockSize != 0) {
+    throw Error("Buffer sizes must be a multiple of the block size to run in tiles", ErrorCode::ExecutorError);
+  }
+  std::vector<ExecutionTile> tiles;
+  for (size_t offset = 0; offset < layout.blockSize; offset += tileSize) {
+    tiles.push_back({offset, std::min(tileSize, layout.blockSize - offset), layout.blockSize, 0});
+  }
+  return tiles;
+}
+
+size_t ExecutionPlan::Impl::getTileScratchBufferSize(int rank, size_t maxTileSize) const {
+  size_t chunkSize = this->getTileSize(rank, maxTileSize) / this->getChunksPerBlock(rank);
+  return this->getScratchBufferSize(rank, chunkSize * this->inputChunks.at(rank),
+                                    chunkSize * this->outputChunks.at(rank));
+}
+
 std::vector<Operation> ExecutionPlan::Impl::getOperations(int rank, int threadblock) const {
   return this->operations.at(rank)[threadblock];
 }
@@ -170,65 +426,141 @@ int ExecutionPlan::Impl::getThreadblockCount(int rank) const { return this->oper
 
 int ExecutionPlan::Impl::getNThreadsPerBlock() const { return this->nThreadsPerBlock; }
 
-void ExecutionPlan::Impl::loadExecutionPlan(size_t inputSize, size_t outputSize, size_t contsSrcOffset,
-                                            size_t constDstOffset) {
-  std::ifstream file(this->planPath);
-  json obj = json::parse(file);
-  if (this->name != obj["name"]) {
-    throw Error("Plan name does not match", ErrorCode::ExecutorError);
-  }
-  std::string protocol = obj["protocol"];
-  if (protocol == "LL") {
-    this->isUsingPacket = true;
-  }
-  this->nThreadsPerBlock = obj.value("num_threads_per_block", 1024);
-  const auto& gpus = obj["gpus"];
-
-  for (const auto& gpu : gpus) {
-    int rank = gpu["id"];
-    this->inputChunks[rank] = gpu["inputChunks"];
-    this->outputChunks[rank] = gpu["outputChunks"];
-    this->scratchChunks[rank] = gpu["scratchChunks"];
-    this->chunkGroups[rank] = gpu["chunkGroups"];
-  }
-  this->setupChannels(gpus);
+bool ExecutionPlan::Impl::reducesInputs() const {
+  return this->collective == "allreduce" || this->collective == "reducescatter" || this->collective == "reduce";
+}
 
+void ExecutionPlan::Impl::loadExecutionPlan(int rank, size_t inputSize, size_t outputSize, size_t contsSrcOffset,
+                                            size_t constDstOffset, const ExecutionTile& tile) {
+  this->loadPlan(rank);
   this->inputSize = inputSize;
   this->outputSize = outputSize;
-  this->setupOperations(gpus, contsSrcOffset, constDstOffset);
+  this->setupOperations(contsSrcOffset, constDstOffset, tile);
 }
 
 void ExecutionPlan::Impl::lightLoadExecutionPlan(size_t inputSize, size_t outputSize, size_t contsSrcOffset,
-                                                 size_t constDstOffset) {
+                                                 size_t constDstOffset, const ExecutionTile& tile) {
+  this->inputSize = inputSize;
+  this->outputSize = outputSize;
+  this->setupOperations(contsSrcOffset, constDstOffset, tile);
+}
+
+void ExecutionPlan::Impl::loadPlan(int rank) {
+  if (this->isAllRanksLoaded || (rank >= 0 && this->operationTemplates.count(rank) > 0)) {
+    return;
+  }
+  if (this->compiledPlanFile == nullptr) {
+    std::string cachePath;
+    if (ExecutionPlanFile::isCompiledPlan(this->planPath)) {
+      this->compiledPlanFile = std::make_shared<ExecutionPlanFile>(this->planPath);
+    } else {
+      cachePath = getCompiledPlanCachePath(this->name, this->planPath);
+      if (!cachePath.empty() && ExecutionPlanFile::isCompiledPlan(cachePath)) {
+        try {
+          this->compiledPlanFile = std::make_shared<ExecutionPlanFile>(cachePath);
+        } catch (const Error& e) {
+          WARN("Ignoring invalid compiled execution plan %s: %s", cachePath.c_str(), e.what());
+        }
+      }
+    }
+    if (this->compiledPlanFile == nullptr) {
+      if (cachePath.empty()) {
+        this->loadJsonPlan(rank);
+        return;
+      }
+      // A single process writes the cached copy, the others load their rank from the JSON file meanwhile.
+      std::string lockPath = cachePath + ".lock";
+      if (!lockCompiledPlanCache(lockPath)) {
+        this->loadJsonPlan(rank);
+        return;
+      }
+      // The cached copy covers all ranks, so that any process can pick it up. It is written to a temporary file and
+      // renamed, so that no process reads it partly written.
+      try {
+        this->loadJsonPlan(-1);
+      } catch (...) {
+        unlink(lockPath.c_str());
+        throw;
+      }
+      std::string tmpPath = cachePath + "." + std::to_string(getpid()) + ".tmp";
+      try {
+        this->saveCompiledPlan(tmpPath);
+        if (std::rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+          throw SysError("Failed to rename " + tmpPath, errno);
+        }
+      } catch (const BaseError& e) {
+        WARN("Failed to write compiled execution plan %s: %s", cachePath.c_str(), e.what());
+        std::remove(tmpPath.c_str());
+      }
+      unlink(lockPath.c_str());
+      return;
+    }
+    if (this->name != this->compiledPlanFile->name()) {
+      throw Error("Plan name does not match", ErrorCode::ExecutorError);
+    }
+    this->isUsingPacket = this->compiledPlanFile->header().flags & PLAN_FILE_FLAG_PACKET;
+    this->marksFinalReduces = this->compiledPlanFile->header().flags & PLAN_FILE_FLAG_FINAL_REDUCES;
+    this->nThreadsPerBlock = this->compiledPlanFile->header().nThreadsPerBlock;
+    this->collective = this->compiledPlanFile->collective();
+    this->worldSize = this->compiledPlanFile->header().nRanks;
+  }
+  if (rank >= 0) {
+    this->loadCompiledRank(rank);
+    return;
+  }
+  for (int r : this->compiledPlanFile->ranks()) {
+    this->loadCompiledRank(r);
+  }
+  this->isAllRanksLoaded = true;
+}
+
+void ExecutionPlan::Impl::loadJsonPlan(int rank) {
   std::ifstream file(this->planPath);
-  json obj = json::parse(file);
+  RankFilter filter(rank);
+  json obj = rank < 0 ? json::parse(file) : json::parse(file, std::ref(filter));
   if (this->name != obj["name"]) {
     throw Error("Plan name does not match", ErrorCode::ExecutorError);
   }
+  this->collective = getCollective(obj);
+  this->worldSize = rank < 0 ? obj["gpus"].size() : filter.nGpus();
+  this->marksFinalReduces = filter.marksFinalReduces();
   std::string protocol = obj["protocol"];
   if (protocol == "LL") {
     this->isUsingPacket = true;
   }
+  this->nThreadsPerBlock = obj.value("num_threads_per_block", 1024);
   const auto& gpus = obj["gpus"];
 
+  bool found = false;
   for (const auto& gpu : gpus) {
-    int rank = gpu["id"];
-    this->inputChunks[rank] = gpu["inputChunks"];
-    this->outputChunks[rank] = gpu["outputChunks"];
-    this->scratchChunks[rank] = gpu["scratchChunks"];
-    this->chunkGroups[rank] = gpu["chunkGroups"];
+    int gpuRank = gpu["id"];
+    if (rank >= 0 && gpuRank != rank) {
+      continue;
+    }
+    this->inputChunks[gpuRank] = gpu["inputChunks"];
+    this->outputChunks[gpuRank] = gpu["outputChunks"];
+    this->scratchChunks[gpuRank] = gpu["scratchChunks"];
+    this->chunkGroups[gpuRank] = gpu["chunkGroups"];
+    found = true;
+  }
+  if (rank >= 0 && !found) {
+    throw Error("Rank " + std::to_string(rank) + " not found in plan " + this->name, ErrorCode::ExecutorError);
+  }
+  this->setupChannels(gpus, rank);
+  this->setupOperationTemplates(gpus, rank);
+  if (rank < 0) {
+    this->isAllRanksLoaded = true;
   }
-
-  this->inputSize = inputSize;
-  this->outputSize = outputSize;
-  this->setupOperations(gpus, contsSrcOffset, constDstOffset);
 }
 
 // Construct the channel info. Step 1. Flatten SM and PROXY channels into separate vectors.
 // Step 2. For each threadblock, construct a vector of channel indexes and keys.
-void ExecutionPlan::Impl::setupChannels(const json& gpus) {
+// If `localRank` is not -1, only the channels of `localRank` and the channels of other ranks connected to it are kept.
+void ExecutionPlan::Impl::setupChannels(const json& gpus, int localRank) {
+  auto isLocal = [localRank](int rank) { return localRank < 0 || rank == localRank; };
   using mapKey = std::tuple<int, BufferType, BufferType, ChannelType>;
   std::map<mapKey, std::vector<int>> chanConnectedPeersMap;
+  std::unordered_map<std::pair<int, ChannelType>, std::unordered_map<int, int>> channelCounts;
   for (const auto& gpu : gpus) {
     int rank = gpu["id"];
     std::vector<ChannelInfo> channelInfos;
@@ -238,15 +570,30 @@ void ExecutionPlan::Impl::setupChannels(const json& gpus) {
       info.dstBufferType = convertToBufferType(channel["dstbuff"]);
       info.channelType = convertToChannelType(channel["type"]);
       for (const auto& peer : channel["connectedTo"]) {
-        info.connectedPeers.push_back(peer);
-        chanConnectedPeersMap[{peer, info.srcBufferType, info.dstBufferType, info.channelType}].push_back(rank);
-        this->channelCountMap[{rank, info.channelType}][peer]++;
+        if (isLocal(rank)) {
+          info.connectedPeers.push_back(peer);
+        }
+        if (isLocal(peer)) {
+          chanConnectedPeersMap[{peer, info.srcBufferType, info.dstBufferType, info.channelType}].push_back(rank);
+        }
+        if (isLocal(rank) || isLocal(peer)) {
+          channelCounts[{rank, info.channelType}][peer]++;
+        }
+      }
+      if (isLocal(rank)) {
+        channelInfos.push_back(info);
       }
-      channelInfos.push_back(info);
     }
-    this->channelInfos[rank] = channelInfos;
+    if (isLocal(rank)) {
+      this->channelInfos[rank] = channelInfos;
+    }
   }
 
+  if (localRank < 0) {
+    this->channelInfosByDstRank.clear();
+  } else {
+    this->channelInfosByDstRank[localRank].clear();
+  }
   for (const auto& [key, connectedFrom] : chanConnectedPeersMap) {
     auto [peer, srcBufferType, dstBufferType, channelType] = key;
     ChannelInfo info;
@@ -256,10 +603,18 @@ void ExecutionPlan::Impl::setupChannels(const json& gpus) {
     info.connectedPeers = connectedFrom;
     this->channelInfosByDstRank[peer].push_back(info);
   }
+  for (const auto& [key, peerCounts] : channelCounts) {
+    for (const auto& [peer, count] : peerCounts) {
+      this->channelCountMap[key][peer] = count;
+    }
+  }
 
   // setup threadblockChannelMap
   for (const auto& gpu : gpus) {
     int rank = gpu["id"];
+    if (!isLocal(rank)) {
+      continue;
+    }
     auto channelTypes = {ChannelType::SM, ChannelType::PROXY};
     std::unordered_map<ChannelKey, std::vector<int>> channelMap;
     for (auto channelType : channelTypes) {
@@ -273,8 +628,8 @@ void ExecutionPlan::Impl::setupChannels(const json& gpus) {
       }
     }
     int nthreadblocks = gpu["threadblocks"].size();
-    this->threadblockSMChannelMap[rank].resize(nthreadblocks);
-    this->threadblockProxyChannelMap[rank].resize(nthreadblocks);
+    this->threadblockSMChannelMap[rank].assign(nthreadblocks, {});
+    this->threadblockProxyChannelMap[rank].assign(nthreadblocks, {});
     for (const auto& threadblock : gpu["threadblocks"]) {
       for (const auto& channel : threadblock["channels"]) {
         ChannelType channelType = convertToChannelType(channel["ctype"]);
@@ -287,17 +642,34 @@ void ExecutionPlan::Impl::setupChannels(const json& gpus) {
           }
         }
       }
+      int threadblockId = threadblock["id"];
+      if (this->threadblockSMChannelMap[rank][threadblockId].size() > MAX_CHANNEL ||
+          this->threadblockProxyChannelMap[rank][threadblockId].size() > MAX_CHANNEL) {
+        throw Error("Too many channels for a threadblock", ErrorCode::ExecutorError);
+      }
     }
   }
 }
 
-void ExecutionPlan::Impl::setupOperations(const json& gpus, size_t contsSrcOffset, size_t constDstOffset) {
-  // setup threadblocks and operations
+void ExecutionPlan::Impl::setupOperationTemplates(const json& gpus, int localRank) {
+  auto checkNChannels = [](size_t nChannels) {
+    if (nChannels > MAX_CHANNEL_PER_OPERATION) {
+      throw Error("Too many channels for an operation", ErrorCode::ExecutorError);
+    }
+    return nChannels;
+  };
   for (const auto& gpu : gpus) {
     int rank = gpu["id"];
+    if (localRank >= 0 && rank != localRank) {
+      continue;
+    }
+    std::vector<std::vector<OperationTemplate>>& templates = this->operationTemplates[rank];
+    templates.assign(gpu["threadblocks"].size(), {});
+    std::vector<std::vector<OperationDependency>>& dependencies = this->operationDependencies[rank];
+    dependencies.assign(gpu["threadblocks"].size(), {});
     for (const auto& threadblock : gpu["threadblocks"]) {
       std::unordered_map<ChannelKey, std::vector<int>> channelIndexes;
-      std::vector<Operation> ops;
+      std::vector<OperationTemplate> ops;
       int threadblockId = threadblock["id"];
       const auto& smChannels = this->threadblockSMChannelMap[rank][threadblockId];
       const auto& proxyChannels = this->threadblockProxyChannelMap[rank][threadblockId];
@@ -310,157 +682,359 @@ void ExecutionPlan::Impl::setupOperations(const json& gpus, size_t contsSrcOffse
         channelIndexes[key].push_back(i);
       }
       for (const auto& op : threadblock["ops"]) {
-        Operation operation = {};
-        std::vector<uint32_t> chunkIndexes;
+        OperationTemplate operation = {};
         operation.type = static_cast<mscclpp::OperationType>(getOpType(op["name"]));
         if (op.contains("ctype")) {
           operation.channelType = convertToChannelType(op["ctype"]);
         }
         if (op.contains("i_cids")) {
-          operation.nInputs = op["i_cids"].size();
+          operation.nInputs = checkNChannels(op["i_cids"].size());
+          operation.hasInputChannels = 1;
+          BufferType srcBufferType = convertToBufferType(op["i_buff"]["src"]);
+          BufferType dstBufferType = convertToBufferType(op["i_buff"]["dst"]);
+          operation.inputBufferType = srcBufferType;
           for (int i = 0; i < operation.nInputs; i++) {
-            BufferType srcBufferType = convertToBufferType(op["i_buff"]["src"]);
-            BufferType dstBufferType = convertToBufferType(op["i_buff"]["dst"]);
             // Get the relevant channel index in rank channelInfos
             operation.inputChannelIndexes[i] =
                 channelIndexes[{srcBufferType, dstBufferType, operation.channelType}][op["i_cids"][i]["id"]];
-            operation.inputOffsets[i] =
-                this->getOffset(rank, this->inputSize, this->outputSize, (uint32_t)op["i_cids"][i]["off"]) +
-                (srcBufferType != BufferType::SCRATCH ? contsSrcOffset : 0);
-            chunkIndexes.push_back((uint32_t)op["i_cids"][i]["off"]);
+            operation.inputChunks[i] = op["i_cids"][i]["off"];
           }
         }
         // will have either srcs or i_cids
         if (op.contains("srcs")) {
-          operation.nInputs = op["srcs"].size();
+          operation.nInputs = checkNChannels(op["srcs"].size());
           operation.inputBufferType = convertToBufferType(op["srcs"][0]["buff"]);
           for (int i = 0; i < operation.nInputs; i++) {
-            operation.inputOffsets[i] =
-                this->getOffset(rank, this->inputSize, this->outputSize, (uint32_t)op["srcs"][i]["off"]) +
-                (operation.inputBufferType != BufferType::SCRATCH ? contsSrcOffset : 0);
-            chunkIndexes.push_back((uint32_t)op["srcs"][i]["off"]);
+            operation.inputChunks[i] = op["srcs"][i]["off"];
           }
         }
         if (op.contains("o_cids")) {
-          operation.nOutputs = op["o_cids"].size();
+          operation.nOutputs = checkNChannels(op["o_cids"].size());
+          operation.hasOutputChannels = 1;
+          BufferType srcBufferType = convertToBufferType(op["o_buff"]["src"]);
+          BufferType dstBufferType = convertToBufferType(op["o_buff"]["dst"]);
+          operation.outputBufferType = dstBufferType;
           for (int i = 0; i < operation.nOutputs; i++) {
-            BufferType srcBufferType = convertToBufferType(op["o_buff"]["src"]);
-            BufferType dstBufferType = convertToBufferType(op["o_buff"]["dst"]);
             operation.outputChannelIndexes[i] =
                 channelIndexes[{srcBufferType, dstBufferType, operation.channelType}][op["o_cids"][i]["id"]];
-            operation.outputOffsets[i] =
-                this->getOffset(rank, this->inputSize, this->outputSize, (uint32_t)op["o_cids"][i]["off"]) +
-                (dstBufferType != BufferType::SCRATCH ? constDstOffset : 0);
-            chunkIndexes.push_back((uint32_t)op["o_cids"][i]["off"]);
+            operation.outputChunks[i] = op["o_cids"][i]["off"];
           }
         }
         // will have either dsts or o_cids
         if (op.contains("dsts")) {
-          operation.nOutputs = op["dsts"].size();
+          operation.nOutputs = checkNChannels(op["dsts"].size());
           operation.outputBufferType = convertToBufferType(op["dsts"][0]["buff"]);
           for (int i = 0; i < operation.nOutputs; i++) {
-            operation.outputOffsets[i] =
-                this->getOffset(rank, this->inputSize, this->outputSize, (uint32_t)op["dsts"][i]["off"]) +
-                (operation.outputBufferType != BufferType::SCRATCH ? constDstOffset : 0);
-            chunkIndexes.push_back((uint32_t)op["dsts"][i]["off"]);
+            operation.outputChunks[i] = op["dsts"][i]["off"];
           }
         }
         if (op.contains("srcbuff")) {
           operation.srcBufferType = convertToBufferType(op["srcbuff"]);
         }
         if (op.contains("srcoff")) {
-          operation.srcOffset = this->getOffset(rank, this->inputSize, this->outputSize, (uint32_t)op["srcoff"]);
-          chunkIndexes.push_back((uint32_t)op["srcoff"]);
+          operation.hasSrcChunk = 1;
+          operation.srcChunk = op["srcoff"];
         }
         if (op.contains("dstbuff")) {
           operation.dstBufferType = convertToBufferType(op["dstbuff"]);
         }
         if (op.contains("dstoff")) {
-          operation.dstOffset = this->getOffset(rank, this->inputSize, this->outputSize, (uint32_t)op["dstoff"]);
-          chunkIndexes.push_back((uint32_t)op["dstoff"]);
+          operation.hasDstChunk = 1;
+          operation.dstChunk = op["dstoff"];
         }
         if (op.contains("cnt")) {
-          operation.size =
-              this->getNChunkSize(rank, this->inputSize, this->outputSize, (uint32_t)op["cnt"], chunkIndexes);
+          operation.hasCount = 1;
+          operation.nChunks = op["cnt"];
+        }
+        if (op.value("final", false)) {
+          if (!isReduce(operation.type)) {
+            throw Error("Only reduce operations can be final", ErrorCode::ExecutorError);
+          }
+          operation.finalReduce = 1;
+          this->marksFinalReduces = true;
+        }
+        if (op.contains("deps")) {
+          for (const auto& dep : op["deps"]) {
+            dependencies[threadblockId].push_back({static_cast<uint32_t>(ops.size()), dep["tb"], dep["step"]});
+          }
         }
         ops.push_back(operation);
       }
-      this->operations[rank].push_back(ops);
+      templates[threadblockId] = std::move(ops);
     }
   }
 }
 
-std::pair<size_t, u_int32_t> ExecutionPlan::Impl::calcSizePerRank(int rank, size_t inputSize, size_t outputSize) const {
-  std::pair<size_t, u_int32_t> sizePerRank;
-  if (this->inputChunks.at(rank) == 0 && this->outputChunks.at(rank) == 0) {
-    throw mscclpp::Error("Output or Input chunks must be greater than 0", mscclpp::ErrorCode::ExecutorError);
-  } else if (this->inputChunks.at(rank) != 0 && this->outputChunks.at(rank) != 0) {
-    if (inputSize / this->inputChunks.at(rank) != outputSize / this->outputChunks.at(rank))
-      throw mscclpp::Error("Size per chunks inconsistent", mscclpp::ErrorCode::ExecutorError);
-    else
-      sizePerRank = std::make_pair(inputSize, this->inputChunks.at(rank));
-  } else if (this->inputChunks.at(rank) != 0) {
-    sizePerRank = std::make_pair(inputSize, this->inputChunks.at(rank));
-  } else if (this->outputChunks.at(rank) != 0) {
-    sizePerRank = std::make_pair(outputSize, this->outputChunks.at(rank));
+void ExecutionPlan::Impl::setupChunkOffsetTable(int rank) {
+  ChunkOffsetTable& table = this->chunkOffsetTables[rank];
+  table = {};
+  std::unordered_map<uint32_t, uint32_t> slots;
+  auto getSlot = [&](uint32_t chunkIndex) {
+    auto [it, inserted] = slots.try_emplace(chunkIndex, table.chunkIndexes.size());
+    if (inserted) {
+      table.chunkIndexes.push_back(chunkIndex);
+    }
+    return it->second;
+  };
+
+  const auto& threadblocks = this->operationTemplates.at(rank);
+  table.operationChunks.resize(threadblocks.size());
+  for (size_t tb = 0; tb < threadblocks.size(); tb++) {
+    table.operationChunks[tb].reserve(threadblocks[tb].size());
+    for (const auto& opTemplate : threadblocks[tb]) {
+      // Same order as the chunk offsets are checked for the operation size: inputs, outputs, src, dst.
+      OperationChunks chunks = {};
+      auto addChunk = [&](uint32_t chunkIndex) {
+        chunks.begin[chunks.nChunks] = getSlot(chunkIndex);
+        if (opTemplate.hasCount) {
+          chunks.end[chunks.nChunks] = getSlot(chunkIndex + opTemplate.nChunks);
+        }
+        chunks.nChunks++;
+      };
+      for (int i = 0; i < opTemplate.nInputs; i++) {
+        addChunk(opTemplate.inputChunks[i]);
+      }
+      for (int i = 0; i < opTemplate.nOutputs; i++) {
+        addChunk(opTemplate.outputChunks[i]);
+      }
+      if (opTemplate.hasSrcChunk) {
+        addChunk(opTemplate.srcChunk);
+      }
+      if (opTemplate.hasDstChunk) {
+        addChunk(opTemplate.dstChunk);
+      }
+      table.operationChunks[tb].push_back(chunks);
+    }
   }
-  return sizePerRank;
-}
 
-size_t ExecutionPlan::Impl::getOffset(int rank, size_t inputSize, size_t outputSize, uint32_t chunkIndex,
-                                      uint32_t alignment) const {
-  if (inputSize % alignment != 0) {
-    throw Error("inputSize must be a multiple of alignment", ErrorCode::ExecutorError);
+  uint32_t nChunks = this->getChunksPerBlock(rank);
+  uint32_t nGroups = this->chunkGroups.at(rank);
+  table.nChunksPerBlock = nChunks;
+  table.nChunksPerGroup = nGroups == 0 ? 0 : nChunks / nGroups;
+  if (table.nChunksPerGroup == 0) {
+    return;
   }
+  table.groupIndexes.resize(table.chunkIndexes.size());
+  table.indexesInGroup.resize(table.chunkIndexes.size());
+  for (size_t i = 0; i < table.chunkIndexes.size(); i++) {
+    table.groupIndexes[i] = table.chunkIndexes[i] / table.nChunksPerGroup;
+    table.indexesInGroup[i] = table.chunkIndexes[i] % table.nChunksPerGroup;
+  }
+  table.offsets.resize(table.chunkIndexes.size());
+}
 
-  const int nGroups = this->chunkGroups.at(rank);
-  auto sizePerRank = calcSizePerRank(rank, inputSize, outputSize);
-  uint32_t nInputChunks = sizePerRank.second;
-  uint32_t nelems = sizePerRank.first / (alignment * sizeof(uint8_t));
+ChunkLayout ExecutionPlan::Impl::calcChunkOffsets(int rank, ChunkOffsetTable& table, uint32_t alignment) const {
+  if (table.chunkIndexes.empty()) {
+    return {};
+  }
+  ChunkLayout layout = this->calcChunkLayout(rank, this->inputSize, this->outputSize);
+  if (layout.blockSize % alignment != 0) {
+    throw Error("Block size must be a multiple of alignment", ErrorCode::ExecutorError);
+  }
+  const uint32_t nGroups = this->chunkGroups.at(rank);
+  uint32_t nelems = layout.blockSize / (alignment * sizeof(uint8_t));
+  if (table.nChunksPerGroup == 0) {
+    throw Error("Number of chunks must be a multiple of nGroups", ErrorCode::ExecutorError);
+  }
   if (nelems % nGroups != 0) {
     throw Error("Input size must be a multiple of nGroups", ErrorCode::ExecutorError);
   }
 
-  int nelemsPerGroup = nelems / nGroups;
-  int nChunksPerGroup = nInputChunks / nGroups;
-  uint32_t minNelems = nelemsPerGroup / nChunksPerGroup;
-  uint32_t remainder = nelemsPerGroup % nChunksPerGroup;
-  uint32_t groupIdx = chunkIndex / nChunksPerGroup;
-  uint32_t chunkIndexInGroup = chunkIndex % nChunksPerGroup;
-  uint32_t offset = groupIdx * nelemsPerGroup + chunkIndexInGroup * minNelems +
-                    (chunkIndexInGroup % nelemsPerGroup < remainder ? chunkIndexInGroup % nelemsPerGroup : remainder);
-  return static_cast<size_t>(offset) * alignment;
+  // offset(c) = alignment * (groupIdx * nelemsPerGroup + indexInGroup * minNelems + min(indexInGroup, remainder)),
+  // which only depends on the message size through minNelems and remainder.
+  const uint32_t nelemsPerGroup = nelems / nGroups;
+  const uint32_t minNelems = nelemsPerGroup / table.nChunksPerGroup;
+  const uint32_t remainder = nelemsPerGroup % table.nChunksPerGroup;
+  const uint32_t* groupIndexes = table.groupIndexes.data();
+  const uint32_t* indexesInGroup = table.indexesInGroup.data();
+  uint32_t* offsets = table.offsets.data();
+  const size_t n = table.offsets.size();
+  if (minNelems > 0) {
+    // indexInGroup < nChunksPerGroup <= nelemsPerGroup
+    for (size_t i = 0; i < n; i++) {
+      offsets[i] = (groupIndexes[i] * nelemsPerGroup + indexesInGroup[i] * minNelems +
+                    std::min(indexesInGroup[i], remainder)) *
+                   alignment;
+    }
+  } else {
+    // Fewer elements than chunks in a group: the leading chunks get one element each and the rest are empty.
+    for (size_t i = 0; i < n; i++) {
+      uint32_t extra = remainder == 0 ? 0 : std::min(indexesInGroup[i] % nelemsPerGroup, remainder);
+      offsets[i] = (groupIndexes[i] * nelemsPerGroup + extra) * alignment;
+    }
+  }
+  return layout;
 }
 
-size_t ExecutionPlan::Impl::getNChunkSize(int rank, size_t inputSize, size_t outputSize, uint32_t nChunks,
-                                          const std::vector<uint32_t> chunkIndexes) const {
-  size_t nChunkSize = 0;
-  for (uint32_t index : chunkIndexes) {
-    uint32_t beginOff = getOffset(rank, inputSize, outputSize, index);
-    uint32_t endOff = getOffset(rank, inputSize, outputSize, index + nChunks);
-    if (nChunkSize == 0) {
-      nChunkSize = endOff - beginOff;
-    } else if (nChunkSize != endOff - beginOff) {
-      throw Error("Inconsistent chunk size", ErrorCode::ExecutorError);
+void ExecutionPlan::Impl::setupOperations(size_t contsSrcOffset, size_t constDstOffset, const ExecutionTile& tile) {
+  for (const auto& [rank, threadblocks] : this->operationTemplates) {
+    auto tableIt = this->chunkOffsetTables.find(rank);
+    if (tableIt == this->chunkOffsetTables.end()) {
+      this->setupChunkOffsetTable(rank);
+      tableIt = this->chunkOffsetTables.find(rank);
+    }
+    ChunkOffsetTable& table = tableIt->second;
+    ChunkLayout layout = this->calcChunkOffsets(rank, table);
+    const uint32_t* offsets = table.offsets.data();
+    // Offset of a chunk in the buffer of type `bufferType`, with the blocks of the input and output spread to the
+    // stride of the tile. The chunks `count` further must stay in the same block.
+    auto getOffset = [&](uint32_t slot, uint32_t endSlot, bool hasCount, BufferType bufferType) -> uint32_t {
+      if (tile.blockStride == 0) {
+        return offsets[slot];
+      }
+      if (bufferType == BufferType::SCRATCH) {
+        return offsets[slot] + tile.scratchOffset;
+      }
+      uint32_t block = table.chunkIndexes[slot] / table.nChunksPerBlock;
+      if (hasCount && (table.chunkIndexes[endSlot] - 1) / table.nChunksPerBlock != block) {
+        throw Error("Plan " + this->name + " cannot run in tiles: an operation spans several blocks",
+                    ErrorCode::ExecutorError);
+      }
+      size_t offset = offsets[slot] + block * (tile.blockStride - layout.blockSize) + tile.offset;
+      if (offset > std::numeric_limits<uint32_t>::max()) {
+        throw Error("Chunk offset exceeds 32 bits", ErrorCode::ExecutorError);
+      }
+      return offset;
+    };
+
+    std::vector<std::vector<Operation>> rankOperations(threadblocks.size());
+    for (size_t tb = 0; tb < threadblocks.size(); tb++) {
+      const auto& templates = threadblocks[tb];
+      std::vector<Operation>& ops = rankOperations[tb];
+      ops.resize(templates.size());
+      for (size_t op = 0; op < templates.size(); op++) {
+        const OperationTemplate& opTemplate = templates[op];
+        const OperationChunks& chunks = table.operationChunks[tb][op];
+        Operation& operation = ops[op];
+        operation.type = opTemplate.type;
+        operation.channelType = opTemplate.channelType;
+        operation.srcBufferType = opTemplate.srcBufferType;
+        operation.dstBufferType = opTemplate.dstBufferType;
+        operation.nInputs = opTemplate.nInputs;
+        operation.nOutputs = opTemplate.nOutputs;
+        operation.finalReduce = opTemplate.finalReduce;
+        if (opTemplate.hasInputChannels) {
+          std::copy_n(opTemplate.inputChannelIndexes, opTemplate.nInputs, operation.inputChannelIndexes);
+        } else if (opTemplate.nInputs > 0) {
+          operation.inputBufferType = opTemplate.inputBufferType;
+        }
+        if (opTemplate.hasOutputChannels) {
+          std::copy_n(opTemplate.outputChannelIndexes, opTemplate.nOutputs, operation.outputChannelIndexes);
+        } else if (opTemplate.nOutputs > 0) {
+          operation.outputBufferType = opTemplate.outputBufferType;
+        }
+        int chunk = 0;
+        auto nextOffset = [&](BufferType bufferType) {
+          uint32_t offset = getOffset(chunks.begin[chunk], chunks.end[chunk], opTemplate.nChunks > 0, bufferType);
+          chunk++;
+          return offset;
+        };
+        const size_t inputBaseOffset = opTemplate.inputBufferType != BufferType::SCRATCH ? contsSrcOffset : 0;
+        for (int i = 0; i < opTemplate.nInputs; i++) {
+          operation.inputOffsets[i] = nextOffset(opTemplate.inputBufferType) + inputBaseOffset;
+        }
+        const size_t outputBaseOffset = opTemplate.outputBufferType != BufferType::SCRATCH ? constDstOffset : 0;
+        for (int i = 0; i < opTemplate.nOutputs; i++) {
+          operation.outputOffsets[i] = nextOffset(opTemplate.outputBufferType) + outputBaseOffset;
+        }
+        if (opTemplate.hasSrcChunk) {
+          operation.srcOffset = nextOffset(opTemplate.srcBufferType);
+        }
+        if (opTemplate.hasDstChunk) {
+          operation.dstOffset = nextOffset(opTemplate.dstBufferType);
+        }
+        if (opTemplate.hasCount) {
+          uint32_t nChunkSize = 0;
+          for (int i = 0; i < chunks.nChunks; i++) {
+            uint32_t size = offsets[chunks.end[i]] - offsets[chunks.begin[i]];
+            if (nChunkSize == 0) {
+              nChunkSize = size;
+            } else if (nChunkSize != size) {
+              throw Error("Inconsistent chunk size", ErrorCode::ExecutorError);
+            }
+          }
+          operation.size = nChunkSize;
+        }
+      }
     }
+    this->operations[rank] = std::move(rankOperations);
   }
-  return nChunkSize;
 }
 
 void ExecutionPlan::Impl::reset() {
   this->operations.clear();
   this->channelInfos.clear();
+  this->channelInfosByDstRank.clear();
+  this->channelCountMap.clear();
   this->threadblockSMChannelMap.clear();
   this->threadblockProxyChannelMap.clear();
+  this->operationTemplates.clear();
+  this->operationDependencies.clear();
+  this->chunkOffsetTables.clear();
   this->inputChunks.clear();
   this->outputChunks.clear();
   this->scratchChunks.clear();
   this->chunkGroups.clear();
+  this->isAllRanksLoaded = false;
+  this->compiledPlanFile.reset();
 }
 
 void ExecutionPlan::Impl::operationsReset() { this->operations.clear(); }
 
+std::pair<std::string, PlanInfo> readPlanInfo(const std::string& planPath) {
+  std::ifstream file(planPath);
+  if (!file) {
+    throw Error("Failed to open execution plan " + planPath, ErrorCode::ExecutorError);
+  }
+  GpuCounter counter;
+  json obj = json::parse(file, std::ref(counter));
+  PlanInfo info;
+  info.collective = getCollective(obj);
+  info.protocol = obj["protocol"].get<std::string>();
+  info.inPlace = obj.value("inplace", false);
+  info.worldSize = counter.nGpus();
+  info.minMessageSize = obj.value("min_message_size", size_t(0));
+  info.maxMessageSize = obj.value("max_message_size", std::numeric_limits<size_t>::max());
+  return {obj["name"].get<std::string>(), info};
+}
+
 ExecutionPlan::ExecutionPlan(const std::string& name, const std::string& planPath)
     : impl_(std::make_shared<Impl>(name, planPath)) {}
 
+void ExecutionPlan::load(int rank) const { this->impl_->loadPlan(rank); }
+
+uint64_t ExecutionPlan::version() const { return this->impl_->version; }
+
+void ExecutionPlan::compile(const std::string& outputPath) const {
+  this->impl_->loadPlan();
+  this->impl_->saveCompiledPlan(outputPath);
+}
+
+PlanOptimizationStats ExecutionPlan::optimize() const {
+  this->impl_->loadPlan();
+  return this->impl_->optimize();
+}
+
+std::vector<PlanIssue> ExecutionPlan::verify(size_t inputSize, size_t outputSize) const {
+  // Operations of all ranks are instantiated for the verification, keep them out of the plan used for execution.
+  try {
+    std::unique_ptr<Impl> plan = PlanAnalysis::instantiate(*this, inputSize, outputSize);
+    return verifyExecutionPlan(PlanAnalysis(*plan));
+  } catch (const std::exception& e) {
+    return {{PlanIssue::Severity::Error, -1, -1, -1, std::string("Failed to load the plan: ") + e.what()}};
+  }
+}
+
+SimulationResult ExecutionPlan::simulate(size_t inputSize, size_t outputSize, const SimulationConfig& config) const {
+  std::unique_ptr<Impl> plan = PlanAnalysis::instantiate(*this, inputSize, outputSize);
+  return simulateExecutionPlan(PlanAnalysis(*plan), config);
+}
+
+void ExecutionPlan::executeOnHost(const std::vector<void*>& inputs, const std::vector<void*>& outputs,
+                                  size_t inputSize, size_t outputSize, DataType dataType,
+                                  const Reduction& reduction) const {
+  std::unique_ptr<Impl> plan = PlanAnalysis::instantiate(*this, inputSize, outputSize);
+  interpretExecutionPlan(PlanAnalysis(*plan), inputs, outputs, dataType, reduction);
+}
+
 }  // namespace mscclpp
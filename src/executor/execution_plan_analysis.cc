@@ -0,0 +1,325 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "execution_plan_analysis.hpp"
+
+#include <algorithm>
+
+namespace mscclpp {
+
+std::string getOperationName(OperationType type) {
+  switch (type) {
+    case OperationType::BARRIER:
+      return "nop";
+    case OperationType::PUT:
+      return "put";
+    case OperationType::PUT_PACKET:
+      return "ppkt";
+    case OperationType::PUT_WITH_SIGNAL:
+      return "pws";
+    case OperationType::PUT_WITH_SIGNAL_AND_FLUSH:
+      return "pwsf";
+    case OperationType::GET:
+      return "get";
+    case OperationType::COPY:
+      return "copy";
+    case OperationType::COPY_PACKET:
+      return "cpkt";
+    case OperationType::TRANSFORM_TO_PACKET:
+      return "tpkt";
+    case OperationType::SIGNAL:
+      return "signal";
+    case OperationType::WAIT:
+      return "wait";
+    case OperationType::FLUSH:
+      return "flush";
+    case OperationType::REDUCE:
+      return "re";
+    case OperationType::REDUCE_PACKET:
+      return "rpkt";
+    case OperationType::REDUCE_SEND:
+      return "rs";
+    case OperationType::REDUCE_SEND_PACKET:
+      return "rspkt";
+    case OperationType::READ_REDUCE_COPY:
+      return "rrc";
+    case OperationType::READ_REDUCE_COPY_SEND:
+      return "rrcs";
+  }
+  return "unknown";
+}
+
+std::string getBufferName(BufferType type) {
+  switch (type) {
+    case BufferType::INPUT:
+      return "input";
+    case BufferType::OUTPUT:
+      return "output";
+    case BufferType::SCRATCH:
+      return "scratch";
+    default:
+      return "none";
+  }
+}
+
+std::string getChannelTypeName(ChannelType type) {
+  switch (type) {
+    case ChannelType::SM:
+      return "sm";
+    case ChannelType::PROXY:
+      return "proxy";
+    default:
+      return "none";
+  }
+}
+
+std::unique_ptr<ExecutionPlan::Impl> PlanAnalysis::instantiate(const ExecutionPlan& plan, size_t inputSize,
+                                                               size_t outputSize) {
+  const ExecutionPlan::Impl& source = ExecutionPlan::Impl::of(plan);
+  auto impl = std::make_unique<ExecutionPlan::Impl>(source.name, source.planPath);
+  impl->loadExecutionPlan(-1, inputSize, outputSize, 0, 0);
+  return impl;
+}
+
+PlanAnalysis::PlanAnalysis(const ExecutionPlan::Impl& plan) : plan_(plan) {
+  for (const auto& [rank, _] : plan.operations) {
+    ranks_.push_back(rank);
+  }
+  std::sort(ranks_.begin(), ranks_.end());
+
+  for (int rank : ranks_) {
+    auto& rankChannels = channels_[rank];
+    for (ChannelType channelType : {ChannelType::SM, ChannelType::PROXY}) {
+      // Same flattening as the executor: channel index i of a type is the i-th (info, peer) pair of that type.
+      std::vector<std::pair<int, int>> peerOrdinals;
+      std::unordered_map<int, int> nChannelsToPeer;
+      for (const auto& info : plan.getChannelInfos(rank, channelType)) {
+        for (int peer : info.connectedPeers) {
+          peerOrdinals.emplace_back(peer, nChannelsToPeer[peer]++);
+        }
+      }
+      const auto& channelMaps =
+          channelType == ChannelType::SM ? plan.threadblockSMChannelMap : plan.threadblockProxyChannelMap;
+      auto& threadblockChannels = rankChannels[static_cast<int>(channelType) - 1];
+      const auto& rankChannelMap = channelMaps.at(rank);
+      threadblockChannels.resize(rankChannelMap.size());
+      for (size_t tb = 0; tb < rankChannelMap.size(); tb++) {
+        for (const auto& [index, key] : rankChannelMap[tb]) {
+          const auto& [peer, ordinal] = peerOrdinals.at(index);
+          threadblockChannels[tb].push_back({peer, channelType, key.srcBufferType, key.dstBufferType, ordinal});
+        }
+      }
+    }
+    scratchSizes_[rank] = plan.getScratchBufferSize(rank, plan.inputSize, plan.outputSize);
+  }
+}
+
+int PlanAnalysis::threadblockCount(int rank) const { return plan_.operations.at(rank).size(); }
+
+const std::vector<Operation>& PlanAnalysis::operations(int rank, int threadblock) const {
+  return plan_.operations.at(rank)[threadblock];
+}
+
+const OperationTemplate& PlanAnalysis::operationTemplate(int rank, int threadblock, int operation) const {
+  return plan_.operationTemplates.at(rank)[threadblock][operation];
+}
+
+const std::vector<OperationDependency>& PlanAnalysis::dependencies(int rank, int threadblock) const {
+  static const std::vector<OperationDependency> noDependencies;
+  auto it = plan_.operationDependencies.find(rank);
+  if (it == plan_.operationDependencies.end()) {
+    return noDependencies;
+  }
+  return it->second.at(threadblock);
+}
+
+size_t PlanAnalysis::bufferSize(int rank, BufferType bufferType) const {
+  switch (bufferType) {
+    case BufferType::INPUT:
+      return plan_.inputSize;
+    case BufferType::OUTPUT:
+      return plan_.outputSize;
+    case BufferType::SCRATCH:
+      return scratchSizes_.at(rank);
+    default:
+      return 0;
+  }
+}
+
+size_t PlanAnalysis::accessLimit(const PlanAccess& access) const {
+  size_t size = this->bufferSize(access.rank, access.bufferType);
+  return access.isPacket ? size / 2 : size;
+}
+
+const PlanChannel* PlanAnalysis::channel(int rank, int threadblock, ChannelType channelType, int index) const {
+  if (channelType != ChannelType::SM && channelType != ChannelType::PROXY) {
+    return nullptr;
+  }
+  const auto& channels = channels_.at(rank)[static_cast<int>(channelType) - 1].at(threadblock);
+  if (index < 0 || index >= static_cast<int>(channels.size())) {
+    return nullptr;
+  }
+  return &channels[index];
+}
+
+std::vector<const PlanChannel*> PlanAnalysis::inputChannels(int rank, int threadblock, int operation) const {
+  std::vector<const PlanChannel*> channels;
+  const OperationTemplate& opTemplate = this->operationTemplate(rank, threadblock, operation);
+  if (opTemplate.hasInputChannels) {
+    for (int i = 0; i < opTemplate.nInputs; i++) {
+      channels.push_back(this->channel(rank, threadblock, opTemplate.channelType, opTemplate.inputChannelIndexes[i]));
+    }
+  }
+  return channels;
+}
+
+std::vector<const PlanChannel*> PlanAnalysis::outputChannels(int rank, int threadblock, int operation) const {
+  std::vector<const PlanChannel*> channels;
+  const OperationTemplate& opTemplate = this->operationTemplate(rank, threadblock, operation);
+  if (opTemplate.hasOutputChannels) {
+    for (int i = 0; i < opTemplate.nOutputs; i++) {
+      channels.push_back(this->channel(rank, threadblock, opTemplate.channelType, opTemplate.outputChannelIndexes[i]));
+    }
+  }
+  return channels;
+}
+
+std::vector<PlanSemaphore> PlanAnalysis::signals(int rank, int threadblock, int operation) const {
+  const Operation& op = this->operations(rank, threadblock)[operation];
+  bool isSignal = op.type == OperationType::SIGNAL;
+  // Only proxy channels signal as part of a put, see handlePut.
+  bool isPutWithSignal =
+      (op.type == OperationType::PUT_WITH_SIGNAL || op.type == OperationType::PUT_WITH_SIGNAL_AND_FLUSH) &&
+      op.channelType == ChannelType::PROXY;
+  std::vector<PlanSemaphore> semaphores;
+  if (isSignal || isPutWithSignal) {
+    for (const PlanChannel* channel : this->outputChannels(rank, threadblock, operation)) {
+      if (channel != nullptr) {
+        semaphores.push_back({rank, channel->peer, channel->channelType, channel->ordinal});
+      }
+    }
+  }
+  return semaphores;
+}
+
+std::vector<PlanSemaphore> PlanAnalysis::waits(int rank, int threadblock, int operation) const {
+  std::vector<PlanSemaphore> semaphores;
+  if (this->operations(rank, threadblock)[operation].type == OperationType::WAIT) {
+    for (const PlanChannel* channel : this->inputChannels(rank, threadblock, operation)) {
+      if (channel != nullptr) {
+        semaphores.push_back({channel->peer, rank, channel->channelType, channel->ordinal});
+      }
+    }
+  }
+  return semaphores;
+}
+
+std::vector<PlanAccess> PlanAnalysis::accesses(int rank, int threadblock, int operation) const {
+  const Operation& op = this->operations(rank, threadblock)[operation];
+  std::vector<const PlanChannel*> inputs = this->inputChannels(rank, threadblock, operation);
+  std::vector<const PlanChannel*> outputs = this->outputChannels(rank, threadblock, operation);
+  std::vector<PlanAccess> accesses;
+  auto local = [&](BufferType bufferType, uint64_t offset, uint64_t size, bool isWrite, bool isPacket = false) {
+    accesses.push_back({rank, bufferType, isPacket, isWrite, offset, size});
+  };
+  auto remote = [&](const PlanChannel* channel, uint64_t offset, uint64_t size, bool isWrite, bool isPacket = false) {
+    if (channel != nullptr) {
+      accesses.push_back({channel->peer, channel->dstBufferType, isPacket, isWrite, offset, size});
+    }
+  };
+  switch (op.type) {
+    case OperationType::PUT:
+    case OperationType::PUT_WITH_SIGNAL:
+    case OperationType::PUT_WITH_SIGNAL_AND_FLUSH:
+      for (size_t i = 0; i < outputs.size(); i++) {
+        if (outputs[i] != nullptr) {
+          local(outputs[i]->srcBufferType, op.inputOffsets[i], op.size, false);
+        }
+        remote(outputs[i], op.outputOffsets[i], op.size, true);
+      }
+      break;
+    case OperationType::PUT_PACKET:
+      for (size_t i = 0; i < outputs.size(); i++) {
+        if (outputs[i] != nullptr) {
+          // Proxy channels copy packets that are already in the local scratch buffer.
+          if (op.channelType == ChannelType::PROXY) {
+            local(outputs[i]->srcBufferType, 2 * uint64_t(op.inputOffsets[i]), 2 * uint64_t(op.size), false, true);
+          } else {
+            local(outputs[i]->srcBufferType, op.inputOffsets[i], op.size, false);
+          }
+        }
+        remote(outputs[i], 2 * uint64_t(op.outputOffsets[i]), 2 * uint64_t(op.size), true, true);
+      }
+      break;
+    case OperationType::GET:
+      for (size_t i = 0; i < inputs.size(); i++) {
+        remote(inputs[i], op.outputOffsets[i], op.size, false);
+        if (inputs[i] != nullptr) {
+          local(inputs[i]->srcBufferType, op.inputOffsets[i], op.size, true);
+        }
+      }
+      break;
+    case OperationType::COPY:
+      local(op.srcBufferType, op.srcOffset, op.size, false);
+      local(op.dstBufferType, op.dstOffset, op.size, true);
+      break;
+    case OperationType::READ_REDUCE_COPY:
+    case OperationType::READ_REDUCE_COPY_SEND:
+      local(op.srcBufferType, op.srcOffset, op.size, false);
+      for (size_t i = 0; i < inputs.size(); i++) {
+        remote(inputs[i], op.inputOffsets[i], op.size, false);
+      }
+      local(op.dstBufferType, op.dstOffset, op.size, true);
+      if (op.type == OperationType::READ_REDUCE_COPY_SEND) {
+        for (size_t i = 0; i < outputs.size(); i++) {
+          remote(outputs[i], op.outputOffsets[i], op.size, true);
+        }
+      }
+      break;
+    case OperationType::REDUCE:
+      local(op.srcBufferType, op.srcOffset, op.size, false);
+      for (int i = 0; i < op.nInputs; i++) {
+        local(op.inputBufferType, op.inputOffsets[i], op.size, false);
+      }
+      local(op.dstBufferType, op.dstOffset, op.size, true);
+      break;
+    case OperationType::REDUCE_SEND:
+      // The kernel reduces one local input per output channel.
+      local(op.srcBufferType, op.srcOffset, op.size, false);
+      for (size_t i = 0; i < outputs.size(); i++) {
+        local(op.inputBufferType, op.inputOffsets[i], op.size, false);
+      }
+      local(op.dstBufferType, op.dstOffset, op.size, true);
+      for (size_t i = 0; i < outputs.size(); i++) {
+        remote(outputs[i], op.outputOffsets[i], op.size, true);
+      }
+      break;
+    case OperationType::REDUCE_PACKET:
+    case OperationType::REDUCE_SEND_PACKET:
+      // Packets are always read from the scratch buffer.
+      for (int i = 0; i < op.nInputs; i++) {
+        local(BufferType::SCRATCH, 2 * uint64_t(op.inputOffsets[i]), 2 * uint64_t(op.size), false, true);
+      }
+      local(op.srcBufferType, op.srcOffset, op.size, false);
+      local(op.dstBufferType, op.dstOffset, op.size, true);
+      if (op.type == OperationType::REDUCE_SEND_PACKET) {
+        for (size_t i = 0; i < outputs.size(); i++) {
+          remote(outputs[i], 2 * uint64_t(op.outputOffsets[i]), 2 * uint64_t(op.size), true, true);
+        }
+      }
+      break;
+    case OperationType::COPY_PACKET:
+      local(op.srcBufferType, 2 * uint64_t(op.srcOffset), 2 * uint64_t(op.size), false, true);
+      local(op.dstBufferType, op.dstOffset, op.size, true);
+      break;
+    case OperationType::TRANSFORM_TO_PACKET:
+      local(op.srcBufferType, op.srcOffset, op.size, false);
+      local(op.dstBufferType, 2 * uint64_t(op.dstOffset), 2 * uint64_t(op.size), true, true);
+      break;
+    default:
+      break;
+  }
+  return accesses;
+}
+
+}  // namespace mscclpp
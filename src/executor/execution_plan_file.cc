@@ -0,0 +1,408 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "execution_plan_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mscclpp/errors.hpp>
+#include <tuple>
+
+#include "execution_plan.hpp"
+
+namespace {
+
+constexpr size_t PLAN_FILE_ALIGNMENT = 8;
+
+size_t alignUp(size_t size) { return (size + PLAN_FILE_ALIGNMENT - 1) / PLAN_FILE_ALIGNMENT * PLAN_FILE_ALIGNMENT; }
+
+class PlanFileWriter {
+ public:
+  template <typename T>
+  void write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>, "Plan file entries must be trivially copyable");
+    const char* ptr = reinterpret_cast<const char*>(&value);
+    buffer_.insert(buffer_.end(), ptr, ptr + sizeof(T));
+  }
+
+  void write(const char* data, size_t size) { buffer_.insert(buffer_.end(), data, data + size); }
+
+  void pad() { buffer_.resize(alignUp(buffer_.size()), 0); }
+
+  template <typename T>
+  void overwrite(size_t offset, const T& value) {
+    std::memcpy(buffer_.data() + offset, &value, sizeof(T));
+  }
+
+  size_t size() const { return buffer_.size(); }
+  const char* data() const { return buffer_.data(); }
+
+ private:
+  std::vector<char> buffer_;
+};
+
+class PlanFileReader {
+ public:
+  PlanFileReader(const char* data, size_t size) : data_(data), size_(size), offset_(0) {}
+
+  template <typename T>
+  T read() {
+    static_assert(std::is_trivially_copyable_v<T>, "Plan file entries must be trivially copyable");
+    if (offset_ + sizeof(T) > size_) {
+      throw mscclpp::Error("Truncated compiled execution plan", mscclpp::ErrorCode::ExecutorError);
+    }
+    T value;
+    std::memcpy(&value, data_ + offset_, sizeof(T));
+    offset_ += sizeof(T);
+    return value;
+  }
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t offset_;
+};
+
+void writeChannelInfo(PlanFileWriter& writer, const mscclpp::ChannelInfo& info) {
+  mscclpp::PlanFileChannelInfo entry = {};
+  entry.srcBufferType = static_cast<uint8_t>(info.srcBufferType);
+  entry.dstBufferType = static_cast<uint8_t>(info.dstBufferType);
+  entry.channelType = static_cast<uint8_t>(info.channelType);
+  entry.nPeers = info.connectedPeers.size();
+  writer.write(entry);
+  for (int peer : info.connectedPeers) {
+    writer.write<int32_t>(peer);
+  }
+}
+
+mscclpp::ChannelInfo readChannelInfo(PlanFileReader& reader) {
+  auto entry = reader.read<mscclpp::PlanFileChannelInfo>();
+  mscclpp::ChannelInfo info;
+  info.srcBufferType = static_cast<mscclpp::BufferType>(entry.srcBufferType);
+  info.dstBufferType = static_cast<mscclpp::BufferType>(entry.dstBufferType);
+  info.channelType = static_cast<mscclpp::ChannelType>(entry.channelType);
+  info.connectedPeers.reserve(entry.nPeers);
+  for (uint32_t i = 0; i < entry.nPeers; i++) {
+    info.connectedPeers.push_back(reader.read<int32_t>());
+  }
+  return info;
+}
+
+void writeChannelRef(PlanFileWriter& writer, const std::pair<int, mscclpp::ChannelKey>& channel) {
+  mscclpp::PlanFileChannelRef ref = {};
+  ref.index = channel.first;
+  ref.srcBufferType = static_cast<uint8_t>(channel.second.srcBufferType);
+  ref.dstBufferType = static_cast<uint8_t>(channel.second.dstBufferType);
+  ref.channelType = static_cast<uint8_t>(channel.second.channelType);
+  writer.write(ref);
+}
+
+std::pair<int, mscclpp::ChannelKey> readChannelRef(PlanFileReader& reader) {
+  auto ref = reader.read<mscclpp::PlanFileChannelRef>();
+  mscclpp::ChannelKey key = {static_cast<mscclpp::BufferType>(ref.srcBufferType),
+                             static_cast<mscclpp::BufferType>(ref.dstBufferType),
+                             static_cast<mscclpp::ChannelType>(ref.channelType)};
+  return {ref.index, key};
+}
+
+}  // namespace
+
+namespace mscclpp {
+
+// FNV-1a
+uint64_t planFileChecksum(const char* data, size_t size) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+ExecutionPlanFile::ExecutionPlanFile(const std::string& path) : path_(path), data_(nullptr), size_(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw SysError("Failed to open compiled execution plan " + path, errno);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    throw SysError("Failed to stat compiled execution plan " + path, err);
+  }
+  size_ = st.st_size;
+  if (size_ < sizeof(PlanFileHeader)) {
+    close(fd);
+    throw Error("Truncated compiled execution plan " + path, ErrorCode::ExecutorError);
+  }
+  void* ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  int err = errno;
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    throw SysError("Failed to map compiled execution plan " + path, err);
+  }
+  data_ = static_cast<const char*>(ptr);
+
+  try {
+    const PlanFileHeader& hdr = this->header();
+    if (std::memcmp(hdr.magic, PLAN_FILE_MAGIC, sizeof(PLAN_FILE_MAGIC)) != 0) {
+      throw Error("Not a compiled execution plan: " + path, ErrorCode::ExecutorError);
+    }
+    if (hdr.version != PLAN_FILE_VERSION) {
+      throw Error("Unsupported compiled execution plan version " + std::to_string(hdr.version) + ": " + path,
+                  ErrorCode::ExecutorError);
+    }
+    size_t indexOffset = sizeof(PlanFileHeader) + alignUp(hdr.nameLength) + alignUp(hdr.collectiveLength);
+    size_t indexEnd = indexOffset + sizeof(PlanFileRankEntry) * hdr.nRanks;
+    if (hdr.fileSize != size_ || indexEnd > size_) {
+      throw Error("Truncated compiled execution plan " + path, ErrorCode::ExecutorError);
+    }
+    if (planFileChecksum(data_ + sizeof(PlanFileHeader), indexEnd - sizeof(PlanFileHeader)) != hdr.indexChecksum) {
+      throw Error("Corrupted compiled execution plan " + path, ErrorCode::ExecutorError);
+    }
+    const PlanFileRankEntry* entries = reinterpret_cast<const PlanFileRankEntry*>(data_ + indexOffset);
+    for (uint32_t i = 0; i < hdr.nRanks; i++) {
+      if (entries[i].offset + entries[i].size > size_) {
+        throw Error("Truncated compiled execution plan " + path, ErrorCode::ExecutorError);
+      }
+      ranks_.push_back(entries[i].rank);
+      rankEntries_[entries[i].rank] = &entries[i];
+    }
+  } catch (...) {
+    munmap(const_cast<char*>(data_), size_);
+    throw;
+  }
+}
+
+ExecutionPlanFile::~ExecutionPlanFile() { munmap(const_cast<char*>(data_), size_); }
+
+bool ExecutionPlanFile::isCompiledPlan(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  char magic[sizeof(PLAN_FILE_MAGIC)];
+  if (!file.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return std::memcmp(magic, PLAN_FILE_MAGIC, sizeof(PLAN_FILE_MAGIC)) == 0;
+}
+
+const PlanFileHeader& ExecutionPlanFile::header() const { return *reinterpret_cast<const PlanFileHeader*>(data_); }
+
+std::string ExecutionPlanFile::name() const {
+  return std::string(data_ + sizeof(PlanFileHeader), this->header().nameLength);
+}
+
+std::string ExecutionPlanFile::collective() const {
+  return std::string(data_ + sizeof(PlanFileHeader) + alignUp(this->header().nameLength),
+                     this->header().collectiveLength);
+}
+
+const std::vector<int>& ExecutionPlanFile::ranks() const { return ranks_; }
+
+bool ExecutionPlanFile::hasRank(int rank) const { return rankEntries_.count(rank) > 0; }
+
+std::pair<const char*, size_t> ExecutionPlanFile::rankSection(int rank) {
+  auto it = rankEntries_.find(rank);
+  if (it == rankEntries_.end()) {
+    throw Error("Rank " + std::to_string(rank) + " not found in compiled execution plan " + path_,
+                ErrorCode::ExecutorError);
+  }
+  const PlanFileRankEntry& entry = *it->second;
+  const char* section = data_ + entry.offset;
+  if (!validated_[rank]) {
+    if (planFileChecksum(section, entry.size) != entry.checksum) {
+      throw Error("Corrupted compiled execution plan " + path_, ErrorCode::ExecutorError);
+    }
+    validated_[rank] = true;
+  }
+  return {section, entry.size};
+}
+
+void ExecutionPlan::Impl::saveCompiledPlan(const std::string& path) const {
+  std::vector<int> ranks;
+  for (const auto& [rank, _] : this->operationTemplates) {
+    ranks.push_back(rank);
+  }
+  std::sort(ranks.begin(), ranks.end());
+
+  // Bucket the channel counts by rank, so that each rank section carries the counts in both directions.
+  std::unordered_map<int, std::vector<PlanFileChannelCount>> channelCounts;
+  for (const auto& [key, peerCounts] : this->channelCountMap) {
+    for (const auto& [peer, count] : peerCounts) {
+      PlanFileChannelCount entry = {key.first, peer, static_cast<uint32_t>(key.second), count};
+      channelCounts[key.first].push_back(entry);
+      if (peer != key.first) {
+        channelCounts[peer].push_back(entry);
+      }
+    }
+  }
+  for (auto& [_, counts] : channelCounts) {
+    std::sort(counts.begin(), counts.end(), [](const PlanFileChannelCount& a, const PlanFileChannelCount& b) {
+      return std::tie(a.rank, a.channelType, a.peer) < std::tie(b.rank, b.channelType, b.peer);
+    });
+  }
+
+  PlanFileWriter writer;
+  PlanFileHeader header = {};
+  std::memcpy(header.magic, PLAN_FILE_MAGIC, sizeof(PLAN_FILE_MAGIC));
+  header.version = PLAN_FILE_VERSION;
+  header.flags = (this->isUsingPacket ? PLAN_FILE_FLAG_PACKET : 0) |
+                 (this->marksFinalReduces ? PLAN_FILE_FLAG_FINAL_REDUCES : 0);
+  header.nRanks = ranks.size();
+  header.nThreadsPerBlock = this->nThreadsPerBlock;
+  header.nameLength = this->name.size();
+  header.collectiveLength = this->collective.size();
+  writer.write(header);
+  writer.write(this->name.data(), this->name.size());
+  writer.pad();
+  writer.write(this->collective.data(), this->collective.size());
+  writer.pad();
+  size_t indexOffset = writer.size();
+  std::vector<PlanFileRankEntry> entries(ranks.size());
+  for (const auto& entry : entries) {
+    writer.write(entry);
+  }
+
+  static const std::vector<ChannelInfo> noChannelInfos;
+  for (size_t i = 0; i < ranks.size(); i++) {
+    int rank = ranks[i];
+    const auto& threadblocks = this->operationTemplates.at(rank);
+    auto channelInfosIt = this->channelInfos.find(rank);
+    auto channelInfosByDstRankIt = this->channelInfosByDstRank.find(rank);
+    const auto& rankChannelInfos = channelInfosIt != this->channelInfos.end() ? channelInfosIt->second : noChannelInfos;
+    const auto& rankChannelInfosByDstRank =
+        channelInfosByDstRankIt != this->channelInfosByDstRank.end() ? channelInfosByDstRankIt->second : noChannelInfos;
+    const auto& rankChannelCounts = channelCounts[rank];
+
+    writer.pad();
+    entries[i].rank = rank;
+    entries[i].offset = writer.size();
+    PlanFileRankHeader rankHeader = {};
+    rankHeader.inputChunks = this->inputChunks.at(rank);
+    rankHeader.outputChunks = this->outputChunks.at(rank);
+    rankHeader.scratchChunks = this->scratchChunks.at(rank);
+    rankHeader.chunkGroups = this->chunkGroups.at(rank);
+    rankHeader.nChannelInfos = rankChannelInfos.size();
+    rankHeader.nChannelInfosByDstRank = rankChannelInfosByDstRank.size();
+    rankHeader.nChannelCounts = rankChannelCounts.size();
+    rankHeader.nThreadblocks = threadblocks.size();
+    writer.write(rankHeader);
+    for (const auto& info : rankChannelInfos) {
+      writeChannelInfo(writer, info);
+    }
+    for (const auto& info : rankChannelInfosByDstRank) {
+      writeChannelInfo(writer, info);
+    }
+    for (const auto& count : rankChannelCounts) {
+      writer.write(count);
+    }
+    for (size_t tb = 0; tb < threadblocks.size(); tb++) {
+      const auto& smChannels = this->threadblockSMChannelMap.at(rank)[tb];
+      const auto& proxyChannels = this->threadblockProxyChannelMap.at(rank)[tb];
+      PlanFileThreadblock threadblock = {};
+      threadblock.nSmChannels = smChannels.size();
+      threadblock.nProxyChannels = proxyChannels.size();
+      threadblock.nOperations = threadblocks[tb].size();
+      const auto& dependencies = this->operationDependencies.at(rank)[tb];
+      threadblock.nDependencies = dependencies.size();
+      writer.write(threadblock);
+      for (const auto& channel : smChannels) {
+        writeChannelRef(writer, channel);
+      }
+      for (const auto& channel : proxyChannels) {
+        writeChannelRef(writer, channel);
+      }
+      for (const auto& op : threadblocks[tb]) {
+        writer.write(op);
+      }
+      for (const auto& dependency : dependencies) {
+        writer.write(dependency);
+      }
+    }
+    entries[i].size = writer.size() - entries[i].offset;
+    entries[i].checksum = planFileChecksum(writer.data() + entries[i].offset, entries[i].size);
+  }
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    writer.overwrite(indexOffset + i * sizeof(PlanFileRankEntry), entries[i]);
+  }
+  header.fileSize = writer.size();
+  header.indexChecksum = planFileChecksum(writer.data() + sizeof(PlanFileHeader),
+                                          indexOffset + entries.size() * sizeof(PlanFileRankEntry) - sizeof(header));
+  writer.overwrite(0, header);
+
+  // Write to a temporary file and rename it, so concurrent readers never observe a partially written plan.
+  std::string tmpPath = path + ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.write(writer.data(), writer.size()) || !file.flush()) {
+      throw Error("Failed to write compiled execution plan " + tmpPath, ErrorCode::ExecutorError);
+    }
+  }
+  if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    int err = errno;
+    std::remove(tmpPath.c_str());
+    throw SysError("Failed to rename compiled execution plan to " + path, err);
+  }
+}
+
+void ExecutionPlan::Impl::loadCompiledRank(int rank) {
+  if (this->operationTemplates.count(rank) > 0) {
+    return;
+  }
+  auto [section, size] = this->compiledPlanFile->rankSection(rank);
+  PlanFileReader reader(section, size);
+  auto rankHeader = reader.read<PlanFileRankHeader>();
+  this->inputChunks[rank] = rankHeader.inputChunks;
+  this->outputChunks[rank] = rankHeader.outputChunks;
+  this->scratchChunks[rank] = rankHeader.scratchChunks;
+  this->chunkGroups[rank] = rankHeader.chunkGroups;
+
+  std::vector<ChannelInfo>& rankChannelInfos = this->channelInfos[rank];
+  rankChannelInfos.clear();
+  for (uint32_t i = 0; i < rankHeader.nChannelInfos; i++) {
+    rankChannelInfos.push_back(readChannelInfo(reader));
+  }
+  std::vector<ChannelInfo>& rankChannelInfosByDstRank = this->channelInfosByDstRank[rank];
+  rankChannelInfosByDstRank.clear();
+  for (uint32_t i = 0; i < rankHeader.nChannelInfosByDstRank; i++) {
+    rankChannelInfosByDstRank.push_back(readChannelInfo(reader));
+  }
+  for (uint32_t i = 0; i < rankHeader.nChannelCounts; i++) {
+    auto count = reader.read<PlanFileChannelCount>();
+    this->channelCountMap[{count.rank, static_cast<ChannelType>(count.channelType)}][count.peer] = count.count;
+  }
+
+  auto& smChannelMap = this->threadblockSMChannelMap[rank];
+  auto& proxyChannelMap = this->threadblockProxyChannelMap[rank];
+  std::vector<std::vector<OperationTemplate>> templates(rankHeader.nThreadblocks);
+  std::vector<std::vector<OperationDependency>> dependencies(rankHeader.nThreadblocks);
+  smChannelMap.assign(rankHeader.nThreadblocks, {});
+  proxyChannelMap.assign(rankHeader.nThreadblocks, {});
+  for (uint32_t tb = 0; tb < rankHeader.nThreadblocks; tb++) {
+    auto threadblock = reader.read<PlanFileThreadblock>();
+    for (uint32_t i = 0; i < threadblock.nSmChannels; i++) {
+      smChannelMap[tb].push_back(readChannelRef(reader));
+    }
+    for (uint32_t i = 0; i < threadblock.nProxyChannels; i++) {
+      proxyChannelMap[tb].push_back(readChannelRef(reader));
+    }
+    templates[tb].reserve(threadblock.nOperations);
+    for (uint32_t i = 0; i < threadblock.nOperations; i++) {
+      templates[tb].push_back(reader.read<OperationTemplate>());
+    }
+    dependencies[tb].reserve(threadblock.nDependencies);
+    for (uint32_t i = 0; i < threadblock.nDependencies; i++) {
+      dependencies[tb].push_back(reader.read<OperationDependency>());
+    }
+  }
+  this->operationTemplates[rank] = std::move(templates);
+  this->operationDependencies[rank] = std::move(dependencies);
+}
+
+}  // namespace mscclpp
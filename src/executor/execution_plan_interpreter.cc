@@ -0,0 +1,567 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <mscclpp/errors.hpp>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+#include "execution_plan_analysis.hpp"
+
+namespace {
+using namespace mscclpp;
+
+// The interpreter runs the plan as the first execution of the executor does: with flag 1, which puts the packets in
+// the first half of the scratch buffer.
+constexpr uint32_t FLAG = 1;
+
+template <typename To, typename From>
+To bitCast(const From& from) {
+  static_assert(sizeof(To) == sizeof(From), "Size mismatch for bitCast");
+  To to;
+  std::memcpy(&to, &from, sizeof(To));
+  return to;
+}
+
+float halfToFloat(uint16_t h) {
+  uint32_t sign = uint32_t(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  if (exponent == 0) {
+    float value = std::ldexp(float(mantissa), -24);
+    return sign ? -value : value;
+  }
+  if (exponent == 0x1f) {
+    return bitCast<float>(sign | 0x7f800000 | (mantissa << 13));
+  }
+  return bitCast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+// Rounds to nearest even, like the device.
+uint16_t floatToHalf(float f) {
+  uint32_t bits = bitCast<uint32_t>(f);
+  uint16_t sign = (bits >> 16) & 0x8000;
+  uint32_t magnitude = bits & 0x7fffffff;
+  if (magnitude > 0x7f800000) {
+    return sign | 0x7e00;
+  }
+  // 65520 and above round to infinity.
+  if (magnitude >= 0x477ff000) {
+    return sign | 0x7c00;
+  }
+  // Below the smallest normal half, the value is a multiple of 2^-24.
+  if (magnitude < 0x38800000) {
+    return sign | uint16_t(std::nearbyint(bitCast<float>(magnitude) * 16777216.0f));
+  }
+  uint32_t half = (((magnitude >> 23) - 112) << 10) | ((magnitude >> 13) & 0x3ff);
+  uint32_t rest = magnitude & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+    half++;
+  }
+  return sign | half;
+}
+
+float bfloat16ToFloat(uint16_t b) { return bitCast<float>(uint32_t(b) << 16); }
+
+uint16_t floatToBfloat16(float f) {
+  uint32_t bits = bitCast<uint32_t>(f);
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return (bits >> 16) | 0x40;
+  }
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return bits >> 16;
+}
+
+// Combine two elements with `op` like the device. Integer sums and products wrap around, and the maximum and minimum
+// of floating point values ignore NaN like fmaxf and fminf. AVG and PREMUL_SUM sum the values.
+template <typename T>
+T combine(T a, T b, ReduceOp op) {
+  switch (op) {
+    case ReduceOp::PROD:
+      if constexpr (std::is_integral_v<T>) {
+        return T(uint32_t(a) * uint32_t(b));
+      } else {
+        return a * b;
+      }
+    case ReduceOp::MAX:
+      if constexpr (std::is_integral_v<T>) {
+        return std::max(a, b);
+      } else {
+        return std::fmax(a, b);
+      }
+    case ReduceOp::MIN:
+      if constexpr (std::is_integral_v<T>) {
+        return std::min(a, b);
+      } else {
+        return std::fmin(a, b);
+      }
+    default:
+      if constexpr (std::is_integral_v<T>) {
+        return T(uint32_t(a) + uint32_t(b));
+      } else {
+        return a + b;
+      }
+  }
+}
+
+// The sum and the product of two 16-bit floating point values are exact in float, so rounding them once gives the
+// device result.
+uint16_t combineFloat16(uint16_t a, uint16_t b, ReduceOp op) {
+  return floatToHalf(combine(halfToFloat(a), halfToFloat(b), op));
+}
+
+uint16_t combineBfloat16(uint16_t a, uint16_t b, ReduceOp op) {
+  return floatToBfloat16(combine(bfloat16ToFloat(a), bfloat16ToFloat(b), op));
+}
+
+// Combine the `size` bytes of `value`, or the single element at `value` if `broadcast`, into `result` element-wise.
+using CombineFunction = void (*)(char* result, const char* value, size_t size, ReduceOp op, bool broadcast);
+
+template <typename T, T (*Combine)(T, T, ReduceOp)>
+void combineBuffers(char* result, const char* value, size_t size, ReduceOp op, bool broadcast) {
+  for (size_t i = 0; i + sizeof(T) <= size; i += sizeof(T)) {
+    T a, b;
+    std::memcpy(&a, result + i, sizeof(T));
+    std::memcpy(&b, value + (broadcast ? 0 : i), sizeof(T));
+    a = Combine(a, b, op);
+    std::memcpy(result + i, &a, sizeof(T));
+  }
+}
+
+// Arithmetic of the reductions of a plan, see Reduction. AVG and PREMUL_SUM sum the data, and the final reduces
+// multiply their result by the factor, converted to the data type like the kernel does.
+class Reducer {
+ public:
+  Reducer(DataType dataType, const Reduction& reduction, size_t nRanks) : op_(reduction.op) {
+    if (reduction.deviceScalar != nullptr) {
+      throw Error("Host executions cannot read the factor of a reduction from device memory", ErrorCode::InvalidUsage);
+    }
+    double scalar = reduction.scalar;
+    if (op_ == ReduceOp::AVG) {
+      if (dataType == DataType::INT32 || dataType == DataType::UINT32) {
+        throw Error("AVG reductions need a floating point data type", ErrorCode::InvalidUsage);
+      }
+      scalar = 1.0 / nRanks;
+    }
+    switch (dataType) {
+      case DataType::INT32:
+        combine_ = combineBuffers<int32_t, combine<int32_t>>;
+        this->setFactor(int32_t(scalar));
+        return;
+      case DataType::UINT32:
+        combine_ = combineBuffers<uint32_t, combine<uint32_t>>;
+        this->setFactor(uint32_t(scalar));
+        return;
+      case DataType::FLOAT16:
+        combine_ = combineBuffers<uint16_t, combineFloat16>;
+        this->setFactor(floatToHalf(float(scalar)));
+        return;
+      case DataType::FLOAT32:
+        combine_ = combineBuffers<float, combine<float>>;
+        this->setFactor(float(scalar));
+        return;
+      case DataType::BFLOAT16:
+        combine_ = combineBuffers<uint16_t, combineBfloat16>;
+        this->setFactor(floatToBfloat16(float(scalar)));
+        return;
+    }
+    throw Error("Unsupported data type", ErrorCode::InvalidUsage);
+  }
+
+  // Combine the `size` bytes of `value` into `result` element-wise.
+  void reduce(char* result, const char* value, size_t size) const {
+    combine_(result, value, size, this->scaled() ? ReduceOp::SUM : op_, false);
+  }
+
+  // Multiply the `size` bytes of the result of a final reduce at `data` by the factor of AVG and PREMUL_SUM.
+  void scale(char* data, size_t size) const {
+    if (this->scaled()) {
+      combine_(data, factor_, size, ReduceOp::PROD, true);
+    }
+  }
+
+  bool scaled() const { return op_ == ReduceOp::AVG || op_ == ReduceOp::PREMUL_SUM; }
+
+ private:
+  template <typename T>
+  void setFactor(T factor) {
+    std::memcpy(factor_, &factor, sizeof(T));
+  }
+
+  ReduceOp op_;
+  CombineFunction combine_;
+  char factor_[sizeof(uint32_t)] = {};
+};
+
+// Packets of both PacketType are a sequence of 8-byte words holding 4 bytes of data and a 4-byte flag, written and
+// read atomically. An LL16 packet is two such words.
+uint64_t loadPacketWord(const char* word) {
+  return __atomic_load_n(reinterpret_cast<const uint64_t*>(word), __ATOMIC_ACQUIRE);
+}
+
+void storePacketWord(char* word, uint64_t value) {
+  __atomic_store_n(reinterpret_cast<uint64_t*>(word), value, __ATOMIC_RELEASE);
+}
+
+// Write the `size` bytes of `data` as packets to `packets`.
+void writePackets(char* packets, const char* data, size_t size) {
+  for (size_t i = 0; i < size / sizeof(uint32_t); i++) {
+    uint32_t value;
+    std::memcpy(&value, data + i * sizeof(uint32_t), sizeof(uint32_t));
+    storePacketWord(packets + i * sizeof(uint64_t), (uint64_t(FLAG) << 32) | value);
+  }
+}
+
+// Runs every threadblock of a plan on its own host thread, see ExecutionPlan::executeOnHost.
+//
+// A threadblock runs its operations one after another, so barriers are no-ops. Semaphores are counters shared by all
+// threads: a signal increments the counter of each of its channels and a wait blocks until it can decrement them.
+// Puts on proxy channels complete before the next operation, which makes flushes no-ops too. A packet read blocks
+// until the flag of the packet is set. When every unfinished threadblock is blocked, the plan deadlocks and all
+// threads stop.
+class PlanInterpreter {
+ public:
+  PlanInterpreter(const PlanAnalysis& analysis, const std::vector<void*>& inputs, const std::vector<void*>& outputs,
+                  DataType dataType, const Reduction& reduction)
+      : analysis_(analysis), reducer_(dataType, reduction, analysis.ranks().size()) {
+    if (reducer_.scaled() && analysis.reducesInputs() && !analysis.marksFinalReduces()) {
+      throw Error("AVG and PREMUL_SUM need a plan that marks its final reduces", ErrorCode::InvalidUsage);
+    }
+    for (int rank : analysis.ranks()) {
+      size_t inputSize = analysis.bufferSize(rank, BufferType::INPUT);
+      size_t outputSize = analysis.bufferSize(rank, BufferType::OUTPUT);
+      RankBuffers& buffers = buffers_[rank];
+      buffers.input = rank < int(inputs.size()) ? static_cast<char*>(inputs[rank]) : nullptr;
+      buffers.output = rank < int(outputs.size()) ? static_cast<char*>(outputs[rank]) : nullptr;
+      if ((inputSize > 0 && buffers.input == nullptr) || (outputSize > 0 && buffers.output == nullptr)) {
+        throw Error("Missing host buffers of rank " + std::to_string(rank), ErrorCode::InvalidUsage);
+      }
+      // Zero flags are never valid, so packets are not read before they are written.
+      size_t scratchSize = analysis.bufferSize(rank, BufferType::SCRATCH);
+      buffers.scratch.assign((scratchSize + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+    }
+    for (int rank : analysis.ranks()) {
+      for (int tb = 0; tb < analysis.threadblockCount(rank); tb++) {
+        this->check(rank, tb);
+        threadblocks_.push_back({rank, tb});
+      }
+    }
+  }
+
+  void run() {
+    running_ = threadblocks_.size();
+    std::vector<std::thread> threads;
+    threads.reserve(threadblocks_.size());
+    for (const auto& [rank, tb] : threadblocks_) {
+      threads.emplace_back([this, rank = rank, tb = tb] { this->runThreadblock(rank, tb); });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    if (deadlocked_) {
+      throw Error("Execution plan deadlocked, the remaining threadblocks wait for signals or packets that never come",
+                  ErrorCode::ExecutorError);
+    }
+  }
+
+ private:
+  struct RankBuffers {
+    char* input;
+    char* output;
+    std::vector<uint64_t> scratch;
+  };
+
+  // Thrown to unwind a thread when the execution stops.
+  struct Stopped {};
+
+  // Operations run without bounds checks, so check them all before anything runs.
+  void check(int rank, int tb) const {
+    const auto& operations = analysis_.operations(rank, tb);
+    for (size_t i = 0; i < operations.size(); i++) {
+      std::string location = "operation " + std::to_string(i) + " of threadblock " + std::to_string(tb) +
+                             " of rank " + std::to_string(rank);
+      for (const auto& channels : {analysis_.inputChannels(rank, tb, i), analysis_.outputChannels(rank, tb, i)}) {
+        for (const PlanChannel* channel : channels) {
+          if (channel == nullptr || buffers_.count(channel->peer) == 0) {
+            throw Error("Invalid channel in " + location, ErrorCode::InvalidUsage);
+          }
+        }
+      }
+      for (const PlanAccess& access : analysis_.accesses(rank, tb, i)) {
+        if (access.bufferType == BufferType::NONE || access.offset + access.size > analysis_.accessLimit(access)) {
+          throw Error("Out of bounds access to the " + getBufferName(access.bufferType) + " buffer of rank " +
+                          std::to_string(access.rank) + " in " + location,
+                      ErrorCode::InvalidUsage);
+        }
+      }
+    }
+  }
+
+  char* buffer(int rank, BufferType bufferType) {
+    RankBuffers& buffers = buffers_.at(rank);
+    switch (bufferType) {
+      case BufferType::INPUT:
+        return buffers.input;
+      case BufferType::OUTPUT:
+        return buffers.output;
+      case BufferType::SCRATCH:
+        return reinterpret_cast<char*>(buffers.scratch.data());
+      default:
+        return nullptr;
+    }
+  }
+
+  // Source buffer of a channel on its rank and destination buffer on its peer.
+  char* local(int rank, const PlanChannel* channel) { return this->buffer(rank, channel->srcBufferType); }
+  char* remote(const PlanChannel* channel) { return this->buffer(channel->peer, channel->dstBufferType); }
+
+  void runThreadblock(int rank, int tb) {
+    try {
+      for (size_t i = 0; i < analysis_.operations(rank, tb).size() && !stopped_; i++) {
+        this->execute(rank, tb, i);
+      }
+    } catch (const Stopped&) {
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+      this->stop(false);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_--;
+    if (running_ > 0 && blocked_ == running_) {
+      this->stop(true);
+    }
+  }
+
+  void execute(int rank, int tb, int index) {
+    const Operation& op = analysis_.operations(rank, tb)[index];
+    std::vector<const PlanChannel*> inputs = analysis_.inputChannels(rank, tb, index);
+    std::vector<const PlanChannel*> outputs = analysis_.outputChannels(rank, tb, index);
+    char* src = this->buffer(rank, op.srcBufferType);
+    char* dst = this->buffer(rank, op.dstBufferType);
+    switch (op.type) {
+      case OperationType::SIGNAL:
+        for (const PlanChannel* channel : outputs) {
+          this->signal({rank, channel->peer, channel->channelType, channel->ordinal});
+        }
+        break;
+      case OperationType::WAIT:
+        for (const PlanChannel* channel : inputs) {
+          this->wait({channel->peer, rank, channel->channelType, channel->ordinal});
+        }
+        break;
+      case OperationType::PUT:
+      case OperationType::PUT_WITH_SIGNAL:
+      case OperationType::PUT_WITH_SIGNAL_AND_FLUSH:
+        for (size_t i = 0; i < outputs.size(); i++) {
+          std::memmove(this->remote(outputs[i]) + op.outputOffsets[i],
+                       this->local(rank, outputs[i]) + op.inputOffsets[i], op.size);
+          // Only proxy channels signal as part of a put, see handlePut.
+          if (op.type != OperationType::PUT && op.channelType == ChannelType::PROXY) {
+            this->signal({rank, outputs[i]->peer, outputs[i]->channelType, outputs[i]->ordinal});
+          }
+        }
+        break;
+      case OperationType::GET:
+        for (size_t i = 0; i < inputs.size(); i++) {
+          std::memmove(this->local(rank, inputs[i]) + op.inputOffsets[i],
+                       this->remote(inputs[i]) + op.outputOffsets[i], op.size);
+        }
+        break;
+      case OperationType::COPY:
+        std::memmove(dst + op.dstOffset, src + op.srcOffset, op.size);
+        break;
+      case OperationType::READ_REDUCE_COPY:
+      case OperationType::READ_REDUCE_COPY_SEND: {
+        std::vector<char> sum(src + op.srcOffset, src + op.srcOffset + op.size);
+        for (size_t i = 0; i < inputs.size(); i++) {
+          reducer_.reduce(sum.data(), this->remote(inputs[i]) + op.inputOffsets[i], op.size);
+        }
+        if (op.finalReduce) {
+          reducer_.scale(sum.data(), op.size);
+        }
+        std::memcpy(dst + op.dstOffset, sum.data(), op.size);
+        if (op.type == OperationType::READ_REDUCE_COPY_SEND) {
+          for (size_t i = 0; i < outputs.size(); i++) {
+            std::memcpy(this->remote(outputs[i]) + op.outputOffsets[i], sum.data(), op.size);
+          }
+        }
+        break;
+      }
+      case OperationType::REDUCE:
+      case OperationType::REDUCE_SEND: {
+        // The kernel reduces one local input per output channel for REDUCE_SEND.
+        char* input = this->buffer(rank, op.inputBufferType);
+        size_t nInputs = op.type == OperationType::REDUCE ? op.nInputs : outputs.size();
+        std::vector<char> sum(src + op.srcOffset, src + op.srcOffset + op.size);
+        for (size_t i = 0; i < nInputs; i++) {
+          reducer_.reduce(sum.data(), input + op.inputOffsets[i], op.size);
+        }
+        if (op.finalReduce) {
+          reducer_.scale(sum.data(), op.size);
+        }
+        std::memcpy(dst + op.dstOffset, sum.data(), op.size);
+        for (size_t i = 0; i < outputs.size(); i++) {
+          std::memcpy(this->remote(outputs[i]) + op.outputOffsets[i], sum.data(), op.size);
+        }
+        break;
+      }
+      case OperationType::PUT_PACKET:
+        for (size_t i = 0; i < outputs.size(); i++) {
+          char* packets = this->remote(outputs[i]) + 2 * size_t(op.outputOffsets[i]);
+          if (op.channelType == ChannelType::PROXY) {
+            // Proxy channels copy packets that are already in the local buffer.
+            const char* source = this->local(rank, outputs[i]) + 2 * size_t(op.inputOffsets[i]);
+            for (size_t offset = 0; offset < 2 * size_t(op.size); offset += sizeof(uint64_t)) {
+              storePacketWord(packets + offset, loadPacketWord(source + offset));
+            }
+          } else {
+            writePackets(packets, this->local(rank, outputs[i]) + op.inputOffsets[i], op.size);
+          }
+        }
+        this->notify();
+        break;
+      case OperationType::REDUCE_PACKET:
+      case OperationType::REDUCE_SEND_PACKET: {
+        // Same order as handleReduceSendPacket: the packets first, then the source.
+        char* scratch = this->buffer(rank, BufferType::SCRATCH);
+        std::vector<char> sum(op.size);
+        std::vector<char> value(op.size);
+        for (int i = 0; i < op.nInputs; i++) {
+          this->readPackets(i == 0 ? sum.data() : value.data(), scratch + 2 * size_t(op.inputOffsets[i]), op.size);
+          if (i > 0) {
+            reducer_.reduce(sum.data(), value.data(), op.size);
+          }
+        }
+        if (op.nInputs == 0) {
+          std::memcpy(sum.data(), src + op.srcOffset, op.size);
+        } else {
+          reducer_.reduce(sum.data(), src + op.srcOffset, op.size);
+        }
+        if (op.finalReduce) {
+          reducer_.scale(sum.data(), op.size);
+        }
+        std::memcpy(dst + op.dstOffset, sum.data(), op.size);
+        if (op.type == OperationType::REDUCE_SEND_PACKET) {
+          for (size_t i = 0; i < outputs.size(); i++) {
+            writePackets(this->remote(outputs[i]) + 2 * size_t(op.outputOffsets[i]), sum.data(), op.size);
+          }
+          this->notify();
+        }
+        break;
+      }
+      case OperationType::COPY_PACKET:
+        this->readPackets(dst + op.dstOffset, src + 2 * size_t(op.srcOffset), op.size);
+        break;
+      case OperationType::TRANSFORM_TO_PACKET:
+        writePackets(dst + 2 * size_t(op.dstOffset), src + op.srcOffset, op.size);
+        this->notify();
+        break;
+      default:
+        break;
+    }
+  }
+
+  void signal(const PlanSemaphore& semaphore) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    semaphores_[semaphore]++;
+    this->progress();
+  }
+
+  void wait(const PlanSemaphore& semaphore) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    int& count = semaphores_[semaphore];
+    this->waitUntil(lock, [&] { return count > 0; });
+    count--;
+  }
+
+  // Read the data of the packets at `packets` into the `size` bytes of `data`.
+  void readPackets(char* data, const char* packets, size_t size) {
+    for (size_t i = 0; i < size / sizeof(uint32_t); i++) {
+      const char* word = packets + i * sizeof(uint64_t);
+      uint64_t value = loadPacketWord(word);
+      if (value >> 32 != FLAG) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        this->waitUntil(lock, [&] { return loadPacketWord(word) >> 32 == FLAG; });
+        value = loadPacketWord(word);
+      }
+      uint32_t payload = uint32_t(value);
+      std::memcpy(data + i * sizeof(uint32_t), &payload, sizeof(uint32_t));
+    }
+  }
+
+  // Wake up the threads blocked on packets after writing some.
+  void notify() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    this->progress();
+  }
+
+  // Called with mutex_ held after a thread may have unblocked others. They all check their condition again.
+  void progress() {
+    progress_++;
+    blocked_ = 0;
+    cv_.notify_all();
+  }
+
+  // Block until `ready`, which is evaluated with mutex_ held, returns true.
+  template <typename Ready>
+  void waitUntil(std::unique_lock<std::mutex>& lock, Ready ready) {
+    while (!ready()) {
+      if (stopped_) {
+        throw Stopped();
+      }
+      if (++blocked_ == running_) {
+        this->stop(true);
+        throw Stopped();
+      }
+      uint64_t progress = progress_;
+      cv_.wait(lock, [&] { return progress_ != progress || stopped_; });
+    }
+  }
+
+  // Called with mutex_ held.
+  void stop(bool deadlocked) {
+    deadlocked_ = deadlocked_ || deadlocked;
+    stopped_ = true;
+    cv_.notify_all();
+  }
+
+  const PlanAnalysis& analysis_;
+  const Reducer reducer_;
+  std::map<int, RankBuffers> buffers_;
+  std::vector<std::pair<int, int>> threadblocks_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::map<PlanSemaphore, int> semaphores_;
+  // Number of unfinished threads and of those blocked since the last progress
+  int running_ = 0;
+  int blocked_ = 0;
+  uint64_t progress_ = 0;
+  std::atomic<bool> stopped_ = false;
+  bool deadlocked_ = false;
+  std::exception_ptr error_;
+};
+
+}  // namespace
+
+namespace mscclpp {
+
+void interpretExecutionPlan(const PlanAnalysis& analysis, const std::vector<void*>& inputs,
+                            const std::vector<void*>& outputs, DataType dataType, const Reduction& reduction) {
+  PlanInterpreter(analysis, inputs, outputs, dataType, reduction).run();
+}
+
+}  // namespace mscclpp
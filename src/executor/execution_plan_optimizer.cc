@@ -0,0 +1,367 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <algorithm>
+#include <limits>
+
+#include "debug.h"
+#include "execution_plan.hpp"
+
+namespace {
+using namespace mscclpp;
+
+// Chunk range of a buffer read or written by an operation template. Chunk offsets grow with the chunk index, so ranges
+// that are disjoint in chunks are disjoint in bytes for every message size.
+struct ChunkAccess {
+  int rank;
+  BufferType bufferType;
+  bool isPacket;
+  bool isWrite;
+  uint32_t begin;
+  uint32_t end;
+};
+
+bool conflicts(const ChunkAccess& a, const ChunkAccess& b) {
+  if (a.rank != b.rank || a.bufferType != b.bufferType || !(a.isWrite || b.isWrite)) {
+    return false;
+  }
+  // Packets take twice the space of their payload, so packet and non-packet chunks do not line up.
+  if (a.isPacket != b.isPacket) {
+    return true;
+  }
+  return a.begin < b.end && b.begin < a.end;
+}
+
+bool isProxyPut(const OperationTemplate& op) {
+  return op.channelType == ChannelType::PROXY &&
+         (op.type == OperationType::PUT || op.type == OperationType::PUT_WITH_SIGNAL ||
+          op.type == OperationType::PUT_WITH_SIGNAL_AND_FLUSH || op.type == OperationType::PUT_PACKET);
+}
+
+// Operations run by one thread per channel, thread i handling channel i.
+bool isPerChannel(const OperationTemplate& op) {
+  return op.type == OperationType::SIGNAL || op.type == OperationType::WAIT || op.type == OperationType::FLUSH ||
+         isProxyPut(op);
+}
+
+// Operations whose memory accesses are spread over all threads of the threadblock
+bool isData(const OperationTemplate& op) { return op.type != OperationType::BARRIER && !isPerChannel(op); }
+
+// Operations that make earlier work visible to a peer
+bool isRelease(const OperationTemplate& op) {
+  return op.type == OperationType::SIGNAL ||
+         (op.channelType == ChannelType::PROXY && (op.type == OperationType::PUT_WITH_SIGNAL ||
+                                                   op.type == OperationType::PUT_WITH_SIGNAL_AND_FLUSH));
+}
+
+int nChannels(const OperationTemplate& op) { return op.type == OperationType::WAIT ? op.nInputs : op.nOutputs; }
+
+const uint8_t* channelIndexes(const OperationTemplate& op) {
+  return op.type == OperationType::WAIT ? op.inputChannelIndexes : op.outputChannelIndexes;
+}
+
+bool sameChannels(const OperationTemplate& a, const OperationTemplate& b) {
+  return a.channelType == b.channelType && nChannels(a) == nChannels(b) &&
+         std::equal(channelIndexes(a), channelIndexes(a) + nChannels(a), channelIndexes(b));
+}
+
+class ThreadblockOptimizer {
+ public:
+  ThreadblockOptimizer(int rank, const std::vector<std::pair<int, ChannelKey>>& smChannels,
+                       const std::vector<std::pair<int, ChannelKey>>& proxyChannels, const std::vector<int>& smPeers,
+                       const std::vector<int>& proxyPeers)
+      : rank_(rank),
+        smChannels_(smChannels),
+        proxyChannels_(proxyChannels),
+        smPeers_(smPeers),
+        proxyPeers_(proxyPeers) {}
+
+  // Same access model as the execution kernel, see PlanAnalysis::accesses.
+  std::vector<ChunkAccess> accesses(const OperationTemplate& op) const {
+    std::vector<ChunkAccess> accesses;
+    const uint32_t count = op.hasCount ? op.nChunks : std::numeric_limits<uint32_t>::max();
+    auto range = [count](uint32_t begin) {
+      return std::make_pair(begin, count == std::numeric_limits<uint32_t>::max() ? count : begin + count);
+    };
+    auto local = [&](BufferType bufferType, uint32_t chunk, bool isWrite, bool isPacket = false) {
+      auto [begin, end] = range(chunk);
+      accesses.push_back({rank_, bufferType, isPacket, isWrite, begin, end});
+    };
+    auto channel = [&](uint8_t index) -> std::pair<int, ChannelKey> {
+      const auto& channels = op.channelType == ChannelType::PROXY ? proxyChannels_ : smChannels_;
+      const auto& peers = op.channelType == ChannelType::PROXY ? proxyPeers_ : smPeers_;
+      const auto& [globalIndex, key] = channels.at(index);
+      return {peers.at(globalIndex), key};
+    };
+    auto remote = [&](uint8_t index, uint32_t chunk, bool isWrite, bool isPacket = false) {
+      auto [peer, key] = channel(index);
+      auto [begin, end] = range(chunk);
+      accesses.push_back({peer, key.dstBufferType, isPacket, isWrite, begin, end});
+    };
+    auto channelSrc = [&](uint8_t index) { return channel(index).second.srcBufferType; };
+
+    switch (op.type) {
+      case OperationType::PUT:
+      case OperationType::PUT_WITH_SIGNAL:
+      case OperationType::PUT_WITH_SIGNAL_AND_FLUSH:
+        for (int i = 0; i < op.nOutputs; i++) {
+          local(channelSrc(op.outputChannelIndexes[i]), op.inputChunks[i], false);
+          remote(op.outputChannelIndexes[i], op.outputChunks[i], true);
+        }
+        break;
+      case OperationType::PUT_PACKET:
+        for (int i = 0; i < op.nOutputs; i++) {
+          local(channelSrc(op.outputChannelIndexes[i]), op.inputChunks[i], false,
+                op.channelType == ChannelType::PROXY);
+          remote(op.outputChannelIndexes[i], op.outputChunks[i], true, true);
+        }
+        break;
+      case OperationType::GET:
+        for (int i = 0; i < op.nInputs; i++) {
+          remote(op.inputChannelIndexes[i], op.outputChunks[i], false);
+          local(channelSrc(op.inputChannelIndexes[i]), op.inputChunks[i], true);
+        }
+        break;
+      case OperationType::COPY:
+        local(op.srcBufferType, op.srcChunk, false);
+        local(op.dstBufferType, op.dstChunk, true);
+        break;
+      case OperationType::READ_REDUCE_COPY:
+      case OperationType::READ_REDUCE_COPY_SEND:
+        local(op.srcBufferType, op.srcChunk, false);
+        for (int i = 0; i < op.nInputs; i++) {
+          remote(op.inputChannelIndexes[i], op.inputChunks[i], false);
+        }
+        local(op.dstBufferType, op.dstChunk, true);
+        if (op.type == OperationType::READ_REDUCE_COPY_SEND) {
+          for (int i = 0; i < op.nOutputs; i++) {
+            remote(op.outputChannelIndexes[i], op.outputChunks[i], true);
+          }
+        }
+        break;
+      case OperationType::REDUCE:
+        local(op.srcBufferType, op.srcChunk, false);
+        for (int i = 0; i < op.nInputs; i++) {
+          local(op.inputBufferType, op.inputChunks[i], false);
+        }
+        local(op.dstBufferType, op.dstChunk, true);
+        break;
+      case OperationType::REDUCE_SEND:
+        local(op.srcBufferType, op.srcChunk, false);
+        for (int i = 0; i < op.nOutputs; i++) {
+          local(op.inputBufferType, op.inputChunks[i], false);
+        }
+        local(op.dstBufferType, op.dstChunk, true);
+        for (int i = 0; i < op.nOutputs; i++) {
+          remote(op.outputChannelIndexes[i], op.outputChunks[i], true);
+        }
+        break;
+      case OperationType::REDUCE_PACKET:
+      case OperationType::REDUCE_SEND_PACKET:
+        for (int i = 0; i < op.nInputs; i++) {
+          local(BufferType::SCRATCH, op.inputChunks[i], false, true);
+        }
+        local(op.srcBufferType, op.srcChunk, false);
+        local(op.dstBufferType, op.dstChunk, true);
+        if (op.type == OperationType::REDUCE_SEND_PACKET) {
+          for (int i = 0; i < op.nOutputs; i++) {
+            remote(op.outputChannelIndexes[i], op.outputChunks[i], true, true);
+          }
+        }
+        break;
+      case OperationType::COPY_PACKET:
+        local(op.srcBufferType, op.srcChunk, false, true);
+        local(op.dstBufferType, op.dstChunk, true);
+        break;
+      case OperationType::TRANSFORM_TO_PACKET:
+        local(op.srcBufferType, op.srcChunk, false);
+        local(op.dstBufferType, op.dstChunk, true, true);
+        break;
+      default:
+        break;
+    }
+    return accesses;
+  }
+
+  // Whether `b` must not start on any thread before `a` completed on all threads, given that `a` comes first in the
+  // threadblock. This is what a barrier between them guarantees and program order alone does not: most operations
+  // split their work over threads, and operations on channels are run by one thread per channel.
+  bool needsBarrier(const OperationTemplate& a, const OperationTemplate& b) const {
+    // Both run on thread 0 only
+    if (isPerChannel(a) && isPerChannel(b) && nChannels(a) == 1 && nChannels(b) == 1) {
+      return false;
+    }
+    // What a wait acquired must be visible to all threads
+    if (a.type == OperationType::WAIT) {
+      return true;
+    }
+    // A flush guarantees the proxy is done with the sources of earlier puts
+    if (a.type == OperationType::FLUSH) {
+      return isData(b) || isRelease(b) || isProxyPut(b);
+    }
+    if (isRelease(b) && (isData(a) || isProxyPut(a))) {
+      // Each thread pushes its proxy requests in order, so a signal on the same channels follows the puts.
+      return !(isProxyPut(a) && sameChannels(a, b));
+    }
+    // A barrier cannot order the proxy's asynchronous reads of a put, and a signal has no memory effect.
+    if (!isData(a) || !(isData(b) || isProxyPut(b))) {
+      return false;
+    }
+    for (const ChunkAccess& x : this->accesses(a)) {
+      for (const ChunkAccess& y : this->accesses(b)) {
+        if (conflicts(x, y)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Returns for each original operation the index of the operation it ends up in, or -1 if it was removed.
+  std::vector<int> optimize(std::vector<OperationTemplate>& ops, PlanOptimizationStats& stats) const {
+    std::vector<int> mapping(ops.size(), -1);
+    std::vector<bool> removed(ops.size(), false);
+
+    // A barrier is redundant if no operation between the previous kept barrier and the next barrier needs it.
+    size_t segmentBegin = 0;
+    for (size_t i = 0; i < ops.size(); i++) {
+      if (ops[i].type != OperationType::BARRIER) {
+        continue;
+      }
+      size_t next = i + 1;
+      while (next < ops.size() && ops[next].type != OperationType::BARRIER) next++;
+      bool needed = false;
+      for (size_t a = segmentBegin; a < i && !needed; a++) {
+        if (removed[a] || ops[a].type == OperationType::BARRIER) continue;
+        for (size_t b = i + 1; b < next && !needed; b++) {
+          needed = this->needsBarrier(ops[a], ops[b]);
+        }
+      }
+      if (needed) {
+        segmentBegin = i + 1;
+      } else {
+        removed[i] = true;
+        stats.barriersRemoved++;
+      }
+    }
+
+    std::vector<OperationTemplate> result;
+    result.reserve(ops.size());
+    for (size_t i = 0; i < ops.size(); i++) {
+      if (removed[i]) {
+        continue;
+      }
+      OperationTemplate op = ops[i];
+      if (!result.empty()) {
+        OperationTemplate& last = result.back();
+        // put + signal -> pws, pws + flush -> pwsf. Only proxy channels signal as part of a put.
+        if (last.channelType == ChannelType::PROXY && sameChannels(last, op)) {
+          if (last.type == OperationType::PUT && op.type == OperationType::SIGNAL) {
+            last.type = OperationType::PUT_WITH_SIGNAL;
+            mapping[i] = result.size() - 1;
+            stats.putsFused++;
+            continue;
+          }
+          if (last.type == OperationType::PUT_WITH_SIGNAL && op.type == OperationType::FLUSH) {
+            last.type = OperationType::PUT_WITH_SIGNAL_AND_FLUSH;
+            mapping[i] = result.size() - 1;
+            stats.putsFused++;
+            continue;
+          }
+        }
+        if (canMergeCopies(last, op)) {
+          last.nChunks += op.nChunks;
+          mapping[i] = result.size() - 1;
+          stats.copiesMerged++;
+          continue;
+        }
+      }
+      mapping[i] = result.size();
+      result.push_back(op);
+    }
+    ops = std::move(result);
+    return mapping;
+  }
+
+ private:
+  // Copies of consecutive chunks of the same buffers, where merging does not make a copy read what it writes.
+  static bool canMergeCopies(const OperationTemplate& a, const OperationTemplate& b) {
+    if (a.type != OperationType::COPY || b.type != OperationType::COPY || !a.hasCount || !b.hasCount ||
+        !a.hasSrcChunk || !b.hasSrcChunk || !a.hasDstChunk || !b.hasDstChunk ||
+        a.srcBufferType != b.srcBufferType || a.dstBufferType != b.dstBufferType) {
+      return false;
+    }
+    if (b.srcChunk != a.srcChunk + a.nChunks || b.dstChunk != a.dstChunk + a.nChunks) {
+      return false;
+    }
+    uint32_t total = a.nChunks + b.nChunks;
+    return a.srcBufferType != a.dstBufferType || a.srcChunk + total <= a.dstChunk || a.dstChunk + total <= a.srcChunk;
+  }
+
+  int rank_;
+  const std::vector<std::pair<int, ChannelKey>>& smChannels_;
+  const std::vector<std::pair<int, ChannelKey>>& proxyChannels_;
+  const std::vector<int>& smPeers_;
+  const std::vector<int>& proxyPeers_;
+};
+
+}  // namespace
+
+namespace mscclpp {
+
+PlanOptimizationStats ExecutionPlan::Impl::optimize() {
+  PlanOptimizationStats stats = {};
+  for (auto& [rank, threadblocks] : this->operationTemplates) {
+    auto flattenPeers = [&](ChannelType channelType) {
+      std::vector<int> peers;
+      for (const auto& info : this->getChannelInfos(rank, channelType)) {
+        peers.insert(peers.end(), info.connectedPeers.begin(), info.connectedPeers.end());
+      }
+      return peers;
+    };
+    std::vector<int> smPeers = flattenPeers(ChannelType::SM);
+    std::vector<int> proxyPeers = flattenPeers(ChannelType::PROXY);
+
+    std::vector<std::vector<int>> mappings(threadblocks.size());
+    for (size_t tb = 0; tb < threadblocks.size(); tb++) {
+      ThreadblockOptimizer optimizer(rank, this->threadblockSMChannelMap.at(rank)[tb],
+                                     this->threadblockProxyChannelMap.at(rank)[tb], smPeers, proxyPeers);
+      stats.operationsBefore += threadblocks[tb].size();
+      mappings[tb] = optimizer.optimize(threadblocks[tb], stats);
+      stats.operationsAfter += threadblocks[tb].size();
+    }
+
+    // Renumber the dependencies. The dependencies of a removed barrier go away with it and a dependency on a removed
+    // barrier moves to the operation before it.
+    auto& rankDependencies = this->operationDependencies[rank];
+    rankDependencies.resize(threadblocks.size());
+    for (size_t tb = 0; tb < rankDependencies.size(); tb++) {
+      std::vector<OperationDependency> renumbered;
+      for (const OperationDependency& dep : rankDependencies[tb]) {
+        int operation = mappings[tb].at(dep.operation);
+        if (operation < 0 || dep.threadblock >= mappings.size() || dep.step >= mappings[dep.threadblock].size()) {
+          continue;
+        }
+        int step = -1;
+        for (int s = dep.step; s >= 0 && step < 0; s--) {
+          step = mappings[dep.threadblock][s];
+        }
+        // Dropped if the operation it depends on was fused into the dependent one
+        if (step < 0 || (dep.threadblock == tb && step >= operation)) {
+          continue;
+        }
+        renumbered.push_back({static_cast<uint32_t>(operation), dep.threadblock, static_cast<uint32_t>(step)});
+      }
+      rankDependencies[tb] = std::move(renumbered);
+    }
+    this->chunkOffsetTables.erase(rank);
+  }
+  this->operations.clear();
+  INFO(MSCCLPP_COLL,
+       "Optimized plan %s: %lu -> %lu operations (%lu barriers removed, %lu puts fused, %lu copies merged)",
+       this->name.c_str(), stats.operationsBefore, stats.operationsAfter, stats.barriersRemoved, stats.putsFused,
+       stats.copiesMerged);
+  return stats;
+}
+
+}  // namespace mscclpp
@@ -0,0 +1,506 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mscclpp/errors.hpp>
+#include <queue>
+#include <tuple>
+
+#include "execution_plan_analysis.hpp"
+
+namespace {
+using namespace mscclpp;
+
+// GB/s in bytes per microsecond
+constexpr double BYTES_PER_US = 1e3;
+constexpr size_t NONE = std::numeric_limits<size_t>::max();
+
+bool isProxyPut(const Operation& op) {
+  return op.channelType == ChannelType::PROXY &&
+         (op.type == OperationType::PUT || op.type == OperationType::PUT_WITH_SIGNAL ||
+          op.type == OperationType::PUT_WITH_SIGNAL_AND_FLUSH || op.type == OperationType::PUT_PACKET);
+}
+
+// Discrete-event simulation of all threadblocks of a plan. Time is in microseconds.
+//
+// A threadblock runs one operation at a time. The data an operation moves is split into flows: one on the local memory
+// of the rank for the bytes it accesses locally and one per peer link for the bytes it reads or writes remotely. The
+// operation is done when all its flows are, and flows of a threadblock together run at most at the threadblock
+// bandwidth. Proxy channel requests are queued per channel and run in order without blocking the threadblock, except
+// for flushes. Flows on the same link share its bandwidth max-min fairly.
+class PlanSimulator {
+ public:
+  PlanSimulator(const PlanAnalysis& analysis, const SimulationConfig& config) : analysis_(analysis), config_(config) {
+    if (config.nRanksPerNode <= 0 || config.threadblockBandwidth <= 0 || config.memoryBandwidth <= 0 ||
+        config.intraNodeBandwidth <= 0 || config.interNodeBandwidth <= 0 || config.timelineInterval <= 0 ||
+        config.maxTimelineIntervals == 0) {
+      throw Error("Invalid simulation config", ErrorCode::InvalidUsage);
+    }
+    for (int rank : analysis.ranks()) {
+      for (int tb = 0; tb < analysis.threadblockCount(rank); tb++) {
+        threadblocks_.push_back({rank, tb});
+      }
+    }
+    states_.resize(threadblocks_.size());
+  }
+
+  SimulationResult run() {
+    for (size_t g = 0; g < threadblocks_.size(); g++) {
+      this->schedule(0, EventType::Ready, g);
+    }
+    while (!events_.empty()) {
+      Event event = events_.top();
+      events_.pop();
+      now_ = event.time;
+      switch (event.type) {
+        case EventType::Ready:
+          this->step(event.index);
+          break;
+        case EventType::FlowDone:
+          if (flows_[event.index].version == event.version) {
+            this->finishFlow(event.index);
+          }
+          break;
+        case EventType::SignalArrival:
+          this->arrive(event.index);
+          break;
+        case EventType::ProxyStart:
+          this->startProxyRequest(event.index);
+          break;
+      }
+    }
+    return this->result();
+  }
+
+ private:
+  enum class EventType { Ready, FlowDone, SignalArrival, ProxyStart };
+
+  struct Event {
+    double time;
+    uint64_t sequence;
+    EventType type;
+    size_t index;
+    uint32_t version;
+
+    bool operator>(const Event& other) const {
+      return std::tie(time, sequence) > std::tie(other.time, other.sequence);
+    }
+  };
+
+  // Bytes moved at `rate` bytes per microsecond from `begin` to `end`
+  struct TimelineSegment {
+    double begin;
+    double end;
+    double rate;
+  };
+
+  struct Link {
+    int src;
+    int dst;
+    std::string type;
+    double bandwidth;
+    double latency;
+    std::vector<size_t> flows;
+    double bytes = 0;
+    // Transfers of the link in the order they were accounted, binned into intervals once the simulation is done
+    std::vector<TimelineSegment> timeline;
+  };
+
+  struct Flow {
+    size_t link;
+    double remaining;
+    double cap;
+    double rate = 0;
+    double updated = 0;
+    uint32_t version = 0;
+    // Threadblock whose current operation waits for the flow, or the proxy queue running it
+    size_t threadblock = NONE;
+    size_t queue = NONE;
+  };
+
+  struct ProxyRequest {
+    size_t link;
+    double bytes;
+    // Semaphore to signal, or NONE for a put
+    size_t semaphore;
+  };
+
+  struct ProxyQueue {
+    int rank;
+    std::deque<ProxyRequest> requests;
+    bool busy = false;
+    std::vector<size_t> flushWaiters;
+  };
+
+  struct ThreadblockState {
+    size_t pc = 0;
+    // Flows and proxy queues the current operation still waits for
+    int pending = 0;
+    // Link latency added to the current operation
+    double latency = 0;
+    double finish = -1;
+  };
+
+  void schedule(double time, EventType type, size_t index, uint32_t version = 0) {
+    events_.push({time, sequence_++, type, index, version});
+  }
+
+  size_t link(int src, int dst) {
+    auto [it, inserted] = linkIndexes_.try_emplace({src, dst}, links_.size());
+    if (inserted) {
+      Link link;
+      link.src = src;
+      link.dst = dst;
+      if (src == dst) {
+        link.type = "memory";
+        link.bandwidth = config_.memoryBandwidth * BYTES_PER_US;
+        link.latency = 0;
+      } else if (src / config_.nRanksPerNode == dst / config_.nRanksPerNode) {
+        link.type = "intra-node";
+        link.bandwidth = config_.intraNodeBandwidth * BYTES_PER_US;
+        link.latency = config_.intraNodeLatency;
+      } else {
+        link.type = "inter-node";
+        link.bandwidth = config_.interNodeBandwidth * BYTES_PER_US;
+        link.latency = config_.interNodeLatency;
+      }
+      links_.push_back(std::move(link));
+    }
+    return it->second;
+  }
+
+  size_t semaphore(const PlanSemaphore& semaphore) {
+    auto [it, inserted] = semaphoreIndexes_.try_emplace(semaphore, semaphoreCounts_.size());
+    if (inserted) {
+      semaphoreCounts_.push_back(0);
+      semaphoreWaiters_.emplace_back();
+    }
+    return it->second;
+  }
+
+  size_t proxyQueue(int rank, int tb, int channel) {
+    auto [it, inserted] = queueIndexes_.try_emplace({rank, tb, channel}, queues_.size());
+    if (inserted) {
+      queues_.emplace_back();
+      queues_.back().rank = rank;
+    }
+    return it->second;
+  }
+
+  // Flows of a link are advanced together, so a transfer usually covers the same time as the previous one of the link
+  // or continues it at the same rate, and is merged into it.
+  void addTimeline(Link& link, double begin, double end, double rate) {
+    if (!config_.timeline) {
+      return;
+    }
+    if (!link.timeline.empty()) {
+      TimelineSegment& last = link.timeline.back();
+      if (last.begin == begin && last.end == end) {
+        last.rate += rate;
+        return;
+      }
+      if (last.end == begin && last.rate == rate) {
+        last.end = end;
+        return;
+      }
+    }
+    link.timeline.push_back({begin, end, rate});
+  }
+
+  // Fraction of the bandwidth of `link` used in each of `nIntervals` intervals of `interval` microseconds, extended to
+  // the last transfer if it ends later.
+  static std::vector<double> getUtilization(const Link& link, double interval, size_t nIntervals) {
+    std::vector<double> bytes(nIntervals, 0);
+    for (const TimelineSegment& segment : link.timeline) {
+      size_t last = static_cast<size_t>(segment.end / interval);
+      if (bytes.size() <= last) {
+        bytes.resize(last + 1, 0);
+      }
+      for (size_t k = static_cast<size_t>(segment.begin / interval); k <= last; k++) {
+        double overlap = std::min(segment.end, (k + 1) * interval) - std::max(segment.begin, k * interval);
+        if (overlap > 0) {
+          bytes[k] += segment.rate * overlap;
+        }
+      }
+    }
+    for (double& utilization : bytes) {
+      utilization /= link.bandwidth * interval;
+    }
+    return bytes;
+  }
+
+  void advance(Flow& flow) {
+    if (now_ > flow.updated && flow.rate > 0) {
+      Link& link = links_[flow.link];
+      double bytes = std::min(flow.remaining, flow.rate * (now_ - flow.updated));
+      flow.remaining -= bytes;
+      link.bytes += bytes;
+      this->addTimeline(link, flow.updated, now_, flow.rate);
+    }
+    flow.updated = now_;
+  }
+
+  // Share the bandwidth of a link max-min fairly among its flows and reschedule their completion.
+  void updateLink(size_t l) {
+    Link& link = links_[l];
+    for (size_t f : link.flows) {
+      this->advance(flows_[f]);
+    }
+    std::sort(link.flows.begin(), link.flows.end(), [&](size_t a, size_t b) { return flows_[a].cap < flows_[b].cap; });
+    double available = link.bandwidth;
+    for (size_t i = 0; i < link.flows.size(); i++) {
+      Flow& flow = flows_[link.flows[i]];
+      flow.rate = std::min(flow.cap, std::max(available, 0.0) / (link.flows.size() - i));
+      available -= flow.rate;
+      flow.version++;
+      if (flow.rate > 0) {
+        this->schedule(now_ + flow.remaining / flow.rate, EventType::FlowDone, link.flows[i], flow.version);
+      }
+    }
+  }
+
+  void startFlow(size_t link, double bytes, double cap, size_t threadblock, size_t queue) {
+    Flow flow;
+    flow.link = link;
+    flow.remaining = bytes;
+    flow.cap = cap;
+    flow.updated = now_;
+    flow.threadblock = threadblock;
+    flow.queue = queue;
+    flows_.push_back(flow);
+    links_[link].flows.push_back(flows_.size() - 1);
+    this->updateLink(link);
+  }
+
+  void finishFlow(size_t f) {
+    Flow& flow = flows_[f];
+    this->advance(flow);
+    flow.version++;
+    Link& link = links_[flow.link];
+    link.flows.erase(std::find(link.flows.begin(), link.flows.end(), f));
+    this->updateLink(flow.link);
+    if (flow.threadblock != NONE) {
+      this->release(flow.threadblock);
+    } else {
+      ProxyQueue& queue = queues_[flow.queue];
+      queue.busy = false;
+      this->runProxyQueue(flow.queue);
+    }
+  }
+
+  // One of the flows or proxy queues the current operation of threadblock `g` waits for is done.
+  void release(size_t g) {
+    ThreadblockState& state = states_[g];
+    if (--state.pending == 0) {
+      this->schedule(now_ + config_.operationOverhead + state.latency, EventType::Ready, g);
+    }
+  }
+
+  void arrive(size_t s) {
+    semaphoreCounts_[s]++;
+    std::vector<size_t> waiters = std::move(semaphoreWaiters_[s]);
+    semaphoreWaiters_[s].clear();
+    for (size_t g : waiters) {
+      this->step(g);
+    }
+  }
+
+  void runProxyQueue(size_t q) {
+    ProxyQueue& queue = queues_[q];
+    while (!queue.busy && !queue.requests.empty()) {
+      const ProxyRequest& request = queue.requests.front();
+      double arrival = now_ + config_.proxyLatency + links_[request.link].latency;
+      if (request.semaphore != NONE) {
+        this->schedule(arrival, EventType::SignalArrival, request.semaphore);
+        queue.requests.pop_front();
+      } else {
+        queue.busy = true;
+        this->schedule(arrival, EventType::ProxyStart, q);
+      }
+    }
+    if (!queue.busy && queue.requests.empty()) {
+      rankFinish_[queue.rank] = std::max(rankFinish_[queue.rank], now_);
+      std::vector<size_t> waiters = std::move(queue.flushWaiters);
+      queue.flushWaiters.clear();
+      for (size_t g : waiters) {
+        this->release(g);
+      }
+    }
+  }
+
+  void startProxyRequest(size_t q) {
+    ProxyQueue& queue = queues_[q];
+    ProxyRequest request = queue.requests.front();
+    queue.requests.pop_front();
+    if (request.bytes > 0) {
+      this->startFlow(request.link, request.bytes, std::numeric_limits<double>::infinity(), NONE, q);
+    } else {
+      queue.busy = false;
+      this->runProxyQueue(q);
+    }
+  }
+
+  void signal(size_t g, const Operation& op, int channel, const PlanChannel& planChannel) {
+    auto [rank, tb] = threadblocks_[g];
+    size_t s = this->semaphore({rank, planChannel.peer, planChannel.channelType, planChannel.ordinal});
+    size_t l = this->link(rank, planChannel.peer);
+    if (op.channelType == ChannelType::PROXY) {
+      size_t q = this->proxyQueue(rank, tb, channel);
+      queues_[q].requests.push_back({l, 0, s});
+      this->runProxyQueue(q);
+    } else {
+      this->schedule(now_ + links_[l].latency, EventType::SignalArrival, s);
+    }
+  }
+
+  void flush(size_t g, int channel) {
+    auto [rank, tb] = threadblocks_[g];
+    ProxyQueue& queue = queues_[this->proxyQueue(rank, tb, channel)];
+    if (queue.busy || !queue.requests.empty()) {
+      queue.flushWaiters.push_back(g);
+      states_[g].pending++;
+    }
+  }
+
+  // Run the current operation of threadblock `g`, or wait for the signals it needs.
+  void step(size_t g) {
+    auto [rank, tb] = threadblocks_[g];
+    ThreadblockState& state = states_[g];
+    const std::vector<Operation>& ops = analysis_.operations(rank, tb);
+    if (state.pc >= ops.size()) {
+      state.finish = now_;
+      rankFinish_[rank] = std::max(rankFinish_[rank], now_);
+      return;
+    }
+    int i = state.pc;
+    const Operation& op = ops[i];
+
+    std::vector<PlanSemaphore> waits = analysis_.waits(rank, tb, i);
+    if (!waits.empty()) {
+      std::map<size_t, int> needed;
+      for (const PlanSemaphore& semaphore : waits) {
+        needed[this->semaphore(semaphore)]++;
+      }
+      for (const auto& [s, count] : needed) {
+        if (semaphoreCounts_[s] < count) {
+          semaphoreWaiters_[s].push_back(g);
+          return;
+        }
+      }
+      for (const auto& [s, count] : needed) {
+        semaphoreCounts_[s] -= count;
+      }
+    }
+
+    state.pc++;
+    state.pending = 1;
+    state.latency = 0;
+    std::vector<const PlanChannel*> outputs = analysis_.outputChannels(rank, tb, i);
+    bool signals = !analysis_.signals(rank, tb, i).empty();
+    if (isProxyPut(op)) {
+      for (size_t j = 0; j < outputs.size(); j++) {
+        if (outputs[j] == nullptr) continue;
+        size_t q = this->proxyQueue(rank, tb, op.outputChannelIndexes[j]);
+        double bytes = op.type == OperationType::PUT_PACKET ? 2.0 * op.size : op.size;
+        queues_[q].requests.push_back({this->link(rank, outputs[j]->peer), bytes, NONE});
+        this->runProxyQueue(q);
+        if (signals) {
+          this->signal(g, op, op.outputChannelIndexes[j], *outputs[j]);
+        }
+        if (op.type == OperationType::PUT_WITH_SIGNAL_AND_FLUSH) {
+          this->flush(g, op.outputChannelIndexes[j]);
+        }
+      }
+    } else if (op.type == OperationType::SIGNAL) {
+      for (size_t j = 0; j < outputs.size(); j++) {
+        if (outputs[j] != nullptr) {
+          this->signal(g, op, op.outputChannelIndexes[j], *outputs[j]);
+        }
+      }
+    } else if (op.type == OperationType::FLUSH) {
+      for (size_t j = 0; j < outputs.size(); j++) {
+        this->flush(g, op.outputChannelIndexes[j]);
+      }
+    } else {
+      // Bytes the threadblock moves on each link
+      std::map<size_t, double> bytes;
+      for (const PlanAccess& access : analysis_.accesses(rank, tb, i)) {
+        if (access.size == 0) continue;
+        size_t l = access.isWrite ? this->link(rank, access.rank) : this->link(access.rank, rank);
+        bytes[l] += access.size;
+        state.latency = std::max(state.latency, links_[l].latency);
+      }
+      double cap = config_.threadblockBandwidth * BYTES_PER_US / std::max<size_t>(bytes.size(), 1);
+      state.pending += bytes.size();
+      for (const auto& [l, size] : bytes) {
+        this->startFlow(l, size, cap, g, NONE);
+      }
+    }
+    this->release(g);
+  }
+
+  SimulationResult result() {
+    SimulationResult result;
+    result.completionTime = 0;
+    result.deadlocked = false;
+    for (size_t g = 0; g < threadblocks_.size(); g++) {
+      result.deadlocked |= states_[g].finish < 0;
+    }
+    const std::vector<int>& ranks = analysis_.ranks();
+    result.rankCompletionTimes.assign(ranks.empty() ? 0 : *std::max_element(ranks.begin(), ranks.end()) + 1, 0);
+    for (const auto& [rank, finish] : rankFinish_) {
+      result.rankCompletionTimes[rank] = finish;
+      result.completionTime = std::max(result.completionTime, finish);
+    }
+    result.timelineInterval =
+        std::max(config_.timelineInterval, result.completionTime / config_.maxTimelineIntervals);
+    size_t nIntervals = static_cast<size_t>(std::ceil(result.completionTime / result.timelineInterval));
+    for (Link& link : links_) {
+      SimulatedLink simulated;
+      simulated.src = link.src;
+      simulated.dst = link.dst;
+      simulated.type = link.type;
+      simulated.bandwidth = link.bandwidth / BYTES_PER_US;
+      simulated.bytes = static_cast<uint64_t>(std::llround(link.bytes));
+      if (config_.timeline) {
+        simulated.utilization = getUtilization(link, result.timelineInterval, nIntervals);
+      }
+      result.links.push_back(std::move(simulated));
+    }
+    std::sort(result.links.begin(), result.links.end(), [](const SimulatedLink& a, const SimulatedLink& b) {
+      return std::tie(a.src, a.dst) < std::tie(b.src, b.dst);
+    });
+    return result;
+  }
+
+  const PlanAnalysis& analysis_;
+  const SimulationConfig config_;
+  std::vector<std::pair<int, int>> threadblocks_;
+  std::vector<ThreadblockState> states_;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+  uint64_t sequence_ = 0;
+  double now_ = 0;
+  std::vector<Link> links_;
+  std::map<std::pair<int, int>, size_t> linkIndexes_;
+  std::vector<Flow> flows_;
+  std::map<PlanSemaphore, size_t> semaphoreIndexes_;
+  std::vector<int> semaphoreCounts_;
+  std::vector<std::vector<size_t>> semaphoreWaiters_;
+  std::vector<ProxyQueue> queues_;
+  std::map<std::tuple<int, int, int>, size_t> queueIndexes_;
+  std::map<int, double> rankFinish_;
+};
+
+}  // namespace
+
+namespace mscclpp {
+
+SimulationResult simulateExecutionPlan(const PlanAnalysis& analysis, const SimulationConfig& config) {
+  return PlanSimulator(analysis, config).run();
+}
+
+}  // namespace mscclpp
@@ -0,0 +1,377 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+
+#include "execution_plan_analysis.hpp"
+
+namespace {
+using namespace mscclpp;
+
+// Happens-before tracking uses one vector clock per threadblock of the plan. Skip it for plans where the clocks would
+// take more than a few hundred MB.
+constexpr size_t MAX_CLOCK_ENTRIES = size_t(1) << 26;
+
+using Clock = std::vector<uint32_t>;
+
+void join(Clock& clock, const Clock& other) {
+  for (size_t i = 0; i < clock.size(); i++) {
+    clock[i] = std::max(clock[i], other[i]);
+  }
+}
+
+class PlanVerifier {
+ public:
+  PlanVerifier(const PlanAnalysis& analysis) : analysis_(analysis) {
+    for (int rank : analysis.ranks()) {
+      rankBases_[rank] = threadblocks_.size();
+      for (int tb = 0; tb < analysis.threadblockCount(rank); tb++) {
+        threadblocks_.push_back({rank, tb});
+      }
+    }
+  }
+
+  std::vector<PlanIssue> run() {
+    this->checkThreadblocks();
+    this->checkSignalCounts();
+    this->checkAccessBounds();
+    this->simulate();
+    return std::move(issues_);
+  }
+
+ private:
+  struct ThreadblockState {
+    size_t pc = 0;
+    // clock[u] = number of leading operations of threadblock u ordered before the current operation for all threads
+    Clock clock;
+    // What threads of this threadblock acquired with waits since the last barrier
+    Clock pending;
+    bool queued = false;
+  };
+
+  void report(PlanIssue::Severity severity, int rank, int tb, int op, std::string message) {
+    issues_.push_back({severity, rank, tb, op, std::move(message)});
+  }
+
+  std::string describe(int rank, int tb, int op) const {
+    return "operation " + std::to_string(op) + " (" + getOperationName(analysis_.operations(rank, tb)[op].type) +
+           ") of threadblock " + std::to_string(tb);
+  }
+
+  // Operations the execution kernel cannot run.
+  void checkThreadblocks() {
+    for (const auto& [rank, tb] : threadblocks_) {
+      const auto& ops = analysis_.operations(rank, tb);
+      for (size_t i = 0; i < ops.size(); i++) {
+        const Operation& op = ops[i];
+        for (const auto& channels : {analysis_.inputChannels(rank, tb, i), analysis_.outputChannels(rank, tb, i)}) {
+          if (std::count(channels.begin(), channels.end(), nullptr) > 0) {
+            report(PlanIssue::Severity::Error, rank, tb, i,
+                   "Operation refers to a " + getChannelTypeName(op.channelType) +
+                       " channel the threadblock does not have");
+          }
+        }
+        switch (op.type) {
+          case OperationType::PUT_WITH_SIGNAL:
+          case OperationType::PUT_WITH_SIGNAL_AND_FLUSH:
+            if (op.channelType == ChannelType::SM) {
+              report(PlanIssue::Severity::Warning, rank, tb, i,
+                     "Operation " + getOperationName(op.type) + " does not signal on sm channels");
+            }
+            break;
+          case OperationType::FLUSH:
+            if (op.channelType != ChannelType::PROXY) {
+              report(PlanIssue::Severity::Error, rank, tb, i, "Operation flush requires proxy channels");
+            }
+            break;
+          case OperationType::GET:
+          case OperationType::READ_REDUCE_COPY:
+          case OperationType::READ_REDUCE_COPY_SEND:
+          case OperationType::REDUCE_SEND:
+          case OperationType::REDUCE_SEND_PACKET:
+            if (op.channelType == ChannelType::PROXY) {
+              report(PlanIssue::Severity::Error, rank, tb, i,
+                     "Operation " + getOperationName(op.type) + " requires sm channels");
+            }
+            break;
+          default:
+            break;
+        }
+      }
+    }
+  }
+
+  // Every signal must be consumed by a wait in the same execution, otherwise the semaphore is off by one for the next
+  // execution of the plan.
+  void checkSignalCounts() {
+    std::map<PlanSemaphore, std::pair<int, int>> counts;
+    for (const auto& [rank, tb] : threadblocks_) {
+      for (size_t i = 0; i < analysis_.operations(rank, tb).size(); i++) {
+        for (const PlanSemaphore& semaphore : analysis_.signals(rank, tb, i)) {
+          counts[semaphore].first++;
+        }
+        for (const PlanSemaphore& semaphore : analysis_.waits(rank, tb, i)) {
+          counts[semaphore].second++;
+        }
+      }
+    }
+    for (const auto& [semaphore, count] : counts) {
+      if (count.first != count.second) {
+        report(PlanIssue::Severity::Error, semaphore.src, -1, -1,
+               "Rank " + std::to_string(semaphore.src) + " signals rank " + std::to_string(semaphore.dst) + " " +
+                   std::to_string(count.first) + " times on " + getChannelTypeName(semaphore.channelType) +
+                   " channel " + std::to_string(semaphore.ordinal) + " but rank " + std::to_string(semaphore.dst) +
+                   " waits " + std::to_string(count.second) + " times");
+      }
+    }
+  }
+
+  void checkAccessBounds() {
+    for (const auto& [rank, tb] : threadblocks_) {
+      for (size_t i = 0; i < analysis_.operations(rank, tb).size(); i++) {
+        for (const PlanAccess& access : analysis_.accesses(rank, tb, i)) {
+          std::string buffer = access.isPacket ? "packet half of the scratch" : getBufferName(access.bufferType);
+          if (access.bufferType == BufferType::NONE) {
+            report(PlanIssue::Severity::Error, rank, tb, i, "Operation accesses a buffer of type none");
+            continue;
+          }
+          size_t limit = analysis_.accessLimit(access);
+          if (access.offset + access.size > limit) {
+            report(PlanIssue::Severity::Error, rank, tb, i,
+                   std::string("Operation ") + (access.isWrite ? "writes" : "reads") + " bytes [" +
+                       std::to_string(access.offset) + ", " + std::to_string(access.offset + access.size) +
+                       ") of the " + buffer + " buffer of rank " + std::to_string(access.rank) + ", which has " +
+                       std::to_string(limit) + " bytes");
+          }
+        }
+      }
+    }
+  }
+
+  // Run the threadblocks of all ranks against semaphore counters. A wait blocks until a matching signal was executed,
+  // so threadblocks left blocked when nothing can progress are deadlocked. Along the way, vector clocks record which
+  // operations are guaranteed to be complete before each operation, which is used to check dependencies and races.
+  //
+  // Within a threadblock, only a barrier orders the work of all threads. A wait is executed by one thread per channel,
+  // so what it acquires only becomes visible to the threadblock at the next barrier. A signal releases what was ordered
+  // at the last barrier and, since the proxy executes requests in order, proxy signals also release earlier proxy
+  // requests of the threadblock.
+  void simulate() {
+    const size_t nThreadblocks = threadblocks_.size();
+    const bool trackClocks = nThreadblocks * nThreadblocks <= MAX_CLOCK_ENTRIES;
+    if (!trackClocks) {
+      report(PlanIssue::Severity::Warning, -1, -1, -1, "Too many threadblocks to check dependencies and races");
+    }
+    std::vector<ThreadblockState> states(nThreadblocks);
+    for (auto& state : states) {
+      if (trackClocks) {
+        state.clock.assign(nThreadblocks, 0);
+        state.pending.assign(nThreadblocks, 0);
+      }
+    }
+    // Clocks released by signals that were not consumed yet
+    std::map<PlanSemaphore, std::deque<Clock>> released;
+    std::map<PlanSemaphore, std::vector<size_t>> waiters;
+    // Clocks of the operations with writes or dependencies, restricted to the threadblocks of the same rank
+    std::map<std::tuple<int, int, int>, Clock> nodeClocks;
+    std::deque<size_t> queue;
+    for (size_t g = 0; g < nThreadblocks; g++) {
+      queue.push_back(g);
+      states[g].queued = true;
+    }
+
+    auto recordClock = [&](size_t g, const Clock& clock) {
+      auto [rank, tb] = threadblocks_[g];
+      size_t base = rankBases_.at(rank);
+      nodeClocks[{rank, tb, static_cast<int>(states[g].pc)}] =
+          Clock(clock.begin() + base, clock.begin() + base + analysis_.threadblockCount(rank));
+    };
+    auto hasDependencies = [&](int rank, int tb, int op) {
+      const auto& deps = analysis_.dependencies(rank, tb);
+      return std::any_of(deps.begin(), deps.end(),
+                         [op](const OperationDependency& dep) { return static_cast<int>(dep.operation) == op; });
+    };
+
+    while (!queue.empty()) {
+      size_t g = queue.front();
+      queue.pop_front();
+      ThreadblockState& state = states[g];
+      state.queued = false;
+      auto [rank, tb] = threadblocks_[g];
+      const auto& ops = analysis_.operations(rank, tb);
+      while (state.pc < ops.size()) {
+        int i = state.pc;
+        const Operation& op = ops[i];
+        std::vector<PlanSemaphore> waits = analysis_.waits(rank, tb, i);
+        std::map<PlanSemaphore, size_t> needed;
+        for (const PlanSemaphore& semaphore : waits) {
+          needed[semaphore]++;
+        }
+        auto blocked = std::find_if(needed.begin(), needed.end(),
+                                    [&](const auto& entry) { return released[entry.first].size() < entry.second; });
+        if (blocked != needed.end()) {
+          waiters[blocked->first].push_back(g);
+          break;
+        }
+        for (const PlanSemaphore& semaphore : waits) {
+          if (trackClocks) {
+            join(state.pending, released[semaphore].front());
+          }
+          released[semaphore].pop_front();
+        }
+
+        if (trackClocks) {
+          if (op.type == OperationType::BARRIER) {
+            join(state.clock, state.pending);
+            state.clock[g] = i;
+          }
+          if (!analysis_.accesses(rank, tb, i).empty() || hasDependencies(rank, tb, i)) {
+            recordClock(g, state.clock);
+          }
+        }
+        std::vector<PlanSemaphore> signals = analysis_.signals(rank, tb, i);
+        if (!signals.empty()) {
+          Clock clock;
+          if (trackClocks) {
+            clock = state.clock;
+            join(clock, state.pending);
+            if (op.channelType == ChannelType::PROXY) {
+              // Includes the put of a put-with-signal
+              clock[g] = std::max<uint32_t>(clock[g], op.type == OperationType::SIGNAL ? i : i + 1);
+            }
+          }
+          for (const PlanSemaphore& semaphore : signals) {
+            released[semaphore].push_back(clock);
+            auto it = waiters.find(semaphore);
+            if (it == waiters.end()) continue;
+            for (size_t waiter : it->second) {
+              if (!states[waiter].queued) {
+                states[waiter].queued = true;
+                queue.push_back(waiter);
+              }
+            }
+            waiters.erase(it);
+          }
+        }
+        state.pc++;
+      }
+    }
+
+    for (size_t g = 0; g < nThreadblocks; g++) {
+      auto [rank, tb] = threadblocks_[g];
+      if (states[g].pc < analysis_.operations(rank, tb).size()) {
+        int i = states[g].pc;
+        std::string peers;
+        for (const PlanSemaphore& semaphore : analysis_.waits(rank, tb, i)) {
+          peers += (peers.empty() ? "" : ", ") + std::to_string(semaphore.src);
+        }
+        report(PlanIssue::Severity::Error, rank, tb, i,
+               "Deadlock: " + describe(rank, tb, i) + " waits forever for rank " + peers);
+      }
+    }
+    if (trackClocks) {
+      this->checkDependencies(nodeClocks);
+      this->checkRaces(nodeClocks);
+    }
+  }
+
+  // Dependencies are not executed by the kernel, so each must be implied by the barriers, signals and waits.
+  void checkDependencies(const std::map<std::tuple<int, int, int>, Clock>& nodeClocks) {
+    for (const auto& [rank, tb] : threadblocks_) {
+      for (const OperationDependency& dep : analysis_.dependencies(rank, tb)) {
+        int op = dep.operation;
+        int depTb = dep.threadblock;
+        int depStep = dep.step;
+        if (depTb >= analysis_.threadblockCount(rank) ||
+            static_cast<size_t>(depStep) >= analysis_.operations(rank, depTb).size()) {
+          report(PlanIssue::Severity::Error, rank, tb, op,
+                 "Dependency on threadblock " + std::to_string(depTb) + " step " + std::to_string(depStep) +
+                     " refers to a missing operation");
+          continue;
+        }
+        if (depTb == tb) {
+          if (depStep >= op) {
+            report(PlanIssue::Severity::Error, rank, tb, op,
+                   "Dependency on step " + std::to_string(depStep) + " of the same threadblock is not an earlier step");
+          }
+          continue;
+        }
+        auto it = nodeClocks.find({rank, tb, op});
+        if (it == nodeClocks.end()) {
+          // Not reached because of a deadlock, which is already reported
+          continue;
+        }
+        if (it->second[depTb] <= static_cast<uint32_t>(depStep)) {
+          report(PlanIssue::Severity::Error, rank, tb, op,
+                 "Dependency on " + describe(rank, depTb, depStep) + " is not enforced by any barrier, signal or wait");
+        }
+      }
+    }
+  }
+
+  // Writes of different threadblocks of a rank to overlapping bytes must be ordered. Ranks writing the same bytes are
+  // not reported, since plans commonly have several ranks write identical reduced data.
+  void checkRaces(const std::map<std::tuple<int, int, int>, Clock>& nodeClocks) {
+    struct Write {
+      uint64_t begin;
+      uint64_t end;
+      int tb;
+      int op;
+    };
+    // writes[{writer rank, buffer rank, buffer type, is packet}]
+    std::map<std::tuple<int, int, BufferType, bool>, std::vector<Write>> writes;
+    for (const auto& [rank, tb] : threadblocks_) {
+      for (size_t i = 0; i < analysis_.operations(rank, tb).size(); i++) {
+        for (const PlanAccess& access : analysis_.accesses(rank, tb, i)) {
+          if (access.isWrite && access.size > 0) {
+            writes[{rank, access.rank, access.bufferType, access.isPacket}].push_back(
+                {access.offset, access.offset + access.size, tb, static_cast<int>(i)});
+          }
+        }
+      }
+    }
+    auto happensBefore = [&](int rank, const Write& a, const Write& b) {
+      auto it = nodeClocks.find({rank, b.tb, b.op});
+      return it != nodeClocks.end() && it->second[a.tb] > static_cast<uint32_t>(a.op);
+    };
+    std::set<std::tuple<int, int, int, int, int>> reported;
+    for (auto& [key, rankWrites] : writes) {
+      auto [rank, bufferRank, bufferType, isPacket] = key;
+      std::sort(rankWrites.begin(), rankWrites.end(), [](const Write& a, const Write& b) { return a.begin < b.begin; });
+      for (size_t i = 0; i < rankWrites.size(); i++) {
+        const Write& a = rankWrites[i];
+        for (size_t j = i + 1; j < rankWrites.size() && rankWrites[j].begin < a.end; j++) {
+          const Write& b = rankWrites[j];
+          if (a.tb == b.tb || happensBefore(rank, a, b) || happensBefore(rank, b, a)) {
+            continue;
+          }
+          const Write& first = std::tie(a.tb, a.op) < std::tie(b.tb, b.op) ? a : b;
+          const Write& second = &first == &a ? b : a;
+          if (!reported.insert({rank, first.tb, first.op, second.tb, second.op}).second) {
+            continue;
+          }
+          report(PlanIssue::Severity::Error, rank, second.tb, second.op,
+                 "Write to the " + std::string(isPacket ? "packet half of the scratch" : getBufferName(bufferType)) +
+                     " buffer of rank " + std::to_string(bufferRank) + " races with " +
+                     describe(rank, first.tb, first.op));
+        }
+      }
+    }
+  }
+
+  const PlanAnalysis& analysis_;
+  std::vector<std::pair<int, int>> threadblocks_;
+  std::unordered_map<int, size_t> rankBases_;
+  std::vector<PlanIssue> issues_;
+};
+
+}  // namespace
+
+namespace mscclpp {
+
+std::vector<PlanIssue> verifyExecutionPlan(const PlanAnalysis& analysis) { return PlanVerifier(analysis).run(); }
+
+}  // namespace mscclpp
@@ -4,10 +4,24 @@
 #include <mscclpp/executor.hpp>
 #include <mscclpp/proxy_channel.hpp>
 #include <mscclpp/sm_channel.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <thread>
+#include <type_traits>
 
+#include "execution_group.hpp"
 #include "execution_kernel.hpp"
 #include "execution_plan.hpp"
+#include "operation_encoding.hpp"
+#include "scratch_arena.hpp"
+#include "sharded_cache.hpp"
 
 namespace mscclpp {
 struct ExecutionContextKey {
@@ -15,11 +29,16 @@ struct ExecutionContextKey {
   void* recvBuff;
   size_t sendBuffSize;
   size_t recvBuffSize;
+  // Path of the plan file, since plans in different files may have the same name, and version of the plan
   std::string plan;
+  uint64_t planVersion;
+  // Position of the execution in its group, see Executor::executeGroup, 0 for executions that are not grouped
+  uint32_t scratchSlot = 0;
 
   bool operator==(const ExecutionContextKey& other) const {
     return sendBuff == other.sendBuff && recvBuff == other.recvBuff && sendBuffSize == other.sendBuffSize &&
-           recvBuffSize == other.recvBuffSize && plan == other.plan;
+           recvBuffSize == other.recvBuffSize && plan == other.plan && planVersion == other.planVersion &&
+           scratchSlot == other.scratchSlot;
   }
 };
 }  // namespace mscclpp
@@ -35,8 +54,28 @@ struct hash<std::pair<mscclpp::BufferType, int>> {
 template <>
 struct hash<mscclpp::ExecutionContextKey> {
   std::size_t operator()(const mscclpp::ExecutionContextKey& key) const {
-    return std::hash<void*>()(key.sendBuff) ^ std::hash<void*>()(key.recvBuff) ^ std::hash<size_t>()(key.sendBuffSize) ^
-           std::hash<size_t>()(key.recvBuffSize) ^ std::hash<std::string>()(key.plan);
+    // Refer hash_combine from boost. XORing the fields would cancel the equal send and receive fields of in-place
+    // executions out.
+    std::size_t seed = std::hash<std::string>()(key.plan);
+    auto combine = [&seed](std::size_t value) { seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2); };
+    combine(std::hash<void*>()(key.sendBuff));
+    combine(std::hash<void*>()(key.recvBuff));
+    combine(std::hash<size_t>()(key.sendBuffSize));
+    combine(std::hash<size_t>()(key.recvBuffSize));
+    combine(std::hash<uint64_t>()(key.planVersion));
+    combine(std::hash<uint32_t>()(key.scratchSlot));
+    return seed;
+  }
+};
+
+template <>
+struct hash<std::vector<mscclpp::ExecutionContextKey>> {
+  std::size_t operator()(const std::vector<mscclpp::ExecutionContextKey>& keys) const {
+    std::size_t seed = keys.size();
+    for (const mscclpp::ExecutionContextKey& key : keys) {
+      seed ^= std::hash<mscclpp::ExecutionContextKey>()(key) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+    return seed;
   }
 };
 }  // namespace std
@@ -46,6 +85,30 @@ auto inSameNode = [](int rank1, int rank2, int nranksPerNode) {
   return rank1 / nranksPerNode == rank2 / nranksPerNode;
 };
 
+using EventPtr = std::shared_ptr<std::remove_pointer_t<cudaEvent_t>>;
+
+EventPtr createEvent() {
+  cudaEvent_t event;
+  MSCCLPP_CUDATHROW(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+  return EventPtr(event, [](cudaEvent_t event) { cudaEventDestroy(event); });
+}
+
+// Bootstrap tags of the setup messages of a context. Vectors are sent on two consecutive tags, semaphores use the tag
+// of their connection.
+constexpr int ConnectionTag = 0;
+int memoryTag(mscclpp::BufferType bufferType) { return 2 * static_cast<int>(bufferType) + 2; }
+
+// Distinct peers of the channels
+std::vector<int> getConnectedPeers(const std::vector<mscclpp::ChannelInfo>& infos) {
+  std::set<int> peers;
+  for (const mscclpp::ChannelInfo& info : infos) {
+    for (int peer : info.connectedPeers) {
+      peers.insert(peer);
+    }
+  }
+  return std::vector<int>(peers.begin(), peers.end());
+}
+
 static const mscclpp::Transport IBs[] = {mscclpp::Transport::IB0, mscclpp::Transport::IB1, mscclpp::Transport::IB2,
                                          mscclpp::Transport::IB3, mscclpp::Transport::IB4, mscclpp::Transport::IB5,
                                          mscclpp::Transport::IB6, mscclpp::Transport::IB7};
@@ -62,61 +125,554 @@ struct ExecutionContext {
   std::vector<mscclpp::SmChannel> smChannels;
   std::vector<mscclpp::SimpleProxyChannel> proxyChannels;
   std::vector<DeviceExecutionPlan> deviceExecutionPlans;
-  std::shared_ptr<char> scratchBuffer;
+  // Host copy of the device plan buffer: the headers in `deviceExecutionPlans`, the channel tables of all threadblocks,
+  // then the encoded operations of each threadblock with room for any message size
+  std::vector<char> hostExecutionPlansBuffer;
+  std::shared_ptr<ScratchBuffer> scratchBuffer;
   size_t scratchBufferSize;
   std::shared_ptr<char> deviceExecutionPlansBuffer;
+  // Message sizes and offsets the operations of `deviceExecutionPlansBuffer` were instantiated for, unset if they were
+  // instantiated for a tile
+  std::optional<std::array<size_t, 4>> messageKey;
+  // Device plans of the tiles of the last message run in tiles, see ExecutorConfig::tileSize, each laid out like
+  // `hostExecutionPlansBuffer`. They were built for the message sizes and offsets in `tilesKey`.
+  std::vector<std::shared_ptr<char>> tileExecutionPlansBuffers;
+  std::array<size_t, 4> tilesKey;
+  size_t sharedMemSize;
+  int nthreadsPerBlock;
+  // Whether the plan reduces the inputs without marking the reduces that complete its output, which multiply by the
+  // factor of a PREMUL_SUM, see ExecutionPlan::Impl::marksFinalReduces
+  bool missesFinalReduces;
+  // Number of ranks of the plan, which AVG divides by
+  int worldSize;
+  // Recorded after the last kernel of the context, which must be done before the context is evicted
+  EventPtr lastUse;
+  // Tick of Executor::Impl::useClock at the last execution
+  std::atomic<uint64_t> lastUseTick;
+  // Number of contexts set up before this one, the same on all ranks as they set up contexts in the same order
+  uint64_t setupSeq;
+  // Set when a PlanRegistry replaced the plan by a reloaded version, see ExecutionPlan::Impl::superseded
+  std::shared_ptr<std::atomic<bool>> planSuperseded;
+  // Held while the device plans are updated and the kernels launched, and by the eviction. Executions of an evicted
+  // context set up a new one.
+  std::mutex mutex;
+  bool evicted = false;
+
+  size_t deviceBytes() const {
+    return this->hostExecutionPlansBuffer.size() * (1 + this->tileExecutionPlansBuffers.size());
+  }
+  bool hasProxyThread() const { return !this->proxyChannels.empty(); }
+};
+
+// ExecutorStats counters, updated by concurrent executions
+struct ExecutorCounters {
+  std::atomic<uint64_t> planUploads{0};
+  std::atomic<uint64_t> planUploadsSkipped{0};
+  std::atomic<uint64_t> planBytesUploaded{0};
+  std::atomic<uint64_t> contextHits{0};
+  std::atomic<uint64_t> contextMisses{0};
+  std::atomic<uint64_t> contextEvictions{0};
+};
+
+// An execution whose context Executor::prepare sets up in the background
+struct Preparation {
+  ExecutionContextKey key;
+  int rank;
+  void* sendBasePtr;
+  void* recvBasePtr;
+  size_t inputMessageSize;
+  size_t outputMessageSize;
+  size_t offsetIn;
+  size_t offsetOut;
+  std::shared_ptr<ExecutionPlan> plan;
+  cudaStream_t stream;
+  int device;
+  // Turn of the preparation in the order of context setups, see Executor::Impl::setupInTurn
+  uint64_t turn;
+  std::promise<void> done;
+};
+
+// An execution of Executor::executeGroup
+struct GroupedExecution {
+  ExecutionContextKey key;
+  void* sendbuff;
+  void* recvbuff;
+  size_t inputMessageSize;
+  size_t outputMessageSize;
+  size_t offsetIn;
+  size_t offsetOut;
+  std::shared_ptr<ExecutionPlan> plan;
+};
+
+// Merged device plan of a group of executions, see mergeDeviceExecutionPlans. Only the kernel arguments of the
+// executions are uploaded again while their contexts and messages stay the same.
+struct ExecutionGroup {
+  // Contexts the plan was merged from and the messages their device plans were instantiated for
+  std::vector<std::weak_ptr<ExecutionContext>> contexts;
+  std::vector<std::optional<std::array<size_t, 4>>> messageKeys;
+  std::vector<char> hostExecutionPlansBuffer;
+  std::shared_ptr<char> deviceExecutionPlansBuffer;
+  size_t argsOffset;
+  int nthreadblocks;
   int nthreadsPerBlock;
+  size_t sharedMemSize;
+  // Recorded after the last kernel of the group
+  EventPtr lastUse;
 };
 
+// Executions of existing contexts only take a shared lock on a shard of `contexts` and the mutex of their context, so
+// concurrent executions of different contexts do not contend. Setting up and evicting contexts is collective and is
+// serialized by `setupMutex`: all ranks must set up and evict the same contexts in the same order, which executions
+// from concurrent threads only guarantee if each context is first executed, or prepared, from a single thread. The
+// preparer releases `setupMutex` between preparations, and executions without a context take turns with them.
+// Locks are taken in the order `setupMutex`, a shard of `contexts`, the mutex of a context, the mutex of a plan. A
+// group takes the mutexes of its contexts in the order of their addresses, then `groupsMutex`.
 struct Executor::Impl {
   int nranksPerNode;
   int nranks;
   std::shared_ptr<Communicator> comm;
-  std::unordered_map<ExecutionContextKey, ExecutionContext> contexts;
+  ExecutorConfig config;
+  ShardedCache<ExecutionContextKey, ExecutionContext> contexts;
+  // Ordering of the context uses, see ExecutionContext::lastUseTick
+  std::atomic<uint64_t> useClock{0};
+  ExecutorCounters counters;
+  std::mutex setupMutex;
+  // The members below are guarded by `setupMutex`
+  ScratchArena scratchArena;
+  // Number of contexts set up so far, see ExecutionContext::setupSeq
+  uint64_t contextsSetUp = 0;
+  std::condition_variable preparationDone;
+  // Pending preparations in the order they were requested, the front one is being set up
+  std::deque<Preparation> preparations;
+  // Size of `preparations`, read by executions without taking `setupMutex`
+  std::atomic<size_t> pendingPreparations{0};
+  // Turns of the context setups taken and ended so far, see setupInTurn
+  uint64_t turnsTaken = 0;
+  uint64_t turnsEnded = 0;
+  std::thread preparer;
+  bool stopPreparer = false;
+  std::mutex groupsMutex;
+  // Merged plans of the groups executed so far, by the keys of their contexts. Dropped when one of them is evicted.
+  std::unordered_map<std::vector<ExecutionContextKey>, std::shared_ptr<ExecutionGroup>> groups;
 
-  Impl(std::shared_ptr<Communicator> comm) : comm(comm) {
+  Impl(std::shared_ptr<Communicator> comm, const ExecutorConfig& config) : comm(comm), config(config) {
     this->nranksPerNode = comm->bootstrap()->getNranksPerNode();
     this->nranks = comm->bootstrap()->getNranks();
   }
-  ~Impl() = default;
 
-  ExecutionContext setupExecutionContext(int rank, void* sendbuff, void* recvbuff, size_t inputMessageSize,
-                                         size_t outputMessageSize, size_t contsSrcOffset, size_t constDstOffset,
-                                         size_t sendBufferSize, size_t recvBufferSize, const ExecutionPlan& plan) {
-    ExecutionContextKey key = {sendbuff, recvbuff, sendBufferSize, recvBufferSize, plan.impl_->name};
-    if (this->contexts.find(key) != this->contexts.end()) {
+  ~Impl() {
+    if (this->preparer.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(this->setupMutex);
+        this->stopPreparer = true;
+      }
+      this->preparationDone.notify_all();
+      this->preparer.join();
+    }
+  }
+
+  void execute(int rank, void* sendbuff, void* recvbuff, void* sendBasePtr, void* recvBasePtr, size_t inputMessageSize,
+               size_t outputMessageSize, size_t offsetIn, size_t offsetOut, size_t sendBytes, size_t recvBytes,
+               DataType dataType, const ExecutionPlan& plan, cudaStream_t stream, PacketType packetType,
+               const Reduction& reduction) {
+    ExecutionContextKey key = {sendBasePtr, recvBasePtr, sendBytes, recvBytes, plan.impl_->planPath,
+                               plan.impl_->version};
+    for (;;) {
+      std::shared_ptr<ExecutionContext> context;
+      bool created = false;
+      if (this->mayExecuteUnordered()) {
+        context = this->contexts.find(key);
+      }
+      if (context != nullptr) {
+        this->counters.contextHits++;
+      } else {
+        context = this->setupInTurn(key, [&]() {
+          return this->setupExecution(rank, sendBasePtr, recvBasePtr, inputMessageSize, outputMessageSize, offsetIn,
+                                      offsetOut, sendBytes, recvBytes, plan, stream, created);
+        });
+      }
+      std::lock_guard<std::mutex> contextLock(context->mutex);
+      if (context->evicted) {
+        continue;
+      }
+      Reduction kernelReduction = getKernelReduction(*context, reduction);
+      context->lastUseTick = ++this->useClock;
+      for (char* deviceExecutionPlansBuffer : this->setupMessage(*context, created, rank, inputMessageSize,
+                                                                 outputMessageSize, offsetIn, offsetOut, plan,
+                                                                 stream)) {
+        this->launchKernel(*context, rank, sendbuff, recvbuff, dataType, stream, packetType, kernelReduction,
+                           deviceExecutionPlansBuffer);
+      }
+      return;
+    }
+  }
+
+  // Split a message into the tiles it runs in, see ExecutorConfig::tileSize. The caller holds the mutex of the plan.
+  static std::vector<ExecutionTile> getTiles(int rank, size_t inputMessageSize, size_t outputMessageSize,
+                                             const ExecutionPlan& plan, size_t tileSize) {
+    if (tileSize == 0) {
+      return {ExecutionTile{}};
+    }
+    plan.impl_->loadPlan(rank);
+    std::vector<ExecutionTile> tiles = plan.impl_->getTiles(rank, inputMessageSize, outputMessageSize, tileSize);
+    // Simple plans alternate between the two scratch slots, see getScratchBufferSize.
+    size_t slotSize = plan.impl_->isUsingPacket ? 0 : plan.impl_->getTileScratchBufferSize(rank, tileSize);
+    for (size_t i = 0; i < tiles.size(); i++) {
+      tiles[i].scratchOffset = i % 2 * slotSize;
+    }
+    return tiles;
+  }
+
+  // Find or create the context of an execution. A message run in tiles creates the context for its first tile. The
+  // caller holds `setupMutex`.
+  std::shared_ptr<ExecutionContext> setupExecution(int rank, void* sendBasePtr, void* recvBasePtr,
+                                                   size_t inputMessageSize, size_t outputMessageSize, size_t offsetIn,
+                                                   size_t offsetOut, size_t sendBytes, size_t recvBytes,
+                                                   const ExecutionPlan& plan, cudaStream_t stream, bool& created,
+                                                   uint32_t scratchSlot = 0) {
+    ExecutionContextKey key = {sendBasePtr, recvBasePtr, sendBytes, recvBytes, plan.impl_->planPath,
+                               plan.impl_->version, scratchSlot};
+    std::shared_ptr<ExecutionContext> context = this->contexts.find(key);
+    created = context == nullptr;
+    if (!created) {
+      this->counters.contextHits++;
+      return context;
+    }
+    {
+      std::lock_guard<std::mutex> planLock(plan.impl_->mutex);
+      std::vector<ExecutionTile> tiles =
+          getTiles(rank, inputMessageSize, outputMessageSize, plan, this->config.tileSize);
+      if (tiles.size() == 1) {
+        context = this->setupExecutionContext(rank, sendBasePtr, recvBasePtr, inputMessageSize, outputMessageSize,
+                                              offsetIn, offsetOut, sendBytes, recvBytes, plan, stream, scratchSlot);
+        context->messageKey = {inputMessageSize, outputMessageSize, offsetIn, offsetOut};
+      } else {
+        context = this->setupExecutionContext(
+            rank, sendBasePtr, recvBasePtr, inputMessageSize / tiles[0].blockStride * tiles[0].size,
+            outputMessageSize / tiles[0].blockStride * tiles[0].size, offsetIn, offsetOut, sendBytes, recvBytes, plan,
+            stream, scratchSlot, tiles[0]);
+      }
+    }
+    context->lastUseTick = ++this->useClock;
+    context->setupSeq = this->contextsSetUp++;
+    context->planSuperseded = plan.impl_->superseded;
+    this->contexts.insert(key, context);
+    this->counters.contextMisses++;
+    this->evictSuperseded(key);
+    this->evictOverBudget();
+    return context;
+  }
+
+  // Instantiate the operations of a context for a message, unless the previous execution was of the same message.
+  // The caller holds the mutex of the context.
+  // @return The device plans to launch: one for the whole message, or one per tile.
+  std::vector<char*> setupMessage(ExecutionContext& context, bool created, int rank, size_t inputMessageSize,
+                                  size_t outputMessageSize, size_t offsetIn, size_t offsetOut,
+                                  const ExecutionPlan& plan, cudaStream_t stream) {
+    std::array<size_t, 4> key = {inputMessageSize, outputMessageSize, offsetIn, offsetOut};
+    if (context.messageKey == key) {
+      if (!created) {
+        this->counters.planUploadsSkipped++;
+      }
+      return {context.deviceExecutionPlansBuffer.get()};
+    }
+    std::lock_guard<std::mutex> planLock(plan.impl_->mutex);
+    std::vector<ExecutionTile> tiles = getTiles(rank, inputMessageSize, outputMessageSize, plan, this->config.tileSize);
+    if (tiles.size() == 1) {
       plan.impl_->operationsReset();
-      plan.impl_->lightLoadExecutionPlan(inputMessageSize, outputMessageSize, contsSrcOffset, constDstOffset);
-      this->setupDeviceExecutionPlan(this->contexts[key], rank, plan);
-      this->contexts[key].deviceExecutionPlansBuffer =
-          allocExtSharedCuda<char>(this->contexts[key].deviceExecutionPlans.size() * sizeof(DeviceExecutionPlan));
-      memcpyCuda(this->contexts[key].deviceExecutionPlansBuffer.get(),
-                 (char*)this->contexts[key].deviceExecutionPlans.data(),
-                 this->contexts[key].deviceExecutionPlans.size() * sizeof(DeviceExecutionPlan), cudaMemcpyHostToDevice);
-      return this->contexts[key];
+      plan.impl_->lightLoadExecutionPlan(inputMessageSize, outputMessageSize, offsetIn, offsetOut);
+      this->updateDeviceExecutionPlan(context, rank, plan, stream);
+      context.messageKey = key;
+      return {context.deviceExecutionPlansBuffer.get()};
+    }
+    this->setupTileExecutionPlans(context, rank, plan, tiles, inputMessageSize, outputMessageSize, offsetIn,
+                                  offsetOut);
+    std::vector<char*> buffers;
+    for (const std::shared_ptr<char>& buffer : context.tileExecutionPlansBuffers) {
+      buffers.push_back(buffer.get());
     }
+    return buffers;
+  }
 
-    plan.impl_->reset();
-    plan.impl_->loadExecutionPlan(inputMessageSize, outputMessageSize, contsSrcOffset, constDstOffset);
+  // Executions of existing contexts do not wait for the preparations, unless a preparation may evict their context:
+  // the eviction is collective, so they must keep their order relative to the preparations.
+  bool mayExecuteUnordered() const { return !this->hasBudgets() || this->pendingPreparations == 0; }
 
-    ExecutionContext context;
-    size_t scratchBufferSize = plan.impl_->getScratchBufferSize(rank, sendBufferSize, recvBufferSize);
-    std::shared_ptr<char> scratchBuffer = allocExtSharedCuda<char>(scratchBufferSize);
-    context.scratchBuffer = scratchBuffer;
+  // Contexts must be set up in the same order on all ranks, so preparations and executions without a context take
+  // turns in the order they were requested. An execution being prepared waits for its preparation instead, and one
+  // whose context exists by then skips its turn unless executions are ordered, see mayExecuteUnordered.
+  template <typename Setup>
+  std::shared_ptr<ExecutionContext> setupInTurn(const ExecutionContextKey& key, Setup setup) {
+    std::unique_lock<std::mutex> lock(this->setupMutex);
+    this->preparationDone.wait(lock, [&]() {
+      return std::none_of(this->preparations.begin(), this->preparations.end(),
+                          [&](const Preparation& preparation) { return preparation.key == key; });
+    });
+    if (!this->hasBudgets() && this->contexts.find(key) != nullptr) {
+      return setup();
+    }
+    uint64_t turn = this->turnsTaken++;
+    this->preparationDone.wait(lock, [&]() { return this->turnsEnded == turn; });
+    std::shared_ptr<ExecutionContext> context;
+    try {
+      context = setup();
+    } catch (...) {
+      this->endTurn();
+      throw;
+    }
+    this->endTurn();
+    return context;
+  }
+
+  // The caller holds `setupMutex`.
+  void endTurn() {
+    this->turnsEnded++;
+    this->preparationDone.notify_all();
+  }
+
+  void prepare(std::vector<Preparation>& preparations) {
+    {
+      std::lock_guard<std::mutex> lock(this->setupMutex);
+      for (Preparation& preparation : preparations) {
+        preparation.turn = this->turnsTaken++;
+        this->preparations.push_back(std::move(preparation));
+      }
+      this->pendingPreparations = this->preparations.size();
+      if (!this->preparer.joinable()) {
+        this->preparer = std::thread([this]() { this->runPreparer(); });
+      }
+    }
+    this->preparationDone.notify_all();
+  }
+
+  // Set up the preparations one at a time, releasing `setupMutex` in between so that executions take their turns.
+  void runPreparer() {
+    for (;;) {
+      std::unique_lock<std::mutex> lock(this->setupMutex);
+      this->preparationDone.wait(lock, [&]() {
+        return this->stopPreparer ||
+               (!this->preparations.empty() && this->preparations.front().turn == this->turnsEnded);
+      });
+      if (this->stopPreparer) {
+        return;
+      }
+      Preparation& preparation = this->preparations.front();
+      try {
+        MSCCLPP_CUDATHROW(cudaSetDevice(preparation.device));
+        bool created;
+        std::shared_ptr<ExecutionContext> context = this->setupExecution(
+            preparation.rank, preparation.sendBasePtr, preparation.recvBasePtr, preparation.inputMessageSize,
+            preparation.outputMessageSize, preparation.offsetIn, preparation.offsetOut, preparation.key.sendBuffSize,
+            preparation.key.recvBuffSize, *preparation.plan, preparation.stream, created);
+        std::lock_guard<std::mutex> contextLock(context->mutex);
+        this->setupMessage(*context, created, preparation.rank, preparation.inputMessageSize,
+                           preparation.outputMessageSize, preparation.offsetIn, preparation.offsetOut,
+                           *preparation.plan, preparation.stream);
+        preparation.done.set_value();
+      } catch (...) {
+        preparation.done.set_exception(std::current_exception());
+      }
+      this->preparations.pop_front();
+      this->pendingPreparations = this->preparations.size();
+      this->endTurn();
+    }
+  }
+
+  // Create the context of the buffers and instantiate the operations for the message, or for `tile` of it. The scratch
+  // buffer is borrowed from `scratchSlot` of the arena. The caller holds `setupMutex` and the mutex of the plan.
+  std::shared_ptr<ExecutionContext> setupExecutionContext(int rank, void* sendbuff, void* recvbuff,
+                                                          size_t inputMessageSize, size_t outputMessageSize,
+                                                          size_t contsSrcOffset, size_t constDstOffset,
+                                                          size_t sendBufferSize, size_t recvBufferSize,
+                                                          const ExecutionPlan& plan, cudaStream_t stream,
+                                                          uint32_t scratchSlot, const ExecutionTile& tile = {}) {
+    plan.impl_->loadExecutionPlan(rank, inputMessageSize, outputMessageSize, contsSrcOffset, constDstOffset, tile);
+
+    auto contextPtr = std::make_shared<ExecutionContext>();
+    ExecutionContext& context = *contextPtr;
+    size_t scratchBufferSize = getScratchBufferSize(rank, sendBufferSize, recvBufferSize, plan, this->config.tileSize);
+    context.scratchBuffer = this->scratchArena.borrow(scratchBufferSize, stream, scratchSlot);
     context.scratchBufferSize = scratchBufferSize;
     context.proxyService = std::make_shared<ProxyService>();
     context.nthreadsPerBlock = plan.impl_->getNThreadsPerBlock();
+    context.missesFinalReduces = plan.impl_->reducesInputs() && !plan.impl_->marksFinalReduces;
+    context.worldSize = plan.impl_->worldSize;
+    // Connections take a setup round of their own, in which the ranks agree on reusing those of the pool of the
+    // communicator, and one more for any they make. The memories of all buffer types and the semaphores are then
+    // exchanged in a single round, which Communicator::setup sends as one message per peer.
     this->setupConnections(context, rank, plan);
-    this->setupRegisteredMemories(context, sendbuff, recvbuff, sendBufferSize, recvBufferSize, rank, plan);
+    auto remoteMemories =
+        this->setupRegisteredMemories(context, sendbuff, recvbuff, sendBufferSize, recvBufferSize, rank, plan);
+    this->setupSemaphores(context, rank, plan);
+    this->comm->setup();
+    for (auto& [key, future] : remoteMemories) {
+      context.registeredMemories[key] = future.get();
+    }
     this->setupChannels(context, sendbuff, recvbuff, sendBufferSize, recvBufferSize, rank, plan);
     this->setupDeviceExecutionPlan(context, rank, plan);
-    context.deviceExecutionPlansBuffer =
-        allocExtSharedCuda<char>(context.deviceExecutionPlans.size() * sizeof(DeviceExecutionPlan));
-    memcpyCuda(context.deviceExecutionPlansBuffer.get(), (char*)context.deviceExecutionPlans.data(),
-               context.deviceExecutionPlans.size() * sizeof(DeviceExecutionPlan), cudaMemcpyHostToDevice);
-    context.proxyService->startProxy();
-    this->contexts.insert({key, context});
-    return context;
+    this->uploadDeviceExecutionPlan(context);
+    if (context.hasProxyThread()) {
+      context.proxyService->startProxy();
+    }
+    context.lastUse = createEvent();
+    return contextPtr;
+  }
+
+  // Count what setupExecution would create for the message, without touching the devices or the peers. The buffers
+  // are as large as the message.
+  static ExecutionFootprint explain(int rank, size_t inputMessageSize, size_t outputMessageSize,
+                                    const ExecutionPlan& plan, int nranksPerNode, const ExecutorConfig& config) {
+    std::lock_guard<std::mutex> planLock(plan.impl_->mutex);
+    std::vector<ExecutionTile> tiles = getTiles(rank, inputMessageSize, outputMessageSize, plan, config.tileSize);
+    const ExecutionTile& tile = tiles[0];
+    if (tiles.size() == 1) {
+      plan.impl_->loadExecutionPlan(rank, inputMessageSize, outputMessageSize, 0, 0);
+    } else {
+      plan.impl_->loadExecutionPlan(rank, inputMessageSize / tile.blockStride * tile.size,
+                                    outputMessageSize / tile.blockStride * tile.size, 0, 0, tile);
+    }
+
+    ExecutionFootprint footprint = {};
+    footprint.rank = rank;
+    for (int peer : plan.impl_->getConnectedPeers(rank)) {
+      footprint.connections[TransportNames[static_cast<int>(getConnectionTransport(rank, peer, nranksPerNode))]]++;
+    }
+    for (BufferType bufferType : plan.impl_->getConnectedBufferTypes(rank)) {
+      footprint.registeredMemories++;
+      footprint.remoteMemories += getConnectedPeers(plan.impl_->getChannelInfos(rank, bufferType)).size();
+    }
+    for (ChannelType channelType : {ChannelType::SM, ChannelType::PROXY}) {
+      size_t nSemaphores = 0;
+      for (const ChannelInfo& info : getSemaphoreChannelInfos(rank, plan.impl_->worldSize, channelType, plan)) {
+        nSemaphores += info.connectedPeers.size();
+      }
+      size_t nChannels = 0;
+      for (const ChannelInfo& info : plan.impl_->getChannelInfos(rank, channelType)) {
+        // setupChannels registers the source buffer of every channel.
+        footprint.registeredMemories++;
+        nChannels += info.connectedPeers.size();
+      }
+      (channelType == ChannelType::SM ? footprint.smSemaphores : footprint.proxySemaphores) = nSemaphores;
+      (channelType == ChannelType::SM ? footprint.smChannels : footprint.proxyChannels) = nChannels;
+    }
+    footprint.proxyThreads = footprint.proxyChannels > 0 ? 1 : 0;
+
+    footprint.scratchBufferSize =
+        getScratchBufferSize(rank, inputMessageSize, outputMessageSize, plan, config.tileSize);
+    footprint.scratchBytesReserved = ScratchArena::sizeClass(footprint.scratchBufferSize);
+    std::vector<DeviceExecutionPlan> deviceExecutionPlans;
+    size_t devicePlanSize = layoutDeviceExecutionPlans(rank, plan, deviceExecutionPlans);
+    footprint.threadblocks = deviceExecutionPlans.size();
+    footprint.threadsPerBlock = plan.impl_->getNThreadsPerBlock();
+    footprint.sharedMemPerBlock = getSharedMemSize(deviceExecutionPlans);
+    footprint.tiles = tiles.size();
+    // A message run in tiles keeps a device plan per tile next to the one of the context, see ExecutionContext.
+    footprint.devicePlanBytes = devicePlanSize * (tiles.size() == 1 ? 1 : 1 + tiles.size());
+    footprint.contextBytes = footprint.scratchBytesReserved + footprint.devicePlanBytes;
+    return footprint;
+  }
+
+  static size_t getScratchBufferSize(int rank, size_t sendBufferSize, size_t recvBufferSize, const ExecutionPlan& plan,
+                                     size_t tileSize) {
+    size_t scratchBufferSize = plan.impl_->getScratchBufferSize(rank, sendBufferSize, recvBufferSize);
+    if (tileSize > 0) {
+      // Messages whose blocks do not fit in a tile run in tiles. Each rank may start a tile while its peers still read
+      // the previous one from their scratch buffer, so Simple plans alternate between two slots of the size of a
+      // tile. LL packets already alternate between the halves of the scratch buffer on every launch.
+      size_t slotSize = plan.impl_->getTileScratchBufferSize(rank, tileSize);
+      if (scratchBufferSize > slotSize) {
+        scratchBufferSize = plan.impl_->isUsingPacket ? slotSize : 2 * slotSize;
+      }
+    }
+    return scratchBufferSize;
+  }
+
+  // Tear down the contexts of plans a PlanRegistry replaced, except the one of `current`. Registries swap plans at the
+  // same point of the executions on all ranks, see PlanRegistry::commitReloads, so all ranks find the same contexts
+  // superseded. The caller holds `setupMutex`.
+  void evictSuperseded(const ExecutionContextKey& current) {
+    std::vector<ExecutionContextKey> superseded;
+    this->contexts.forEach([&](const ExecutionContextKey& key, const std::shared_ptr<ExecutionContext>& context) {
+      if (*context->planSuperseded && !(key == current)) {
+        superseded.push_back(key);
+      }
+    });
+    for (const ExecutionContextKey& key : superseded) {
+      this->evict(key);
+    }
+  }
+
+  bool hasBudgets() const {
+    return this->config.maxContexts != 0 || this->config.maxContextBytes != 0 || this->config.maxProxyThreads != 0;
+  }
+
+  // Tear down least recently used contexts until the budgets of ExecutorConfig are met, keeping the one set up last.
+  // Contexts are set up collectively, so all ranks must evict the same ones: they evict as long as any rank is over
+  // budget, and all evict the least recently used context of rank 0. The ranks may use their contexts in different
+  // orders, so they name it by its ExecutionContext::setupSeq. The caller holds `setupMutex`.
+  void evictOverBudget() {
+    if (!this->hasBudgets()) {
+      return;
+    }
+    struct EvictionVote {
+      uint64_t leastRecentlyUsed;
+      bool overBudget;
+    };
+    std::shared_ptr<Bootstrap> bootstrap = this->comm->bootstrap();
+    std::vector<EvictionVote> votes(this->nranks);
+    for (;;) {
+      this->scratchArena.trim();
+      size_t bytes = this->scratchArena.bytesReserved();
+      size_t nContexts = 0;
+      size_t proxyThreads = 0;
+      uint64_t leastRecentTick = UINT64_MAX;
+      EvictionVote vote = {UINT64_MAX, false};
+      this->contexts.forEach([&](const ExecutionContextKey&, const std::shared_ptr<ExecutionContext>& context) {
+        nContexts++;
+        bytes += context->deviceBytes();
+        proxyThreads += context->hasProxyThread();
+        if (context->setupSeq + 1 != this->contextsSetUp && context->lastUseTick < leastRecentTick) {
+          leastRecentTick = context->lastUseTick;
+          vote.leastRecentlyUsed = context->setupSeq;
+        }
+      });
+      auto exceeds = [](size_t value, size_t budget) { return budget != 0 && value > budget; };
+      vote.overBudget = nContexts > 1 && (exceeds(nContexts, this->config.maxContexts) ||
+                                          exceeds(bytes, this->config.maxContextBytes) ||
+                                          exceeds(proxyThreads, this->config.maxProxyThreads));
+      votes[bootstrap->getRank()] = vote;
+      bootstrap->allGather(votes.data(), sizeof(EvictionVote));
+      if (std::none_of(votes.begin(), votes.end(), [](const EvictionVote& vote) { return vote.overBudget; })) {
+        return;
+      }
+      std::optional<ExecutionContextKey> leastRecentlyUsed;
+      this->contexts.forEach([&](const ExecutionContextKey& key, const std::shared_ptr<ExecutionContext>& context) {
+        if (context->setupSeq == votes[0].leastRecentlyUsed) {
+          leastRecentlyUsed = key;
+        }
+      });
+      if (!leastRecentlyUsed) {
+        throw Error("Ranks set up different execution contexts", ErrorCode::ExecutorError);
+      }
+      this->evict(*leastRecentlyUsed);
+    }
+  }
+
+  void evict(ExecutionContextKey key) {
+    std::shared_ptr<ExecutionContext> context = this->contexts.erase(key);
+    std::lock_guard<std::mutex> contextLock(context->mutex);
+    MSCCLPP_CUDATHROW(cudaEventSynchronize(context->lastUse.get()));
+    context->proxyService->stopProxy();
+    context->evicted = true;
+    this->counters.contextEvictions++;
+    std::lock_guard<std::mutex> groupsLock(this->groupsMutex);
+    for (auto it = this->groups.begin(); it != this->groups.end();) {
+      if (std::find(it->first.begin(), it->first.end(), key) != it->first.end()) {
+        it = this->groups.erase(it);
+      } else {
+        ++it;
+      }
+    }
   }
 
   TransportFlags getTransportFlags(std::vector<ChannelInfo>& infos, int rank) {
@@ -136,13 +692,16 @@ struct Executor::Impl {
     return flags;
   };
 
+  static Transport getConnectionTransport(int rank, int peer, int nranksPerNode) {
+    return inSameNode(rank, peer, nranksPerNode) ? Transport::CudaIpc : IBs[rank % nranksPerNode];
+  }
+
   void setupConnections(ExecutionContext& context, int rank, const ExecutionPlan& plan) {
     std::vector<int> connectedPeers = plan.impl_->getConnectedPeers(rank);
     std::vector<mscclpp::NonblockingFuture<std::shared_ptr<mscclpp::Connection>>> connectionFutures;
     for (int peer : connectedPeers) {
-      Transport transport =
-          inSameNode(rank, peer, this->nranksPerNode) ? Transport::CudaIpc : IBs[rank % this->nranksPerNode];
-      connectionFutures.push_back(this->comm->connectOnSetup(peer, 0, transport));
+      Transport transport = getConnectionTransport(rank, peer, this->nranksPerNode);
+      connectionFutures.push_back(this->comm->sharedConnectOnSetup(peer, ConnectionTag, transport));
     }
     this->comm->setup();
     for (size_t i = 0; i < connectionFutures.size(); i++) {
@@ -150,8 +709,10 @@ struct Executor::Impl {
     }
   }
 
-  void setupRegisteredMemories(ExecutionContext& context, void* sendbuff, void* recvbuff, size_t sendBufferSize,
-                               size_t recvBufferSize, int rank, const ExecutionPlan& plan) {
+  // Queue the exchange of the buffers with the peers, the remote memories are ready after the next setup round.
+  std::vector<std::pair<std::pair<BufferType, int>, NonblockingFuture<RegisteredMemory>>> setupRegisteredMemories(
+      ExecutionContext& context, void* sendbuff, void* recvbuff, size_t sendBufferSize, size_t recvBufferSize, int rank,
+      const ExecutionPlan& plan) {
     auto getBufferInfo = [&](BufferType type) {
       switch (type) {
         case BufferType::INPUT:
@@ -159,46 +720,47 @@ struct Executor::Impl {
         case BufferType::OUTPUT:
           return std::make_pair(recvbuff, recvBufferSize);
         case BufferType::SCRATCH:
-          return std::make_pair((void*)context.scratchBuffer.get(), context.scratchBufferSize);
+          return std::make_pair((void*)context.scratchBuffer->data(), context.scratchBufferSize);
         default:
           throw Error("Invalid buffer type", ErrorCode::ExecutorError);
       }
     };
-    auto getConnectedPeers = [&](std::vector<ChannelInfo>& infos) {
-      std::set<int> peers;
-      for (ChannelInfo& info : infos) {
-        for (int peer : info.connectedPeers) {
-          peers.insert(peer);
-        }
-      }
-      return std::vector<int>(peers.begin(), peers.end());
-    };
 
+    std::vector<std::pair<std::pair<BufferType, int>, NonblockingFuture<RegisteredMemory>>> remoteMemories;
     std::vector<BufferType> bufferTypes = plan.impl_->getConnectedBufferTypes(rank);
     for (BufferType bufferType : bufferTypes) {
       std::vector<ChannelInfo> channelInfos = plan.impl_->getChannelInfosByDstRank(rank, bufferType);
       TransportFlags transportFlags = getTransportFlags(channelInfos, rank);
       RegisteredMemory memory =
           this->comm->registerMemory(getBufferInfo(bufferType).first, getBufferInfo(bufferType).second, transportFlags);
-      std::vector<int> connectedPeers = getConnectedPeers(channelInfos);
-      std::vector<mscclpp::NonblockingFuture<mscclpp::RegisteredMemory>> remoteRegMemoryFutures;
-      for (int peer : connectedPeers) {
-        comm->sendMemoryOnSetup(memory, peer, 0);
+      for (int peer : getConnectedPeers(channelInfos)) {
+        comm->sendMemoryOnSetup(memory, peer, memoryTag(bufferType));
       }
       channelInfos = plan.impl_->getChannelInfos(rank, bufferType);
-      connectedPeers = getConnectedPeers(channelInfos);
-      for (int peer : connectedPeers) {
-        remoteRegMemoryFutures.push_back(comm->recvMemoryOnSetup(peer, 0));
-      }
-      comm->setup();
-      for (size_t i = 0; i < remoteRegMemoryFutures.size(); i++) {
-        context.registeredMemories[{bufferType, connectedPeers[i]}] = std::move(remoteRegMemoryFutures[i].get());
+      for (int peer : getConnectedPeers(channelInfos)) {
+        remoteMemories.emplace_back(std::make_pair(bufferType, peer),
+                                    comm->recvMemoryOnSetup(peer, memoryTag(bufferType)));
       }
     }
+    return remoteMemories;
   }
 
-  void setupChannels(ExecutionContext& context, void* sendbuff, void* recvbuff, size_t sendBufferSize,
-                     size_t recvBufferSize, int rank, const ExecutionPlan& plan) {
+  // The channels of the rank, then one channel per semaphore its peers build towards it without a matching channel.
+  // Current semaphore construction requires two-way communication, e.g., to construct a semaphore signaling from rank
+  // 0 to rank 1, both rank 0 and rank 1 need to send a message to each other. This PR fixes an executor bug that fails
+  // to conduct two-way communication for constructing such one-way semaphores, and instead hangs during the semaphore
+  // construction. In the future, we may need to change the implementation to construct semaphore via one-way
+  // communication.
+  static std::vector<ChannelInfo> getSemaphoreChannelInfos(int rank, int nranks, ChannelType channelType,
+                                                           const ExecutionPlan& plan) {
+    std::vector<ChannelInfo> channelInfos = plan.impl_->getChannelInfos(rank, channelType);
+    std::vector<ChannelInfo> unpaired = plan.impl_->getUnpairedChannelInfos(rank, nranks, channelType);
+    channelInfos.insert(channelInfos.end(), unpaired.begin(), unpaired.end());
+    return channelInfos;
+  }
+
+  // Create the semaphores of the channels. Their IDs are exchanged in the next setup round.
+  void setupSemaphores(ExecutionContext& context, int rank, const ExecutionPlan& plan) {
     const auto channelTypes = {ChannelType::SM, ChannelType::PROXY};
     std::vector<std::shared_ptr<SmDevice2DeviceSemaphore>> smSemaphores;
     std::vector<mscclpp::SemaphoreId> proxySemaphores;
@@ -216,20 +778,16 @@ struct Executor::Impl {
       }
     };
     for (ChannelType channelType : channelTypes) {
-      std::vector<ChannelInfo> channelInfos = plan.impl_->getChannelInfos(rank, channelType);
-      processChannelInfos(channelInfos);
-      // Current semaphore construction requires two-way communication, e.g., to construct a semaphore signaling from
-      // rank 0 to rank 1, both rank 0 and rank 1 need to send a message to each other. This PR fixes an executor bug
-      // that fails to conduct two-way communication for constructing such one-way semaphores, and instead hangs
-      // during the semaphore construction. In the future, we may need to change the implementation to construct
-      // semaphore via one-way communication.
-      channelInfos = plan.impl_->getUnpairedChannelInfos(rank, nranks, channelType);
+      std::vector<ChannelInfo> channelInfos = getSemaphoreChannelInfos(rank, this->nranks, channelType, plan);
       processChannelInfos(channelInfos);
     }
-    this->comm->setup();
     context.smSemaphores = std::move(smSemaphores);
     context.proxySemaphores = std::move(proxySemaphores);
+  }
 
+  void setupChannels(ExecutionContext& context, void* sendbuff, void* recvbuff, size_t sendBufferSize,
+                     size_t recvBufferSize, int rank, const ExecutionPlan& plan) {
+    const auto channelTypes = {ChannelType::SM, ChannelType::PROXY};
     auto getBuffer = [&](BufferType type) {
       switch (type) {
         case BufferType::INPUT:
@@ -237,7 +795,7 @@ struct Executor::Impl {
         case BufferType::OUTPUT:
           return recvbuff;
         case BufferType::SCRATCH:
-          return (void*)context.scratchBuffer.get();
+          return (void*)context.scratchBuffer->data();
         default:
           throw Error("Invalid buffer type", ErrorCode::ExecutorError);
       }
@@ -278,34 +836,226 @@ struct Executor::Impl {
     }
   }
 
-  void setupDeviceExecutionPlan(ExecutionContext& context, int rank, const ExecutionPlan& plan) {
-    std::vector<DeviceExecutionPlan> deviceExecutionPlans;
-    for (int threadblock = 0; threadblock < plan.impl_->getThreadblockCount(rank); threadblock++) {
-      DeviceExecutionPlan deviceExecutionPlan = {};
-      std::vector<Operation> ops = plan.impl_->getOperations(rank, threadblock);
-      deviceExecutionPlan.nOperations = ops.size();
+  // Lay out the device plan buffer: the headers of all threadblocks, their channel tables, then their encoded
+  // operations. Channel tables are kept in shared memory if they are small enough for all threadblocks, and
+  // operations are paged into shared memory, so neither count is bounded by the shared memory size. The operations
+  // must be loaded for the rank.
+  // @return The size of the buffer.
+  static size_t layoutDeviceExecutionPlans(int rank, const ExecutionPlan& plan,
+                                           std::vector<DeviceExecutionPlan>& deviceExecutionPlans) {
+    auto align = [](size_t size) { return (size + 15) / 16 * 16; };
+    int nthreadblocks = plan.impl_->getThreadblockCount(rank);
+    deviceExecutionPlans.assign(nthreadblocks, DeviceExecutionPlan{});
+    size_t bufferSize = align(nthreadblocks * sizeof(DeviceExecutionPlan));
+    size_t maxChannelsSize = 0;
+    for (int threadblock = 0; threadblock < nthreadblocks; threadblock++) {
+      DeviceExecutionPlan& deviceExecutionPlan = deviceExecutionPlans[threadblock];
       deviceExecutionPlan.nSmChannels = plan.impl_->threadblockSMChannelMap.at(rank).at(threadblock).size();
       deviceExecutionPlan.nProxyChannels = plan.impl_->threadblockProxyChannelMap.at(rank).at(threadblock).size();
-      int chanIndex = 0;
+      deviceExecutionPlan.smChannelsOffset = bufferSize;
+      deviceExecutionPlan.proxyChannelsOffset =
+          bufferSize + deviceExecutionPlan.nSmChannels * sizeof(DeviceHandle<SmChannel>);
+      deviceExecutionPlan.channelsSize =
+          align(deviceExecutionPlan.nSmChannels * sizeof(DeviceHandle<SmChannel>) +
+                deviceExecutionPlan.nProxyChannels * sizeof(DeviceHandle<SimpleProxyChannel>));
+      bufferSize += deviceExecutionPlan.channelsSize;
+      maxChannelsSize = std::max<size_t>(maxChannelsSize, deviceExecutionPlan.channelsSize);
+    }
+    // Offsets change with the message size and so does the size of their encoding. Reserve room for the largest
+    // encoding so that updates never move the operations of a threadblock.
+    size_t maxOperationsCapacity = 0;
+    for (int threadblock = 0; threadblock < nthreadblocks; threadblock++) {
+      DeviceExecutionPlan& deviceExecutionPlan = deviceExecutionPlans[threadblock];
+      size_t capacity = 0;
+      for (const Operation& op : plan.impl_->operations.at(rank)[threadblock]) {
+        capacity += maxEncodedOperationSize(op);
+      }
+      deviceExecutionPlan.operationsOffset = bufferSize;
+      bufferSize += align(capacity);
+      maxOperationsCapacity = std::max(maxOperationsCapacity, align(capacity));
+    }
+
+    // A page must hold any operation after a start aligned down to 16 bytes, unless all operations fit in it.
+    static_assert(OPERATION_PAGE_SIZE % 16 == 0 && OPERATION_PAGE_SIZE >= MAX_ENCODED_OPERATION_SIZE + 16,
+                  "Invalid operation page size");
+    uint32_t sharedChannelsSize = maxChannelsSize <= MAX_SHARED_CHANNELS_SIZE ? maxChannelsSize : 0;
+    uint32_t operationPageSize = std::min<size_t>(OPERATION_PAGE_SIZE, maxOperationsCapacity);
+    for (DeviceExecutionPlan& deviceExecutionPlan : deviceExecutionPlans) {
+      deviceExecutionPlan.sharedChannelsSize = sharedChannelsSize;
+      deviceExecutionPlan.operationPageSize = operationPageSize;
+    }
+    return bufferSize;
+  }
+
+  static size_t getSharedMemSize(const std::vector<DeviceExecutionPlan>& deviceExecutionPlans) {
+    if (deviceExecutionPlans.empty()) {
+      return 0;
+    }
+    return deviceExecutionPlans.front().sharedChannelsSize + deviceExecutionPlans.front().operationPageSize;
+  }
+
+  void setupDeviceExecutionPlan(ExecutionContext& context, int rank, const ExecutionPlan& plan) {
+    std::vector<DeviceExecutionPlan> deviceExecutionPlans;
+    std::vector<char> buffer(layoutDeviceExecutionPlans(rank, plan, deviceExecutionPlans));
+    for (size_t threadblock = 0; threadblock < deviceExecutionPlans.size(); threadblock++) {
+      DeviceExecutionPlan& deviceExecutionPlan = deviceExecutionPlans[threadblock];
+      auto* smChannels = (DeviceHandle<SmChannel>*)(buffer.data() + deviceExecutionPlan.smChannelsOffset);
       for (const auto& [index, _] : plan.impl_->threadblockSMChannelMap.at(rank).at(threadblock)) {
-        deviceExecutionPlan.channels.smChannels[chanIndex++] = mscclpp::deviceHandle(context.smChannels[index]);
+        *smChannels++ = mscclpp::deviceHandle(context.smChannels[index]);
       }
-      chanIndex = 0;
+      auto* proxyChannels =
+          (DeviceHandle<SimpleProxyChannel>*)(buffer.data() + deviceExecutionPlan.proxyChannelsOffset);
       for (const auto& [index, _] : plan.impl_->threadblockProxyChannelMap.at(rank).at(threadblock)) {
-        deviceExecutionPlan.channels.proxyChannels[chanIndex++] = mscclpp::deviceHandle(context.proxyChannels[index]);
+        *proxyChannels++ = mscclpp::deviceHandle(context.proxyChannels[index]);
       }
-      for (size_t i = 0; i < ops.size(); i++) {
-        deviceExecutionPlan.operations[i] = ops[i];
-      }
-      deviceExecutionPlans.push_back(deviceExecutionPlan);
+      std::vector<uint8_t> encoded = encodeOperations(plan.impl_->operations.at(rank)[threadblock]);
+      deviceExecutionPlan.nOperations = plan.impl_->operations.at(rank)[threadblock].size();
+      deviceExecutionPlan.operationsSize = encoded.size();
+      std::memcpy(buffer.data() + deviceExecutionPlan.operationsOffset, encoded.data(), encoded.size());
     }
+    std::memcpy(buffer.data(), deviceExecutionPlans.data(), deviceExecutionPlans.size() * sizeof(DeviceExecutionPlan));
+    context.sharedMemSize = getSharedMemSize(deviceExecutionPlans);
     context.deviceExecutionPlans = std::move(deviceExecutionPlans);
+    context.hostExecutionPlansBuffer = std::move(buffer);
+  }
+
+  // Allocate the device plan buffer and upload the headers, the channel tables and the encoded operations, leaving
+  // out the room reserved for longer encodings.
+  void uploadDeviceExecutionPlan(ExecutionContext& context) {
+    const std::vector<char>& buffer = context.hostExecutionPlansBuffer;
+    context.deviceExecutionPlansBuffer = allocExtSharedCuda<char>(buffer.size());
+    size_t tablesSize = buffer.size();
+    if (!context.deviceExecutionPlans.empty()) {
+      tablesSize = context.deviceExecutionPlans.front().operationsOffset;
+    }
+    memcpyCuda(context.deviceExecutionPlansBuffer.get(), buffer.data(), tablesSize, cudaMemcpyHostToDevice);
+    size_t bytes = tablesSize;
+    for (const DeviceExecutionPlan& deviceExecutionPlan : context.deviceExecutionPlans) {
+      memcpyCuda(context.deviceExecutionPlansBuffer.get() + deviceExecutionPlan.operationsOffset,
+                 buffer.data() + deviceExecutionPlan.operationsOffset, deviceExecutionPlan.operationsSize,
+                 cudaMemcpyHostToDevice);
+      bytes += deviceExecutionPlan.operationsSize;
+    }
+    this->counters.planUploads++;
+    this->counters.planBytesUploaded += bytes;
+  }
+
+  // Build a device plan per tile of a message, unless they were built for the same message by the previous execution.
+  // The channel tables are those of the context and only the operations differ, so the buffers are uploaded once and
+  // the kernels of the tiles are launched back to back.
+  void setupTileExecutionPlans(ExecutionContext& context, int rank, const ExecutionPlan& plan,
+                               const std::vector<ExecutionTile>& tiles, size_t inputMessageSize,
+                               size_t outputMessageSize, size_t contsSrcOffset, size_t constDstOffset) {
+    std::array<size_t, 4> key = {inputMessageSize, outputMessageSize, contsSrcOffset, constDstOffset};
+    if (!context.tileExecutionPlansBuffers.empty() && context.tilesKey == key) {
+      this->counters.planUploadsSkipped++;
+      return;
+    }
+    context.tileExecutionPlansBuffers.clear();
+    for (const ExecutionTile& tile : tiles) {
+      plan.impl_->operationsReset();
+      plan.impl_->lightLoadExecutionPlan(inputMessageSize / tile.blockStride * tile.size,
+                                         outputMessageSize / tile.blockStride * tile.size, contsSrcOffset,
+                                         constDstOffset, tile);
+      std::vector<char> buffer = context.hostExecutionPlansBuffer;
+      for (size_t threadblock = 0; threadblock < context.deviceExecutionPlans.size(); threadblock++) {
+        DeviceExecutionPlan deviceExecutionPlan = context.deviceExecutionPlans[threadblock];
+        std::vector<uint8_t> encoded = encodeOperations(plan.impl_->operations.at(rank)[threadblock]);
+        deviceExecutionPlan.operationsSize = encoded.size();
+        std::memcpy(buffer.data() + deviceExecutionPlan.operationsOffset, encoded.data(), encoded.size());
+        std::memcpy(buffer.data() + threadblock * sizeof(DeviceExecutionPlan), &deviceExecutionPlan,
+                    sizeof(DeviceExecutionPlan));
+      }
+      std::shared_ptr<char> deviceBuffer = allocExtSharedCuda<char>(buffer.size());
+      memcpyCuda(deviceBuffer.get(), buffer.data(), buffer.size(), cudaMemcpyHostToDevice);
+      context.tileExecutionPlansBuffers.push_back(std::move(deviceBuffer));
+      this->counters.planBytesUploaded += buffer.size();
+    }
+    context.tilesKey = key;
+    this->counters.planUploads++;
+  }
+
+  // Refresh the operations of an existing context's device plans. Only the bytes of the encoded operations that differ
+  // from the previous instantiation are uploaded, on `stream` after the last kernel of the context, which may have been
+  // launched on another stream, so that kernels still reading the buffer are not affected.
+  void updateDeviceExecutionPlan(ExecutionContext& context, int rank, const ExecutionPlan& plan, cudaStream_t stream) {
+    MSCCLPP_CUDATHROW(cudaStreamWaitEvent(stream, context.lastUse.get(), 0));
+    bool uploaded = false;
+    for (size_t threadblock = 0; threadblock < context.deviceExecutionPlans.size(); threadblock++) {
+      DeviceExecutionPlan& deviceExecutionPlan = context.deviceExecutionPlans[threadblock];
+      char* deviceOps = context.hostExecutionPlansBuffer.data() + deviceExecutionPlan.operationsOffset;
+      std::vector<uint8_t> encoded = encodeOperations(plan.impl_->operations.at(rank)[threadblock]);
+      size_t firstChanged = encoded.size();
+      size_t lastChanged = 0;
+      for (size_t i = 0; i < encoded.size(); i++) {
+        if (deviceOps[i] != static_cast<char>(encoded[i])) {
+          deviceOps[i] = encoded[i];
+          firstChanged = std::min(firstChanged, i);
+          lastChanged = i;
+        }
+      }
+      if (firstChanged < encoded.size()) {
+        char* src = deviceOps + firstChanged;
+        size_t offset = src - context.hostExecutionPlansBuffer.data();
+        size_t bytes = lastChanged - firstChanged + 1;
+        memcpyCudaAsync(context.deviceExecutionPlansBuffer.get() + offset, src, bytes, stream, cudaMemcpyHostToDevice);
+        this->counters.planBytesUploaded += bytes;
+        uploaded = true;
+      }
+      if (deviceExecutionPlan.operationsSize != encoded.size()) {
+        deviceExecutionPlan.operationsSize = encoded.size();
+        char* header = context.hostExecutionPlansBuffer.data() + threadblock * sizeof(DeviceExecutionPlan);
+        std::memcpy(header, &deviceExecutionPlan, sizeof(DeviceExecutionPlan));
+        memcpyCudaAsync(context.deviceExecutionPlansBuffer.get() + threadblock * sizeof(DeviceExecutionPlan), header,
+                        sizeof(DeviceExecutionPlan), stream, cudaMemcpyHostToDevice);
+        this->counters.planBytesUploaded += sizeof(DeviceExecutionPlan);
+        uploaded = true;
+      }
+    }
+    if (uploaded) {
+      this->counters.planUploads++;
+    } else {
+      this->counters.planUploadsSkipped++;
+    }
+  }
+
+  // Checks what can be checked before a context is set up: integer averages would round every contribution to zero.
+  static void checkReduction(const Reduction& reduction, DataType dataType) {
+    if (reduction.op == ReduceOp::AVG && (dataType == DataType::INT32 || dataType == DataType::UINT32)) {
+      throw Error("AVG reductions need a floating point data type", ErrorCode::InvalidUsage);
+    }
+  }
+
+  // The reduction the kernel applies for `reduction` with the plan of `context`: AVG is a PREMUL_SUM by 1 / worldSize
+  // of the plan. The kernels multiply by the factor of a PREMUL_SUM in the reduces that complete the output, see
+  // Reduction.
+  static Reduction getKernelReduction(const ExecutionContext& context, const Reduction& reduction) {
+    Reduction kernelReduction = reduction;
+    if (reduction.op == ReduceOp::AVG) {
+      kernelReduction = {ReduceOp::PREMUL_SUM, 1.0 / context.worldSize};
+    }
+    if (kernelReduction.op == ReduceOp::PREMUL_SUM && context.missesFinalReduces) {
+      throw Error("AVG and PREMUL_SUM need a plan that marks its final reduces", ErrorCode::InvalidUsage);
+    }
+    return kernelReduction;
   }
 
   void launchKernel(ExecutionContext& context, int rank, void* sendbuff, void* recvbuff, DataType dataType,
-                    cudaStream_t stream, PacketType packetType) {
-    static uint32_t flag = 0;
-    int nthreadblocks = context.deviceExecutionPlans.size();
+                    cudaStream_t stream, PacketType packetType, const Reduction& reduction,
+                    char* deviceExecutionPlansBuffer) {
+    std::lock_guard<std::mutex> scratchLock(context.scratchBuffer->mutex());
+    context.scratchBuffer->beginUse(stream);
+    uint32_t flag = context.scratchBuffer->nextFlag();
+    launch(rank, context.deviceExecutionPlans.size(), context.nthreadsPerBlock, sendbuff, recvbuff,
+           context.scratchBuffer->data(), context.scratchBufferSize, dataType, deviceExecutionPlansBuffer,
+           context.sharedMemSize, stream, packetType, flag, reduction);
+    context.scratchBuffer->endUse(stream);
+    MSCCLPP_CUDATHROW(cudaEventRecord(context.lastUse.get(), stream));
+  }
+
+  static void launch(int rank, int nthreadblocks, int nthreadsPerBlock, void* sendbuff, void* recvbuff, void* scratch,
+                     size_t scratchSize, DataType dataType, char* deviceExecutionPlansBuffer, size_t sharedMemSize,
+                     cudaStream_t stream, PacketType packetType, uint32_t flag, const Reduction& reduction) {
 #if defined(ENABLE_NPKIT)
 #if defined(__HIP_PLATFORM_AMD__)
     if (nthreadblocks > NPKIT_MAX_NUM_GPU_THREADBLOCKS) {
@@ -315,34 +1065,210 @@ struct Executor::Impl {
                   ErrorCode::ExecutorError);
     }
 #endif
-    size_t sharedMemSize = sizeof(DeviceExecutionPlan) + NPKIT_SHM_NUM_EVENTS * sizeof(NpKitEvent);
-#else
-    size_t sharedMemSize = sizeof(DeviceExecutionPlan);
+    sharedMemSize += NPKIT_SHM_NUM_EVENTS * sizeof(NpKitEvent);
 #endif
     switch (packetType) {
       case PacketType::LL16:
-        ExecutionKernel::launchKernel<LL16Packet>(
-            rank, nthreadblocks, context.nthreadsPerBlock, sendbuff, recvbuff, (void*)context.scratchBuffer.get(),
-            context.scratchBufferSize, dataType, (DeviceExecutionPlan*)context.deviceExecutionPlansBuffer.get(),
-            sharedMemSize, stream, ++flag);
+        ExecutionKernel::launchKernel<LL16Packet>(rank, nthreadblocks, nthreadsPerBlock, sendbuff, recvbuff, scratch,
+                                                  scratchSize, dataType,
+                                                  (DeviceExecutionPlan*)deviceExecutionPlansBuffer, sharedMemSize,
+                                                  stream, flag, reduction);
         break;
       case PacketType::LL8:
-        ExecutionKernel::launchKernel<LL8Packet>(
-            rank, nthreadblocks, context.nthreadsPerBlock, sendbuff, recvbuff, (void*)context.scratchBuffer.get(),
-            context.scratchBufferSize, dataType, (DeviceExecutionPlan*)context.deviceExecutionPlansBuffer.get(),
-            sharedMemSize, stream, ++flag);
+        ExecutionKernel::launchKernel<LL8Packet>(rank, nthreadblocks, nthreadsPerBlock, sendbuff, recvbuff, scratch,
+                                                 scratchSize, dataType,
+                                                 (DeviceExecutionPlan*)deviceExecutionPlansBuffer, sharedMemSize,
+                                                 stream, flag, reduction);
         break;
       default:
         throw Error("Invalid packet type", ErrorCode::ExecutorError);
     }
   }
+
+  void executeGroup(int rank, const std::vector<GroupedExecution>& executions, DataType dataType, cudaStream_t stream,
+                    PacketType packetType, const Reduction& reduction) {
+    std::vector<ExecutionContextKey> keys;
+    for (const GroupedExecution& execution : executions) {
+      keys.push_back(execution.key);
+    }
+    for (;;) {
+      std::vector<std::shared_ptr<ExecutionContext>> contexts(executions.size());
+      std::vector<char> created(executions.size(), false);
+      if (this->mayExecuteUnordered()) {
+        for (size_t i = 0; i < executions.size(); i++) {
+          contexts[i] = this->contexts.find(keys[i]);
+        }
+      }
+      for (size_t i = 0; i < executions.size(); i++) {
+        if (contexts[i] != nullptr) {
+          this->counters.contextHits++;
+          continue;
+        }
+        const GroupedExecution& execution = executions[i];
+        bool contextCreated = false;
+        contexts[i] = this->setupInTurn(keys[i], [&]() {
+          return this->setupExecution(rank, execution.key.sendBuff, execution.key.recvBuff, execution.inputMessageSize,
+                                      execution.outputMessageSize, execution.offsetIn, execution.offsetOut,
+                                      execution.key.sendBuffSize, execution.key.recvBuffSize, *execution.plan, stream,
+                                      contextCreated, i);
+        });
+        created[i] = contextCreated;
+      }
+      // The keys of a group differ in their slot, so its contexts are distinct.
+      std::vector<ExecutionContext*> lockOrder;
+      for (const std::shared_ptr<ExecutionContext>& context : contexts) {
+        lockOrder.push_back(context.get());
+      }
+      std::sort(lockOrder.begin(), lockOrder.end());
+      std::vector<std::unique_lock<std::mutex>> contextLocks;
+      for (ExecutionContext* context : lockOrder) {
+        contextLocks.emplace_back(context->mutex);
+      }
+      if (std::any_of(lockOrder.begin(), lockOrder.end(), [](ExecutionContext* context) { return context->evicted; })) {
+        continue;
+      }
+      // The executions of a group share one kernel, so their plans must agree on the factor.
+      Reduction kernelReduction = getKernelReduction(*contexts[0], reduction);
+      for (size_t i = 1; i < executions.size(); i++) {
+        if (getKernelReduction(*contexts[i], reduction).scalar != kernelReduction.scalar) {
+          throw Error("AVG executions of a group need plans with the same number of ranks", ErrorCode::InvalidUsage);
+        }
+      }
+      for (size_t i = 0; i < executions.size(); i++) {
+        const GroupedExecution& execution = executions[i];
+        contexts[i]->lastUseTick = ++this->useClock;
+        std::vector<char*> buffers =
+            this->setupMessage(*contexts[i], created[i], rank, execution.inputMessageSize, execution.outputMessageSize,
+                               execution.offsetIn, execution.offsetOut, *execution.plan, stream);
+        if (buffers.size() != 1) {
+          throw Error("Execution " + std::to_string(i) + " of the group runs in tiles and cannot be grouped",
+                      ErrorCode::ExecutorError);
+        }
+      }
+      this->launchGroup(keys, contexts, executions, rank, dataType, stream, packetType, kernelReduction);
+      return;
+    }
+  }
+
+  // Launch the threadblocks of all executions of a group in one kernel. The caller holds the mutexes of the contexts.
+  void launchGroup(const std::vector<ExecutionContextKey>& keys,
+                   const std::vector<std::shared_ptr<ExecutionContext>>& contexts,
+                   const std::vector<GroupedExecution>& executions, int rank, DataType dataType, cudaStream_t stream,
+                   PacketType packetType, const Reduction& reduction) {
+    std::shared_ptr<ExecutionGroup> group;
+    {
+      std::lock_guard<std::mutex> groupsLock(this->groupsMutex);
+      std::shared_ptr<ExecutionGroup>& entry = this->groups[keys];
+      if (entry == nullptr) {
+        entry = std::make_shared<ExecutionGroup>();
+        entry->lastUse = createEvent();
+      }
+      group = entry;
+    }
+    std::vector<ScratchBuffer*> scratchBuffers;
+    for (const std::shared_ptr<ExecutionContext>& context : contexts) {
+      scratchBuffers.push_back(context->scratchBuffer.get());
+    }
+    std::sort(scratchBuffers.begin(), scratchBuffers.end());
+    scratchBuffers.erase(std::unique(scratchBuffers.begin(), scratchBuffers.end()), scratchBuffers.end());
+    std::vector<std::unique_lock<std::mutex>> scratchLocks;
+    for (ScratchBuffer* scratchBuffer : scratchBuffers) {
+      scratchLocks.emplace_back(scratchBuffer->mutex());
+    }
+    std::vector<ExecutionGroupPart> parts;
+    for (size_t i = 0; i < contexts.size(); i++) {
+      ExecutionContext& context = *contexts[i];
+      DeviceExecutionArgs args = {executions[i].sendbuff, executions[i].recvbuff, context.scratchBuffer->data(),
+                                  context.scratchBufferSize, context.scratchBuffer->nextFlag()};
+      parts.push_back({context.hostExecutionPlansBuffer.data(), context.hostExecutionPlansBuffer.size(),
+                       context.deviceExecutionPlans.size(), args});
+    }
+    this->updateGroupExecutionPlan(*group, contexts, parts, stream);
+    for (ScratchBuffer* scratchBuffer : scratchBuffers) {
+      scratchBuffer->beginUse(stream);
+    }
+    launch(rank, group->nthreadblocks, group->nthreadsPerBlock, nullptr, nullptr, nullptr, 0, dataType,
+           group->deviceExecutionPlansBuffer.get(), group->sharedMemSize, stream, packetType, 0, reduction);
+    for (ScratchBuffer* scratchBuffer : scratchBuffers) {
+      scratchBuffer->endUse(stream);
+    }
+    for (const std::shared_ptr<ExecutionContext>& context : contexts) {
+      MSCCLPP_CUDATHROW(cudaEventRecord(context->lastUse.get(), stream));
+    }
+    MSCCLPP_CUDATHROW(cudaEventRecord(group->lastUse.get(), stream));
+  }
+
+  // Merge the device plans of the contexts of a group, unless they are those it was merged from and were instantiated
+  // for the same messages, in which case only the kernel arguments are uploaded. Threadblocks run with the largest
+  // block size of the contexts. Uploads run on `stream` after the last kernel of the group.
+  void updateGroupExecutionPlan(ExecutionGroup& group, const std::vector<std::shared_ptr<ExecutionContext>>& contexts,
+                                const std::vector<ExecutionGroupPart>& parts, cudaStream_t stream) {
+    MSCCLPP_CUDATHROW(cudaStreamWaitEvent(stream, group.lastUse.get(), 0));
+    bool merged = group.contexts.size() == contexts.size();
+    for (size_t i = 0; merged && i < contexts.size(); i++) {
+      merged = group.contexts[i].lock() == contexts[i] && group.messageKeys[i] == contexts[i]->messageKey;
+    }
+    if (merged) {
+      std::vector<char>& buffer = group.hostExecutionPlansBuffer;
+      for (size_t i = 0; i < parts.size(); i++) {
+        std::memcpy(buffer.data() + group.argsOffset + i * sizeof(DeviceExecutionArgs), &parts[i].args,
+                    sizeof(DeviceExecutionArgs));
+      }
+      size_t bytes = parts.size() * sizeof(DeviceExecutionArgs);
+      memcpyCudaAsync(group.deviceExecutionPlansBuffer.get() + group.argsOffset, buffer.data() + group.argsOffset,
+                      bytes, stream, cudaMemcpyHostToDevice);
+      this->counters.planBytesUploaded += bytes;
+      this->counters.planUploadsSkipped++;
+      return;
+    }
+
+    std::vector<char> buffer = mergeDeviceExecutionPlans(parts);
+    if (group.deviceExecutionPlansBuffer == nullptr || buffer.size() != group.hostExecutionPlansBuffer.size()) {
+      group.deviceExecutionPlansBuffer = allocExtSharedCuda<char>(buffer.size());
+      memcpyCuda(group.deviceExecutionPlansBuffer.get(), buffer.data(), buffer.size(), cudaMemcpyHostToDevice);
+      this->counters.planBytesUploaded += buffer.size();
+    } else {
+      size_t firstChanged = buffer.size();
+      size_t lastChanged = 0;
+      for (size_t i = 0; i < buffer.size(); i++) {
+        if (buffer[i] != group.hostExecutionPlansBuffer[i]) {
+          firstChanged = std::min(firstChanged, i);
+          lastChanged = i;
+        }
+      }
+      if (firstChanged < buffer.size()) {
+        size_t bytes = lastChanged - firstChanged + 1;
+        memcpyCudaAsync(group.deviceExecutionPlansBuffer.get() + firstChanged, buffer.data() + firstChanged, bytes,
+                        stream, cudaMemcpyHostToDevice);
+        this->counters.planBytesUploaded += bytes;
+      }
+    }
+    this->counters.planUploads++;
+    group.hostExecutionPlansBuffer = std::move(buffer);
+    group.contexts.assign(contexts.begin(), contexts.end());
+    group.messageKeys.clear();
+    group.nthreadblocks = 0;
+    group.nthreadsPerBlock = 0;
+    group.sharedMemSize = 0;
+    for (const std::shared_ptr<ExecutionContext>& context : contexts) {
+      group.messageKeys.push_back(context->messageKey);
+      group.nthreadblocks += context->deviceExecutionPlans.size();
+      group.nthreadsPerBlock = std::max(group.nthreadsPerBlock, context->nthreadsPerBlock);
+      group.sharedMemSize = std::max(group.sharedMemSize, context->sharedMemSize);
+    }
+    DeviceExecutionPlan header;
+    std::memcpy(&header, group.hostExecutionPlansBuffer.data(), sizeof(DeviceExecutionPlan));
+    group.argsOffset = header.argsOffset;
+  }
 };
 
-Executor::Executor(std::shared_ptr<Communicator> comm) : impl_(std::make_unique<Impl>(comm)) {}
+Executor::Executor(std::shared_ptr<Communicator> comm, const ExecutorConfig& config)
+    : impl_(std::make_unique<Impl>(comm, config)) {}
 
 void Executor::execute(int rank, void* sendbuff, void* recvbuff, size_t sendBuffSize,
                        [[maybe_unused]] size_t recvBuffSize, DataType dataType, const ExecutionPlan& plan,
-                       cudaStream_t stream, PacketType packetType) {
+                       cudaStream_t stream, PacketType packetType, const Reduction& reduction) {
+  Impl::checkReduction(reduction, dataType);
   size_t sendBytes, recvBytes;
   CUdeviceptr sendBasePtr, recvBasePtr;
   MSCCLPP_CUTHROW(cuMemGetAddressRange(&sendBasePtr, &sendBytes, (CUdeviceptr)sendbuff));
@@ -350,10 +1276,112 @@ void Executor::execute(int rank, void* sendbuff, void* recvbuff, size_t sendBuff
   size_t offsetIn = (char*)sendbuff - (char*)sendBasePtr;
   size_t offsetOut = (char*)recvbuff - (char*)recvBasePtr;
 
-  ExecutionContext context =
-      this->impl_->setupExecutionContext(rank, (void*)sendBasePtr, (void*)recvBasePtr, sendBuffSize, recvBuffSize,
-                                         offsetIn, offsetOut, sendBytes, recvBytes, plan);
-  this->impl_->launchKernel(context, rank, sendbuff, recvbuff, dataType, stream, packetType);
+  this->impl_->execute(rank, sendbuff, recvbuff, (void*)sendBasePtr, (void*)recvBasePtr, sendBuffSize, recvBuffSize,
+                       offsetIn, offsetOut, sendBytes, recvBytes, dataType, plan, stream, packetType, reduction);
+}
+
+bool Executor::execute(int rank, void* sendbuff, void* recvbuff, size_t sendBuffSize, size_t recvBuffSize,
+                       DataType dataType, const PlanRegistry& registry, const CollectiveDescriptor& collective,
+                       cudaStream_t stream, PacketType packetType, const Reduction& reduction) {
+  std::shared_ptr<ExecutionPlan> plan;
+  if (collective.worldSize == 0) {
+    CollectiveDescriptor withWorldSize = collective;
+    withWorldSize.worldSize = this->impl_->nranks;
+    plan = registry.select(withWorldSize);
+  } else {
+    plan = registry.select(collective);
+  }
+  if (plan == nullptr) {
+    return false;
+  }
+  this->execute(rank, sendbuff, recvbuff, sendBuffSize, recvBuffSize, dataType, *plan, stream, packetType,
+                reduction);
+  return true;
+}
+
+std::vector<std::shared_future<void>> Executor::prepare(int rank, const std::vector<ExecutionDescriptor>& executions,
+                                                        cudaStream_t stream) {
+  int device;
+  MSCCLPP_CUDATHROW(cudaGetDevice(&device));
+  std::vector<Preparation> preparations;
+  std::vector<std::shared_future<void>> futures;
+  for (const ExecutionDescriptor& execution : executions) {
+    size_t sendBytes, recvBytes;
+    CUdeviceptr sendBasePtr, recvBasePtr;
+    MSCCLPP_CUTHROW(cuMemGetAddressRange(&sendBasePtr, &sendBytes, (CUdeviceptr)execution.sendbuff));
+    MSCCLPP_CUTHROW(cuMemGetAddressRange(&recvBasePtr, &recvBytes, (CUdeviceptr)execution.recvbuff));
+    Preparation preparation;
+    preparation.key = {(void*)sendBasePtr, (void*)recvBasePtr, sendBytes, recvBytes, execution.plan->impl_->planPath,
+                       execution.plan->impl_->version};
+    preparation.rank = rank;
+    preparation.sendBasePtr = (void*)sendBasePtr;
+    preparation.recvBasePtr = (void*)recvBasePtr;
+    preparation.inputMessageSize = execution.sendBuffSize;
+    preparation.outputMessageSize = execution.recvBuffSize;
+    preparation.offsetIn = (char*)execution.sendbuff - (char*)sendBasePtr;
+    preparation.offsetOut = (char*)execution.recvbuff - (char*)recvBasePtr;
+    preparation.plan = execution.plan;
+    preparation.stream = stream;
+    preparation.device = device;
+    futures.push_back(preparation.done.get_future().share());
+    preparations.push_back(std::move(preparation));
+  }
+  this->impl_->prepare(preparations);
+  return futures;
+}
+
+void Executor::executeGroup(int rank, const std::vector<ExecutionDescriptor>& executions, DataType dataType,
+                            cudaStream_t stream, PacketType packetType, const Reduction& reduction) {
+  if (executions.empty()) {
+    return;
+  }
+  if (executions.size() == 1) {
+    const ExecutionDescriptor& execution = executions.front();
+    this->execute(rank, execution.sendbuff, execution.recvbuff, execution.sendBuffSize, execution.recvBuffSize,
+                  dataType, *execution.plan, stream, packetType, reduction);
+    return;
+  }
+  std::vector<GroupedExecution> grouped;
+  for (size_t i = 0; i < executions.size(); i++) {
+    const ExecutionDescriptor& execution = executions[i];
+    size_t sendBytes, recvBytes;
+    CUdeviceptr sendBasePtr, recvBasePtr;
+    MSCCLPP_CUTHROW(cuMemGetAddressRange(&sendBasePtr, &sendBytes, (CUdeviceptr)execution.sendbuff));
+    MSCCLPP_CUTHROW(cuMemGetAddressRange(&recvBasePtr, &recvBytes, (CUdeviceptr)execution.recvbuff));
+    GroupedExecution groupedExecution;
+    groupedExecution.key = {(void*)sendBasePtr, (void*)recvBasePtr, sendBytes, recvBytes,
+                            execution.plan->impl_->planPath, execution.plan->impl_->version, static_cast<uint32_t>(i)};
+    groupedExecution.sendbuff = execution.sendbuff;
+    groupedExecution.recvbuff = execution.recvbuff;
+    groupedExecution.inputMessageSize = execution.sendBuffSize;
+    groupedExecution.outputMessageSize = execution.recvBuffSize;
+    groupedExecution.offsetIn = (char*)execution.sendbuff - (char*)sendBasePtr;
+    groupedExecution.offsetOut = (char*)execution.recvbuff - (char*)recvBasePtr;
+    groupedExecution.plan = execution.plan;
+    grouped.push_back(std::move(groupedExecution));
+  }
+  Impl::checkReduction(reduction, dataType);
+  this->impl_->executeGroup(rank, grouped, dataType, stream, packetType, reduction);
+}
+
+ExecutionFootprint Executor::explain(int rank, size_t sendBuffSize, size_t recvBuffSize, const ExecutionPlan& plan,
+                                    int nRanksPerNode, const ExecutorConfig& config) {
+  return Impl::explain(rank, sendBuffSize, recvBuffSize, plan, nRanksPerNode, config);
+}
+
+ExecutorStats Executor::stats() const {
+  const ExecutorCounters& counters = this->impl_->counters;
+  ExecutorStats stats;
+  stats.planUploads = counters.planUploads;
+  stats.planUploadsSkipped = counters.planUploadsSkipped;
+  stats.planBytesUploaded = counters.planBytesUploaded;
+  stats.contextHits = counters.contextHits;
+  stats.contextMisses = counters.contextMisses;
+  stats.contextEvictions = counters.contextEvictions;
+  std::lock_guard<std::mutex> lock(this->impl_->setupMutex);
+  stats.scratchBytesReserved = this->impl_->scratchArena.bytesReserved();
+  stats.scratchBytesInUse = this->impl_->scratchArena.bytesInUse();
+  return stats;
 }
 
 Executor::~Executor() = default;
@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "operation_encoding.hpp"
+
+#include <mscclpp/errors.hpp>
+
+namespace {
+void encodeVarint(uint32_t value, std::vector<uint8_t>& data) {
+  while (value >= 0x80) {
+    data.push_back(uint8_t(value) | 0x80);
+    value >>= 7;
+  }
+  data.push_back(uint8_t(value));
+}
+}  // namespace
+
+namespace mscclpp {
+
+static_assert(static_cast<int>(OperationType::READ_REDUCE_COPY_SEND) < 32, "Operation types must fit in 5 bits");
+static_assert(static_cast<int>(BufferType::SCRATCH) < 4 && static_cast<int>(ChannelType::PROXY) < 4,
+              "Buffer and channel types must fit in 2 bits");
+static_assert(MAX_CHANNEL_PER_OPERATION < 16, "Channel counts must fit in 4 bits");
+
+size_t encodeOperation(const Operation& op, std::vector<uint8_t>& data) {
+  size_t begin = data.size();
+  uint8_t tag = static_cast<uint8_t>(op.type);
+  if (op.srcOffset != 0) tag |= ENCODED_SRC_OFFSET;
+  if (op.dstOffset != 0) tag |= ENCODED_DST_OFFSET;
+  if (op.size != 0) tag |= ENCODED_SIZE;
+  data.push_back(tag);
+  data.push_back(static_cast<uint8_t>(op.channelType) | static_cast<uint8_t>(op.srcBufferType) << 2 |
+                 static_cast<uint8_t>(op.dstBufferType) << 4 | (op.finalReduce ? 1 : 0) << 6);
+  data.push_back(op.nInputs | op.nOutputs << 4);
+  data.insert(data.end(), op.inputChannelIndexes, op.inputChannelIndexes + op.nInputs);
+  data.insert(data.end(), op.outputChannelIndexes, op.outputChannelIndexes + op.nOutputs);
+  for (int i = 0; i < op.nInputs; i++) encodeVarint(op.inputOffsets[i], data);
+  for (int i = 0; i < op.nOutputs; i++) encodeVarint(op.outputOffsets[i], data);
+  if (op.srcOffset != 0) encodeVarint(op.srcOffset, data);
+  if (op.dstOffset != 0) encodeVarint(op.dstOffset, data);
+  if (op.size != 0) encodeVarint(op.size, data);
+  return data.size() - begin;
+}
+
+std::vector<uint8_t> encodeOperations(const std::vector<Operation>& ops) {
+  std::vector<uint8_t> data;
+  data.reserve(ops.size() * 16);
+  for (const Operation& op : ops) {
+    encodeOperation(op, data);
+  }
+  return data;
+}
+
+std::vector<Operation> decodeOperations(const std::vector<uint8_t>& data, size_t nOperations) {
+  // Pad with zeros so that decoding a truncated operation stops past the end instead of reading out of bounds.
+  std::vector<uint8_t> padded(data);
+  padded.resize(data.size() + MAX_ENCODED_OPERATION_SIZE, 0);
+  std::vector<Operation> ops(nOperations);
+  size_t position = 0;
+  for (Operation& op : ops) {
+    position += decodeOperation(padded.data() + position, op);
+    if (position > data.size()) {
+      throw Error("Truncated encoded operations", ErrorCode::ExecutorError);
+    }
+  }
+  if (position != data.size()) {
+    throw Error("Trailing bytes after encoded operations", ErrorCode::ExecutorError);
+  }
+  return ops;
+}
+
+size_t maxEncodedOperationSize(const Operation& op) {
+  return 3 + (op.nInputs + op.nOutputs) * (1 + MAX_VARINT_SIZE) + 3 * MAX_VARINT_SIZE;
+}
+
+}  // namespace mscclpp
@@ -0,0 +1,994 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mscclpp/errors.hpp>
+#include <mscclpp/executor.hpp>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <tuple>
+
+#include "execution_plan.hpp"
+
+namespace {
+using json = nlohmann::json;
+using namespace mscclpp;
+
+std::string getAlgorithmName(PlanAlgorithm algorithm) {
+  switch (algorithm) {
+    case PlanAlgorithm::RingAllReduce:
+      return "ring_allreduce";
+    case PlanAlgorithm::DoubleBinaryTreeAllReduce:
+      return "double_binary_tree_allreduce";
+    case PlanAlgorithm::HalvingDoublingAllReduce:
+      return "halving_doubling_allreduce";
+    case PlanAlgorithm::HierarchicalAllReduce:
+      return "hierarchical_allreduce";
+    case PlanAlgorithm::RingAllGather:
+      return "ring_allgather";
+    case PlanAlgorithm::BruckAllGather:
+      return "bruck_allgather";
+    case PlanAlgorithm::HierarchicalAllGather:
+      return "hierarchical_allgather";
+    case PlanAlgorithm::PairwiseAllToAll:
+      return "pairwise_alltoall";
+  }
+  throw Error("Unknown plan algorithm", ErrorCode::InvalidUsage);
+}
+
+std::string getBufferKey(BufferType type) {
+  switch (type) {
+    case BufferType::INPUT:
+      return "i";
+    case BufferType::OUTPUT:
+      return "o";
+    case BufferType::SCRATCH:
+      return "s";
+    default:
+      throw Error("Unexpected buffer type", ErrorCode::InternalError);
+  }
+}
+
+std::string getChannelTypeKey(ChannelType type) {
+  switch (type) {
+    case ChannelType::SM:
+      return "sm";
+    case ChannelType::PROXY:
+      return "proxy";
+    default:
+      return "none";
+  }
+}
+
+// `count` consecutive chunks starting at chunk `index` of a buffer.
+struct Chunks {
+  BufferType buffer;
+  int index = 0;
+  int count = 0;
+};
+
+// Data of a block in the order it is sent, as runs of consecutive chunks.
+using Block = std::vector<Chunks>;
+
+bool overlaps(const Chunks& a, const Chunks& b) {
+  return a.buffer == b.buffer && a.index < b.index + b.count && b.index < a.index + a.count;
+}
+
+// Emits the operations of every rank from point-to-point transfers between threadblocks. Transfers go through
+// `send`, `signal` and `receive`, which pick the channels, the scratch slots of the protocol and the operations
+// implementing them; barriers are inserted where a threadblock needs one. Calls must follow an order in which every
+// `receive` comes after the `signal` it consumes.
+//
+// The builder counts the inputs of the ranks every chunk holds a reduction of. The reduce that brings a chunk to all
+// ranks is marked final, which is where AVG and PREMUL_SUM multiply by their factor.
+class PlanBuilder {
+ public:
+  PlanBuilder(int worldSize, int nRanksPerNode, bool isLL) : nRanksPerNode_(nRanksPerNode), isLL_(isLL) {
+    this->ranks_.resize(worldSize);
+  }
+
+  int addThreadblock(int rank) {
+    this->ranks_[rank].threadblocks.emplace_back();
+    return this->ranks_[rank].threadblocks.size() - 1;
+  }
+
+  // Send `src` of `rank` to `dst` of `peer`, or add it to `dst` if `reduce`. The data is applied to `dst` by the next
+  // `receive` of threadblock `peerTb` from `tb` of `rank` after the next `signal`.
+  void send(int rank, int tb, int peer, int peerTb, Chunks src, Chunks dst, bool reduce) {
+    Flow& flow = this->flows_[{rank, tb, peer, peerTb}];
+    ChannelType channelType = this->getChannelType(rank, peer);
+    Delivery delivery{dst, -1, reduce, this->getContributions(rank, src)};
+    if (this->isLL_) {
+      delivery.slot = this->allocateScratch(peer, dst.count);
+      Chunks source = src;
+      if (channelType == ChannelType::PROXY) {
+        // Proxy channels copy bytes as they are, so the packets are formed in local scratch first.
+        source = {BufferType::SCRATCH, this->allocateScratch(rank, src.count), src.count};
+        this->append(rank, tb, makeOp("tpkt", {}, source, src));
+      }
+      int channel = this->getChannel(rank, tb, peer, peerTb, source.buffer, BufferType::SCRATCH);
+      Op op = makeOp("ppkt", {source}, {BufferType::NONE, 0, src.count});
+      op.channel = channel;
+      op.channelChunk = delivery.slot;
+      this->append(rank, tb, op);
+    } else {
+      Chunks target = dst;
+      if (reduce) {
+        delivery.slot = this->allocateScratch(peer, dst.count);
+        target = {BufferType::SCRATCH, delivery.slot, dst.count};
+      }
+      int pair;
+      int channel = this->getChannel(rank, tb, peer, peerTb, src.buffer, target.buffer, &pair);
+      if (flow.handshaked.insert(pair).second) {
+        // The receiver signals when it starts, so that this execution does not overwrite the destination while the
+        // previous execution of the plan may still read it.
+        this->ranks_[peer].threadblocks[peerTb].handshakeSignals.push_back(
+            this->pairs_[pair].channels[peer < rank ? 0 : 1]);
+        this->ranks_[rank].threadblocks[tb].handshakeWaits.push_back(channel);
+      }
+      Op op = makeOp("put", {src}, {BufferType::NONE, 0, src.count});
+      op.channel = channel;
+      op.channelChunk = target.index;
+      this->append(rank, tb, op);
+      if (std::find(flow.pending.pairs.begin(), flow.pending.pairs.end(), pair) == flow.pending.pairs.end()) {
+        flow.pending.pairs.push_back(pair);
+      }
+    }
+    flow.pending.deliveries.push_back(delivery);
+  }
+
+  void signal(int rank, int tb, int peer, int peerTb) {
+    Flow& flow = this->flows_[{rank, tb, peer, peerTb}];
+    for (int pair : flow.pending.pairs) {
+      int channel = this->pairs_[pair].channels[rank < peer ? 0 : 1];
+      std::vector<Op>& ops = this->ranks_[rank].threadblocks[tb].ops;
+      if (this->getChannelType(rank, peer) == ChannelType::SM) {
+        this->append(rank, tb, makeChannelOp("signal", channel));
+      } else if (!ops.empty() && ops.back().name == "put" && ops.back().channel == channel) {
+        ops.back().name = "pwsf";
+        this->ranks_[rank].threadblocks[tb].needsBarrier = true;
+      } else {
+        this->append(rank, tb, makeChannelOp("signal", channel));
+        this->append(rank, tb, makeChannelOp("flush", channel));
+      }
+    }
+    flow.signaled.push_back(std::move(flow.pending));
+    flow.pending = {};
+  }
+
+  void receive(int rank, int tb, int peer, int peerTb) {
+    Flow& flow = this->flows_[{peer, peerTb, rank, tb}];
+    if (flow.signaled.empty()) {
+      throw Error("Plan generator received without a matching signal", ErrorCode::InternalError);
+    }
+    Message message = std::move(flow.signaled.front());
+    flow.signaled.erase(flow.signaled.begin());
+    for (int pair : message.pairs) {
+      this->append(rank, tb, makeChannelOp("wait", this->pairs_[pair].channels[rank < peer ? 0 : 1]));
+    }
+    for (const Delivery& delivery : message.deliveries) {
+      Chunks scratch{BufferType::SCRATCH, delivery.slot, delivery.dst.count};
+      bool final = this->addContributions(rank, delivery.dst, delivery.contributions, delivery.reduce);
+      Op op;
+      if (this->isLL_) {
+        op = delivery.reduce ? makeOp("rpkt", {scratch}, delivery.dst, delivery.dst)
+                             : makeOp("cpkt", {}, delivery.dst, scratch);
+      } else if (delivery.reduce) {
+        op = makeOp("re", {scratch}, delivery.dst, delivery.dst);
+      } else {
+        continue;
+      }
+      op.final = final;
+      this->append(rank, tb, op);
+    }
+  }
+
+  void copy(int rank, int tb, Chunks src, Chunks dst) {
+    this->addContributions(rank, dst, this->getContributions(rank, src), false);
+    this->append(rank, tb, makeOp("copy", {}, dst, src));
+  }
+
+  json build(int nInputChunks, int nOutputChunks) const {
+    json gpus = json::array();
+    for (int rank = 0; rank < int(this->ranks_.size()); rank++) {
+      const Rank& rankState = this->ranks_[rank];
+      // Channels in creation order, adjacent ones with the same buffers and type grouped; `cids` index into the
+      // channels with the same key across groups.
+      json channels = json::array();
+      std::map<int, int> channelIndexes;
+      std::map<std::tuple<BufferType, BufferType, ChannelType>, int> keyCounts;
+      std::tuple<BufferType, BufferType, ChannelType> lastKey{BufferType::NONE, BufferType::NONE, ChannelType::NONE};
+      for (int channel = 0; channel < int(this->channels_.size()); channel++) {
+        const Channel& info = this->channels_[channel];
+        if (info.rank != rank) continue;
+        auto key = this->getChannelKey(channel);
+        if (channels.empty() || key != lastKey) {
+          channels.push_back({{"srcbuff", getBufferKey(std::get<0>(key))},
+                              {"dstbuff", getBufferKey(std::get<1>(key))},
+                              {"type", getChannelTypeKey(std::get<2>(key))},
+                              {"connectedTo", json::array()}});
+          lastKey = key;
+        }
+        channels.back()["connectedTo"].push_back(info.peer);
+        channelIndexes[channel] = keyCounts[key]++;
+      }
+
+      json threadblocks = json::array();
+      for (int tb = 0; tb < int(rankState.threadblocks.size()); tb++) {
+        const Threadblock& threadblock = rankState.threadblocks[tb];
+        std::vector<Op> ops;
+        for (int channel : threadblock.handshakeSignals) {
+          ops.push_back(makeChannelOp("signal", channel));
+        }
+        for (int channel : threadblock.handshakeWaits) {
+          ops.push_back(makeChannelOp("wait", channel));
+        }
+        if (!threadblock.handshakeWaits.empty()) {
+          ops.push_back(makeOp("nop", {}, {BufferType::NONE}));
+        }
+        ops.insert(ops.end(), threadblock.ops.begin(), threadblock.ops.end());
+
+        std::map<std::tuple<BufferType, BufferType, ChannelType>, std::vector<int>> tbChannels;
+        auto getLocalIndex = [&](int channel) {
+          std::vector<int>& list = tbChannels[this->getChannelKey(channel)];
+          auto it = std::find(list.begin(), list.end(), channel);
+          if (it != list.end()) return int(it - list.begin());
+          list.push_back(channel);
+          return int(list.size()) - 1;
+        };
+        json opsJson = json::array();
+        for (const Op& op : ops) {
+          json opJson = {{"name", op.name}, {"ctype", "none"}};
+          if (op.channel >= 0) {
+            auto key = this->getChannelKey(op.channel);
+            bool isInput = op.name == "wait";
+            opJson[isInput ? "i_buff" : "o_buff"] = {{"src", getBufferKey(std::get<0>(key))},
+                                                     {"dst", getBufferKey(std::get<1>(key))}};
+            opJson[isInput ? "i_cids" : "o_cids"] = {{{"id", getLocalIndex(op.channel)}, {"off", op.channelChunk}}};
+            opJson["ctype"] = getChannelTypeKey(std::get<2>(key));
+          }
+          if (!op.srcs.empty()) {
+            opJson["srcs"] = json::array();
+            for (const Chunks& src : op.srcs) {
+              opJson["srcs"].push_back({{"buff", getBufferKey(src.buffer)}, {"off", src.index}});
+            }
+          }
+          if (op.src.buffer != BufferType::NONE) {
+            opJson["srcbuff"] = getBufferKey(op.src.buffer);
+            opJson["srcoff"] = op.src.index;
+          }
+          if (op.dst.buffer != BufferType::NONE) {
+            opJson["dstbuff"] = getBufferKey(op.dst.buffer);
+            opJson["dstoff"] = op.dst.index;
+          }
+          if (op.dst.count > 0) {
+            opJson["cnt"] = op.dst.count;
+          }
+          if (op.final) {
+            opJson["final"] = true;
+          }
+          opsJson.push_back(std::move(opJson));
+        }
+
+        json tbChannelsJson = json::array();
+        for (const auto& [key, list] : tbChannels) {
+          if (int(list.size()) > MAX_CHANNEL) {
+            throw Error("Generated plan needs more than " + std::to_string(MAX_CHANNEL) + " channels per threadblock",
+                        ErrorCode::InvalidUsage);
+          }
+          json cids = json::array();
+          for (int channel : list) cids.push_back(channelIndexes.at(channel));
+          tbChannelsJson.push_back({{"src", getBufferKey(std::get<0>(key))},
+                                    {"dst", getBufferKey(std::get<1>(key))},
+                                    {"ctype", getChannelTypeKey(std::get<2>(key))},
+                                    {"cids", std::move(cids)}});
+        }
+        threadblocks.push_back({{"id", tb}, {"ops", std::move(opsJson)}, {"channels", std::move(tbChannelsJson)}});
+      }
+
+      gpus.push_back({{"id", rank},
+                      {"inputChunks", nInputChunks},
+                      {"outputChunks", nOutputChunks},
+                      {"scratchChunks", rankState.scratchChunks},
+                      {"chunkGroups", 1},
+                      {"channels", std::move(channels)},
+                      {"threadblocks", std::move(threadblocks)}});
+    }
+    return gpus;
+  }
+
+ private:
+  // An operation before it is resolved to the JSON format. `dst.count` is the number of chunks the operation moves.
+  struct Op {
+    std::string name;
+    std::vector<Chunks> srcs;
+    Chunks dst{BufferType::NONE, 0, 0};
+    Chunks src{BufferType::NONE, 0, 0};
+    // Index in `channels_`, -1 for local operations
+    int channel = -1;
+    // Chunk of the remote buffer of `channel` the operation writes to
+    int channelChunk = 0;
+    // The reduce completes `dst`, see PlanBuilder
+    bool final = false;
+  };
+
+  struct Threadblock {
+    std::vector<Op> ops;
+    // Channels to signal and then wait on at the start of the threadblock, see `send`. The handshakes come before all
+    // other signals and waits, so that they never pair with a signal or wait of the data on the same semaphore.
+    std::vector<int> handshakeSignals;
+    std::vector<int> handshakeWaits;
+    // Local chunks read and written by all threads since the last barrier
+    std::vector<Chunks> reads;
+    std::vector<Chunks> writes;
+    // The next operation using all threads needs a barrier: a wait acquired data or a flush released a source.
+    bool needsBarrier = false;
+    // An operation using all threads ran since the last barrier.
+    bool dirty = false;
+  };
+
+  struct Rank {
+    std::vector<Threadblock> threadblocks;
+    int scratchChunks = 0;
+  };
+
+  struct Channel {
+    int rank;
+    int peer;
+    ChannelType channelType;
+    // NONE until an operation on this side uses the channel
+    BufferType srcBufferType = BufferType::NONE;
+    BufferType dstBufferType = BufferType::NONE;
+  };
+
+  // Channels at both ends between two threadblocks that share semaphores. `channels[0]` is on the lower rank.
+  struct Pair {
+    int channels[2];
+  };
+
+  struct Delivery {
+    Chunks dst;
+    // Scratch chunk of the receiver the data is staged in, -1 if it is written to `dst` directly
+    int slot;
+    bool reduce;
+    // Number of inputs reduced in each chunk of the data when it was sent
+    std::vector<int> contributions;
+  };
+
+  struct Message {
+    std::vector<int> pairs;
+    std::vector<Delivery> deliveries;
+  };
+
+  // Transfers from one threadblock to a threadblock of another rank.
+  struct Flow {
+    Message pending;
+    std::vector<Message> signaled;
+    // Pairs the handshake was emitted for
+    std::set<int> handshaked;
+  };
+
+  static Op makeOp(const std::string& name, std::vector<Chunks> srcs, Chunks dst, Chunks src = {BufferType::NONE}) {
+    Op op;
+    op.name = name;
+    op.srcs = std::move(srcs);
+    op.dst = dst;
+    op.src = src;
+    if (op.dst.buffer == BufferType::NONE && op.dst.count == 0 && !op.srcs.empty()) {
+      op.dst.count = op.srcs.front().count;
+    }
+    return op;
+  }
+
+  static Op makeChannelOp(const std::string& name, int channel) {
+    Op op;
+    op.name = name;
+    op.channel = channel;
+    return op;
+  }
+
+  ChannelType getChannelType(int rank, int peer) const {
+    return rank / this->nRanksPerNode_ == peer / this->nRanksPerNode_ ? ChannelType::SM : ChannelType::PROXY;
+  }
+
+  std::tuple<BufferType, BufferType, ChannelType> getChannelKey(int channel) const {
+    const Channel& info = this->channels_[channel];
+    // A side that never sends keeps the default buffers, its channel only carries the semaphore.
+    if (info.srcBufferType == BufferType::NONE) {
+      return {BufferType::INPUT, BufferType::INPUT, info.channelType};
+    }
+    return {info.srcBufferType, info.dstBufferType, info.channelType};
+  }
+
+  int allocateScratch(int rank, int count) {
+    int slot = this->ranks_[rank].scratchChunks;
+    this->ranks_[rank].scratchChunks += count;
+    return slot;
+  }
+
+  // Channel of `rank` to `peer` with the given buffers, between threadblocks `tb` and `peerTb`. Reuses a pair whose
+  // side on `rank` has the same buffers or is unused before creating one.
+  int getChannel(int rank, int tb, int peer, int peerTb, BufferType src, BufferType dst, int* pairIndex = nullptr) {
+    bool isLower = rank < peer;
+    auto key = isLower ? std::make_tuple(rank, tb, peer, peerTb) : std::make_tuple(peer, peerTb, rank, tb);
+    std::vector<int>& pairs = this->pairsByThreadblocks_[key];
+    int side = isLower ? 0 : 1;
+    int selected = -1;
+    for (int pair : pairs) {
+      const Channel& channel = this->channels_[this->pairs_[pair].channels[side]];
+      if (channel.srcBufferType == src && channel.dstBufferType == dst) {
+        selected = pair;
+        break;
+      }
+    }
+    for (int i = 0; selected < 0 && i < int(pairs.size()); i++) {
+      if (this->channels_[this->pairs_[pairs[i]].channels[side]].srcBufferType == BufferType::NONE) {
+        selected = pairs[i];
+      }
+    }
+    if (selected < 0) {
+      ChannelType channelType = this->getChannelType(rank, peer);
+      int lower = this->channels_.size();
+      this->channels_.push_back({std::min(rank, peer), std::max(rank, peer), channelType});
+      this->channels_.push_back({std::max(rank, peer), std::min(rank, peer), channelType});
+      selected = this->pairs_.size();
+      this->pairs_.push_back({{lower, lower + 1}});
+      pairs.push_back(selected);
+    }
+    int channel = this->pairs_[selected].channels[side];
+    this->channels_[channel].srcBufferType = src;
+    this->channels_[channel].dstBufferType = dst;
+    if (pairIndex != nullptr) *pairIndex = selected;
+    return channel;
+  }
+
+  // Number of inputs reduced in each chunk of `chunks` of `rank`. Every input chunk starts with its own.
+  std::vector<int> getContributions(int rank, const Chunks& chunks) const {
+    std::vector<int> contributions;
+    for (int i = 0; i < chunks.count; i++) {
+      auto it = this->contributions_.find({rank, chunks.buffer, chunks.index + i});
+      contributions.push_back(it != this->contributions_.end() ? it->second : chunks.buffer == BufferType::INPUT);
+    }
+    return contributions;
+  }
+
+  // Set the contributions of `dst` of `rank`, or add them if `reduce`. Returns whether the reduce completes `dst`.
+  bool addContributions(int rank, const Chunks& dst, const std::vector<int>& contributions, bool reduce) {
+    std::vector<int> current = this->getContributions(rank, dst);
+    int nComplete = 0;
+    for (int i = 0; i < dst.count; i++) {
+      int count = reduce ? current[i] + contributions[i] : contributions[i];
+      this->contributions_[{rank, dst.buffer, dst.index + i}] = count;
+      nComplete += count == int(this->ranks_.size());
+    }
+    if (!reduce) {
+      return false;
+    }
+    if (nComplete > 0 && nComplete < dst.count) {
+      throw Error("Plan generator reduce completes only part of its chunks", ErrorCode::InternalError);
+    }
+    return nComplete > 0;
+  }
+
+  // Append `op`, preceded by a barrier if it depends on the threads of an earlier operation.
+  void append(int rank, int tb, const Op& op) {
+    Threadblock& threadblock = this->ranks_[rank].threadblocks[tb];
+    bool isChannelOnly = op.name == "signal" || op.name == "wait" || op.name == "flush";
+    bool isProxy = op.channel >= 0 && std::get<2>(this->getChannelKey(op.channel)) == ChannelType::PROXY;
+    std::vector<Chunks> reads = op.srcs;
+    std::vector<Chunks> writes;
+    if (op.src.buffer != BufferType::NONE) reads.push_back(op.src);
+    if (op.dst.buffer != BufferType::NONE) writes.push_back(op.dst);
+
+    bool needsBarrier = false;
+    if (op.name == "signal") {
+      needsBarrier = threadblock.dirty;
+    } else if (!isChannelOnly) {
+      needsBarrier = threadblock.needsBarrier;
+      for (const Chunks& read : reads) {
+        for (const Chunks& write : threadblock.writes) needsBarrier |= overlaps(read, write);
+      }
+      for (const Chunks& write : writes) {
+        for (const Chunks& read : threadblock.reads) needsBarrier |= overlaps(write, read);
+        for (const Chunks& other : threadblock.writes) needsBarrier |= overlaps(write, other);
+      }
+    }
+    if (needsBarrier) {
+      threadblock.ops.push_back(makeOp("nop", {}, {BufferType::NONE}));
+      threadblock.reads.clear();
+      threadblock.writes.clear();
+      threadblock.needsBarrier = false;
+      threadblock.dirty = false;
+    }
+
+    threadblock.ops.push_back(op);
+    if (op.name == "wait" || op.name == "flush") {
+      threadblock.needsBarrier = true;
+    } else if (!isChannelOnly && !isProxy) {
+      threadblock.reads.insert(threadblock.reads.end(), reads.begin(), reads.end());
+      threadblock.writes.insert(threadblock.writes.end(), writes.begin(), writes.end());
+      threadblock.dirty = true;
+    }
+  }
+
+  int nRanksPerNode_;
+  bool isLL_;
+  std::vector<Rank> ranks_;
+  std::vector<Channel> channels_;
+  std::vector<Pair> pairs_;
+  std::map<std::tuple<int, int, int, int>, std::vector<int>> pairsByThreadblocks_;
+  std::map<std::tuple<int, int, int, int>, Flow> flows_;
+  // contributions_[{rank, buffer, chunk}], see getContributions
+  std::map<std::tuple<int, BufferType, int>, int> contributions_;
+};
+
+// Ring over `members`, using threadblock `tbs[i]` on `members[i]`. Blocks are numbered by the member owning them.
+class Ring {
+ public:
+  Ring(PlanBuilder& builder, std::vector<int> members, std::vector<int> tbs)
+      : builder_(builder), members_(std::move(members)), tbs_(std::move(tbs)) {}
+
+  // Afterwards member j holds the sum of block j over all members. Member j sends block j - s - 1 to member j + 1 in
+  // step s, which adds it to its own copy.
+  void reduceScatter(const std::function<Block(int)>& block) {
+    int size = this->members_.size();
+    for (int step = 0; step < size - 1; step++) {
+      for (int j = 0; j < size; j++) {
+        this->transfer(j, block((j - step - 1 + size) % size), block((j - step - 1 + size) % size), true);
+      }
+      this->receiveAll();
+    }
+  }
+
+  // Afterwards every member holds block j of member j. `source(j)` is where member j reads its own block from, with
+  // the same shape as `block(j)`.
+  void allGather(const std::function<Block(int)>& block, const std::function<Block(int)>& source) {
+    int size = this->members_.size();
+    for (int step = 0; step < size - 1; step++) {
+      for (int j = 0; j < size; j++) {
+        int index = (j - step + size) % size;
+        this->transfer(j, step == 0 ? source(j) : block(index), block(index), false);
+      }
+      this->receiveAll();
+    }
+  }
+
+ private:
+  void transfer(int j, const Block& src, const Block& dst, bool reduce) {
+    int next = (j + 1) % this->members_.size();
+    for (size_t i = 0; i < src.size(); i++) {
+      this->builder_.send(this->members_[j], this->tbs_[j], this->members_[next], this->tbs_[next], src[i], dst[i],
+                          reduce);
+    }
+    this->builder_.signal(this->members_[j], this->tbs_[j], this->members_[next], this->tbs_[next]);
+  }
+
+  void receiveAll() {
+    int size = this->members_.size();
+    for (int j = 0; j < size; j++) {
+      int prev = (j - 1 + size) % size;
+      this->builder_.receive(this->members_[j], this->tbs_[j], this->members_[prev], this->tbs_[prev]);
+    }
+  }
+
+  PlanBuilder& builder_;
+  std::vector<int> members_;
+  std::vector<int> tbs_;
+};
+
+struct Layout {
+  std::string collective;
+  int nInputChunks;
+  int nOutputChunks;
+};
+
+// Copy the input to the output first for an out-of-place allreduce, and run the algorithm on the buffer returned.
+BufferType prepareAllReduce(PlanBuilder& builder, const PlanGeneratorConfig& config, int nChunks,
+                            const std::vector<int>& tbs) {
+  if (config.inPlace) return BufferType::INPUT;
+  int perThreadblock = nChunks / tbs.size();
+  for (int rank = 0; rank < config.worldSize; rank++) {
+    for (size_t i = 0; i < tbs.size(); i++) {
+      int first = i * perThreadblock;
+      builder.copy(rank, tbs[i], {BufferType::INPUT, first, perThreadblock},
+                   {BufferType::OUTPUT, first, perThreadblock});
+    }
+  }
+  return BufferType::OUTPUT;
+}
+
+std::vector<int> addThreadblocks(PlanBuilder& builder, int worldSize, int count) {
+  std::vector<int> tbs(count);
+  for (int rank = 0; rank < worldSize; rank++) {
+    for (int i = 0; i < count; i++) tbs[i] = builder.addThreadblock(rank);
+  }
+  return tbs;
+}
+
+std::vector<int> range(int begin, int end, int stride = 1) {
+  std::vector<int> values;
+  for (int value = begin; value < end; value += stride) values.push_back(value);
+  return values;
+}
+
+// Chunk c * n + b is block b of ring c; each ring runs on its own threadblock.
+Layout generateRingAllReduce(PlanBuilder& builder, const PlanGeneratorConfig& config) {
+  int n = config.worldSize;
+  std::vector<int> tbs = addThreadblocks(builder, n, config.nChunks);
+  BufferType buffer = prepareAllReduce(builder, config, n * config.nChunks, tbs);
+  for (int c = 0; c < config.nChunks; c++) {
+    Ring ring(builder, range(0, n), std::vector<int>(n, tbs[c]));
+    auto block = [&](int b) { return Block{{buffer, c * n + b, 1}}; };
+    ring.reduceScatter(block);
+    ring.allGather(block, block);
+  }
+  return {"allreduce", n * config.nChunks, config.inPlace ? 0 : n * config.nChunks};
+}
+
+// Parent and children of `rank` in the binary tree of ncclGetBtree: the lowest set bit of a rank gives its level,
+// rank 0 is the root and ranks missing from a complete tree are skipped.
+void getBinaryTree(int n, int rank, int& parent, std::vector<int>& children) {
+  children.clear();
+  parent = -1;
+  int bit = 1;
+  while (bit < n) bit <<= 1;
+  if (rank == 0) {
+    if (n > 1) children.push_back(bit >> 1);
+    return;
+  }
+  bit = rank & -rank;
+  int up = (rank ^ bit) | (bit << 1);
+  parent = up < n ? up : rank ^ bit;
+  int lowBit = bit >> 1;
+  if (lowBit == 0) return;
+  children.push_back(rank - lowBit);
+  int down = rank + lowBit;
+  while (down >= n) {
+    lowBit >>= 1;
+    if (lowBit == 0) return;
+    down = rank + lowBit;
+  }
+  children.push_back(down);
+}
+
+// Two trees in which most ranks are a leaf in one and an inner node in the other, see ncclGetDtree: the second tree
+// mirrors the first for an odd number of ranks and shifts it by one for an even number. Each tree reduces and
+// broadcasts half of the data, chunk t * nChunks + c being chunk c of tree t, pipelined through the tree.
+Layout generateDoubleBinaryTreeAllReduce(PlanBuilder& builder, const PlanGeneratorConfig& config) {
+  int n = config.worldSize;
+  int nChunks = config.nChunks;
+  std::vector<int> tbs = addThreadblocks(builder, n, 2);
+  BufferType buffer = prepareAllReduce(builder, config, 2 * nChunks, tbs);
+  for (int t = 0; t < 2; t++) {
+    auto toTree = [&](int rank) { return t == 0 ? rank : (n % 2 == 1 ? n - 1 - rank : (rank - 1 + n) % n); };
+    auto fromTree = [&](int node) { return t == 0 ? node : (n % 2 == 1 ? n - 1 - node : (node + 1) % n); };
+    std::vector<int> parents(n), depths(n, 0);
+    std::vector<std::vector<int>> children(n);
+    for (int rank = 0; rank < n; rank++) {
+      int parent;
+      std::vector<int> nodeChildren;
+      getBinaryTree(n, toTree(rank), parent, nodeChildren);
+      parents[rank] = parent < 0 ? -1 : fromTree(parent);
+      for (int child : nodeChildren) children[rank].push_back(fromTree(child));
+    }
+    for (int rank = 0; rank < n; rank++) {
+      for (int node = parents[rank]; node >= 0; node = parents[node]) depths[rank]++;
+    }
+    std::vector<int> order = range(0, n);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return depths[a] > depths[b]; });
+
+    int tb = tbs[t];
+    for (int c = 0; c < nChunks; c++) {
+      Chunks chunk{buffer, t * nChunks + c, 1};
+      for (int rank : order) {
+        for (int child : children[rank]) builder.receive(rank, tb, child, tb);
+        if (parents[rank] >= 0) {
+          builder.send(rank, tb, parents[rank], tb, chunk, chunk, true);
+          builder.signal(rank, tb, parents[rank], tb);
+        }
+      }
+    }
+    for (int c = 0; c < nChunks; c++) {
+      Chunks chunk{buffer, t * nChunks + c, 1};
+      for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        int rank = *it;
+        if (parents[rank] >= 0) builder.receive(rank, tb, parents[rank], tb);
+        for (int child : children[rank]) {
+          builder.send(rank, tb, child, tb, chunk, chunk, false);
+          builder.signal(rank, tb, child, tb);
+        }
+      }
+    }
+  }
+  return {"allreduce", 2 * nChunks, config.inPlace ? 0 : 2 * nChunks};
+}
+
+// Rabenseifner's algorithm on the largest power of two p of ranks: recursive vector halving reduce-scatter and
+// recursive doubling allgather over p blocks. The first 2 * (n - p) ranks fold pairwise into the odd rank of the pair
+// before and get the result from it after. Chunk c * p + b is block b of instance c, one threadblock per instance.
+Layout generateHalvingDoublingAllReduce(PlanBuilder& builder, const PlanGeneratorConfig& config) {
+  int n = config.worldSize;
+  int p = 1;
+  while (p * 2 <= n) p *= 2;
+  int extra = n - p;
+  auto toRank = [&](int v) { return v < extra ? 2 * v + 1 : v + extra; };
+  std::vector<int> tbs = addThreadblocks(builder, n, config.nChunks);
+  BufferType buffer = prepareAllReduce(builder, config, p * config.nChunks, tbs);
+  for (int c = 0; c < config.nChunks; c++) {
+    int tb = tbs[c];
+    Chunks all{buffer, c * p, p};
+    for (int rank = 0; rank < 2 * extra; rank += 2) {
+      builder.send(rank, tb, rank + 1, tb, all, all, true);
+      builder.signal(rank, tb, rank + 1, tb);
+      builder.receive(rank + 1, tb, rank, tb);
+    }
+
+    std::vector<int> lo(p, 0), hi(p, p);
+    for (int mask = p / 2; mask > 0; mask /= 2) {
+      std::vector<int> newLo(lo), newHi(hi);
+      for (int v = 0; v < p; v++) {
+        int middle = (lo[v] + hi[v]) / 2;
+        bool keepLower = (v & mask) == 0;
+        Chunks sent = keepLower ? Chunks{buffer, c * p + middle, hi[v] - middle}
+                                : Chunks{buffer, c * p + lo[v], middle - lo[v]};
+        builder.send(toRank(v), tb, toRank(v ^ mask), tb, sent, sent, true);
+        builder.signal(toRank(v), tb, toRank(v ^ mask), tb);
+        (keepLower ? newHi[v] : newLo[v]) = middle;
+      }
+      for (int v = 0; v < p; v++) builder.receive(toRank(v), tb, toRank(v ^ mask), tb);
+      lo = newLo;
+      hi = newHi;
+    }
+    for (int mask = 1; mask < p; mask *= 2) {
+      for (int v = 0; v < p; v++) {
+        Chunks sent{buffer, c * p + lo[v], hi[v] - lo[v]};
+        builder.send(toRank(v), tb, toRank(v ^ mask), tb, sent, sent, false);
+        builder.signal(toRank(v), tb, toRank(v ^ mask), tb);
+      }
+      for (int v = 0; v < p; v++) builder.receive(toRank(v), tb, toRank(v ^ mask), tb);
+      std::vector<int> newLo(lo), newHi(hi);
+      for (int v = 0; v < p; v++) {
+        newLo[v] = std::min(lo[v], lo[v ^ mask]);
+        newHi[v] = std::max(hi[v], hi[v ^ mask]);
+      }
+      lo = newLo;
+      hi = newHi;
+    }
+
+    for (int rank = 0; rank < 2 * extra; rank += 2) {
+      builder.send(rank + 1, tb, rank, tb, all, all, false);
+      builder.signal(rank + 1, tb, rank, tb);
+      builder.receive(rank, tb, rank + 1, tb);
+    }
+  }
+  return {"allreduce", p * config.nChunks, config.inPlace ? 0 : p * config.nChunks};
+}
+
+// Ring reduce-scatter within each node, ring allreduce of the reduced block across the ranks with the same local rank
+// (the rail), and ring allgather within each node. With R ranks per node and N nodes, chunk c * R * N + l * N + m is
+// sub-block m of the block of local rank l in instance c.
+Layout generateHierarchicalAllReduce(PlanBuilder& builder, const PlanGeneratorConfig& config, int nRanksPerNode) {
+  int n = config.worldSize;
+  int nNodes = n / nRanksPerNode;
+  std::vector<int> tbs = addThreadblocks(builder, n, config.nChunks);
+  BufferType buffer = prepareAllReduce(builder, config, n * config.nChunks, tbs);
+  for (int c = 0; c < config.nChunks; c++) {
+    auto nodeBlock = [&](int l) { return Block{{buffer, c * n + l * nNodes, nNodes}}; };
+    std::vector<Ring> nodeRings, railRings;
+    for (int m = 0; m < nNodes; m++) {
+      nodeRings.emplace_back(builder, range(m * nRanksPerNode, (m + 1) * nRanksPerNode),
+                             std::vector<int>(nRanksPerNode, tbs[c]));
+    }
+    for (int l = 0; l < nRanksPerNode; l++) {
+      railRings.emplace_back(builder, range(l, n, nRanksPerNode), std::vector<int>(nNodes, tbs[c]));
+    }
+    for (Ring& ring : nodeRings) ring.reduceScatter(nodeBlock);
+    for (int l = 0; l < nRanksPerNode; l++) {
+      auto railBlock = [&](int m) { return Block{{buffer, c * n + l * nNodes + m, 1}}; };
+      railRings[l].reduceScatter(railBlock);
+      railRings[l].allGather(railBlock, railBlock);
+    }
+    for (Ring& ring : nodeRings) ring.allGather(nodeBlock, nodeBlock);
+  }
+  return {"allreduce", n * config.nChunks, config.inPlace ? 0 : n * config.nChunks};
+}
+
+// Chunk b * nChunks + c of the output is chunk c of rank b. The own chunk is read from the input, or from its place
+// in the output for an in-place allgather.
+Chunks getAllGatherSource(const PlanGeneratorConfig& config, int rank, int c) {
+  return config.inPlace ? Chunks{BufferType::OUTPUT, rank * config.nChunks + c, 1} : Chunks{BufferType::INPUT, c, 1};
+}
+
+void copyAllGatherInput(PlanBuilder& builder, const PlanGeneratorConfig& config, const std::vector<int>& tbs) {
+  if (config.inPlace) return;
+  for (int rank = 0; rank < config.worldSize; rank++) {
+    for (int c = 0; c < config.nChunks; c++) {
+      builder.copy(rank, tbs[c], {BufferType::INPUT, c, 1}, {BufferType::OUTPUT, rank * config.nChunks + c, 1});
+    }
+  }
+}
+
+Layout generateRingAllGather(PlanBuilder& builder, const PlanGeneratorConfig& config) {
+  int n = config.worldSize;
+  std::vector<int> tbs = addThreadblocks(builder, n, config.nChunks);
+  for (int c = 0; c < config.nChunks; c++) {
+    Ring ring(builder, range(0, n), std::vector<int>(n, tbs[c]));
+    ring.allGather([&](int b) { return Block{{BufferType::OUTPUT, b * config.nChunks + c, 1}}; },
+                   [&](int j) { return Block{getAllGatherSource(config, j, c)}; });
+  }
+  copyAllGatherInput(builder, config, tbs);
+  return {"allgather", config.nChunks, n * config.nChunks};
+}
+
+// In step s, rank r sends the min(2^s, n - 2^s) blocks it holds, r, r + 1, ..., to rank r - 2^s and receives the
+// next ones from rank r + 2^s. Runs of blocks that are adjacent in the output are sent as one transfer.
+Layout generateBruckAllGather(PlanBuilder& builder, const PlanGeneratorConfig& config) {
+  int n = config.worldSize;
+  std::vector<int> tbs = addThreadblocks(builder, n, config.nChunks);
+  for (int c = 0; c < config.nChunks; c++) {
+    int tb = tbs[c];
+    for (int distance = 1; distance < n; distance *= 2) {
+      int count = std::min(distance, n - distance);
+      for (int rank = 0; rank < n; rank++) {
+        int peer = (rank - distance + n) % n;
+        for (int i = 0; i < count;) {
+          int block = (rank + i) % n;
+          int run = 1;
+          // The own block is sent separately since it may not be copied to the output yet.
+          while (i > 0 && config.nChunks == 1 && i + run < count && block + run < n) run++;
+          Chunks dst{BufferType::OUTPUT, block * config.nChunks + c, run};
+          Chunks src = i == 0 ? getAllGatherSource(config, rank, c) : dst;
+          builder.send(rank, tb, peer, tb, src, dst, false);
+          i += run;
+        }
+        builder.signal(rank, tb, peer, tb);
+      }
+      for (int rank = 0; rank < n; rank++) builder.receive(rank, tb, (rank + distance) % n, tb);
+    }
+  }
+  copyAllGatherInput(builder, config, tbs);
+  return {"allgather", config.nChunks, n * config.nChunks};
+}
+
+// Ring allgather across each rail, then ring allgather within each node of the blocks gathered from the rail.
+Layout generateHierarchicalAllGather(PlanBuilder& builder, const PlanGeneratorConfig& config, int nRanksPerNode) {
+  int n = config.worldSize;
+  int nNodes = n / nRanksPerNode;
+  std::vector<int> tbs = addThreadblocks(builder, n, config.nChunks);
+  auto output = [&](int rank, int c) { return Chunks{BufferType::OUTPUT, rank * config.nChunks + c, 1}; };
+  for (int c = 0; c < config.nChunks; c++) {
+    for (int l = 0; l < nRanksPerNode; l++) {
+      Ring ring(builder, range(l, n, nRanksPerNode), std::vector<int>(nNodes, tbs[c]));
+      ring.allGather([&](int m) { return Block{output(m * nRanksPerNode + l, c)}; },
+                     [&](int m) { return Block{getAllGatherSource(config, m * nRanksPerNode + l, c)}; });
+    }
+    for (int m = 0; m < nNodes; m++) {
+      Ring ring(builder, range(m * nRanksPerNode, (m + 1) * nRanksPerNode), std::vector<int>(nRanksPerNode, tbs[c]));
+      auto block = [&](int l) {
+        Block result;
+        for (int node = 0; node < nNodes; node++) {
+          // The rank's own chunk may not be copied to the output yet.
+          int rank = node * nRanksPerNode + l;
+          result.push_back(rank == m * nRanksPerNode + l ? getAllGatherSource(config, rank, c) : output(rank, c));
+        }
+        return result;
+      };
+      ring.allGather(
+          [&](int l) {
+            Block result;
+            for (int node = 0; node < nNodes; node++) result.push_back(output(node * nRanksPerNode + l, c));
+            return result;
+          },
+          block);
+    }
+  }
+  copyAllGatherInput(builder, config, tbs);
+  return {"allgather", config.nChunks, n * config.nChunks};
+}
+
+// In step s, rank r sends its block for rank r + s and receives the block of rank r - s. Chunk j * nChunks + c of
+// the input is chunk c of the block for rank j, and of the output chunk c of the block from rank j.
+Layout generatePairwiseAllToAll(PlanBuilder& builder, const PlanGeneratorConfig& config) {
+  if (config.inPlace) {
+    throw Error("Pairwise alltoall cannot be generated in place", ErrorCode::InvalidUsage);
+  }
+  int n = config.worldSize;
+  int nChunks = config.nChunks;
+  std::vector<int> tbs = addThreadblocks(builder, n, nChunks);
+  for (int c = 0; c < nChunks; c++) {
+    int tb = tbs[c];
+    for (int step = 1; step < n; step++) {
+      for (int rank = 0; rank < n; rank++) {
+        int peer = (rank + step) % n;
+        builder.send(rank, tb, peer, tb, {BufferType::INPUT, peer * nChunks + c, 1},
+                     {BufferType::OUTPUT, rank * nChunks + c, 1}, false);
+        builder.signal(rank, tb, peer, tb);
+      }
+      for (int rank = 0; rank < n; rank++) builder.receive(rank, tb, (rank - step + n) % n, tb);
+    }
+    for (int rank = 0; rank < n; rank++) {
+      builder.copy(rank, tb, {BufferType::INPUT, rank * nChunks + c, 1}, {BufferType::OUTPUT, rank * nChunks + c, 1});
+    }
+  }
+  return {"alltoall", n * nChunks, n * nChunks};
+}
+}  // namespace
+
+namespace mscclpp {
+
+std::string generateExecutionPlan(const PlanGeneratorConfig& config) {
+  int nRanksPerNode = config.nRanksPerNode == 0 ? config.worldSize : config.nRanksPerNode;
+  if (config.worldSize < 2 || nRanksPerNode <= 0 || config.worldSize % nRanksPerNode != 0 || config.nChunks <= 0 ||
+      config.nThreadsPerBlock <= 0) {
+    throw Error("Invalid plan generator config for world size " + std::to_string(config.worldSize),
+                ErrorCode::InvalidUsage);
+  }
+  if (config.protocol != "Simple" && config.protocol != "LL") {
+    throw Error("Unknown protocol " + config.protocol, ErrorCode::InvalidUsage);
+  }
+
+  PlanBuilder builder(config.worldSize, nRanksPerNode, config.protocol == "LL");
+  Layout layout;
+  switch (config.algorithm) {
+    case PlanAlgorithm::RingAllReduce:
+      layout = generateRingAllReduce(builder, config);
+      break;
+    case PlanAlgorithm::DoubleBinaryTreeAllReduce:
+      layout = generateDoubleBinaryTreeAllReduce(builder, config);
+      break;
+    case PlanAlgorithm::HalvingDoublingAllReduce:
+      layout = generateHalvingDoublingAllReduce(builder, config);
+      break;
+    case PlanAlgorithm::HierarchicalAllReduce:
+      layout = generateHierarchicalAllReduce(builder, config, nRanksPerNode);
+      break;
+    case PlanAlgorithm::RingAllGather:
+      layout = generateRingAllGather(builder, config);
+      break;
+    case PlanAlgorithm::BruckAllGather:
+      layout = generateBruckAllGather(builder, config);
+      break;
+    case PlanAlgorithm::HierarchicalAllGather:
+      layout = generateHierarchicalAllGather(builder, config, nRanksPerNode);
+      break;
+    case PlanAlgorithm::PairwiseAllToAll:
+      layout = generatePairwiseAllToAll(builder, config);
+      break;
+  }
+
+  json plan = {{"name", config.name.empty() ? getAlgorithmName(config.algorithm) : config.name},
+               {"collective", layout.collective},
+               {"protocol", config.protocol},
+               {"inplace", config.inPlace},
+               {"num_threads_per_block", config.nThreadsPerBlock},
+               {"gpus", builder.build(layout.nInputChunks, layout.nOutputChunks)}};
+  return plan.dump();
+}
+
+void writeExecutionPlan(const PlanGeneratorConfig& config, const std::string& outputPath, bool compiled) {
+  std::string plan = generateExecutionPlan(config);
+  std::string jsonPath = compiled ? outputPath + ".json.tmp" : outputPath;
+  {
+    std::ofstream file(jsonPath);
+    file << plan;
+    if (!file) {
+      throw Error("Failed to write execution plan to " + jsonPath, ErrorCode::InvalidUsage);
+    }
+  }
+  if (compiled) {
+    std::string name = config.name.empty() ? getAlgorithmName(config.algorithm) : config.name;
+    try {
+      ExecutionPlan(name, jsonPath).compile(outputPath);
+    } catch (...) {
+      std::remove(jsonPath.c_str());
+      throw;
+    }
+    std::remove(jsonPath.c_str());
+  }
+}
+
+}  // namespace mscclpp
@@ -0,0 +1,442 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <mscclpp/errors.hpp>
+#include <mscclpp/executor.hpp>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <tuple>
+
+#include "debug.h"
+#include "execution_plan.hpp"
+#include "execution_plan_file.hpp"
+
+namespace {
+// collective, protocol, inPlace, worldSize. Plans are indexed under their protocol and under the empty protocol, which
+// selects any protocol.
+using PlanKey = std::tuple<std::string, std::string, bool, int>;
+
+// Size class of a message: 0 for 0 bytes, k for [2^(k-1), 2^k) bytes.
+constexpr int N_SIZE_CLASSES = 65;
+constexpr int NO_PLAN = -1;
+constexpr int MIXED_PLANS = -2;
+
+int getSizeClass(size_t size) { return size == 0 ? 0 : 64 - __builtin_clzll(size); }
+
+uint64_t getFileChecksum(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw mscclpp::Error("Cannot open " + path, mscclpp::ErrorCode::InvalidUsage);
+  }
+  std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  return mscclpp::planFileChecksum(contents.data(), contents.size());
+}
+
+// Input and output sizes a reloaded plan is verified for: messages of 1 MiB, or of the closest size in its range.
+std::pair<size_t, size_t> getVerificationSizes(const mscclpp::PlanInfo& info) {
+  size_t size = std::clamp<size_t>(1 << 20, info.minMessageSize, info.maxMessageSize - 1);
+  if (info.collective == "allgather") {
+    return {size, size * info.worldSize};
+  }
+  if (info.collective == "reducescatter") {
+    return {size / info.worldSize * info.worldSize, size / info.worldSize};
+  }
+  return {size, size};
+}
+
+// Modification times of the JSON plans in a directory
+std::map<std::string, std::filesystem::file_time_type> getPlanFileTimes(const std::string& path) {
+  std::map<std::string, std::filesystem::file_time_type> times;
+  for (const auto& entry : std::filesystem::directory_iterator(path)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".json") {
+      times[entry.path().string()] = entry.last_write_time();
+    }
+  }
+  return times;
+}
+}  // namespace
+
+namespace mscclpp {
+
+struct PlanRegistry::Impl {
+  struct Slot {
+    // Indexes in `entries` of the plans registered for the key
+    std::vector<int> plans;
+    // Start of each size range to the index in `entries` of the plan selected for it, or NO_PLAN. Always has a range
+    // starting at 0.
+    std::map<size_t, int> segments;
+    // Plan selected for all sizes of a size class, or MIXED_PLANS if the class spans several ranges
+    std::array<int, N_SIZE_CLASSES> sizeClasses;
+  };
+
+  // A reloaded plan waiting for commitReloads
+  struct StagedPlan {
+    std::shared_ptr<ExecutionPlan> plan;
+    PlanInfo info;
+    uint64_t checksum;
+  };
+
+  struct Reload {
+    std::string path;
+    int rank;
+    std::promise<uint64_t> done;
+  };
+
+  // Guards `entries` and `slots`, taken shared by select
+  mutable std::shared_mutex mutex;
+  std::vector<std::pair<std::shared_ptr<ExecutionPlan>, PlanInfo>> entries;
+  std::map<PlanKey, Slot> slots;
+
+  // The members below are guarded by `reloadMutex`
+  std::mutex reloadMutex;
+  // Staged plans by path
+  std::map<std::string, StagedPlan> staged;
+  // Last version staged for each path
+  std::map<std::string, uint64_t> versions;
+  std::deque<Reload> reloads;
+  std::condition_variable reloadRequested;
+  std::thread reloader;
+  bool stopReloader = false;
+
+  // The members below are guarded by `watchMutex`
+  std::mutex watchMutex;
+  std::condition_variable watchStopped;
+  std::thread watcher;
+  bool stopWatcher = false;
+
+  ~Impl() {
+    this->stopWatching();
+    if (this->reloader.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(this->reloadMutex);
+        this->stopReloader = true;
+      }
+      this->reloadRequested.notify_all();
+      this->reloader.join();
+    }
+  }
+
+  static void validate(const std::shared_ptr<ExecutionPlan>& plan, const PlanInfo& info) {
+    if (plan == nullptr || info.collective.empty() || info.worldSize <= 0 ||
+        info.minMessageSize >= info.maxMessageSize) {
+      throw Error("Invalid plan registration for collective " + info.collective, ErrorCode::InvalidUsage);
+    }
+  }
+
+  // The caller holds `mutex`.
+  void add(std::shared_ptr<ExecutionPlan> plan, const PlanInfo& info) {
+    validate(plan, info);
+    int index = this->entries.size();
+    this->entries.emplace_back(std::move(plan), info);
+    this->index(index);
+  }
+
+  // Add the plan at `index` of `entries` to its slots.
+  void index(int index) {
+    const PlanInfo& info = this->entries[index].second;
+    for (const std::string& protocol : {std::string(), info.protocol}) {
+      Slot& slot = this->slots[{info.collective, protocol, info.inPlace, info.worldSize}];
+      slot.plans.push_back(index);
+      this->rebuild(slot);
+      if (info.protocol.empty()) break;
+    }
+  }
+
+  void unindex(int index) {
+    const PlanInfo& info = this->entries[index].second;
+    for (const std::string& protocol : {std::string(), info.protocol}) {
+      Slot& slot = this->slots[{info.collective, protocol, info.inPlace, info.worldSize}];
+      slot.plans.erase(std::remove(slot.plans.begin(), slot.plans.end(), index), slot.plans.end());
+      this->rebuild(slot);
+      if (info.protocol.empty()) break;
+    }
+  }
+
+  // Swap `plan` in for the registered plans of the same file, or register it if there are none. Replaced plans are
+  // marked superseded. The caller holds `mutex`.
+  void replace(std::shared_ptr<ExecutionPlan> plan, const PlanInfo& info) {
+    validate(plan, info);
+    bool replaced = false;
+    for (size_t index = 0; index < this->entries.size(); index++) {
+      auto& [registered, registeredInfo] = this->entries[index];
+      if (registered->impl_->planPath != plan->impl_->planPath) {
+        continue;
+      }
+      registered->impl_->superseded->store(true);
+      registered = plan;
+      if (std::tie(registeredInfo.collective, registeredInfo.protocol, registeredInfo.inPlace,
+                   registeredInfo.worldSize, registeredInfo.minMessageSize, registeredInfo.maxMessageSize) !=
+          std::tie(info.collective, info.protocol, info.inPlace, info.worldSize, info.minMessageSize,
+                   info.maxMessageSize)) {
+        this->unindex(index);
+        registeredInfo = info;
+        this->index(index);
+      }
+      replaced = true;
+    }
+    if (!replaced) {
+      this->add(plan, info);
+    }
+  }
+
+  std::shared_future<uint64_t> reload(const std::string& path, int rank) {
+    Reload reload = {path, rank, std::promise<uint64_t>()};
+    std::shared_future<uint64_t> future = reload.done.get_future().share();
+    {
+      std::lock_guard<std::mutex> lock(this->reloadMutex);
+      this->reloads.push_back(std::move(reload));
+      if (!this->reloader.joinable()) {
+        this->reloader = std::thread([this]() { this->runReloader(); });
+      }
+    }
+    this->reloadRequested.notify_all();
+    return future;
+  }
+
+  void runReloader() {
+    std::unique_lock<std::mutex> lock(this->reloadMutex);
+    for (;;) {
+      this->reloadRequested.wait(lock, [this]() { return this->stopReloader || !this->reloads.empty(); });
+      if (this->stopReloader) {
+        return;
+      }
+      Reload reload = std::move(this->reloads.front());
+      this->reloads.pop_front();
+      lock.unlock();
+      std::exception_ptr error;
+      StagedPlan staged;
+      try {
+        staged = this->load(reload.path, reload.rank);
+      } catch (const std::exception& e) {
+        WARN("Failed to reload execution plan %s: %s", reload.path.c_str(), e.what());
+        error = std::current_exception();
+      }
+      lock.lock();
+      if (error) {
+        reload.done.set_exception(error);
+        continue;
+      }
+      uint64_t version = ++this->versions[reload.path];
+      staged.plan->impl_->version = version;
+      this->staged[reload.path] = std::move(staged);
+      reload.done.set_value(version);
+    }
+  }
+
+  // Load and verify the plan at `path`.
+  StagedPlan load(const std::string& path, int rank) {
+    uint64_t checksum = getFileChecksum(path);
+    auto [name, info] = readPlanInfo(path);
+    auto plan = std::make_shared<ExecutionPlan>(name, path);
+    plan->load(rank);
+    auto [inputSize, outputSize] = getVerificationSizes(info);
+    for (const PlanIssue& issue : plan->verify(inputSize, outputSize)) {
+      if (issue.severity == PlanIssue::Severity::Error) {
+        throw Error("Plan " + path + " failed verification on rank " + std::to_string(issue.rank) + ": " +
+                        issue.message,
+                    ErrorCode::InvalidUsage);
+      }
+    }
+    // The checksum is compared across ranks by commitReloads, so it must be the one of the file that was loaded.
+    if (getFileChecksum(path) != checksum) {
+      throw Error("Plan " + path + " changed while it was reloaded", ErrorCode::InvalidUsage);
+    }
+    return {plan, info, checksum};
+  }
+
+  size_t commitReloads(std::shared_ptr<Bootstrap> bootstrap) {
+    std::map<std::string, StagedPlan> staged;
+    {
+      std::lock_guard<std::mutex> lock(this->reloadMutex);
+      staged = this->staged;
+    }
+    if (bootstrap != nullptr) {
+      // Ranks agree on the paths and contents of the staged files through a checksum of them.
+      std::string key;
+      for (const auto& [path, plan] : staged) {
+        key += path;
+        key.append(reinterpret_cast<const char*>(&plan.checksum), sizeof(plan.checksum));
+      }
+      std::vector<uint64_t> checksums(bootstrap->getNranks());
+      checksums[bootstrap->getRank()] = planFileChecksum(key.data(), key.size());
+      bootstrap->allGather(checksums.data(), sizeof(uint64_t));
+      if (std::adjacent_find(checksums.begin(), checksums.end(), std::not_equal_to<uint64_t>()) !=
+          checksums.end()) {
+        return 0;
+      }
+    }
+    {
+      std::unique_lock<std::shared_mutex> lock(this->mutex);
+      for (const auto& [path, plan] : staged) {
+        this->replace(plan.plan, plan.info);
+      }
+    }
+    std::lock_guard<std::mutex> lock(this->reloadMutex);
+    for (const auto& [path, plan] : staged) {
+      auto it = this->staged.find(path);
+      if (it != this->staged.end() && it->second.plan == plan.plan) {
+        this->staged.erase(it);
+      }
+    }
+    return staged.size();
+  }
+
+  void watchDirectory(const std::string& path, std::chrono::milliseconds interval, int rank) {
+    this->stopWatching();
+    auto times = getPlanFileTimes(path);
+    this->watcher = std::thread([this, path, interval, rank, times]() mutable {
+      std::unique_lock<std::mutex> lock(this->watchMutex);
+      while (!this->watchStopped.wait_for(lock, interval, [this]() { return this->stopWatcher; })) {
+        try {
+          for (const auto& [planPath, time] : getPlanFileTimes(path)) {
+            auto it = times.find(planPath);
+            if (it == times.end() || it->second != time) {
+              times[planPath] = time;
+              this->reload(planPath, rank);
+            }
+          }
+        } catch (const std::exception& e) {
+          WARN("Failed to watch execution plan directory %s: %s", path.c_str(), e.what());
+        }
+      }
+    });
+  }
+
+  void stopWatching() {
+    if (!this->watcher.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(this->watchMutex);
+      this->stopWatcher = true;
+    }
+    this->watchStopped.notify_all();
+    this->watcher.join();
+    this->stopWatcher = false;
+  }
+
+  // Split the sizes into ranges where the same plan applies, so that selection is a single search.
+  void rebuild(Slot& slot) {
+    std::vector<size_t> bounds = {0};
+    for (int index : slot.plans) {
+      const PlanInfo& info = this->entries[index].second;
+      bounds.push_back(info.minMessageSize);
+      if (info.maxMessageSize != std::numeric_limits<size_t>::max()) {
+        bounds.push_back(info.maxMessageSize);
+      }
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    slot.segments.clear();
+    int previous = MIXED_PLANS;
+    for (size_t begin : bounds) {
+      int selected = NO_PLAN;
+      size_t selectedWidth = 0;
+      for (int index : slot.plans) {
+        const PlanInfo& info = this->entries[index].second;
+        size_t width = info.maxMessageSize - info.minMessageSize;
+        if (info.minMessageSize <= begin && begin < info.maxMessageSize &&
+            (selected == NO_PLAN || width <= selectedWidth)) {
+          selected = index;
+          selectedWidth = width;
+        }
+      }
+      if (selected != previous) {
+        slot.segments[begin] = selected;
+        previous = selected;
+      }
+    }
+
+    for (int sizeClass = 0; sizeClass < N_SIZE_CLASSES; sizeClass++) {
+      size_t first = sizeClass == 0 ? 0 : size_t(1) << (sizeClass - 1);
+      size_t last = sizeClass == 0 ? 0 : first + (first - 1);
+      auto it = std::prev(slot.segments.upper_bound(first));
+      auto next = std::next(it);
+      slot.sizeClasses[sizeClass] = (next == slot.segments.end() || next->first > last) ? it->second : MIXED_PLANS;
+    }
+  }
+
+  std::shared_ptr<ExecutionPlan> select(const CollectiveDescriptor& collective) const {
+    auto slotIt =
+        this->slots.find({collective.collective, collective.protocol, collective.inPlace, collective.worldSize});
+    if (slotIt == this->slots.end()) {
+      return nullptr;
+    }
+    const Slot& slot = slotIt->second;
+    int index = slot.sizeClasses[getSizeClass(collective.messageSize)];
+    if (index == MIXED_PLANS) {
+      index = std::prev(slot.segments.upper_bound(collective.messageSize))->second;
+    }
+    return index == NO_PLAN ? nullptr : this->entries[index].first;
+  }
+};
+
+PlanRegistry::PlanRegistry() : impl_(std::make_unique<Impl>()) {}
+
+PlanRegistry::~PlanRegistry() = default;
+
+size_t PlanRegistry::loadDirectory(const std::string& path) {
+  std::vector<std::filesystem::path> planPaths;
+  for (const auto& entry : std::filesystem::directory_iterator(path)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".json") {
+      planPaths.push_back(entry.path());
+    }
+  }
+  std::sort(planPaths.begin(), planPaths.end());
+  for (const auto& planPath : planPaths) {
+    this->registerPlan(planPath.string());
+  }
+  return planPaths.size();
+}
+
+std::shared_ptr<ExecutionPlan> PlanRegistry::registerPlan(const std::string& planPath) {
+  auto [name, info] = readPlanInfo(planPath);
+  auto plan = std::make_shared<ExecutionPlan>(name, planPath);
+  std::unique_lock<std::shared_mutex> lock(this->impl_->mutex);
+  this->impl_->add(plan, info);
+  return plan;
+}
+
+void PlanRegistry::registerPlan(std::shared_ptr<ExecutionPlan> plan, const PlanInfo& info) {
+  std::unique_lock<std::shared_mutex> lock(this->impl_->mutex);
+  this->impl_->add(std::move(plan), info);
+}
+
+std::shared_ptr<ExecutionPlan> PlanRegistry::select(const CollectiveDescriptor& collective) const {
+  std::shared_lock<std::shared_mutex> lock(this->impl_->mutex);
+  return this->impl_->select(collective);
+}
+
+std::vector<std::pair<std::shared_ptr<ExecutionPlan>, PlanInfo>> PlanRegistry::plans() const {
+  std::shared_lock<std::shared_mutex> lock(this->impl_->mutex);
+  return this->impl_->entries;
+}
+
+std::shared_future<uint64_t> PlanRegistry::reload(const std::string& planPath, int rank) {
+  return this->impl_->reload(planPath, rank);
+}
+
+void PlanRegistry::watchDirectory(const std::string& path, std::chrono::milliseconds interval, int rank) {
+  this->impl_->watchDirectory(path, interval, rank);
+}
+
+void PlanRegistry::stopWatching() { this->impl_->stopWatching(); }
+
+size_t PlanRegistry::commitReloads(std::shared_ptr<Bootstrap> bootstrap) {
+  return this->impl_->commitReloads(bootstrap);
+}
+
+}  // namespace mscclpp
@@ -0,0 +1,77 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "scratch_arena.hpp"
+
+#include <mscclpp/gpu_utils.hpp>
+
+namespace mscclpp {
+
+ScratchBuffer::ScratchBuffer(size_t size, cudaStream_t stream, std::shared_ptr<std::atomic<uint32_t>> flags)
+    : buffer_(allocExtSharedCuda<char>(size)), size_(size), flags_(flags), lastStream_(stream) {
+  MSCCLPP_CUDATHROW(cudaEventCreateWithFlags(&this->lastUse_, cudaEventDisableTiming));
+}
+
+ScratchBuffer::~ScratchBuffer() { cudaEventDestroy(this->lastUse_); }
+
+void ScratchBuffer::beginUse(cudaStream_t stream) {
+  if (stream != this->lastStream_) {
+    MSCCLPP_CUDATHROW(cudaStreamWaitEvent(stream, this->lastUse_, 0));
+  }
+}
+
+void ScratchBuffer::endUse(cudaStream_t stream) {
+  MSCCLPP_CUDATHROW(cudaEventRecord(this->lastUse_, stream));
+  this->lastStream_ = stream;
+}
+
+std::shared_ptr<ScratchBuffer> ScratchArena::borrow(size_t size, cudaStream_t stream, uint32_t slot) {
+  size_t sizeClass = ScratchArena::sizeClass(size);
+  std::shared_ptr<ScratchBuffer>& buffer = this->buffers_[{stream, sizeClass, slot}];
+  if (buffer == nullptr) {
+    std::shared_ptr<std::atomic<uint32_t>>& flags = this->flags_[stream];
+    if (flags == nullptr) {
+      flags = std::make_shared<std::atomic<uint32_t>>(0);
+    }
+    buffer = std::make_shared<ScratchBuffer>(sizeClass, stream, flags);
+  }
+  return buffer;
+}
+
+void ScratchArena::trim() {
+  for (auto it = this->buffers_.begin(); it != this->buffers_.end();) {
+    if (it->second.use_count() == 1) {
+      it = this->buffers_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+size_t ScratchArena::bytesReserved() const {
+  size_t bytes = 0;
+  for (const auto& [_, buffer] : this->buffers_) {
+    bytes += buffer->size();
+  }
+  return bytes;
+}
+
+size_t ScratchArena::bytesInUse() const {
+  size_t bytes = 0;
+  for (const auto& [_, buffer] : this->buffers_) {
+    if (buffer.use_count() > 1) {
+      bytes += buffer->size();
+    }
+  }
+  return bytes;
+}
+
+size_t ScratchArena::sizeClass(size_t size) {
+  size_t sizeClass = 1;
+  while (sizeClass < size) {
+    sizeClass <<= 1;
+  }
+  return sizeClass;
+}
+
+}  // namespace mscclpp
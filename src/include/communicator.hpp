@@ -4,8 +4,11 @@
 #ifndef MSCCLPP_COMMUNICATOR_HPP_
 #define MSCCLPP_COMMUNICATOR_HPP_
 
+#include <deque>
+#include <map>
 #include <memory>
 #include <mscclpp/core.hpp>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -18,15 +21,62 @@ struct ConnectionInfo {
   int tag;
 };
 
+// Remote rank, tag and the fields of the local EndpointConfig of a shared connection
+using SharedConnectionKey = std::tuple<int, int, Transport, int, int, int, int>;
+
+// A connection of the pool of Communicator::sharedConnectOnSetup. `pending` is set until setup() decides whether to
+// reuse the connection, which is only weakly referenced so that it is destroyed with its last user.
+struct SharedConnection {
+  std::shared_future<std::shared_ptr<Connection>> pending;
+  std::weak_ptr<Connection> connection;
+  // Number of connections made for the key so far, which both sides compare before reusing one
+  uint64_t generation;
+};
+
+// Bootstrap passed to the Setuppables by Communicator::setup. Messages sent during beginSetup are batched and sent as a
+// single message per peer once all Setuppables began, so a setup round costs one exchange with each peer however many
+// endpoints and memories it carries. Messages sent outside of a batch go out at once. Received batches are split back
+// into the messages of each tag, which are kept until received even across setup rounds.
+class SetupBootstrap : public Bootstrap {
+ public:
+  SetupBootstrap(std::shared_ptr<Bootstrap> bootstrap);
+
+  int getRank() override;
+  int getNranks() override;
+  int getNranksPerNode() override;
+  void send(void* data, int size, int peer, int tag) override;
+  void recv(void* data, int size, int peer, int tag) override;
+  void allGather(void* allData, int size) override;
+  void barrier() override;
+
+  void beginBatch();
+  // Send the batched messages and stop batching.
+  void endBatch();
+
+ private:
+  void flush(int peer);
+  void receiveBatch(int peer);
+
+  std::shared_ptr<Bootstrap> bootstrap_;
+  bool batching_;
+  // Pending batch of each peer: (tag, size, data) entries
+  std::map<int, std::vector<char>> batches_;
+  // Received messages of each (peer, tag), oldest first
+  std::map<std::pair<int, int>, std::deque<std::vector<char>>> received_;
+};
+
 struct Communicator::Impl {
   std::shared_ptr<Bootstrap> bootstrap_;
+  std::shared_ptr<SetupBootstrap> setupBootstrap_;
   std::shared_ptr<Context> context_;
   std::unordered_map<const Connection*, ConnectionInfo> connectionInfos_;
   std::vector<std::shared_ptr<Setuppable>> toSetup_;
+  std::map<SharedConnectionKey, SharedConnection> sharedConnections_;
 
   Impl(std::shared_ptr<Bootstrap> bootstrap, std::shared_ptr<Context> context);
 
   struct Connector;
+  struct SharedConnector;
 };
 
 }  // namespace mscclpp
@@ -6,6 +6,7 @@
 
 #include <mscclpp/core.hpp>
 #include <mscclpp/gpu.hpp>
+#include <mutex>
 
 #include "communicator.hpp"
 #include "context.hpp"
@@ -39,6 +40,8 @@ class IBConnection : public Connection {
   std::unique_ptr<uint64_t> dummyAtomicSource_;  // not used anywhere but IB needs a source
   RegisteredMemory dummyAtomicSourceMem_;
   mscclpp::TransportInfo dstTransportInfo_;
+  // Serializes the proxies of the contexts sharing the connection, see Communicator::sharedConnectOnSetup
+  std::mutex mutex_;
 
  public:
   IBConnection(Endpoint localEndpoint, Endpoint remoteEndpoint, Context& context);
@@ -9,9 +9,13 @@
 
 namespace mscclpp {
 
-constexpr int MAX_CHANNEL = 16;
+// Operations refer to the channels of their threadblock with 8-bit indexes.
+constexpr int MAX_CHANNEL = 256;
 constexpr int MAX_CHANNEL_PER_OPERATION = 8;
-constexpr int MAX_OPERATION = 64;
+// Encoded operations are copied from global to shared memory in pages of up to this many bytes.
+constexpr int OPERATION_PAGE_SIZE = 4096;
+// Channel tables of up to this size are copied to shared memory, larger ones are read from global memory.
+constexpr size_t MAX_SHARED_CHANNELS_SIZE = 4096;
 
 enum class BufferType : uint8_t {
   NONE,
@@ -48,11 +52,6 @@ enum class OperationType : uint8_t {
   READ_REDUCE_COPY_SEND,
 };
 
-struct Channels {
-  mscclpp::DeviceHandle<mscclpp::SmChannel> smChannels[MAX_CHANNEL];
-  mscclpp::DeviceHandle<mscclpp::SimpleProxyChannel> proxyChannels[MAX_CHANNEL];
-};
-
 struct Operation {
   OperationType type;
   ChannelType channelType;
@@ -60,6 +59,8 @@ struct Operation {
   BufferType dstBufferType;
   uint8_t nInputs;
   uint8_t nOutputs;
+  // Set on the reduce that completes a chunk of the output, which multiplies its result by the PREMUL_SUM factor
+  uint8_t finalReduce;
   union {
     uint8_t inputChannelIndexes[MAX_CHANNEL_PER_OPERATION];
     BufferType inputBufferType;
@@ -75,13 +76,40 @@ struct Operation {
   uint32_t size;
 };
 
-// total size = 1920 + 6400 + 4 + 4(padding) + 12(align) = 8336 bytes
+// Per-threadblock header of a device plan. The device plan buffer starts with the headers of all threadblocks,
+// followed by the channel tables and operations they point to, each aligned to 16 bytes. Offsets are in bytes from
+// the start of the buffer. Operations are encoded as described in operation_encoding.hpp and take `operationsSize`
+// bytes.
+//
+// The SM channel table directly precedes the proxy channel table and `channelsSize` covers both. In shared memory,
+// the kernel keeps the channel tables in the first `sharedChannelsSize` bytes, unless that is 0 and they are read from
+// global memory, followed by a page of `operationPageSize` bytes of operations. Both sizes are the same for all
+// threadblocks.
+//
+// A grouped plan merges the threadblocks of several executions, see Executor::executeGroup. Their threadblocks run on
+// the buffers in the DeviceExecutionArgs at `argsOffset` instead of those passed to the kernel, which are only used if
+// `argsOffset` is 0.
 struct __attribute__((aligned(16))) DeviceExecutionPlan {
-  uint8_t nSmChannels;                  // 1 bytes
-  uint8_t nProxyChannels;               // 1 bytes
-  uint16_t nOperations;                 // 2 bytes
-  Channels channels;                    // 1920 bytes
-  Operation operations[MAX_OPERATION];  // 64 * 100 = 6400 bytes
+  uint32_t nOperations;
+  uint16_t nSmChannels;
+  uint16_t nProxyChannels;
+  uint32_t channelsSize;
+  uint32_t sharedChannelsSize;
+  uint32_t operationsSize;
+  uint32_t operationPageSize;
+  uint64_t smChannelsOffset;
+  uint64_t proxyChannelsOffset;
+  uint64_t operationsOffset;
+  uint64_t argsOffset;
+};
+
+// Kernel arguments of the threadblocks of one execution in a grouped plan
+struct __attribute__((aligned(16))) DeviceExecutionArgs {
+  void* input;
+  void* output;
+  void* scratch;
+  uint64_t scratchSize;
+  uint32_t flag;
 };
 
 }  // namespace mscclpp
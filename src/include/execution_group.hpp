@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef MSCCLPP_EXECUTION_GROUP_HPP_
+#define MSCCLPP_EXECUTION_GROUP_HPP_
+
+#include <vector>
+
+#include "execution_common.hpp"
+
+namespace mscclpp {
+
+// Device plan buffer of an execution of a group, laid out as described at DeviceExecutionPlan, and the buffers it runs
+// on.
+struct ExecutionGroupPart {
+  const char* buffer;
+  size_t size;
+  size_t nThreadblocks;
+  DeviceExecutionArgs args;
+};
+
+// Merge the device plans of `parts` into the buffer of a grouped plan: the headers of the threadblocks of all parts,
+// one part after the other, the DeviceExecutionArgs of each part, then the channel tables and operations of each part.
+// The headers are remapped to the tables of their part in the merged buffer and to its arguments. Throws an Error if
+// the threadblocks of the parts could not run in the same launch: an operation using a channel out of the tables of
+// its threadblock, or parts whose scratch buffers overlap.
+std::vector<char> mergeDeviceExecutionPlans(const std::vector<ExecutionGroupPart>& parts);
+
+}  // namespace mscclpp
+
+#endif  // MSCCLPP_EXECUTION_GROUP_HPP_
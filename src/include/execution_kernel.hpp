@@ -13,6 +13,7 @@
 #include <mscclpp/sm_channel.hpp>
 
 #include "execution_common.hpp"
+#include "operation_encoding.hpp"
 
 #if defined(MSCCLPP_DEVICE_COMPILE)
 #include "gpu_data_types.hpp"
@@ -51,91 +52,257 @@ MSCCLPP_DEVICE_INLINE __bfloat162 add_elements(__bfloat162 a, __bfloat162 b) {
 }
 
 template <typename T>
-MSCCLPP_DEVICE_INLINE int4 add_vectors_helper(int4 a, int4 b) {
-  int4 ret;
-  ret.w = bit_cast<int, T>(add_elements(bit_cast<T, int>(a.w), bit_cast<T, int>(b.w)));
-  ret.x = bit_cast<int, T>(add_elements(bit_cast<T, int>(a.x), bit_cast<T, int>(b.x)));
-  ret.y = bit_cast<int, T>(add_elements(bit_cast<T, int>(a.y), bit_cast<T, int>(b.y)));
-  ret.z = bit_cast<int, T>(add_elements(bit_cast<T, int>(a.z), bit_cast<T, int>(b.z)));
-  return ret;
+MSCCLPP_DEVICE_INLINE T mul_elements(T a, T b) {
+  return a * b;
 }
 
-template <typename T>
-MSCCLPP_DEVICE_INLINE int4 add_vectors(int4 a, int4 b) {
-  return add_vectors_helper<T>(a, b);
+template <>
+MSCCLPP_DEVICE_INLINE __half2 mul_elements(__half2 a, __half2 b) {
+  return __hmul2(a, b);
 }
 
 template <>
-MSCCLPP_DEVICE_INLINE int4 add_vectors<__half>(int4 a, int4 b) {
-  return add_vectors_helper<__half2>(a, b);
+MSCCLPP_DEVICE_INLINE __bfloat16 mul_elements(__bfloat16 a, __bfloat16 b) {
+  return __hmul(a, b);
 }
 
 template <>
-MSCCLPP_DEVICE_INLINE int4 add_vectors<__bfloat16>(int4 a, int4 b) {
-  return add_vectors_helper<__bfloat162>(a, b);
+MSCCLPP_DEVICE_INLINE __bfloat162 mul_elements(__bfloat162 a, __bfloat162 b) {
+  return __hmul2(a, b);
 }
 
+// The maximum and minimum of floating point values ignore NaN. 16-bit values are compared in float, which is exact.
 template <typename T>
-MSCCLPP_DEVICE_INLINE uint2 add_vectors_helper(uint2 a, uint2 b) {
-  uint2 ret;
-  ret.x = bit_cast<int, T>(add_elements(bit_cast<T, int>(a.x), bit_cast<T, int>(b.x)));
-  ret.y = bit_cast<int, T>(add_elements(bit_cast<T, int>(a.y), bit_cast<T, int>(b.y)));
-  return ret;
+MSCCLPP_DEVICE_INLINE T max_elements(T a, T b) {
+  return a > b ? a : b;
 }
 
-template <typename T>
-MSCCLPP_DEVICE_INLINE uint2 add_vectors(uint2 a, uint2 b) {
-  return add_vectors_helper<T>(a, b);
+template <>
+MSCCLPP_DEVICE_INLINE float max_elements(float a, float b) {
+  return fmaxf(a, b);
+}
+
+template <>
+MSCCLPP_DEVICE_INLINE __half max_elements(__half a, __half b) {
+  return __float2half(fmaxf(__half2float(a), __half2float(b)));
+}
+
+template <>
+MSCCLPP_DEVICE_INLINE __half2 max_elements(__half2 a, __half2 b) {
+  float2 fa = __half22float2(a), fb = __half22float2(b);
+  return __floats2half2_rn(fmaxf(fa.x, fb.x), fmaxf(fa.y, fb.y));
 }
 
 template <>
-MSCCLPP_DEVICE_INLINE __attribute__((unused)) uint2 add_vectors<__half>(uint2 a, uint2 b) {
-  return add_vectors_helper<__half2>(a, b);
+MSCCLPP_DEVICE_INLINE __bfloat16 max_elements(__bfloat16 a, __bfloat16 b) {
+  return __float2bfloat16(fmaxf(__bfloat162float(a), __bfloat162float(b)));
 }
 
 template <>
-MSCCLPP_DEVICE_INLINE __attribute__((unused)) uint2 add_vectors<__bfloat16>(uint2 a, uint2 b) {
-  return add_vectors_helper<__bfloat162>(a, b);
+MSCCLPP_DEVICE_INLINE __bfloat162 max_elements(__bfloat162 a, __bfloat162 b) {
+  float2 fa = __bfloat1622float2(a), fb = __bfloat1622float2(b);
+  return __floats2bfloat162_rn(fmaxf(fa.x, fb.x), fmaxf(fa.y, fb.y));
 }
 
 template <typename T>
-MSCCLPP_DEVICE_INLINE int add_vectors_helper(int a, int b) {
-  return bit_cast<int, T>(add_elements(bit_cast<T, int>(a), bit_cast<T, int>(b)));
+MSCCLPP_DEVICE_INLINE T min_elements(T a, T b) {
+  return a < b ? a : b;
+}
+
+template <>
+MSCCLPP_DEVICE_INLINE float min_elements(float a, float b) {
+  return fminf(a, b);
+}
+
+template <>
+MSCCLPP_DEVICE_INLINE __half min_elements(__half a, __half b) {
+  return __float2half(fminf(__half2float(a), __half2float(b)));
+}
+
+template <>
+MSCCLPP_DEVICE_INLINE __half2 min_elements(__half2 a, __half2 b) {
+  float2 fa = __half22float2(a), fb = __half22float2(b);
+  return __floats2half2_rn(fminf(fa.x, fb.x), fminf(fa.y, fb.y));
+}
+
+template <>
+MSCCLPP_DEVICE_INLINE __bfloat16 min_elements(__bfloat16 a, __bfloat16 b) {
+  return __float2bfloat16(fminf(__bfloat162float(a), __bfloat162float(b)));
+}
+
+template <>
+MSCCLPP_DEVICE_INLINE __bfloat162 min_elements(__bfloat162 a, __bfloat162 b) {
+  float2 fa = __bfloat1622float2(a), fb = __bfloat1622float2(b);
+  return __floats2bfloat162_rn(fminf(fa.x, fb.x), fminf(fa.y, fb.y));
 }
 
+struct SumOp {
+  template <typename T>
+  MSCCLPP_DEVICE_INLINE static T apply(T a, T b) {
+    return add_elements(a, b);
+  }
+};
+
+struct ProdOp {
+  template <typename T>
+  MSCCLPP_DEVICE_INLINE static T apply(T a, T b) {
+    return mul_elements(a, b);
+  }
+};
+
+struct MaxOp {
+  template <typename T>
+  MSCCLPP_DEVICE_INLINE static T apply(T a, T b) {
+    return max_elements(a, b);
+  }
+};
+
+struct MinOp {
+  template <typename T>
+  MSCCLPP_DEVICE_INLINE static T apply(T a, T b) {
+    return min_elements(a, b);
+  }
+};
+
+// Vectors are reduced 32 bits at a time: one element of a 32-bit type, or two of a 16-bit one.
 template <typename T>
-MSCCLPP_DEVICE_INLINE int add_vectors(int a, int b) {
-  return add_vectors_helper<T>(a, b);
+struct PackedElements {
+  using type = T;
+};
+
+template <>
+struct PackedElements<__half> {
+  using type = __half2;
+};
+
+template <>
+struct PackedElements<__bfloat16> {
+  using type = __bfloat162;
+};
+
+template <typename T, typename Op>
+MSCCLPP_DEVICE_INLINE uint32_t apply_words(uint32_t a, uint32_t b) {
+  using P = typename PackedElements<T>::type;
+  return bit_cast<uint32_t, P>(Op::template apply<P>(bit_cast<P, uint32_t>(a), bit_cast<P, uint32_t>(b)));
+}
+
+template <typename T, typename Op>
+MSCCLPP_DEVICE_INLINE int4 apply_vectors(int4 a, int4 b) {
+  int4 ret;
+  ret.w = apply_words<T, Op>(a.w, b.w);
+  ret.x = apply_words<T, Op>(a.x, b.x);
+  ret.y = apply_words<T, Op>(a.y, b.y);
+  ret.z = apply_words<T, Op>(a.z, b.z);
+  return ret;
+}
+
+template <typename T, typename Op>
+MSCCLPP_DEVICE_INLINE uint2 apply_vectors(uint2 a, uint2 b) {
+  uint2 ret;
+  ret.x = apply_words<T, Op>(a.x, b.x);
+  ret.y = apply_words<T, Op>(a.y, b.y);
+  return ret;
+}
+
+template <typename T, typename Op>
+MSCCLPP_DEVICE_INLINE __attribute__((unused)) int apply_vectors(int a, int b) {
+  return apply_words<T, Op>(a, b);
+}
+
+template <typename T, typename Op>
+MSCCLPP_DEVICE_INLINE uint32_t apply_vectors(uint32_t a, uint32_t b) {
+  return apply_words<T, Op>(a, b);
+}
+
+// Vector of the same 32 bits in every component
+template <typename V>
+MSCCLPP_DEVICE_INLINE V broadcast_word(uint32_t word);
+
+template <>
+MSCCLPP_DEVICE_INLINE int4 broadcast_word(uint32_t word) {
+  return make_int4(word, word, word, word);
+}
+
+template <>
+MSCCLPP_DEVICE_INLINE uint2 broadcast_word(uint32_t word) {
+  return make_uint2(word, word);
 }
 
 template <>
-MSCCLPP_DEVICE_INLINE __attribute__((unused)) int add_vectors<__half>(int a, int b) {
-  return add_vectors_helper<__half2>(a, b);
+MSCCLPP_DEVICE_INLINE __attribute__((unused)) int broadcast_word(uint32_t word) {
+  return word;
 }
 
 template <>
-MSCCLPP_DEVICE_INLINE __attribute__((unused)) int add_vectors<__bfloat16>(int a, int b) {
-  return add_vectors_helper<__bfloat162>(a, b);
+MSCCLPP_DEVICE_INLINE uint32_t broadcast_word(uint32_t word) {
+  return word;
+}
+
+// Combine two vectors of elements of type T with `op`. PREMUL_SUM sums, the final reduces multiply by the factor.
+template <typename T, typename V>
+MSCCLPP_DEVICE_INLINE V reduce_vectors(V a, V b, mscclpp::ReduceOp op) {
+  switch (op) {
+    case mscclpp::ReduceOp::PROD:
+      return apply_vectors<T, ProdOp>(a, b);
+    case mscclpp::ReduceOp::MAX:
+      return apply_vectors<T, MaxOp>(a, b);
+    case mscclpp::ReduceOp::MIN:
+      return apply_vectors<T, MinOp>(a, b);
+    default:
+      return apply_vectors<T, SumOp>(a, b);
+  }
 }
 
 template <typename T>
-MSCCLPP_DEVICE_INLINE uint32_t add_vectors_helper(uint32_t a, uint32_t b) {
-  return bit_cast<uint32_t, T>(add_elements(bit_cast<T, uint32_t>(a), bit_cast<T, uint32_t>(b)));
+MSCCLPP_DEVICE_INLINE T reduce_elements(T a, T b, mscclpp::ReduceOp op) {
+  switch (op) {
+    case mscclpp::ReduceOp::PROD:
+      return mul_elements(a, b);
+    case mscclpp::ReduceOp::MAX:
+      return max_elements(a, b);
+    case mscclpp::ReduceOp::MIN:
+      return min_elements(a, b);
+    default:
+      return add_elements(a, b);
+  }
 }
 
+// Factor of a PREMUL_SUM, read from `scalar` if it is not null, as a word of packed elements of type T, see
+// PackedElements
 template <typename T>
-MSCCLPP_DEVICE_INLINE uint32_t add_vectors(uint32_t a, uint32_t b) {
-  return add_vectors_helper<T>(a, b);
+MSCCLPP_DEVICE_INLINE uint32_t scale_word(double value, const T* scalar) {
+  return bit_cast<uint32_t, T>(scalar != nullptr ? *scalar : T(value));
+}
+
+template <>
+MSCCLPP_DEVICE_INLINE uint32_t scale_word<float>(double value, const float* scalar) {
+  return bit_cast<uint32_t, float>(scalar != nullptr ? *scalar : float(value));
 }
 
 template <>
-MSCCLPP_DEVICE_INLINE uint32_t add_vectors<__half>(uint32_t a, uint32_t b) {
-  return add_vectors_helper<__half2>(a, b);
+MSCCLPP_DEVICE_INLINE uint32_t scale_word<__half>(double value, const __half* scalar) {
+  return bit_cast<uint32_t, __half2>(scalar != nullptr ? __half2half2(*scalar) : __float2half2_rn(float(value)));
 }
 
 template <>
-MSCCLPP_DEVICE_INLINE uint32_t add_vectors<__bfloat16>(uint32_t a, uint32_t b) {
-  return add_vectors_helper<__bfloat162>(a, b);
+MSCCLPP_DEVICE_INLINE uint32_t scale_word<__bfloat16>(double value, const __bfloat16* scalar) {
+  return bit_cast<uint32_t, __bfloat162>(scalar != nullptr ? __bfloat162bfloat162(*scalar)
+                                                             : __float2bfloat162_rn(float(value)));
+}
+
+// Multiply the elements of type T of `a` by the factor packed in `scale`, see scale_word
+template <typename T, typename V>
+MSCCLPP_DEVICE_INLINE V scale_vectors(V a, uint32_t scale) {
+  return apply_vectors<T, ProdOp>(a, broadcast_word<V>(scale));
+}
+
+template <typename T>
+MSCCLPP_DEVICE_INLINE T scale_elements(T a, uint32_t scale) {
+  if constexpr (sizeof(T) == sizeof(uint16_t)) {
+    return mul_elements(a, bit_cast<T, uint16_t>(uint16_t(scale)));
+  } else {
+    return mul_elements(a, bit_cast<T, uint32_t>(scale));
+  }
 }
 
 }  // namespace
@@ -229,12 +396,15 @@ MSCCLPP_DEVICE_INLINE void handlePut(DeviceHandle<SmChannel>* smChannel,
   }
 }
 
+// Reductions combine their operands with `op`. The final reduce of a chunk of a PREMUL_SUM is `scaled`: it multiplies
+// the result by the factor packed in `scale` before storing and sending it, see Operation::finalReduce.
 template <typename T>
 MSCCLPP_DEVICE_INLINE void handleReadReduceCopySend(T* output, uint32_t outputOffsetByBytes, T* input,
                                                     uint32_t inputOffsetByBytes, DeviceHandle<SmChannel>* smChannels,
                                                     uint8_t* dstChannelIndexes, uint8_t* srcChannelIndexes,
                                                     uint32_t* dstOffsets, uint32_t* srcOffsets, int nDstChannels,
-                                                    int nSrcChannels, uint32_t size, bool sendToRemote = true) {
+                                                    int nSrcChannels, uint32_t size, ReduceOp op, bool scaled,
+                                                    uint32_t scale, bool sendToRemote = true) {
   const size_t nInt4 = size / sizeof(int4);
   const size_t inputOffset4 = inputOffsetByBytes / sizeof(int4);
   const size_t outputOffset4 = outputOffsetByBytes / sizeof(int4);
@@ -246,7 +416,10 @@ MSCCLPP_DEVICE_INLINE void handleReadReduceCopySend(T* output, uint32_t outputOf
       int4 val;
       size_t srcOffset = srcOffsets[index] / sizeof(int4);
       val = smChannels[srcChannelIndexes[index]].read<int4>(srcOffset + idx);
-      tmp = add_vectors<T>(tmp, val);
+      tmp = reduce_vectors<T>(tmp, val, op);
+    }
+    if (scaled) {
+      tmp = scale_vectors<T>(tmp, scale);
     }
     output4[outputOffset4 + idx] = tmp;
     if (sendToRemote) {
@@ -264,7 +437,11 @@ MSCCLPP_DEVICE_INLINE void handleReadReduceCopySend(T* output, uint32_t outputOf
     T tmp = input[idx];
     for (int index = 0; index < nSrcChannels; ++index) {
       size_t srcOffset = srcOffsets[index] / sizeof(T);
-      tmp = add_elements(tmp, smChannels[srcChannelIndexes[index]].read<T>(srcOffset + idx));
+      T val = smChannels[srcChannelIndexes[index]].read<T>(srcOffset + idx);
+      tmp = reduce_elements(tmp, val, op);
+    }
+    if (scaled) {
+      tmp = scale_elements(tmp, scale);
     }
     output[idx] = tmp;
     if (sendToRemote) {
@@ -284,8 +461,9 @@ MSCCLPP_DEVICE_INLINE void handlePutPacket(size_t scratchSize, DeviceHandle<SmCh
   const size_t scratchBaseOffset = flag & 0x1 ? 0 : scratchSize >> 1;
   if (chType == ChannelType::SM) {
     for (int index = 0; index < nDstChannels; ++index) {
-      smChannels[dstChannelIndexes[index]].putPackets<PacketType>(
-          scratchBaseOffset + dstOffsets[index] * 2, srcOffsets[index], size, threadIdx.x, blockDim.x, flag);
+      smChannels[dstChannelIndexes[index]].putPackets<PacketType>(scratchBaseOffset + dstOffsets[index] * 2,
+                                                                  srcOffsets[index], size, threadIdx.x, blockDim.x,
+                                                                  flag);
     }
   }
   if (chType == ChannelType::PROXY) {
@@ -305,7 +483,7 @@ MSCCLPP_DEVICE_INLINE void handleReduceSendPacket(T* dst, uint32_t dstOffsetByBy
                                                   T* inputBuff, size_t inputBuffSize, uint32_t* inputOffsets, int nSrcs,
                                                   DeviceHandle<SmChannel>* smChannels, uint8_t* outputChannelIndexes,
                                                   uint32_t* outputOffsets, int nDstChannels, size_t size,
-                                                  uint32_t flag) {
+                                                  uint32_t flag, ReduceOp op, bool scaled, uint32_t scale) {
   size_t nPackets = size * 2 / sizeof(PacketType);
   const size_t intputBaseOffset = flag & 0x1 ? 0 : inputBuffSize >> 1;
   const uint32_t srcOffset = srcOffsetByBytes / sizeof(PacketPayload<PacketType>);
@@ -313,13 +491,20 @@ MSCCLPP_DEVICE_INLINE void handleReduceSendPacket(T* dst, uint32_t dstOffsetByBy
   PacketPayload<PacketType>* srcPacketPayload = (PacketPayload<PacketType>*)src + srcOffset;
   PacketPayload<PacketType>* dstPacketPayload = (PacketPayload<PacketType>*)dst + dstOffset;
   for (size_t idx = threadIdx.x; idx < nPackets; idx += blockDim.x) {
-    PacketPayload<PacketType> data = {};
-    for (int index = 0; index < nSrcs; ++index) {
-      PacketType* pkt = (PacketType*)((char*)inputBuff + intputBaseOffset + 2 * inputOffsets[index]);
-      PacketPayload<PacketType> val = pkt[idx].read(flag);
-      data = add_vectors<T>(data, val);
+    PacketPayload<PacketType> data = srcPacketPayload[idx];
+    if (nSrcs > 0) {
+      // The packets first, then the source
+      PacketPayload<PacketType> local = data;
+      for (int index = 0; index < nSrcs; ++index) {
+        PacketType* pkt = (PacketType*)((char*)inputBuff + intputBaseOffset + 2 * inputOffsets[index]);
+        PacketPayload<PacketType> val = pkt[idx].read(flag);
+        data = index == 0 ? val : reduce_vectors<T>(data, val, op);
+      }
+      data = reduce_vectors<T>(data, local, op);
+    }
+    if (scaled) {
+      data = scale_vectors<T>(data, scale);
     }
-    data = add_vectors<T>(data, srcPacketPayload[idx]);
     dstPacketPayload[idx] = data;
 
     if (SendToRemote) {
@@ -355,9 +540,10 @@ MSCCLPP_DEVICE_INLINE void handleTransformToPacket(void* dst, void* src, size_t
 
 template <typename T>
 MSCCLPP_DEVICE_INLINE void handleReduceSend(T* dst, uint32_t dstOffsetByBytes, T* src, uint32_t srcOffsetByBytes,
-                                            T* input, uint32_t* inputOffsets, DeviceHandle<SmChannel>* smChannels,
-                                            uint8_t* outputChannelIndexes, uint32_t* outputOffsets, int nOutChannels,
-                                            uint32_t size) {
+                                            T* input, uint32_t* inputOffsets, int nInputs,
+                                            DeviceHandle<SmChannel>* smChannels, uint8_t* outputChannelIndexes,
+                                            uint32_t* outputOffsets, int nOutChannels, uint32_t size, ReduceOp op,
+                                            bool scaled, uint32_t scale) {
   const size_t nInt4 = size / sizeof(int4);
   const size_t srcOffset4 = srcOffsetByBytes / sizeof(int4);
   const size_t dstOffset4 = dstOffsetByBytes / sizeof(int4);
@@ -366,10 +552,13 @@ MSCCLPP_DEVICE_INLINE void handleReduceSend(T* dst, uint32_t dstOffsetByBytes, T
   int4* input4 = (int4*)input;
   for (size_t idx = threadIdx.x; idx < nInt4; idx += blockDim.x) {
     int4 tmp = src4[srcOffset4 + idx];
-    for (int index = 0; index < nOutChannels; ++index) {
+    for (int index = 0; index < nInputs; ++index) {
       size_t offset = inputOffsets[index] / sizeof(int4);
       int4 val = input4[offset + idx];
-      tmp = add_vectors<T>(tmp, val);
+      tmp = reduce_vectors<T>(tmp, val, op);
+    }
+    if (scaled) {
+      tmp = scale_vectors<T>(tmp, scale);
     }
     dst4[dstOffset4 + idx] = tmp;
     for (int index = 0; index < nOutChannels; ++index) {
@@ -383,9 +572,13 @@ MSCCLPP_DEVICE_INLINE void handleReduceSend(T* dst, uint32_t dstOffsetByBytes, T
   const size_t endIdx = (srcOffsetByBytes + size) / sizeof(T);
   for (size_t idx = threadIdx.x + startIdx; idx < endIdx; idx += blockDim.x) {
     T tmp = src[idx];
-    for (int index = 0; index < nOutChannels; ++index) {
+    for (int index = 0; index < nInputs; ++index) {
       size_t offset = inputOffsets[index] / sizeof(T);
-      tmp = add_elements(tmp, input[offset + idx]);
+      T val = input[offset + idx];
+      tmp = reduce_elements(tmp, val, op);
+    }
+    if (scaled) {
+      tmp = scale_elements(tmp, scale);
     }
     dst[idx] = tmp;
     for (int index = 0; index < nOutChannels; ++index) {
@@ -395,6 +588,13 @@ MSCCLPP_DEVICE_INLINE void handleReduceSend(T* dst, uint32_t dstOffsetByBytes, T
   }
 }
 
+// Copy `size` bytes, rounded up to whole int4, from global to shared memory. Both must be 16-byte aligned.
+MSCCLPP_DEVICE_INLINE void loadSharedMemory(void* dst, const void* src, size_t size) {
+  for (size_t i = threadIdx.x; i < (size + sizeof(int4) - 1) / sizeof(int4); i += blockDim.x) {
+    ((int4*)dst)[i] = ((const int4*)src)[i];
+  }
+}
+
 MSCCLPP_DEVICE_INLINE void handleCopy(void* dst, void* src, uint32_t dstOffset, uint32_t srcOffset, size_t size) {
   char* srcData = (char*)src + srcOffset;
   char* dstData = (char*)dst + dstOffset;
@@ -403,7 +603,7 @@ MSCCLPP_DEVICE_INLINE void handleCopy(void* dst, void* src, uint32_t dstOffset,
 
 template <typename T, typename PacketType = LL16Packet>
 __global__ void executionKernel([[maybe_unused]] int rank /*for debug*/, T* input, T* output, T* scratch,
-                                size_t scratchSize, DeviceExecutionPlan* plan, uint32_t flag
+                                size_t scratchSize, DeviceExecutionPlan* plan, uint32_t flag, Reduction reduction
 #if defined(ENABLE_NPKIT)
                                 ,
                                 NpKitEventCollectContext* npKitEventCollectContexts, uint64_t* cpuTimestamp) {
@@ -412,27 +612,47 @@ __global__ void executionKernel([[maybe_unused]] int rank /*for debug*/, T* inpu
 #endif
   extern __shared__ int4 sharedMem[];
   int bid = blockIdx.x;
-  int tid = threadIdx.x;
+  // A PREMUL_SUM sums, and the final reduces multiply by its factor
+  const bool premul = reduction.op == ReduceOp::PREMUL_SUM;
+  const ReduceOp reduceOp = premul ? ReduceOp::SUM : reduction.op;
+  const uint32_t scale = premul ? scale_word<T>(reduction.scalar, (const T*)reduction.deviceScalar) : 0;
+  DeviceExecutionPlan localPlan = plan[bid];
+  char* planBuffer = (char*)plan;
+  if (localPlan.argsOffset != 0) {
+    const DeviceExecutionArgs* args = (const DeviceExecutionArgs*)(planBuffer + localPlan.argsOffset);
+    input = (T*)args->input;
+    output = (T*)args->output;
+    scratch = (T*)args->scratch;
+    scratchSize = args->scratchSize;
+    flag = args->flag;
+  }
+  uint8_t* operations = (uint8_t*)sharedMem + localPlan.sharedChannelsSize;
 #if defined(ENABLE_NPKIT)
-  NpKitEvent* event_buffer = (NpKitEvent*)((char*)sharedMem + sizeof(DeviceExecutionPlan));
+  NpKitEvent* event_buffer = (NpKitEvent*)(operations + localPlan.operationPageSize);
   uint64_t event_buffer_head = 0;
 #if defined(ENABLE_NPKIT_EVENT_EXECUTOR_INIT_ENTRY) && defined(ENABLE_NPKIT_EVENT_EXECUTOR_INIT_EXIT)
   uint64_t npkit_timestamp_entry = 0;
-  if (tid == 0) {
+  if (threadIdx.x == 0) {
     npkit_timestamp_entry = NPKIT_GET_GPU_TIMESTAMP();
   }
 #endif
 #endif
-  DeviceExecutionPlan* localPlan = plan + bid;
-  for (size_t i = tid; i < sizeof(DeviceExecutionPlan) / sizeof(int4); i += blockDim.x) {
-    sharedMem[i] = ((int4*)localPlan)[i];
+  DeviceHandle<SmChannel>* smChannels = (DeviceHandle<SmChannel>*)(planBuffer + localPlan.smChannelsOffset);
+  DeviceHandle<SimpleProxyChannel>* proxyChannels =
+      (DeviceHandle<SimpleProxyChannel>*)(planBuffer + localPlan.proxyChannelsOffset);
+  if (localPlan.sharedChannelsSize > 0) {
+    loadSharedMemory(sharedMem, planBuffer + localPlan.smChannelsOffset, localPlan.channelsSize);
+    smChannels = (DeviceHandle<SmChannel>*)sharedMem;
+    proxyChannels = (DeviceHandle<SimpleProxyChannel>*)((char*)sharedMem +
+                                                        (localPlan.proxyChannelsOffset - localPlan.smChannelsOffset));
   }
+  int nOperations = localPlan.nOperations;
+  uint32_t operationsSize = localPlan.operationsSize;
+  uint32_t pageSize = localPlan.operationPageSize;
+  uint32_t pageBegin = 0;
+  const char* globalOperations = planBuffer + localPlan.operationsOffset;
+  loadSharedMemory(operations, globalOperations, min(operationsSize, pageSize));
   __syncshm();
-  localPlan = (DeviceExecutionPlan*)sharedMem;
-  int nOperations = localPlan->nOperations;
-  Operation* operations = localPlan->operations;
-  DeviceHandle<SmChannel>* smChannels = localPlan->channels.smChannels;
-  DeviceHandle<SimpleProxyChannel>* proxyChannels = localPlan->channels.proxyChannels;
 
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_TIME_SYNC_CPU)
 #if defined(MSCCLPP_DEVICE_HIP)
@@ -456,8 +676,18 @@ __global__ void executionKernel([[maybe_unused]] int rank /*for debug*/, T* inpu
                             &event_buffer_head);
 #endif
 
+  uint32_t position = 0;
   for (int i = 0; i < nOperations; i++) {
-    Operation& op = operations[i];
+    // Move the page forward when the next operation may not be entirely in it. Every thread must be done with the
+    // current page before it is overwritten.
+    if (position + MAX_ENCODED_OPERATION_SIZE > pageBegin + pageSize && pageBegin + pageSize < operationsSize) {
+      pageBegin = position / sizeof(int4) * sizeof(int4);
+      __syncshm();
+      loadSharedMemory(operations, globalOperations + pageBegin, min(operationsSize - pageBegin, pageSize));
+      __syncshm();
+    }
+    Operation op;
+    position += decodeOperation(operations + (position - pageBegin), op);
 
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_EXECUTOR_OP_BASE_ENTRY)
     NpKit::CollectGpuEventShm(NPKIT_EVENT_EXECUTOR_OP_BASE_ENTRY + (int)op.type, op.size, 0, NPKIT_GET_GPU_TIMESTAMP(),
@@ -492,14 +722,14 @@ __global__ void executionKernel([[maybe_unused]] int rank /*for debug*/, T* inpu
       T* src = getBuffer(input, output, scratch, op.srcBufferType);
       handleReadReduceCopySend(dst, op.dstOffset, src, op.srcOffset, smChannels, op.outputChannelIndexes,
                                op.inputChannelIndexes, op.outputOffsets, op.inputOffsets, op.nOutputs, op.nInputs,
-                               op.size);
+                               op.size, reduceOp, premul && op.finalReduce, scale);
     } else if (op.type == OperationType::READ_REDUCE_COPY) {
       T* dst = getBuffer(input, output, scratch, op.dstBufferType);
       T* src = getBuffer(input, output, scratch, op.srcBufferType);
 
       handleReadReduceCopySend(dst, op.dstOffset, src, op.srcOffset, smChannels, op.outputChannelIndexes,
                                op.inputChannelIndexes, op.outputOffsets, op.inputOffsets, op.nOutputs, op.nInputs,
-                               op.size, false);
+                               op.size, reduceOp, premul && op.finalReduce, scale, false);
     } else if (op.type == OperationType::PUT_PACKET) {
       handlePutPacket<PacketType>(scratchSize, smChannels, proxyChannels, op.outputChannelIndexes, op.outputOffsets,
                                   op.inputOffsets, op.nOutputs, op.size, op.channelType, flag);
@@ -508,13 +738,14 @@ __global__ void executionKernel([[maybe_unused]] int rank /*for debug*/, T* inpu
       T* src = getBuffer(input, output, scratch, op.srcBufferType);
       handleReduceSendPacket<T, PacketType>(dst, op.dstOffset, src, op.srcOffset, scratch, scratchSize, op.inputOffsets,
                                             op.nInputs, smChannels, op.outputChannelIndexes, op.outputOffsets,
-                                            op.nOutputs, op.size, flag);
+                                            op.nOutputs, op.size, flag, reduceOp, premul && op.finalReduce, scale);
     } else if (op.type == OperationType::REDUCE_PACKET) {
       T* dst = getBuffer(input, output, scratch, op.dstBufferType);
       T* src = getBuffer(input, output, scratch, op.srcBufferType);
       handleReduceSendPacket<T, PacketType, false>(dst, op.dstOffset, src, op.srcOffset, scratch, scratchSize,
                                                    op.inputOffsets, op.nInputs, smChannels, op.outputChannelIndexes,
-                                                   op.outputOffsets, op.nOutputs, op.size, flag);
+                                                   op.outputOffsets, op.nOutputs, op.size, flag, reduceOp,
+                                                   premul && op.finalReduce, scale);
     } else if (op.type == OperationType::COPY_PACKET) {
       T* dst = getBuffer(input, output, scratch, op.dstBufferType);
       T* src = getBuffer(input, output, scratch, op.srcBufferType);
@@ -527,8 +758,15 @@ __global__ void executionKernel([[maybe_unused]] int rank /*for debug*/, T* inpu
       T* dst = getBuffer(input, output, scratch, op.dstBufferType);
       T* src = getBuffer(input, output, scratch, op.srcBufferType);
       T* tmp = getBuffer(input, output, scratch, op.inputBufferType);
-      handleReduceSend(dst, op.dstOffset, src, op.srcOffset, tmp, op.inputOffsets, smChannels, op.outputChannelIndexes,
-                       op.outputOffsets, op.nOutputs, op.size);
+      handleReduceSend(dst, op.dstOffset, src, op.srcOffset, tmp, op.inputOffsets, op.nOutputs, smChannels,
+                       op.outputChannelIndexes, op.outputOffsets, op.nOutputs, op.size, reduceOp,
+                       premul && op.finalReduce, scale);
+    } else if (op.type == OperationType::REDUCE) {
+      T* dst = getBuffer(input, output, scratch, op.dstBufferType);
+      T* src = getBuffer(input, output, scratch, op.srcBufferType);
+      T* tmp = getBuffer(input, output, scratch, op.inputBufferType);
+      handleReduceSend(dst, op.dstOffset, src, op.srcOffset, tmp, op.inputOffsets, op.nInputs, smChannels, nullptr,
+                       nullptr, 0, op.size, reduceOp, premul && op.finalReduce, scale);
     }
 
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_EXECUTOR_OP_BASE_EXIT)
@@ -549,11 +787,11 @@ class ExecutionKernel {
   template <typename PacketType>
   static void launchKernel(int rank, int nthreadblocks, int nthreads, void* src, void* dst, void* scratch,
                            size_t scratchSize, DataType dataType, DeviceExecutionPlan* plan, size_t sharedMemSize,
-                           cudaStream_t stream, uint32_t flag = 0) {
+                           cudaStream_t stream, uint32_t flag = 0, Reduction reduction = {}) {
     switch (dataType) {
       case DataType::INT32:
         executionKernel<int32_t, PacketType><<<nthreadblocks, nthreads, sharedMemSize, stream>>>(
-            rank, (int32_t*)src, (int32_t*)dst, (int32_t*)scratch, scratchSize, plan, flag
+            rank, (int32_t*)src, (int32_t*)dst, (int32_t*)scratch, scratchSize, plan, flag, reduction
 #if defined(ENABLE_NPKIT)
             ,
             NpKit::GetGpuEventCollectContexts(), NpKit::GetCpuTimestamp());
@@ -563,7 +801,7 @@ class ExecutionKernel {
         break;
       case DataType::UINT32:
         executionKernel<uint32_t, PacketType><<<nthreadblocks, nthreads, sharedMemSize, stream>>>(
-            rank, (uint32_t*)src, (uint32_t*)dst, (uint32_t*)scratch, scratchSize, plan, flag
+            rank, (uint32_t*)src, (uint32_t*)dst, (uint32_t*)scratch, scratchSize, plan, flag, reduction
 #if defined(ENABLE_NPKIT)
             ,
             NpKit::GetGpuEventCollectContexts(), NpKit::GetCpuTimestamp());
@@ -573,7 +811,7 @@ class ExecutionKernel {
         break;
       case DataType::FLOAT16:
         executionKernel<half, PacketType><<<nthreadblocks, nthreads, sharedMemSize, stream>>>(
-            rank, (half*)src, (half*)dst, (half*)scratch, scratchSize, plan, flag
+            rank, (half*)src, (half*)dst, (half*)scratch, scratchSize, plan, flag, reduction
 #if defined(ENABLE_NPKIT)
             ,
             NpKit::GetGpuEventCollectContexts(), NpKit::GetCpuTimestamp());
@@ -583,7 +821,7 @@ class ExecutionKernel {
         break;
       case DataType::FLOAT32:
         executionKernel<float, PacketType><<<nthreadblocks, nthreads, sharedMemSize, stream>>>(
-            rank, (float*)src, (float*)dst, (float*)scratch, scratchSize, plan, flag
+            rank, (float*)src, (float*)dst, (float*)scratch, scratchSize, plan, flag, reduction
 #if defined(ENABLE_NPKIT)
             ,
             NpKit::GetGpuEventCollectContexts(), NpKit::GetCpuTimestamp());
@@ -593,7 +831,7 @@ class ExecutionKernel {
         break;
       case DataType::BFLOAT16:
         executionKernel<__bfloat16, PacketType><<<nthreadblocks, nthreads, sharedMemSize, stream>>>(
-            rank, (__bfloat16*)src, (__bfloat16*)dst, (__bfloat16*)scratch, scratchSize, plan, flag
+            rank, (__bfloat16*)src, (__bfloat16*)dst, (__bfloat16*)scratch, scratchSize, plan, flag, reduction
 #if defined(ENABLE_NPKIT)
             ,
             NpKit::GetGpuEventCollectContexts(), NpKit::GetCpuTimestamp());
@@ -607,7 +845,7 @@ class ExecutionKernel {
   template <typename PacketType>
   static void launchKernel(int rank, int nthreadblocks, int nthreads, void* src, void* dst, void* scratch,
                            size_t scratchSize, DataType dataType, DeviceExecutionPlan* plan, size_t sharedMemSize,
-                           cudaStream_t stream, uint32_t flag = 0);
+                           cudaStream_t stream, uint32_t flag = 0, Reduction reduction = {});
 #endif  // !defined(MSCCLPP_DEVICE_HIP)
 };
 }  // namespace mscclpp
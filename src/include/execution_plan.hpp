@@ -4,10 +4,14 @@
 #ifndef MSCCLPP_EXECUTOR_PLAN_HPP_
 #define MSCCLPP_EXECUTOR_PLAN_HPP_
 
+#include <atomic>
+#include <memory>
 #include <mscclpp/core.hpp>
 #include <mscclpp/executor.hpp>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 
 #include "execution_common.hpp"
@@ -54,11 +58,97 @@ struct ChannelInfo {
   std::vector<int> connectedPeers;
 };
 
+// Size-independent form of an operation. Channels are already resolved to threadblock-local indexes while offsets are
+// kept as chunk indexes, so an `Operation` can be instantiated for any message size without going back to the plan
+// file. The layout is fixed because templates are stored as-is in compiled plan files.
+struct OperationTemplate {
+  OperationType type;
+  ChannelType channelType;
+  BufferType srcBufferType;
+  BufferType dstBufferType;
+  // Buffer the input/output chunk indexes refer to
+  BufferType inputBufferType;
+  BufferType outputBufferType;
+  uint8_t nInputs;
+  uint8_t nOutputs;
+  uint8_t hasInputChannels;
+  uint8_t hasOutputChannels;
+  uint8_t hasSrcChunk;
+  uint8_t hasDstChunk;
+  uint8_t hasCount;
+  // Set on the reduce that completes a chunk of the output, `"final": true` in the plan
+  uint8_t finalReduce;
+  uint8_t inputChannelIndexes[MAX_CHANNEL_PER_OPERATION];
+  uint8_t outputChannelIndexes[MAX_CHANNEL_PER_OPERATION];
+  uint32_t inputChunks[MAX_CHANNEL_PER_OPERATION];
+  uint32_t outputChunks[MAX_CHANNEL_PER_OPERATION];
+  uint32_t srcChunk;
+  uint32_t dstChunk;
+  uint32_t nChunks;
+};
+static_assert(std::is_trivially_copyable_v<OperationTemplate>);
+
+// Positions in `ChunkOffsetTable::offsets` of the chunks an operation refers to, in the order inputs, outputs, src and
+// dst. `end` holds the chunks `nChunks` further, which give the operation size.
+struct OperationChunks {
+  uint8_t nChunks;
+  uint32_t begin[2 * MAX_CHANNEL_PER_OPERATION + 2];
+  uint32_t end[2 * MAX_CHANNEL_PER_OPERATION + 2];
+};
+
+// Chunk k of a rank is chunk k % nChunks of block k / nChunks. The input, output and scratch buffers each hold one or
+// more blocks of `blockSize` bytes: the output of an allgather and the input of a reduce-scatter hold one block per
+// rank, both buffers of an alltoall one block per peer, and the buffers of other collectives a single block. Chunks of
+// a block differ in size by at most one alignment unit.
+struct ChunkLayout {
+  size_t blockSize;
+  uint32_t nChunks;
+};
+
+// Part of a message one execution of a plan covers. A message whose blocks are larger than ExecutorConfig::tileSize
+// runs the plan once per tile, on bytes [offset, offset + size) of every block of the input and output. The operations
+// are instantiated for blocks of `size` bytes, which sit `blockStride` bytes apart in the input and output and from
+// `scratchOffset` on in the scratch buffer. The default tile is the whole message with adjacent blocks.
+struct ExecutionTile {
+  size_t offset;
+  size_t size;
+  size_t blockStride;
+  size_t scratchOffset;
+};
+
+// Chunk indexes referenced by the operations of a rank, deduplicated and split into group and in-group indexes once.
+// Instantiating the operations for a message size only computes `offsets` with a loop over these tables.
+struct ChunkOffsetTable {
+  uint32_t nChunksPerBlock;
+  uint32_t nChunksPerGroup;
+  std::vector<uint32_t> chunkIndexes;
+  std::vector<uint32_t> groupIndexes;
+  std::vector<uint32_t> indexesInGroup;
+  // Byte offsets of `chunkIndexes` for the current message size
+  std::vector<uint32_t> offsets;
+  // operationChunks[threadblock][operation]
+  std::vector<std::vector<OperationChunks>> operationChunks;
+};
+
+// `deps` entry of an operation: the operation at `operation` in a threadblock must run after step `step` of threadblock
+// `threadblock` of the same rank. Dependencies are not executed by the kernel, plans must order the operations with
+// barriers, signals and waits; they are kept for verification.
+struct OperationDependency {
+  uint32_t operation;
+  uint32_t threadblock;
+  uint32_t step;
+};
+
+class ExecutionPlanFile;
+
 struct ExecutionPlan::Impl {
  public:
   Impl(const std::string name, const std::string planPath);
   ~Impl() = default;
 
+  // Implementation of `plan`, for the tools of the library that work on plans
+  static const Impl& of(const ExecutionPlan& plan) { return *plan.impl_; }
+
   std::vector<ChannelInfo> getChannelInfos(int rank, ChannelType channelType) const;
   std::vector<ChannelInfo> getChannelInfos(int rank, BufferType bufferType) const;
   std::vector<ChannelInfo> getChannelInfosByDstRank(int rank, BufferType bufferType) const;
@@ -66,21 +156,48 @@ struct ExecutionPlan::Impl {
   std::vector<int> getConnectedPeers(int rank) const;
   std::vector<BufferType> getConnectedBufferTypes(int rank) const;
   size_t getScratchBufferSize(int rank, size_t inputSize, size_t outputSize) const;
+  ChunkLayout calcChunkLayout(int rank, size_t inputSize, size_t outputSize) const;
+  // Split a message into tiles of at most `maxTileSize` bytes of every block, see ExecutionTile. The scratch offsets
+  // are left to the caller. A message whose blocks fit returns the default tile.
+  std::vector<ExecutionTile> getTiles(int rank, size_t inputSize, size_t outputSize, size_t maxTileSize) const;
+  size_t getTileScratchBufferSize(int rank, size_t maxTileSize) const;
   std::vector<Operation> getOperations(int rank, int threadblock) const;
   int getThreadblockCount(int rank) const;
   int getNThreadsPerBlock() const;
-
-  void loadExecutionPlan(size_t inputSize, size_t outputSize, size_t contsSrcOffset, size_t constDstOffset);
-  void lightLoadExecutionPlan(size_t inputSize, size_t outputSize, size_t contsSrcOffset, size_t constDstOffset);
-  void setupChannels(const nlohmann::json& gpus);
-  void setupOperations(const nlohmann::json& gpus, size_t contsSrcOffset, size_t constDstOffset);
+  // Whether the output of the collective is a reduction of the inputs of the ranks, which AVG and PREMUL_SUM scale
+  bool reducesInputs() const;
+
+  void loadExecutionPlan(int rank, size_t inputSize, size_t outputSize, size_t contsSrcOffset, size_t constDstOffset,
+                         const ExecutionTile& tile = {});
+  void lightLoadExecutionPlan(size_t inputSize, size_t outputSize, size_t contsSrcOffset, size_t constDstOffset,
+                              const ExecutionTile& tile = {});
+  void setupChannels(const nlohmann::json& gpus, int localRank = -1);
+  void setupOperationTemplates(const nlohmann::json& gpus, int localRank = -1);
+  void setupChunkOffsetTable(int rank);
+  void setupOperations(size_t contsSrcOffset, size_t constDstOffset, const ExecutionTile& tile = {});
+
+  // Load the structure of the plan for `rank` (or all ranks if `rank` is -1). Only the channels, channel maps and
+  // operation templates of the requested rank are materialized, plus what other ranks connect to it (incoming channels
+  // and channel counts). A compiled plan file is mapped and only the sections of the requested ranks are decoded.
+  void loadPlan(int rank = -1);
+  void loadJsonPlan(int rank = -1);
+  void loadCompiledRank(int rank);
+  void saveCompiledPlan(const std::string& path) const;
+  // Rewrite the operation templates of the loaded ranks, see ExecutionPlan::optimize.
+  PlanOptimizationStats optimize();
 
   void reset();
   void operationsReset();
 
   const std::string name;
   const std::string planPath;
+  // `collective` of the plan, empty if it has none
+  std::string collective;
+  int worldSize;
   bool isUsingPacket;
+  // Whether the plan marks the reduce that completes each chunk of the output on any rank. Only such plans can
+  // multiply by the factor of AVG and PREMUL_SUM.
+  bool marksFinalReduces;
   // operations for [rank][threadblock] = [operations]
   std::unordered_map<int, std::vector<std::vector<Operation>>> operations;
   std::unordered_map<int, std::vector<ChannelInfo>> channelInfos;
@@ -89,6 +206,11 @@ struct ExecutionPlan::Impl {
   // threadblockChannelMap[rank][threadblock] = [channelIndex, channelKey]
   std::unordered_map<int, std::vector<std::vector<std::pair<int, ChannelKey>>>> threadblockSMChannelMap;
   std::unordered_map<int, std::vector<std::vector<std::pair<int, ChannelKey>>>> threadblockProxyChannelMap;
+  // operationTemplates[rank][threadblock] = [operation templates]
+  std::unordered_map<int, std::vector<std::vector<OperationTemplate>>> operationTemplates;
+  // operationDependencies[rank][threadblock] = [dependencies of the operations of the threadblock]
+  std::unordered_map<int, std::vector<std::vector<OperationDependency>>> operationDependencies;
+  std::unordered_map<int, ChunkOffsetTable> chunkOffsetTables;
   std::unordered_map<int, uint32_t> inputChunks;
   std::unordered_map<int, uint32_t> outputChunks;
   std::unordered_map<int, uint32_t> scratchChunks;
@@ -96,14 +218,25 @@ struct ExecutionPlan::Impl {
   size_t inputSize;
   size_t outputSize;
   int nThreadsPerBlock;
+  bool isAllRanksLoaded;
+  std::shared_ptr<ExecutionPlanFile> compiledPlanFile;
+  // Held by the executors while they load the plan and instantiate its operations
+  std::mutex mutex;
+  // Number of times a PlanRegistry reloaded the plan file before this version, see ExecutionPlan::version
+  uint64_t version = 0;
+  // Set when a PlanRegistry replaces this version by a reloaded one. Shared with the executor contexts of the plan,
+  // which are torn down once it is set.
+  std::shared_ptr<std::atomic<bool>> superseded = std::make_shared<std::atomic<bool>>(false);
 
  private:
-  std::pair<size_t, u_int32_t> calcSizePerRank(int rank, size_t inputSize, size_t outputSize) const;
-  size_t getOffset(int rank, size_t inputSize, size_t outputSize, uint32_t chunkIndex, uint32_t alignment = 16) const;
-  size_t getNChunkSize(int rank, size_t inputSize, size_t outputSize, uint32_t nChunks,
-                       const std::vector<uint32_t> offsets) const;
+  uint32_t getChunksPerBlock(int rank) const;
+  size_t getTileSize(int rank, size_t maxTileSize, uint32_t alignment = 16) const;
+  ChunkLayout calcChunkOffsets(int rank, ChunkOffsetTable& table, uint32_t alignment = 16) const;
 };
 
+// Read the name and the PlanInfo of a JSON plan without loading its gpus, see PlanRegistry::loadDirectory.
+std::pair<std::string, PlanInfo> readPlanInfo(const std::string& planPath);
+
 }  // namespace mscclpp
 
 #endif  // MSCCLPP_EXECUTOR_PLAN_HPP_
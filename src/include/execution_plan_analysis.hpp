@@ -0,0 +1,117 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef MSCCLPP_EXECUTION_PLAN_ANALYSIS_HPP_
+#define MSCCLPP_EXECUTION_PLAN_ANALYSIS_HPP_
+
+#include <array>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "execution_plan.hpp"
+
+namespace mscclpp {
+
+// A threadblock channel resolved to the peer it connects to.
+struct PlanChannel {
+  int peer;
+  ChannelType channelType;
+  BufferType srcBufferType;
+  BufferType dstBufferType;
+  // Index among the channels of the same type from this rank to `peer`. The executor pairs the semaphore of the
+  // `ordinal`-th channel from rank A to B with the `ordinal`-th channel of the same type from B to A.
+  int ordinal;
+};
+
+// Semaphore signaled by rank `src` and waited on by rank `dst`.
+struct PlanSemaphore {
+  int src;
+  int dst;
+  ChannelType channelType;
+  int ordinal;
+
+  bool operator<(const PlanSemaphore& other) const {
+    return std::tie(src, dst, channelType, ordinal) < std::tie(other.src, other.dst, other.channelType, other.ordinal);
+  }
+  bool operator==(const PlanSemaphore& other) const {
+    return std::tie(src, dst, channelType, ordinal) == std::tie(other.src, other.dst, other.channelType, other.ordinal);
+  }
+};
+
+// Byte range of a buffer read or written by an operation. Packet accesses are relative to the half of the scratch
+// buffer used by the current execution and count the flags, i.e. they cover twice the payload size.
+struct PlanAccess {
+  int rank;
+  BufferType bufferType;
+  bool isPacket;
+  bool isWrite;
+  uint64_t offset;
+  uint64_t size;
+};
+
+std::string getOperationName(OperationType type);
+std::string getBufferName(BufferType type);
+std::string getChannelTypeName(ChannelType type);
+
+// Whole-plan view used by offline analyses. `plan` must be loaded for all ranks and have its operations instantiated
+// for a message size; channels are resolved to peers and the buffers each operation touches are derived from the
+// semantics of the execution kernel.
+class PlanAnalysis {
+ public:
+  PlanAnalysis(const ExecutionPlan::Impl& plan);
+
+  // Load a separate copy of `plan` for all ranks with the operations instantiated for a message size, leaving `plan`
+  // untouched. Throws if the plan cannot be loaded.
+  static std::unique_ptr<ExecutionPlan::Impl> instantiate(const ExecutionPlan& plan, size_t inputSize,
+                                                          size_t outputSize);
+
+  const std::vector<int>& ranks() const { return ranks_; }
+  int threadblockCount(int rank) const;
+  const std::vector<Operation>& operations(int rank, int threadblock) const;
+  const OperationTemplate& operationTemplate(int rank, int threadblock, int operation) const;
+  const std::vector<OperationDependency>& dependencies(int rank, int threadblock) const;
+  size_t bufferSize(int rank, BufferType bufferType) const;
+  // See ExecutionPlan::Impl::reducesInputs
+  bool reducesInputs() const { return plan_.reducesInputs(); }
+  // See ExecutionPlan::Impl::marksFinalReduces
+  bool marksFinalReduces() const { return plan_.marksFinalReduces; }
+  // Size of the region an access must fit in: the buffer, or half of the scratch buffer for packets
+  size_t accessLimit(const PlanAccess& access) const;
+
+  // Channel `index` of the given type of a threadblock, or nullptr if there is no such channel
+  const PlanChannel* channel(int rank, int threadblock, ChannelType channelType, int index) const;
+  // Input/output channels of an operation, with nullptr for invalid indexes. Empty if the operation has none.
+  std::vector<const PlanChannel*> inputChannels(int rank, int threadblock, int operation) const;
+  std::vector<const PlanChannel*> outputChannels(int rank, int threadblock, int operation) const;
+
+  std::vector<PlanSemaphore> signals(int rank, int threadblock, int operation) const;
+  std::vector<PlanSemaphore> waits(int rank, int threadblock, int operation) const;
+  std::vector<PlanAccess> accesses(int rank, int threadblock, int operation) const;
+
+ private:
+  const ExecutionPlan::Impl& plan_;
+  std::vector<int> ranks_;
+  // channels_[rank][channelType - 1][threadblock] = resolved channels
+  std::unordered_map<int, std::array<std::vector<std::vector<PlanChannel>>, 2>> channels_;
+  std::unordered_map<int, size_t> scratchSizes_;
+};
+
+// Check that a plan is safe to execute for the message size its operations were instantiated for, see
+// ExecutionPlan::verify.
+std::vector<PlanIssue> verifyExecutionPlan(const PlanAnalysis& analysis);
+
+// Predict the execution of a plan for the message size its operations were instantiated for, see
+// ExecutionPlan::simulate.
+SimulationResult simulateExecutionPlan(const PlanAnalysis& analysis, const SimulationConfig& config);
+
+// Run a plan on host buffers for the message size its operations were instantiated for, see
+// ExecutionPlan::executeOnHost.
+void interpretExecutionPlan(const PlanAnalysis& analysis, const std::vector<void*>& inputs,
+                            const std::vector<void*>& outputs, DataType dataType, const Reduction& reduction);
+
+}  // namespace mscclpp
+
+#endif  // MSCCLPP_EXECUTION_PLAN_ANALYSIS_HPP_
@@ -0,0 +1,127 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef MSCCLPP_EXECUTION_PLAN_FILE_HPP_
+#define MSCCLPP_EXECUTION_PLAN_FILE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mscclpp {
+
+// Compiled execution plan file layout (all integers are little-endian):
+//
+//   PlanFileHeader
+//   plan name (nameLength bytes, padded to 8 bytes)
+//   collective (collectiveLength bytes, padded to 8 bytes)
+//   PlanFileRankEntry[nRanks]
+//   rank sections (each aligned to 8 bytes)
+//
+// Each rank section is self-contained: it holds the chunk counts, the channel infos of the rank, the channel infos of
+// the ranks connected to it, the channel counts between the rank and its peers, and the resolved channel maps and
+// operation templates of all its threadblocks. This lets a process decode only the ranks it needs.
+constexpr char PLAN_FILE_MAGIC[8] = {'M', 'S', 'C', 'L', 'P', 'L', 'A', 'N'};
+constexpr uint32_t PLAN_FILE_VERSION = 4;
+constexpr uint32_t PLAN_FILE_FLAG_PACKET = 0x1;
+// The plan marks the reduce that completes each chunk of the output, see OperationTemplate::finalReduce
+constexpr uint32_t PLAN_FILE_FLAG_FINAL_REDUCES = 0x2;
+
+struct PlanFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t fileSize;
+  uint32_t nRanks;
+  uint32_t nThreadsPerBlock;
+  uint32_t nameLength;
+  uint32_t collectiveLength;
+  // Checksum of the plan name, the collective and the rank index
+  uint64_t indexChecksum;
+};
+
+struct PlanFileRankEntry {
+  int32_t rank;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t checksum;
+};
+
+struct PlanFileRankHeader {
+  uint32_t inputChunks;
+  uint32_t outputChunks;
+  uint32_t scratchChunks;
+  uint32_t chunkGroups;
+  uint32_t nChannelInfos;
+  uint32_t nChannelInfosByDstRank;
+  uint32_t nChannelCounts;
+  uint32_t nThreadblocks;
+};
+
+// Followed by nPeers int32_t peer ranks
+struct PlanFileChannelInfo {
+  uint8_t srcBufferType;
+  uint8_t dstBufferType;
+  uint8_t channelType;
+  uint8_t reserved;
+  uint32_t nPeers;
+};
+
+struct PlanFileChannelCount {
+  int32_t rank;
+  int32_t peer;
+  uint32_t channelType;
+  int32_t count;
+};
+
+// Followed by (nSmChannels + nProxyChannels) PlanFileChannelRef, nOperations OperationTemplate and nDependencies
+// OperationDependency
+struct PlanFileThreadblock {
+  uint32_t nSmChannels;
+  uint32_t nProxyChannels;
+  uint32_t nOperations;
+  uint32_t nDependencies;
+};
+
+struct PlanFileChannelRef {
+  int32_t index;
+  uint8_t srcBufferType;
+  uint8_t dstBufferType;
+  uint8_t channelType;
+  uint8_t reserved;
+};
+
+uint64_t planFileChecksum(const char* data, size_t size);
+
+// Read-only view of a compiled execution plan. The file is memory-mapped on construction, where only the header and
+// the rank index are validated. The checksum of a rank section is verified the first time the section is accessed.
+class ExecutionPlanFile {
+ public:
+  ExecutionPlanFile(const std::string& path);
+  ExecutionPlanFile(const ExecutionPlanFile&) = delete;
+  ExecutionPlanFile& operator=(const ExecutionPlanFile&) = delete;
+  ~ExecutionPlanFile();
+
+  static bool isCompiledPlan(const std::string& path);
+
+  const PlanFileHeader& header() const;
+  std::string name() const;
+  std::string collective() const;
+  const std::vector<int>& ranks() const;
+  bool hasRank(int rank) const;
+  std::pair<const char*, size_t> rankSection(int rank);
+
+ private:
+  std::string path_;
+  const char* data_;
+  size_t size_;
+  std::vector<int> ranks_;
+  std::unordered_map<int, const PlanFileRankEntry*> rankEntries_;
+  std::unordered_map<int, bool> validated_;
+};
+
+}  // namespace mscclpp
+
+#endif  // MSCCLPP_EXECUTION_PLAN_FILE_HPP_
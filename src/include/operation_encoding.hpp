@@ -0,0 +1,78 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef MSCCLPP_OPERATION_ENCODING_HPP_
+#define MSCCLPP_OPERATION_ENCODING_HPP_
+
+#include <mscclpp/device.hpp>
+#include <vector>
+
+#include "execution_common.hpp"
+
+namespace mscclpp {
+
+// Device plans store the operations of a threadblock as a byte stream, one operation after another:
+//
+//   tag       type in bits 0-4, bits 5, 6 and 7 are set if srcOffset, dstOffset and size follow
+//   layout    channelType in bits 0-1, srcBufferType in bits 2-3, dstBufferType in bits 4-5, finalReduce in bit 6
+//   counts    nInputs in bits 0-3, nOutputs in bits 4-7
+//   nInputs bytes of inputChannelIndexes, then nOutputs bytes of outputChannelIndexes. For operations on buffers
+//   instead of channels, the first byte is inputBufferType/outputBufferType and the others are 0.
+//   nInputs varint inputOffsets, nOutputs varint outputOffsets, then the varint srcOffset, dstOffset and size
+//   flagged in the tag
+//
+// Varints are LEB128: 7 bits per byte, least significant first, with the high bit set on all bytes but the last.
+// Decoding an encoded operation gives back the original one if its unused fields were zero.
+constexpr int MAX_VARINT_SIZE = 5;
+constexpr int MAX_ENCODED_OPERATION_SIZE =
+    3 + 2 * MAX_CHANNEL_PER_OPERATION * (1 + MAX_VARINT_SIZE) + 3 * MAX_VARINT_SIZE;
+
+constexpr uint8_t ENCODED_SRC_OFFSET = 1 << 5;
+constexpr uint8_t ENCODED_DST_OFFSET = 1 << 6;
+constexpr uint8_t ENCODED_SIZE = 1 << 7;
+
+MSCCLPP_HOST_DEVICE_INLINE uint32_t decodeVarint(const uint8_t*& data) {
+  uint32_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t byte = *data++;
+    value |= uint32_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return value;
+  }
+}
+
+// Decode the operation at `data` into `op` and return the number of bytes it takes. Fields the operation does not
+// use are left as they are.
+MSCCLPP_HOST_DEVICE_INLINE int decodeOperation(const uint8_t* data, Operation& op) {
+  const uint8_t* begin = data;
+  uint8_t tag = *data++;
+  uint8_t layout = *data++;
+  uint8_t counts = *data++;
+  op.type = OperationType(tag & 0x1f);
+  op.channelType = ChannelType(layout & 0x3);
+  op.srcBufferType = BufferType((layout >> 2) & 0x3);
+  op.dstBufferType = BufferType((layout >> 4) & 0x3);
+  op.finalReduce = (layout >> 6) & 0x1;
+  op.nInputs = counts & 0xf;
+  op.nOutputs = counts >> 4;
+  for (int i = 0; i < op.nInputs; i++) op.inputChannelIndexes[i] = *data++;
+  for (int i = 0; i < op.nOutputs; i++) op.outputChannelIndexes[i] = *data++;
+  for (int i = 0; i < op.nInputs; i++) op.inputOffsets[i] = decodeVarint(data);
+  for (int i = 0; i < op.nOutputs; i++) op.outputOffsets[i] = decodeVarint(data);
+  op.srcOffset = (tag & ENCODED_SRC_OFFSET) ? decodeVarint(data) : 0;
+  op.dstOffset = (tag & ENCODED_DST_OFFSET) ? decodeVarint(data) : 0;
+  op.size = (tag & ENCODED_SIZE) ? decodeVarint(data) : 0;
+  return data - begin;
+}
+
+// Append the encoding of `op` to `data` and return its size.
+size_t encodeOperation(const Operation& op, std::vector<uint8_t>& data);
+std::vector<uint8_t> encodeOperations(const std::vector<Operation>& ops);
+// Decode `nOperations` operations from `data`, which must hold exactly their encoding as made by encodeOperations.
+std::vector<Operation> decodeOperations(const std::vector<uint8_t>& data, size_t nOperations);
+// Size of the encoding of `op` with the largest possible offsets and size, i.e. an upper bound for the same operation
+// instantiated for any message size.
+size_t maxEncodedOperationSize(const Operation& op);
+
+}  // namespace mscclpp
+
+#endif  // MSCCLPP_OPERATION_ENCODING_HPP_
@@ -0,0 +1,77 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef MSCCLPP_SCRATCH_ARENA_HPP_
+#define MSCCLPP_SCRATCH_ARENA_HPP_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mscclpp/gpu.hpp>
+#include <mutex>
+#include <tuple>
+
+namespace mscclpp {
+
+// A scratch buffer of the arena and the last stream that used it.
+class ScratchBuffer {
+ public:
+  ScratchBuffer(size_t size, cudaStream_t stream, std::shared_ptr<std::atomic<uint32_t>> flags);
+  ScratchBuffer(const ScratchBuffer&) = delete;
+  ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+  ~ScratchBuffer();
+
+  char* data() const { return this->buffer_.get(); }
+  size_t size() const { return this->size_; }
+
+  // Order a kernel using the buffer on `stream` after the previous one. Call before launching the kernel, and
+  // `endUse` right after.
+  void beginUse(cudaStream_t stream);
+  void endUse(cudaStream_t stream);
+  // Held by a launch from beginUse to endUse.
+  std::mutex& mutex() { return this->mutex_; }
+
+  // LL packet flag of the next kernel using the buffer. A packet is only read by the launch with the flag it was
+  // written with, so consecutive launches on the same memory need different flags, and peers must use the same flag
+  // for a launch. Buffers borrowed on the same stream share a sequence of flags, which is the same on all ranks as
+  // long as they run the same executions on that stream, whatever other threads and streams do.
+  uint32_t nextFlag() { return ++*this->flags_; }
+
+ private:
+  std::shared_ptr<char> buffer_;
+  size_t size_;
+  std::shared_ptr<std::atomic<uint32_t>> flags_;
+  std::mutex mutex_;
+  cudaStream_t lastStream_;
+  // Recorded after the last kernel using the buffer, waited for by a kernel on another stream
+  cudaEvent_t lastUse_;
+};
+
+// Scratch buffers shared by the execution contexts of an executor. Sizes are rounded up to a power of two and all
+// contexts borrowing the same size class on the same stream get the same buffer, since the kernels of a stream never
+// run concurrently. Peers only write to the scratch buffer of a rank during an execution that rank takes part in, so
+// sharing it between contexts is as safe as running the same context twice. A context executed on another stream
+// than the one it borrowed on is ordered after the last kernel using the buffer, see ScratchBuffer::beginUse.
+// Contexts whose kernels run concurrently in a grouped launch borrow from different slots, which never share buffers.
+class ScratchArena {
+ public:
+  // Borrow a buffer of at least `size` bytes. It is in use while a borrower holds it and reserved until trim.
+  std::shared_ptr<ScratchBuffer> borrow(size_t size, cudaStream_t stream, uint32_t slot = 0);
+  // Free the buffers no context holds.
+  void trim();
+
+  size_t bytesReserved() const;
+  size_t bytesInUse() const;
+
+  // Size of the buffer borrowed for `size` bytes.
+  static size_t sizeClass(size_t size);
+
+ private:
+  std::map<std::tuple<cudaStream_t, size_t, uint32_t>, std::shared_ptr<ScratchBuffer>> buffers_;
+  // Last LL packet flag of each stream, see ScratchBuffer::nextFlag. Kept when the buffers are freed.
+  std::map<cudaStream_t, std::shared_ptr<std::atomic<uint32_t>>> flags_;
+};
+
+}  // namespace mscclpp
+
+#endif  // MSCCLPP_SCRATCH_ARENA_HPP_
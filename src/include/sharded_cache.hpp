@@ -0,0 +1,90 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#ifndef MSCCLPP_SHARDED_CACHE_HPP_
+#define MSCCLPP_SHARDED_CACHE_HPP_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace mscclpp {
+
+// Map from keys to shared values for many concurrent readers. Keys are spread over `NShards` maps with a reader-writer
+// lock each, so lookups only contend with insertions and erasures of the same shard. Values are held by shared_ptr: a
+// value erased while another thread uses it stays alive until that thread drops it.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, size_t NShards = 16>
+class ShardedCache {
+ public:
+  std::shared_ptr<Value> find(const Key& key) const {
+    const Shard& shard = this->shardOf(key);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.values.find(key);
+    return it == shard.values.end() ? nullptr : it->second;
+  }
+
+  // Insert `value` for `key` unless the key already has a value.
+  // @return The value of `key` after the insertion.
+  std::shared_ptr<Value> insert(const Key& key, std::shared_ptr<Value> value) {
+    Shard& shard = this->shardOf(key);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    return shard.values.emplace(key, std::move(value)).first->second;
+  }
+
+  // @return The erased value, or nullptr if `key` had none.
+  std::shared_ptr<Value> erase(const Key& key) {
+    Shard& shard = this->shardOf(key);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.values.find(key);
+    if (it == shard.values.end()) {
+      return nullptr;
+    }
+    std::shared_ptr<Value> value = std::move(it->second);
+    shard.values.erase(it);
+    return value;
+  }
+
+  size_t size() const {
+    size_t size = 0;
+    for (const Shard& shard : this->shards_) {
+      std::shared_lock<std::shared_mutex> lock(shard.mutex);
+      size += shard.values.size();
+    }
+    return size;
+  }
+
+  // Call `f(key, value)` for every entry, one shard at a time. `f` must not modify the cache.
+  template <typename F>
+  void forEach(F&& f) const {
+    for (const Shard& shard : this->shards_) {
+      std::shared_lock<std::shared_mutex> lock(shard.mutex);
+      for (const auto& [key, value] : shard.values) {
+        f(key, value);
+      }
+    }
+  }
+
+ private:
+  struct Shard {
+    mutable std::shared_mutex mutex;
+    std::unordered_map<Key, std::shared_ptr<Value>, Hash> values;
+  };
+
+  // Keys are spread by the high bits of their hash multiplied by 2^64 / golden ratio, since the low bits of hashes
+  // of aligned pointers and sizes are often all zero.
+  static size_t shardIndex(const Key& key) {
+    return (static_cast<uint64_t>(Hash()(key)) * 0x9e3779b97f4a7c15ull >> 32) % NShards;
+  }
+  Shard& shardOf(const Key& key) { return this->shards_[shardIndex(key)]; }
+  const Shard& shardOf(const Key& key) const { return this->shards_[shardIndex(key)]; }
+
+  std::array<Shard, NShards> shards_;
+};
+
+}  // namespace mscclpp
+
+#endif  // MSCCLPP_SHARDED_CACHE_HPP_
@@ -0,0 +1,117 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Compares the load time and peak RSS of loading a plan for all ranks (the full JSON DOM) against loading it for a
+// single rank (streamed, keeping only that rank and its peers). Synthetic plans with many ranks are generated by
+// replicating the two-rank allreduce.json. Each load runs in a separate process so that peak RSS is not shared.
+
+#include <limits.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mscclpp/executor.hpp>
+#include <nlohmann/json.hpp>
+#include <string>
+
+namespace {
+using json = nlohmann::json;
+
+std::string getExecutablePath() {
+  char result[PATH_MAX];
+  ssize_t count = readlink("/proc/self/exe", result, PATH_MAX);
+  if (count == -1) {
+    throw std::runtime_error("Failed to get executable path");
+  }
+  return std::string(result, count);
+}
+
+// Peak resident set size of this process in KB
+long getPeakRss() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmHWM:", 0) == 0) {
+      return std::stol(line.substr(6));
+    }
+  }
+  return -1;
+}
+
+// Build an `nRanks`-rank plan out of nRanks / 2 copies of a two-rank plan, pairing rank 2p with rank 2p + 1.
+void generatePlan(const std::string& templatePath, int nRanks, const std::string& outputPath) {
+  std::ifstream file(templatePath);
+  json plan = json::parse(file);
+  if (plan["gpus"].size() != 2) {
+    throw std::runtime_error("The template plan must have two ranks");
+  }
+  json gpus = json::array();
+  for (int pair = 0; pair < nRanks / 2; pair++) {
+    for (const auto& gpu : plan["gpus"]) {
+      json newGpu = gpu;
+      newGpu["id"] = pair * 2 + gpu["id"].get<int>();
+      for (auto& channel : newGpu["channels"]) {
+        for (auto& peer : channel["connectedTo"]) {
+          peer = pair * 2 + peer.get<int>();
+        }
+      }
+      gpus.push_back(std::move(newGpu));
+    }
+  }
+  plan["gpus"] = std::move(gpus);
+  std::ofstream(outputPath) << plan;
+}
+
+int runLoad(const std::string& mode, const std::string& name, const std::string& path, int rank) {
+  mscclpp::ExecutionPlan plan(name, path);
+  auto start = std::chrono::steady_clock::now();
+  plan.load(mode == "rank" ? rank : -1);
+  auto end = std::chrono::steady_clock::now();
+  std::printf("%.3f %ld\n", std::chrono::duration<double, std::milli>(end - start).count(), getPeakRss());
+  return 0;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc == 6 && std::string(argv[1]) == "--load") {
+    return runLoad(argv[2], argv[3], argv[4], std::stoi(argv[5]));
+  }
+  std::filesystem::path templatePath;
+  if (argc == 2) {
+    templatePath = argv[1];
+  } else if (argc == 1) {
+    templatePath = std::filesystem::path(getExecutablePath()).parent_path().parent_path().parent_path() /
+                   "test/execution-files/allreduce.json";
+  } else {
+    std::cerr << "Usage: " << argv[0] << " [two-rank plan file]" << std::endl;
+    return 1;
+  }
+  std::string name = json::parse(std::ifstream(templatePath))["name"];
+
+  std::filesystem::path workDir =
+      std::filesystem::temp_directory_path() / ("mscclpp_plan_bench_" + std::to_string(getpid()));
+  std::filesystem::create_directories(workDir);
+  std::printf("%8s %12s %8s %14s %14s\n", "ranks", "file (KB)", "mode", "load (ms)", "peak RSS (KB)");
+  for (int nRanks : {64, 512, 4096}) {
+    std::string path = (workDir / ("plan_" + std::to_string(nRanks) + ".json")).string();
+    generatePlan(templatePath.string(), nRanks, path);
+    for (std::string mode : {"all", "rank"}) {
+      std::string command =
+          getExecutablePath() + " --load " + mode + " " + name + " " + path + " " + std::to_string(nRanks / 2);
+      FILE* pipe = popen(command.c_str(), "r");
+      double ms = -1;
+      long rss = -1;
+      if (pipe == nullptr || std::fscanf(pipe, "%lf %ld", &ms, &rss) != 2) {
+        std::cerr << "Failed to run " << command << std::endl;
+      }
+      if (pipe != nullptr) pclose(pipe);
+      std::printf("%8d %12ju %8s %14.3f %14ld\n", nRanks, std::filesystem::file_size(path) / 1024, mode.c_str(), ms,
+                  rss);
+    }
+  }
+  std::filesystem::remove_all(workDir);
+  return 0;
+}
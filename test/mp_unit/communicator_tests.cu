@@ -192,6 +192,53 @@ TEST_F(CommunicatorTest, BasicWrite) {
   communicator->bootstrap()->barrier();
 }
 
+TEST_F(CommunicatorTest, SharesConnections) {
+  if (gEnv->rank >= numRanksToUse) return;
+
+  auto connectAll = [&]() {
+    std::unordered_map<int, mscclpp::NonblockingFuture<std::shared_ptr<mscclpp::Connection>>> futures;
+    for (int i = 0; i < numRanksToUse; i++) {
+      if (i != gEnv->rank) {
+        mscclpp::Transport transport =
+            rankToNode(i) == rankToNode(gEnv->rank) ? mscclpp::Transport::CudaIpc : ibTransport;
+        futures[i] = communicator->sharedConnectOnSetup(i, 1, transport);
+      }
+    }
+    return futures;
+  };
+  auto first = connectAll();
+  auto second = connectAll();
+  communicator->setup();
+  std::unordered_map<int, std::shared_ptr<mscclpp::Connection>> held;
+  for (auto& [peer, future] : first) {
+    held[peer] = future.get();
+    EXPECT_EQ(second[peer].get(), held[peer]);
+  }
+
+  // Connections held by both sides are reused.
+  auto reused = connectAll();
+  communicator->setup();
+  for (auto& [peer, future] : reused) {
+    EXPECT_EQ(future.get(), held[peer]);
+  }
+  reused.clear();
+
+  // A connection held by one side only is made again on both.
+  first.clear();
+  second.clear();
+  for (auto it = held.begin(); it != held.end();) {
+    it = it->first < gEnv->rank ? held.erase(it) : std::next(it);
+  }
+  auto third = connectAll();
+  communicator->setup();
+  for (auto& [peer, future] : third) {
+    if (held.count(peer)) {
+      EXPECT_NE(future.get(), held[peer]);
+    }
+  }
+  communicator->bootstrap()->barrier();
+}
+
 __global__ void kernelWaitSemaphores(mscclpp::Host2DeviceSemaphore::DeviceHandle* deviceSemaphores, int rank,
                                      int worldSize) {
   int tid = threadIdx.x;
@@ -4,7 +4,9 @@
 #include <mpi.h>
 
 #include <filesystem>
+#include <fstream>
 #include <mscclpp/npkit/npkit.hpp>
+#include <nlohmann/json.hpp>
 
 #include "mp_unit_tests.hpp"
 
@@ -17,6 +19,58 @@ std::string getExecutablePath() {
   }
   return std::string(result, count);
 }
+
+// Writes a send/recv plan between ranks 0 and 1 that sends each of `nChunks` chunks on a proxy channel of its own and
+// copies it from the scratch buffer to the output, four operations per chunk on one threadblock, to `path`.
+void writePipelinedSendRecvPlan(const std::string& path, int nChunks) {
+  nlohmann::json plan = {{"name", "send_recv_pipelined"},
+                         {"collective", "sendrecv"},
+                         {"protocol", "Simple"},
+                         {"inplace", false},
+                         {"gpus", nlohmann::json::array()}};
+  for (int rank = 0; rank < 2; rank++) {
+    int peer = 1 - rank;
+    nlohmann::json ops = nlohmann::json::array();
+    std::vector<int> channelIds;
+    for (int chunk = 0; chunk < nChunks; chunk++) {
+      ops.push_back({{"name", "pwsf"},
+                     {"o_buff", {{"src", "i"}, {"dst", "s"}}},
+                     {"o_cids", {{{"id", chunk}, {"off", chunk}}}},
+                     {"srcs", {{{"buff", "i"}, {"off", chunk}}}},
+                     {"ctype", "proxy"},
+                     {"cnt", 1}});
+      ops.push_back({{"name", "wait"},
+                     {"i_buff", {{"src", "i"}, {"dst", "s"}}},
+                     {"i_cids", {{{"id", chunk}, {"off", chunk}}}},
+                     {"ctype", "proxy"},
+                     {"cnt", 1}});
+      ops.push_back({{"name", "nop"}, {"deps", {{{"tb", 0}, {"step", 4 * chunk + 1}}}}});
+      ops.push_back({{"name", "copy"},
+                     {"src", peer},
+                     {"srcbuff", "s"},
+                     {"srcoff", chunk},
+                     {"dst", rank},
+                     {"dstbuff", "o"},
+                     {"dstoff", chunk},
+                     {"ctype", "none"},
+                     {"cnt", 1}});
+      channelIds.push_back(chunk);
+    }
+    plan["gpus"].push_back(
+        {{"id", rank},
+         {"inputChunks", nChunks},
+         {"outputChunks", nChunks},
+         {"scratchChunks", nChunks},
+         {"chunkGroups", 1},
+         {"channels",
+          {{{"srcbuff", "i"}, {"dstbuff", "s"}, {"type", "proxy"}, {"connectedTo", std::vector<int>(nChunks, peer)}}}},
+         {"threadblocks",
+          {{{"id", 0},
+            {"ops", ops},
+            {"channels", {{{"src", "i"}, {"dst", "s"}, {"ctype", "proxy"}, {"cids", channelIds}}}}}}}});
+  }
+  std::ofstream(path) << plan.dump();
+}
 }  // namespace
 
 void ExecutorTest::SetUp() {
@@ -29,7 +83,7 @@ void ExecutorTest::SetUp() {
   if (gEnv->rank == 0) id = bootstrap->createUniqueId();
   MPI_Bcast(&id, sizeof(id), MPI_BYTE, 0, MPI_COMM_WORLD);
   bootstrap->initialize(id);
-  std::shared_ptr<mscclpp::Communicator> communicator = std::make_shared<mscclpp::Communicator>(bootstrap);
+  communicator = std::make_shared<mscclpp::Communicator>(bootstrap);
   executor = std::make_shared<mscclpp::Executor>(communicator);
   npkitDumpDir = getenv("NPKIT_DUMP_DIR");
   if (npkitDumpDir != nullptr) {
@@ -43,6 +97,7 @@ void ExecutorTest::TearDown() {
     NpKit::Shutdown();
   }
   executor.reset();
+  communicator.reset();
   MultiProcessTest::TearDown();
 }
 
@@ -63,3 +118,267 @@ TEST_F(ExecutorTest, TwoNodesAllreduce) {
                     plan, stream);
   MSCCLPP_CUDATHROW(cudaStreamSynchronize(stream));
 }
+
+TEST_F(ExecutorTest, SkipsUnchangedPlanUploads) {
+  if (gEnv->worldSize != 2 || gEnv->nRanksPerNode != 2) {
+    GTEST_SKIP() << "This test requires world size to be 2 and ranks per node to be 2";
+    return;
+  }
+  std::string executablePath = getExecutablePath();
+  std::filesystem::path path = executablePath;
+  std::filesystem::path executionFilesPath =
+      path.parent_path().parent_path().parent_path() / "test/execution-files/allreduce.json";
+  mscclpp::ExecutionPlan plan("allreduce_pairs", executionFilesPath.string());
+  const int bufferSize = 1024 * 1024;
+  std::shared_ptr<char> sendbuff = mscclpp::allocExtSharedCuda<char>(bufferSize);
+  mscclpp::CudaStreamWithFlags stream(cudaStreamNonBlocking);
+  for (int i = 0; i < 3; i++) {
+    executor->execute(gEnv->rank, sendbuff.get(), sendbuff.get(), bufferSize, bufferSize, mscclpp::DataType::FLOAT16,
+                      plan, stream);
+  }
+  mscclpp::ExecutorStats stats = executor->stats();
+  EXPECT_EQ(stats.planUploads, 1u);
+  EXPECT_EQ(stats.planUploadsSkipped, 2u);
+
+  // A smaller message on the same buffers reuses the context but changes the operations.
+  executor->execute(gEnv->rank, sendbuff.get(), sendbuff.get(), bufferSize / 2, bufferSize / 2,
+                    mscclpp::DataType::FLOAT16, plan, stream);
+  stats = executor->stats();
+  EXPECT_EQ(stats.planUploads, 2u);
+  EXPECT_EQ(stats.planUploadsSkipped, 2u);
+  MSCCLPP_CUDATHROW(cudaStreamSynchronize(stream));
+}
+
+TEST_F(ExecutorTest, SharesScratchBuffers) {
+  if (gEnv->worldSize != 2 || gEnv->nRanksPerNode != 2) {
+    GTEST_SKIP() << "This test requires world size to be 2 and ranks per node to be 2";
+    return;
+  }
+  std::string executablePath = getExecutablePath();
+  std::filesystem::path path = executablePath;
+  std::filesystem::path executionFilesPath =
+      path.parent_path().parent_path().parent_path() / "test/execution-files/allreduce.json";
+  mscclpp::ExecutionPlan plan("allreduce_pairs", executionFilesPath.string());
+  const int bufferSize = 1024 * 1024;
+  std::shared_ptr<char> buff1 = mscclpp::allocExtSharedCuda<char>(bufferSize);
+  std::shared_ptr<char> buff2 = mscclpp::allocExtSharedCuda<char>(bufferSize);
+  mscclpp::CudaStreamWithFlags stream(cudaStreamNonBlocking);
+  executor->execute(gEnv->rank, buff1.get(), buff1.get(), bufferSize, bufferSize, mscclpp::DataType::FLOAT16, plan,
+                    stream);
+  mscclpp::ExecutorStats stats = executor->stats();
+  EXPECT_GT(stats.scratchBytesReserved, 0u);
+  EXPECT_EQ(stats.scratchBytesInUse, stats.scratchBytesReserved);
+
+  // A second context of the same size on the same stream borrows the same scratch buffer.
+  executor->execute(gEnv->rank, buff2.get(), buff2.get(), bufferSize, bufferSize, mscclpp::DataType::FLOAT16, plan,
+                    stream);
+  EXPECT_EQ(executor->stats().scratchBytesReserved, stats.scratchBytesReserved);
+  MSCCLPP_CUDATHROW(cudaStreamSynchronize(stream));
+}
+
+TEST_F(ExecutorTest, EvictsLeastRecentlyUsedContexts) {
+  if (gEnv->worldSize != 2 || gEnv->nRanksPerNode != 2) {
+    GTEST_SKIP() << "This test requires world size to be 2 and ranks per node to be 2";
+    return;
+  }
+  std::string executablePath = getExecutablePath();
+  std::filesystem::path path = executablePath;
+  std::filesystem::path executionFilesPath =
+      path.parent_path().parent_path().parent_path() / "test/execution-files/allreduce.json";
+  mscclpp::ExecutionPlan plan("allreduce_pairs", executionFilesPath.string());
+  mscclpp::ExecutorConfig config;
+  config.maxContexts = 2;
+  mscclpp::Executor budgetedExecutor(communicator, config);
+  const int bufferSize = 1024 * 1024;
+  std::vector<std::shared_ptr<char>> buffers;
+  for (int i = 0; i < 3; i++) {
+    buffers.push_back(mscclpp::allocExtSharedCuda<char>(bufferSize));
+  }
+  mscclpp::CudaStreamWithFlags stream(cudaStreamNonBlocking);
+  auto execute = [&](int buffer) {
+    budgetedExecutor.execute(gEnv->rank, buffers[buffer].get(), buffers[buffer].get(), bufferSize, bufferSize,
+                             mscclpp::DataType::FLOAT16, plan, stream);
+  };
+  execute(0);
+  execute(1);
+  execute(0);
+  // The context of buffer 1 is the least recently used one.
+  execute(2);
+  execute(0);
+  mscclpp::ExecutorStats stats = budgetedExecutor.stats();
+  EXPECT_EQ(stats.contextMisses, 3u);
+  EXPECT_EQ(stats.contextHits, 2u);
+  EXPECT_EQ(stats.contextEvictions, 1u);
+  execute(1);
+  EXPECT_EQ(budgetedExecutor.stats().contextEvictions, 2u);
+  MSCCLPP_CUDATHROW(cudaStreamSynchronize(stream));
+}
+
+TEST_F(ExecutorTest, PreparesContexts) {
+  if (gEnv->worldSize != 2 || gEnv->nRanksPerNode != 2) {
+    GTEST_SKIP() << "This test requires world size to be 2 and ranks per node to be 2";
+    return;
+  }
+  std::string executablePath = getExecutablePath();
+  std::filesystem::path path = executablePath;
+  std::filesystem::path executionFilesPath =
+      path.parent_path().parent_path().parent_path() / "test/execution-files/allreduce.json";
+  auto plan = std::make_shared<mscclpp::ExecutionPlan>("allreduce_pairs", executionFilesPath.string());
+  mscclpp::Executor preparedExecutor(communicator);
+  const int bufferSize = 1024 * 1024;
+  std::vector<std::shared_ptr<char>> buffers;
+  std::vector<mscclpp::ExecutionDescriptor> executions;
+  for (int i = 0; i < 3; i++) {
+    buffers.push_back(mscclpp::allocExtSharedCuda<char>(bufferSize));
+    executions.push_back({buffers[i].get(), buffers[i].get(), bufferSize, bufferSize, plan});
+  }
+  mscclpp::CudaStreamWithFlags stream(cudaStreamNonBlocking);
+  std::vector<std::shared_future<void>> futures = preparedExecutor.prepare(gEnv->rank, executions, stream);
+  ASSERT_EQ(futures.size(), 3u);
+  // Waits for the preparation of the second context instead of setting it up again.
+  preparedExecutor.execute(gEnv->rank, buffers[1].get(), buffers[1].get(), bufferSize, bufferSize,
+                           mscclpp::DataType::FLOAT16, *plan, stream);
+  for (auto& future : futures) {
+    future.get();
+  }
+  preparedExecutor.execute(gEnv->rank, buffers[2].get(), buffers[2].get(), bufferSize, bufferSize,
+                           mscclpp::DataType::FLOAT16, *plan, stream);
+  mscclpp::ExecutorStats stats = preparedExecutor.stats();
+  EXPECT_EQ(stats.contextMisses, 3u);
+  EXPECT_EQ(stats.contextHits, 2u);
+  MSCCLPP_CUDATHROW(cudaStreamSynchronize(stream));
+}
+
+TEST_F(ExecutorTest, ExecutesGroups) {
+  if (gEnv->worldSize != 2 || gEnv->nRanksPerNode != 2) {
+    GTEST_SKIP() << "This test requires world size to be 2 and ranks per node to be 2";
+    return;
+  }
+  std::string executablePath = getExecutablePath();
+  std::filesystem::path path = executablePath;
+  std::filesystem::path executionFilesPath =
+      path.parent_path().parent_path().parent_path() / "test/execution-files/allreduce.json";
+  auto plan = std::make_shared<mscclpp::ExecutionPlan>("allreduce_pairs", executionFilesPath.string());
+  mscclpp::Executor groupExecutor(communicator);
+  const int bufferSize = 64 * 1024;
+  std::vector<std::shared_ptr<char>> buffers;
+  std::vector<mscclpp::ExecutionDescriptor> executions;
+  for (int i = 0; i < 3; i++) {
+    buffers.push_back(mscclpp::allocExtSharedCuda<char>(bufferSize));
+    executions.push_back({buffers[i].get(), buffers[i].get(), bufferSize, bufferSize, plan});
+  }
+  mscclpp::CudaStreamWithFlags stream(cudaStreamNonBlocking);
+  groupExecutor.executeGroup(gEnv->rank, executions, mscclpp::DataType::FLOAT16, stream);
+  mscclpp::ExecutorStats stats = groupExecutor.stats();
+  EXPECT_EQ(stats.contextMisses, 3u);
+  // The executions of a group run concurrently on scratch buffers of their own.
+  size_t scratchBytes = stats.scratchBytesReserved;
+  EXPECT_EQ(scratchBytes % 3, 0u);
+
+  // The same group reuses the merged plan and only uploads the kernel arguments.
+  groupExecutor.executeGroup(gEnv->rank, executions, mscclpp::DataType::FLOAT16, stream);
+  mscclpp::ExecutorStats regrouped = groupExecutor.stats();
+  EXPECT_EQ(regrouped.contextHits, 3u);
+  EXPECT_EQ(regrouped.planUploads, stats.planUploads);
+  EXPECT_EQ(regrouped.scratchBytesReserved, scratchBytes);
+
+  // The first execution of a group shares the context of execute().
+  groupExecutor.execute(gEnv->rank, buffers[0].get(), buffers[0].get(), bufferSize, bufferSize,
+                        mscclpp::DataType::FLOAT16, *plan, stream);
+  EXPECT_EQ(groupExecutor.stats().contextHits, 4u);
+  MSCCLPP_CUDATHROW(cudaStreamSynchronize(stream));
+}
+
+TEST_F(ExecutorTest, TearsDownContextsOfReloadedPlans) {
+  if (gEnv->worldSize != 2 || gEnv->nRanksPerNode != 2) {
+    GTEST_SKIP() << "This test requires world size to be 2 and ranks per node to be 2";
+    return;
+  }
+  std::string executablePath = getExecutablePath();
+  std::filesystem::path path = executablePath;
+  std::filesystem::path executionFilesPath =
+      path.parent_path().parent_path().parent_path() / "test/execution-files/allreduce.json";
+  mscclpp::PlanRegistry registry;
+  registry.registerPlan(executionFilesPath.string());
+  const int bufferSize = 1024 * 1024;
+  std::shared_ptr<char> buffer = mscclpp::allocExtSharedCuda<char>(bufferSize);
+  mscclpp::CudaStreamWithFlags stream(cudaStreamNonBlocking);
+  mscclpp::CollectiveDescriptor collective = {"allreduce", bufferSize, true};
+  auto execute = [&]() {
+    return executor->execute(gEnv->rank, buffer.get(), buffer.get(), bufferSize, bufferSize,
+                             mscclpp::DataType::FLOAT16, registry, collective, stream);
+  };
+  ASSERT_TRUE(execute());
+  EXPECT_EQ(registry.reload(executionFilesPath.string(), gEnv->rank).get(), 1u);
+  EXPECT_EQ(registry.commitReloads(communicator->bootstrap()), 1u);
+  // The reloaded version gets a context of its own and the one of the replaced version is torn down.
+  ASSERT_TRUE(execute());
+  ASSERT_TRUE(execute());
+  mscclpp::ExecutorStats stats = executor->stats();
+  EXPECT_EQ(stats.contextMisses, 2u);
+  EXPECT_EQ(stats.contextHits, 1u);
+  EXPECT_EQ(stats.contextEvictions, 1u);
+  MSCCLPP_CUDATHROW(cudaStreamSynchronize(stream));
+}
+
+TEST_F(ExecutorTest, PagesLongPlans) {
+  if (gEnv->worldSize != 2 || gEnv->nRanksPerNode != 2) {
+    GTEST_SKIP() << "This test requires world size to be 2 and ranks per node to be 2";
+    return;
+  }
+  // The threadblock of each rank runs 128 operations on 32 channels, more than fit in one page of operations and more
+  // channels than the old limit of 16.
+  std::filesystem::path planPath = std::filesystem::temp_directory_path() /
+                                   ("mscclpp_pipelined_plan_" + std::to_string(gEnv->rank) + ".json");
+  writePipelinedSendRecvPlan(planPath.string(), 32);
+  mscclpp::ExecutionPlan plan("send_recv_pipelined", planPath.string());
+  const int nElems = 256 * 1024;
+  std::vector<int> hostBuffer(nElems);
+  for (int i = 0; i < nElems; i++) hostBuffer[i] = gEnv->rank * nElems + i;
+  std::shared_ptr<int> sendbuff = mscclpp::allocExtSharedCuda<int>(nElems);
+  std::shared_ptr<int> recvbuff = mscclpp::allocExtSharedCuda<int>(nElems);
+  mscclpp::memcpyCuda<int>(sendbuff.get(), hostBuffer.data(), nElems, cudaMemcpyHostToDevice);
+  mscclpp::CudaStreamWithFlags stream(cudaStreamNonBlocking);
+  executor->execute(gEnv->rank, sendbuff.get(), recvbuff.get(), nElems * sizeof(int), nElems * sizeof(int),
+                    mscclpp::DataType::INT32, plan, stream);
+  MSCCLPP_CUDATHROW(cudaStreamSynchronize(stream));
+  std::filesystem::remove(planPath);
+
+  mscclpp::memcpyCuda<int>(hostBuffer.data(), recvbuff.get(), nElems, cudaMemcpyDeviceToHost);
+  int peer = 1 - gEnv->rank;
+  for (int i = 0; i < nElems; i++) {
+    ASSERT_EQ(hostBuffer[i], peer * nElems + i);
+  }
+}
+
+TEST_F(ExecutorTest, AveragesOverPlanRanks) {
+  if (gEnv->worldSize <= 2) {
+    GTEST_SKIP() << "This test requires world size to be larger than 2";
+    return;
+  }
+  // AVG divides by the 2 ranks of the plan, not by the ranks of the communicator.
+  mscclpp::PlanGeneratorConfig config = {mscclpp::PlanAlgorithm::RingAllReduce, 2, std::min(gEnv->nRanksPerNode, 2)};
+  std::filesystem::path planPath = std::filesystem::temp_directory_path() /
+                                   ("mscclpp_avg_plan_" + std::to_string(gEnv->rank) + ".json");
+  mscclpp::writeExecutionPlan(config, planPath.string());
+  if (gEnv->rank < 2) {
+    mscclpp::ExecutionPlan plan("ring_allreduce", planPath.string());
+    const int nElems = 64 * 1024;
+    std::vector<float> hostBuffer(nElems);
+    for (int i = 0; i < nElems; i++) hostBuffer[i] = float((gEnv->rank + 1) * (i % 16));
+    std::shared_ptr<float> sendbuff = mscclpp::allocExtSharedCuda<float>(nElems);
+    std::shared_ptr<float> recvbuff = mscclpp::allocExtSharedCuda<float>(nElems);
+    mscclpp::memcpyCuda<float>(sendbuff.get(), hostBuffer.data(), nElems, cudaMemcpyHostToDevice);
+    mscclpp::CudaStreamWithFlags stream(cudaStreamNonBlocking);
+    executor->execute(gEnv->rank, sendbuff.get(), recvbuff.get(), nElems * sizeof(float), nElems * sizeof(float),
+                      mscclpp::DataType::FLOAT32, plan, stream, mscclpp::PacketType::LL16,
+                      {mscclpp::ReduceOp::AVG});
+    MSCCLPP_CUDATHROW(cudaStreamSynchronize(stream));
+
+    mscclpp::memcpyCuda<float>(hostBuffer.data(), recvbuff.get(), nElems, cudaMemcpyDeviceToHost);
+    for (int i = 0; i < nElems; i++) {
+      ASSERT_EQ(hostBuffer[i], 1.5f * (i % 16));
+    }
+  }
+  std::filesystem::remove(planPath);
+}
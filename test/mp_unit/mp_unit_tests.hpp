@@ -169,6 +169,7 @@ class ExecutorTest : public MultiProcessTest {
   void SetUp() override;
   void TearDown() override;
 
+  std::shared_ptr<mscclpp::Communicator> communicator;
   std::shared_ptr<mscclpp::Executor> executor;
   const char* npkitDumpDir;
 };
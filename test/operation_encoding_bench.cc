@@ -0,0 +1,110 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Compares the size of the operations of the shipped plans in their in-memory layout against the compact encoding
+// uploaded to the device, and measures the host encode and decode time. Every encoding is decoded and checked against
+// the original operations.
+
+#include <limits.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mscclpp/executor.hpp>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include "execution_plan_analysis.hpp"
+#include "operation_encoding.hpp"
+
+namespace {
+using json = nlohmann::json;
+
+constexpr int ITERATIONS = 100;
+
+std::string getExecutablePath() {
+  char result[PATH_MAX];
+  ssize_t count = readlink("/proc/self/exe", result, PATH_MAX);
+  if (count == -1) {
+    throw std::runtime_error("Failed to get executable path");
+  }
+  return std::string(result, count);
+}
+
+struct EncodingResult {
+  size_t nOperations = 0;
+  size_t rawSize = 0;
+  size_t encodedSize = 0;
+  double encodeNs = 0;
+  double decodeNs = 0;
+  bool matches = true;
+};
+
+EncodingResult benchmarkPlan(const mscclpp::ExecutionPlan& plan, size_t size) {
+  auto impl = mscclpp::PlanAnalysis::instantiate(plan, size, size);
+  mscclpp::PlanAnalysis analysis(*impl);
+  EncodingResult result;
+  for (int rank : analysis.ranks()) {
+    for (int threadblock = 0; threadblock < analysis.threadblockCount(rank); threadblock++) {
+      const std::vector<mscclpp::Operation>& ops = analysis.operations(rank, threadblock);
+      std::vector<uint8_t> encoded;
+      std::vector<mscclpp::Operation> decoded;
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < ITERATIONS; i++) {
+        encoded = mscclpp::encodeOperations(ops);
+      }
+      auto middle = std::chrono::steady_clock::now();
+      for (int i = 0; i < ITERATIONS; i++) {
+        decoded = mscclpp::decodeOperations(encoded, ops.size());
+      }
+      auto end = std::chrono::steady_clock::now();
+      result.encodeNs += std::chrono::duration<double, std::nano>(middle - start).count() / ITERATIONS;
+      result.decodeNs += std::chrono::duration<double, std::nano>(end - middle).count() / ITERATIONS;
+      result.nOperations += ops.size();
+      result.rawSize += ops.size() * sizeof(mscclpp::Operation);
+      result.encodedSize += encoded.size();
+      for (size_t i = 0; i < ops.size(); i++) {
+        result.matches &= std::memcmp(&ops[i], &decoded[i], sizeof(mscclpp::Operation)) == 0;
+      }
+    }
+  }
+  return result;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::filesystem::path directory;
+  if (argc == 2) {
+    directory = argv[1];
+  } else if (argc == 1) {
+    directory = std::filesystem::path(getExecutablePath()).parent_path().parent_path().parent_path() /
+                "test/execution-files";
+  } else {
+    std::cerr << "Usage: " << argv[0] << " [plan directory]" << std::endl;
+    return 1;
+  }
+
+  bool allMatch = true;
+  std::printf("%-26s %12s %6s %12s %14s %7s %16s %16s\n", "plan", "size (B)", "ops", "raw (B)", "encoded (B)", "ratio",
+              "encode (ns/op)", "decode (ns/op)");
+  for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+    if (entry.path().extension() != ".json") continue;
+    std::string name = json::parse(std::ifstream(entry.path()))["name"];
+    mscclpp::ExecutionPlan plan(name, entry.path().string());
+    for (size_t size : {size_t(1) << 10, size_t(1) << 20, size_t(1) << 30}) {
+      EncodingResult result = benchmarkPlan(plan, size);
+      allMatch &= result.matches;
+      std::printf("%-26s %12zu %6zu %12zu %14zu %7.2f %16.1f %16.1f%s\n", entry.path().filename().c_str(), size,
+                  result.nOperations, result.rawSize, result.encodedSize,
+                  double(result.rawSize) / std::max<size_t>(result.encodedSize, 1),
+                  result.encodeNs / std::max<size_t>(result.nOperations, 1),
+                  result.decodeNs / std::max<size_t>(result.nOperations, 1), result.matches ? "" : " MISMATCH");
+    }
+  }
+  return allMatch ? 0 : 1;
+}
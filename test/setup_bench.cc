@@ -0,0 +1,157 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Compares the wall time of exchanging the memories and semaphore IDs of an execution context with all peers:
+//   unbatched: one Communicator::setup round per buffer type and one for the semaphores, each message sent on its own
+//              as Communicator::setup did before batching
+//   rounds:    the same rounds, with the messages of a round batched into one per peer
+//   single:    everything in a single batched round, as the executor now does
+// Ranks are forked processes connected by a TcpBootstrap over loopback. Memories are host buffers without transports so
+// that no GPU is needed.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <mscclpp/core.hpp>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int BufferTypes = 3;
+const int Iterations = 20;
+
+const int SemaphoreTag = 0;
+int memoryTag(int bufferType) { return 2 * bufferType + 4; }
+
+// Exchange the messages of a round the way Communicator::setup did before batching: every message on its own.
+void unbatchedRound(mscclpp::Bootstrap& bootstrap, const std::vector<std::vector<char>>& messages, int tag) {
+  int rank = bootstrap.getRank();
+  int nRanks = bootstrap.getNranks();
+  for (int peer = 0; peer < nRanks; peer++) {
+    if (peer == rank) continue;
+    for (const auto& message : messages) {
+      bootstrap.send(message, peer, tag);
+    }
+  }
+  for (int peer = 0; peer < nRanks; peer++) {
+    if (peer == rank) continue;
+    for (size_t i = 0; i < messages.size(); i++) {
+      std::vector<char> data;
+      bootstrap.recv(data, peer, tag);
+      mscclpp::RegisteredMemory::deserialize(data);
+    }
+  }
+}
+
+// Queue the exchange of `memories` with all peers on the communicator.
+void queueRound(mscclpp::Communicator& comm, const std::vector<mscclpp::RegisteredMemory>& memories, int tag,
+                std::vector<mscclpp::NonblockingFuture<mscclpp::RegisteredMemory>>& futures) {
+  int rank = comm.bootstrap()->getRank();
+  int nRanks = comm.bootstrap()->getNranks();
+  for (int peer = 0; peer < nRanks; peer++) {
+    if (peer == rank) continue;
+    for (const auto& memory : memories) {
+      comm.sendMemoryOnSetup(memory, peer, tag);
+      futures.push_back(comm.recvMemoryOnSetup(peer, tag));
+    }
+  }
+}
+
+int runRank(const mscclpp::UniqueId& uniqueId, int rank, int nRanks, int nChannels) {
+  auto bootstrap = std::make_shared<mscclpp::TcpBootstrap>(rank, nRanks);
+  bootstrap->initialize(uniqueId);
+  mscclpp::Communicator comm(bootstrap);
+
+  std::vector<char> buffers(BufferTypes * 1024);
+  std::vector<uint64_t> semaphoreIds(nChannels);
+  std::vector<std::vector<mscclpp::RegisteredMemory>> bufferMemories(BufferTypes);
+  std::vector<std::vector<std::vector<char>>> serializedBuffers(BufferTypes);
+  for (int type = 0; type < BufferTypes; type++) {
+    bufferMemories[type].push_back(comm.registerMemory(buffers.data() + type * 1024, 1024, mscclpp::NoTransports));
+    serializedBuffers[type].push_back(bufferMemories[type].back().serialize());
+  }
+  std::vector<mscclpp::RegisteredMemory> semaphoreMemories;
+  std::vector<std::vector<char>> serializedSemaphores;
+  for (int i = 0; i < nChannels; i++) {
+    semaphoreMemories.push_back(comm.registerMemory(&semaphoreIds[i], sizeof(uint64_t), mscclpp::NoTransports));
+    serializedSemaphores.push_back(semaphoreMemories.back().serialize());
+  }
+
+  auto time = [&](auto&& setup) {
+    bootstrap->barrier();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Iterations; i++) {
+      setup();
+    }
+    bootstrap->barrier();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / Iterations;
+  };
+  double unbatched = time([&]() {
+    for (int type = 0; type < BufferTypes; type++) {
+      unbatchedRound(*bootstrap, serializedBuffers[type], memoryTag(type));
+    }
+    unbatchedRound(*bootstrap, serializedSemaphores, SemaphoreTag);
+  });
+  double rounds = time([&]() {
+    std::vector<mscclpp::NonblockingFuture<mscclpp::RegisteredMemory>> futures;
+    for (int type = 0; type < BufferTypes; type++) {
+      queueRound(comm, bufferMemories[type], memoryTag(type), futures);
+      comm.setup();
+    }
+    queueRound(comm, semaphoreMemories, SemaphoreTag, futures);
+    comm.setup();
+  });
+  double single = time([&]() {
+    std::vector<mscclpp::NonblockingFuture<mscclpp::RegisteredMemory>> futures;
+    for (int type = 0; type < BufferTypes; type++) {
+      queueRound(comm, bufferMemories[type], memoryTag(type), futures);
+    }
+    queueRound(comm, semaphoreMemories, SemaphoreTag, futures);
+    comm.setup();
+  });
+  if (rank == 0) {
+    std::printf("%8d %10d %14.3f %14.3f %14.3f\n", nRanks, nChannels, unbatched, rounds, single);
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc > 2) {
+    std::cerr << "Usage: " << argv[0] << " [max ranks]" << std::endl;
+    return 1;
+  }
+  int maxRanks = argc == 2 ? std::stoi(argv[1]) : 8;
+  std::printf("%8s %10s %14s %14s %14s\n", "ranks", "channels", "unbatched (ms)", "rounds (ms)", "single (ms)");
+  std::fflush(stdout);
+  for (int nRanks = 2; nRanks <= maxRanks; nRanks *= 2) {
+    for (int nChannels : {1, 8, 32}) {
+      mscclpp::UniqueId uniqueId = mscclpp::TcpBootstrap::createUniqueId();
+      std::vector<pid_t> pids;
+      for (int rank = 0; rank < nRanks; rank++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+          int ret = runRank(uniqueId, rank, nRanks, nChannels);
+          std::fflush(stdout);
+          _exit(ret);
+        }
+        pids.push_back(pid);
+      }
+      for (pid_t pid : pids) {
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+          std::cerr << "Rank process " << pid << " failed" << std::endl;
+          return 1;
+        }
+      }
+    }
+  }
+  return 0;
+}
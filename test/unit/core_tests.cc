@@ -27,8 +27,9 @@ class MockSetuppable : public mscclpp::Setuppable {
 TEST_F(LocalCommunicatorTest, OnSetup) {
   auto mockSetuppable = std::make_shared<MockSetuppable>();
   comm->onSetup(mockSetuppable);
-  EXPECT_CALL(*mockSetuppable, beginSetup(std::dynamic_pointer_cast<mscclpp::Bootstrap>(bootstrap)));
-  EXPECT_CALL(*mockSetuppable, endSetup(std::dynamic_pointer_cast<mscclpp::Bootstrap>(bootstrap)));
+  // Setuppables get a bootstrap batching their messages on top of the communicator's
+  EXPECT_CALL(*mockSetuppable, beginSetup(::testing::NotNull()));
+  EXPECT_CALL(*mockSetuppable, endSetup(::testing::NotNull()));
   comm->setup();
 }
 
@@ -51,3 +52,17 @@ TEST_F(LocalCommunicatorTest, SendMemoryToSelf) {
   EXPECT_EQ(sameMemory.size(), memory.size());
   EXPECT_EQ(sameMemory.transports(), memory.transports());
 }
+
+TEST_F(LocalCommunicatorTest, SendMemoriesWithTagsToSelf) {
+  int dummy[42];
+  auto memory = comm->registerMemory(&dummy, sizeof(dummy), mscclpp::NoTransports);
+  auto halfMemory = comm->registerMemory(&dummy, sizeof(dummy) / 2, mscclpp::NoTransports);
+  comm->sendMemoryOnSetup(memory, 0, 0);
+  comm->sendMemoryOnSetup(halfMemory, 0, 2);
+  // Received in another order than sent, in a single setup round
+  auto halfMemoryFuture = comm->recvMemoryOnSetup(0, 2);
+  auto memoryFuture = comm->recvMemoryOnSetup(0, 0);
+  comm->setup();
+  EXPECT_EQ(memoryFuture.get().size(), memory.size());
+  EXPECT_EQ(halfMemoryFuture.get().size(), halfMemory.size());
+}
@@ -0,0 +1,1092 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <gtest/gtest.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <mscclpp/executor.hpp>
+#include <nlohmann/json.hpp>
+#include <thread>
+
+#include "execution_group.hpp"
+#include "execution_plan_analysis.hpp"
+#include "operation_encoding.hpp"
+
+namespace {
+std::string getExecutablePath() {
+  char result[PATH_MAX];
+  ssize_t count = readlink("/proc/self/exe", result, PATH_MAX);
+  if (count == -1) {
+    throw std::runtime_error("Failed to get executable path");
+  }
+  return std::string(result, count);
+}
+
+std::string getExecutionFilePath(const std::string& fileName) {
+  std::filesystem::path path = getExecutablePath();
+  return (path.parent_path().parent_path().parent_path() / "test/execution-files" / fileName).string();
+}
+
+std::string readFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+mscclpp::Operation makeChannelOperation(mscclpp::OperationType type, std::vector<uint8_t> outputChannelIndexes) {
+  mscclpp::Operation op = {};
+  op.type = type;
+  op.channelType = mscclpp::ChannelType::SM;
+  op.nOutputs = outputChannelIndexes.size();
+  std::copy(outputChannelIndexes.begin(), outputChannelIndexes.end(), op.outputChannelIndexes);
+  op.size = 1024;
+  return op;
+}
+
+// Device plan buffer laid out as the executor does, with `nSmChannels` SM channels of 16 bytes per threadblock. The
+// channel tables are filled with `fill`.
+std::vector<char> makeDevicePlanBuffer(const std::vector<std::vector<mscclpp::Operation>>& threadblocks,
+                                       uint16_t nSmChannels, char fill) {
+  auto align = [](size_t size) { return (size + 15) / 16 * 16; };
+  std::vector<mscclpp::DeviceExecutionPlan> headers(threadblocks.size(), mscclpp::DeviceExecutionPlan{});
+  std::vector<std::vector<uint8_t>> encoded;
+  size_t size = align(threadblocks.size() * sizeof(mscclpp::DeviceExecutionPlan));
+  for (size_t i = 0; i < threadblocks.size(); i++) {
+    headers[i].nSmChannels = nSmChannels;
+    headers[i].channelsSize = align(nSmChannels * 16);
+    headers[i].smChannelsOffset = size;
+    headers[i].proxyChannelsOffset = size + nSmChannels * 16;
+    size += headers[i].channelsSize;
+  }
+  for (size_t i = 0; i < threadblocks.size(); i++) {
+    encoded.push_back(mscclpp::encodeOperations(threadblocks[i]));
+    headers[i].nOperations = threadblocks[i].size();
+    headers[i].operationsSize = encoded[i].size();
+    headers[i].operationsOffset = size;
+    size += align(encoded[i].size());
+  }
+  std::vector<char> buffer(size);
+  for (size_t i = 0; i < threadblocks.size(); i++) {
+    std::memset(buffer.data() + headers[i].smChannelsOffset, fill, headers[i].channelsSize);
+    std::memcpy(buffer.data() + headers[i].operationsOffset, encoded[i].data(), encoded[i].size());
+  }
+  std::memcpy(buffer.data(), headers.data(), headers.size() * sizeof(mscclpp::DeviceExecutionPlan));
+  return buffer;
+}
+
+class ExecutionPlanFileTest : public ::testing::TestWithParam<std::pair<std::string, std::string>> {
+ protected:
+  void SetUp() override {
+    std::string prefix = "mscclpp_plan_test_" + std::to_string(getpid()) + "_";
+    compiledPath = (std::filesystem::temp_directory_path() / (prefix + "a.plan")).string();
+    recompiledPath = (std::filesystem::temp_directory_path() / (prefix + "b.plan")).string();
+  }
+  void TearDown() override {
+    std::filesystem::remove(compiledPath);
+    std::filesystem::remove(recompiledPath);
+  }
+
+  std::string compiledPath;
+  std::string recompiledPath;
+};
+
+// Rank 0 waits for a signal that rank 1 never sends.
+constexpr char UNMATCHED_WAIT_PLAN[] = R"({
+  "name": "unmatched_wait",
+  "protocol": "Simple",
+  "gpus": [
+    {
+      "id": 0, "inputChunks": 1, "outputChunks": 0, "scratchChunks": 0, "chunkGroups": 1,
+      "channels": [{"srcbuff": "i", "dstbuff": "i", "type": "sm", "connectedTo": [1]}],
+      "threadblocks": [{
+        "id": 0,
+        "ops": [{"name": "wait", "i_buff": {"src": "i", "dst": "i"}, "i_cids": [{"id": 0, "off": 0}], "ctype": "sm",
+                 "cnt": 1}],
+        "channels": [{"src": "i", "dst": "i", "ctype": "sm", "cids": [0]}]
+      }]
+    },
+    {
+      "id": 1, "inputChunks": 1, "outputChunks": 0, "scratchChunks": 0, "chunkGroups": 1,
+      "channels": [{"srcbuff": "i", "dstbuff": "i", "type": "sm", "connectedTo": [0]}],
+      "threadblocks": [{
+        "id": 0,
+        "ops": [{"name": "nop"}],
+        "channels": [{"src": "i", "dst": "i", "ctype": "sm", "cids": [0]}]
+      }]
+    }
+  ]
+})";
+
+// Both ranks copy their input to the output, send it to the peer's scratch buffer and copy it back from there, with
+// redundant barriers and unfused operations.
+constexpr char UNOPTIMIZED_PLAN[] = R"({
+  "name": "unoptimized",
+  "protocol": "Simple",
+  "gpus": [
+    {
+      "id": 0, "inputChunks": 2, "outputChunks": 2, "scratchChunks": 2, "chunkGroups": 1,
+      "channels": [{"srcbuff": "i", "dstbuff": "s", "type": "proxy", "connectedTo": [1]}],
+      "threadblocks": [{
+        "id": 0,
+        "ops": [
+          {"name": "nop"},
+          {"name": "copy", "srcbuff": "i", "srcoff": 0, "dstbuff": "o", "dstoff": 0, "cnt": 1},
+          {"name": "copy", "srcbuff": "i", "srcoff": 1, "dstbuff": "o", "dstoff": 1, "cnt": 1},
+          {"name": "nop"},
+          {"name": "put", "o_buff": {"src": "i", "dst": "s"}, "o_cids": [{"id": 0, "off": 0}],
+           "srcs": [{"buff": "i", "off": 0}], "ctype": "proxy", "cnt": 2},
+          {"name": "signal", "o_buff": {"src": "i", "dst": "s"}, "o_cids": [{"id": 0, "off": 0}], "ctype": "proxy",
+           "cnt": 2},
+          {"name": "flush", "o_buff": {"src": "i", "dst": "s"}, "o_cids": [{"id": 0, "off": 0}], "ctype": "proxy",
+           "cnt": 2},
+          {"name": "wait", "i_buff": {"src": "i", "dst": "s"}, "i_cids": [{"id": 0, "off": 0}], "ctype": "proxy",
+           "cnt": 2},
+          {"name": "nop"},
+          {"name": "nop"},
+          {"name": "copy", "srcbuff": "s", "srcoff": 0, "dstbuff": "o", "dstoff": 0, "cnt": 1},
+          {"name": "copy", "srcbuff": "s", "srcoff": 1, "dstbuff": "o", "dstoff": 1, "cnt": 1},
+          {"name": "nop"}
+        ],
+        "channels": [{"src": "i", "dst": "s", "ctype": "proxy", "cids": [0]}]
+      }]
+    },
+    {
+      "id": 1, "inputChunks": 2, "outputChunks": 2, "scratchChunks": 2, "chunkGroups": 1,
+      "channels": [{"srcbuff": "i", "dstbuff": "s", "type": "proxy", "connectedTo": [0]}],
+      "threadblocks": [{
+        "id": 0,
+        "ops": [
+          {"name": "nop"},
+          {"name": "copy", "srcbuff": "i", "srcoff": 0, "dstbuff": "o", "dstoff": 0, "cnt": 1},
+          {"name": "copy", "srcbuff": "i", "srcoff": 1, "dstbuff": "o", "dstoff": 1, "cnt": 1},
+          {"name": "nop"},
+          {"name": "put", "o_buff": {"src": "i", "dst": "s"}, "o_cids": [{"id": 0, "off": 0}],
+           "srcs": [{"buff": "i", "off": 0}], "ctype": "proxy", "cnt": 2},
+          {"name": "signal", "o_buff": {"src": "i", "dst": "s"}, "o_cids": [{"id": 0, "off": 0}], "ctype": "proxy",
+           "cnt": 2},
+          {"name": "flush", "o_buff": {"src": "i", "dst": "s"}, "o_cids": [{"id": 0, "off": 0}], "ctype": "proxy",
+           "cnt": 2},
+          {"name": "wait", "i_buff": {"src": "i", "dst": "s"}, "i_cids": [{"id": 0, "off": 0}], "ctype": "proxy",
+           "cnt": 2},
+          {"name": "nop"},
+          {"name": "nop"},
+          {"name": "copy", "srcbuff": "s", "srcoff": 0, "dstbuff": "o", "dstoff": 0, "cnt": 1},
+          {"name": "copy", "srcbuff": "s", "srcoff": 1, "dstbuff": "o", "dstoff": 1, "cnt": 1},
+          {"name": "nop"}
+        ],
+        "channels": [{"src": "i", "dst": "s", "ctype": "proxy", "cids": [0]}]
+      }]
+    }
+  ]
+})";
+
+// Writes a plan for `collective` in which every rank runs the single operation `op` and returns its path.
+std::string writeSingleOperationPlan(const std::string& name, const std::string& collective, int nRanks,
+                                     int inputChunks, int outputChunks, const nlohmann::json& op) {
+  nlohmann::json plan = {
+      {"name", name}, {"collective", collective}, {"protocol", "Simple"}, {"gpus", nlohmann::json::array()}};
+  for (int rank = 0; rank < nRanks; rank++) {
+    plan["gpus"].push_back({{"id", rank},
+                            {"inputChunks", inputChunks},
+                            {"outputChunks", outputChunks},
+                            {"scratchChunks", 1},
+                            {"chunkGroups", 1},
+                            {"channels", nlohmann::json::array()},
+                            {"threadblocks", {{{"id", 0}, {"ops", {op}}, {"channels", nlohmann::json::array()}}}}});
+  }
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("mscclpp_plan_test_" + std::to_string(getpid()) + "_" + name + ".json"))
+                         .string();
+  std::ofstream(path) << plan.dump();
+  return path;
+}
+
+// Writes a send/recv plan between ranks 0 and 1 that sends each of `nChunks` chunks on a proxy channel of its own and
+// copies it from the scratch buffer to the output, four operations per chunk on one threadblock, to `path`.
+void writePipelinedSendRecvPlan(const std::string& path, int nChunks) {
+  nlohmann::json plan = {{"name", "send_recv_pipelined"},
+                         {"collective", "sendrecv"},
+                         {"protocol", "Simple"},
+                         {"inplace", false},
+                         {"gpus", nlohmann::json::array()}};
+  for (int rank = 0; rank < 2; rank++) {
+    int peer = 1 - rank;
+    nlohmann::json ops = nlohmann::json::array();
+    std::vector<int> channelIds;
+    for (int chunk = 0; chunk < nChunks; chunk++) {
+      ops.push_back({{"name", "pwsf"},
+                     {"o_buff", {{"src", "i"}, {"dst", "s"}}},
+                     {"o_cids", {{{"id", chunk}, {"off", chunk}}}},
+                     {"srcs", {{{"buff", "i"}, {"off", chunk}}}},
+                     {"ctype", "proxy"},
+                     {"cnt", 1}});
+      ops.push_back({{"name", "wait"},
+                     {"i_buff", {{"src", "i"}, {"dst", "s"}}},
+                     {"i_cids", {{{"id", chunk}, {"off", chunk}}}},
+                     {"ctype", "proxy"},
+                     {"cnt", 1}});
+      ops.push_back({{"name", "nop"}, {"deps", {{{"tb", 0}, {"step", 4 * chunk + 1}}}}});
+      ops.push_back({{"name", "copy"},
+                     {"src", peer},
+                     {"srcbuff", "s"},
+                     {"srcoff", chunk},
+                     {"dst", rank},
+                     {"dstbuff", "o"},
+                     {"dstoff", chunk},
+                     {"ctype", "none"},
+                     {"cnt", 1}});
+      channelIds.push_back(chunk);
+    }
+    plan["gpus"].push_back(
+        {{"id", rank},
+         {"inputChunks", nChunks},
+         {"outputChunks", nChunks},
+         {"scratchChunks", nChunks},
+         {"chunkGroups", 1},
+         {"channels",
+          {{{"srcbuff", "i"}, {"dstbuff", "s"}, {"type", "proxy"}, {"connectedTo", std::vector<int>(nChunks, peer)}}}},
+         {"threadblocks",
+          {{{"id", 0},
+            {"ops", ops},
+            {"channels", {{{"src", "i"}, {"dst", "s"}, {"ctype", "proxy"}, {"cids", channelIds}}}}}}}});
+  }
+  std::ofstream(path) << plan.dump();
+}
+}  // namespace
+
+TEST_P(ExecutionPlanFileTest, RoundTrip) {
+  const auto& [fileName, name] = GetParam();
+  mscclpp::ExecutionPlan plan(name, getExecutionFilePath(fileName));
+  plan.compile(compiledPath);
+  std::string compiled = readFile(compiledPath);
+  ASSERT_GT(compiled.size(), 0u);
+
+  // Decoding a compiled plan and compiling it again must reproduce the same file.
+  mscclpp::ExecutionPlan compiledPlan(name, compiledPath);
+  compiledPlan.compile(recompiledPath);
+  EXPECT_EQ(compiled, readFile(recompiledPath));
+}
+
+TEST_P(ExecutionPlanFileTest, RejectsCorruptedFile) {
+  const auto& [fileName, name] = GetParam();
+  mscclpp::ExecutionPlan(name, getExecutionFilePath(fileName)).compile(compiledPath);
+
+  std::string compiled = readFile(compiledPath);
+  compiled.back() ^= 0xff;
+  std::ofstream(compiledPath, std::ios::binary | std::ios::trunc) << compiled;
+  EXPECT_THROW(mscclpp::ExecutionPlan(name, compiledPath).compile(recompiledPath), mscclpp::Error);
+
+  compiled.back() ^= 0xff;
+  std::ofstream(compiledPath, std::ios::binary | std::ios::trunc) << compiled.substr(0, compiled.size() / 2);
+  EXPECT_THROW(mscclpp::ExecutionPlan(name, compiledPath).compile(recompiledPath), mscclpp::Error);
+}
+
+TEST_P(ExecutionPlanFileTest, RejectsMismatchedName) {
+  const auto& [fileName, name] = GetParam();
+  mscclpp::ExecutionPlan(name, getExecutionFilePath(fileName)).compile(compiledPath);
+  EXPECT_THROW(mscclpp::ExecutionPlan(name + "_other", compiledPath).compile(recompiledPath), mscclpp::Error);
+}
+
+TEST_P(ExecutionPlanFileTest, Verify) {
+  const auto& [fileName, name] = GetParam();
+  mscclpp::ExecutionPlan plan(name, getExecutionFilePath(fileName));
+  for (size_t size : {size_t(4096), size_t(1) << 20}) {
+    for (const auto& issue : plan.verify(size, size)) {
+      ADD_FAILURE() << "rank " << issue.rank << ", threadblock " << issue.threadblock << ", operation "
+                    << issue.operation << ": " << issue.message;
+    }
+  }
+}
+
+TEST_P(ExecutionPlanFileTest, Simulate) {
+  const auto& [fileName, name] = GetParam();
+  mscclpp::ExecutionPlan plan(name, getExecutionFilePath(fileName));
+  mscclpp::SimulationResult small = plan.simulate(4096, 4096);
+  mscclpp::SimulationResult large = plan.simulate(size_t(1) << 26, size_t(1) << 26);
+  EXPECT_FALSE(small.deadlocked);
+  EXPECT_FALSE(large.deadlocked);
+  EXPECT_GT(small.completionTime, 0);
+  EXPECT_GT(large.completionTime, small.completionTime);
+  ASSERT_FALSE(large.links.empty());
+  for (const auto& link : large.links) {
+    for (double utilization : link.utilization) {
+      EXPECT_GE(utilization, 0);
+      EXPECT_LE(utilization, 1 + 1e-6);
+    }
+  }
+
+  mscclpp::SimulationConfig config;
+  config.maxTimelineIntervals = 16;
+  mscclpp::SimulationResult capped = plan.simulate(size_t(1) << 26, size_t(1) << 26, config);
+  EXPECT_DOUBLE_EQ(capped.completionTime, large.completionTime);
+  EXPECT_GT(capped.timelineInterval, large.timelineInterval);
+  for (size_t i = 0; i < capped.links.size(); i++) {
+    EXPECT_LE(capped.links[i].utilization.size(), 16u);
+    double bytes = 0;
+    for (double utilization : capped.links[i].utilization) {
+      bytes += utilization * capped.links[i].bandwidth * 1e3 * capped.timelineInterval;
+    }
+    EXPECT_NEAR(bytes, capped.links[i].bytes, 1e-6 * capped.links[i].bytes + 1);
+  }
+  config.timeline = false;
+  for (const auto& link : plan.simulate(size_t(1) << 26, size_t(1) << 26, config).links) {
+    EXPECT_TRUE(link.utilization.empty());
+  }
+}
+
+TEST_P(ExecutionPlanFileTest, EncodedOperationsRoundTrip) {
+  const auto& [fileName, name] = GetParam();
+  mscclpp::ExecutionPlan plan(name, getExecutionFilePath(fileName));
+  for (size_t size : {size_t(4096), size_t(1) << 20, size_t(1) << 30}) {
+    auto impl = mscclpp::PlanAnalysis::instantiate(plan, size, size);
+    mscclpp::PlanAnalysis analysis(*impl);
+    size_t rawSize = 0;
+    size_t encodedSize = 0;
+    for (int rank : analysis.ranks()) {
+      for (int threadblock = 0; threadblock < analysis.threadblockCount(rank); threadblock++) {
+        const std::vector<mscclpp::Operation>& ops = analysis.operations(rank, threadblock);
+        std::vector<uint8_t> encoded = mscclpp::encodeOperations(ops);
+        std::vector<mscclpp::Operation> decoded = mscclpp::decodeOperations(encoded, ops.size());
+        // Unused fields of instantiated operations are zero, so the decoded operations must be identical.
+        for (size_t i = 0; i < ops.size(); i++) {
+          EXPECT_EQ(std::memcmp(&ops[i], &decoded[i], sizeof(mscclpp::Operation)), 0)
+              << "rank " << rank << ", threadblock " << threadblock << ", operation " << i;
+          std::vector<uint8_t> single;
+          EXPECT_LE(mscclpp::encodeOperation(ops[i], single), mscclpp::maxEncodedOperationSize(ops[i]));
+        }
+        rawSize += ops.size() * sizeof(mscclpp::Operation);
+        encodedSize += encoded.size();
+      }
+    }
+    EXPECT_GE(rawSize, 3 * encodedSize) << "message size " << size;
+  }
+}
+
+TEST_P(ExecutionPlanFileTest, OptimizeKeepsPlanValid) {
+  const auto& [fileName, name] = GetParam();
+  mscclpp::ExecutionPlan plan(name, getExecutionFilePath(fileName));
+  mscclpp::PlanOptimizationStats stats = plan.optimize();
+  EXPECT_LE(stats.operationsAfter, stats.operationsBefore);
+  plan.compile(compiledPath);
+  for (const auto& issue : mscclpp::ExecutionPlan(name, compiledPath).verify(4096, 4096)) {
+    ADD_FAILURE() << "rank " << issue.rank << ", threadblock " << issue.threadblock << ", operation "
+                  << issue.operation << ": " << issue.message;
+  }
+}
+
+TEST(ExecutionPlanVerifyTest, DetectsUnmatchedWait) {
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("mscclpp_plan_test_" + std::to_string(getpid()) + "_unmatched_wait.json"))
+                         .string();
+  std::ofstream(path) << UNMATCHED_WAIT_PLAN;
+  std::vector<mscclpp::PlanIssue> issues = mscclpp::ExecutionPlan("unmatched_wait", path).verify(1024, 1024);
+  std::filesystem::remove(path);
+
+  bool hasDeadlock = false;
+  for (const auto& issue : issues) {
+    EXPECT_EQ(issue.severity, mscclpp::PlanIssue::Severity::Error);
+    hasDeadlock |= issue.rank == 0 && issue.threadblock == 0 && issue.operation == 0;
+  }
+  EXPECT_EQ(issues.size(), 2u);
+  EXPECT_TRUE(hasDeadlock);
+}
+
+TEST(ExecutionPlanCacheTest, KeepsCompiledPlanInCacheDirectory) {
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / ("mscclpp_plan_test_" + std::to_string(getpid()) + "_cache");
+  std::filesystem::create_directories(dir / "cache");
+  std::string name = "../escaped";
+  std::string plan = UNMATCHED_WAIT_PLAN;
+  plan.replace(plan.find("unmatched_wait"), std::strlen("unmatched_wait"), name);
+  std::string path = (dir / "plan.json").string();
+  std::ofstream(path) << plan;
+
+  setenv("MSCCLPP_EXECUTION_PLAN_CACHE_DIR", (dir / "cache").c_str(), 1);
+  mscclpp::ExecutionPlan(name, path).verify(1024, 1024);
+  unsetenv("MSCCLPP_EXECUTION_PLAN_CACHE_DIR");
+
+  std::vector<std::string> cached;
+  for (const auto& entry : std::filesystem::directory_iterator(dir / "cache")) {
+    cached.push_back(entry.path().filename().string());
+  }
+  size_t nEntries = std::distance(std::filesystem::directory_iterator(dir), std::filesystem::directory_iterator());
+  std::filesystem::remove_all(dir);
+  ASSERT_EQ(cached.size(), 1u);
+  EXPECT_EQ(cached[0].rfind("___escaped-", 0), 0u);
+  EXPECT_EQ(nEntries, 2u);
+}
+
+TEST(ExecutionPlanCacheTest, WritesCompiledPlanOnce) {
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / ("mscclpp_plan_test_" + std::to_string(getpid()) + "_cache_lock");
+  std::filesystem::create_directories(dir);
+  std::string path = (dir / "plan.json").string();
+  std::ofstream(path) << UNMATCHED_WAIT_PLAN;
+  auto countPlans = [&]() {
+    size_t count = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dir / "cache")) {
+      count += entry.path().extension() == ".plan";
+    }
+    return count;
+  };
+
+  // A first load writes the cached copy, next to which the lock is taken.
+  setenv("MSCCLPP_EXECUTION_PLAN_CACHE_DIR", (dir / "cache").c_str(), 1);
+  std::filesystem::create_directories(dir / "cache");
+  mscclpp::ExecutionPlan("unmatched_wait", path).verify(1024, 1024);
+  std::filesystem::path lockPath;
+  for (const auto& entry : std::filesystem::directory_iterator(dir / "cache")) {
+    lockPath = entry.path().string() + ".lock";
+    std::filesystem::remove(entry.path());
+  }
+  ASSERT_FALSE(lockPath.empty());
+
+  // While another process holds the lock, the plan is loaded from the JSON file without writing the cached copy.
+  std::ofstream(lockPath.string());
+  EXPECT_EQ(mscclpp::ExecutionPlan("unmatched_wait", path).verify(1024, 1024).size(), 2u);
+  EXPECT_EQ(countPlans(), 0u);
+
+  // A lock left by a process that died is taken over.
+  std::filesystem::last_write_time(lockPath, std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+  EXPECT_EQ(mscclpp::ExecutionPlan("unmatched_wait", path).verify(1024, 1024).size(), 2u);
+  unsetenv("MSCCLPP_EXECUTION_PLAN_CACHE_DIR");
+  EXPECT_EQ(countPlans(), 1u);
+  EXPECT_FALSE(std::filesystem::exists(lockPath));
+  std::filesystem::remove_all(dir);
+}
+
+TEST(ExecutionPlanOptimizeTest, FusesAndRemovesOperations) {
+  std::string prefix = "mscclpp_plan_test_" + std::to_string(getpid()) + "_unoptimized";
+  std::string path = (std::filesystem::temp_directory_path() / (prefix + ".json")).string();
+  std::string compiledPath = (std::filesystem::temp_directory_path() / (prefix + ".plan")).string();
+  std::ofstream(path) << UNOPTIMIZED_PLAN;
+  mscclpp::ExecutionPlan plan("unoptimized", path);
+  mscclpp::PlanOptimizationStats stats = plan.optimize();
+  plan.compile(compiledPath);
+  std::vector<mscclpp::PlanIssue> issues = mscclpp::ExecutionPlan("unoptimized", compiledPath).verify(4096, 4096);
+  std::filesystem::remove(path);
+  std::filesystem::remove(compiledPath);
+
+  // Per rank: the leading, repeated and trailing barriers go, the one before the signal stays as the signal releases
+  // the copied output, and the one after the wait stays as the wait runs on a single thread.
+  EXPECT_EQ(stats.operationsBefore, 26u);
+  EXPECT_EQ(stats.operationsAfter, 12u);
+  EXPECT_EQ(stats.barriersRemoved, 6u);
+  EXPECT_EQ(stats.putsFused, 4u);
+  EXPECT_EQ(stats.copiesMerged, 4u);
+  EXPECT_TRUE(issues.empty());
+}
+
+TEST(PlanRegistryTest, LoadsDirectory) {
+  mscclpp::PlanRegistry registry;
+  std::filesystem::path directory = std::filesystem::path(getExecutionFilePath("allreduce.json")).parent_path();
+  EXPECT_EQ(registry.loadDirectory(directory.string()), 4u);
+  for (const auto& [plan, info] : registry.plans()) {
+    EXPECT_EQ(info.worldSize, 2);
+    EXPECT_EQ(info.minMessageSize, 0u);
+  }
+  EXPECT_NE(registry.select({"allreduce", 1 << 20, true, 2}), nullptr);
+  EXPECT_NE(registry.select({"sendrecv", 1 << 20, false, 2, "LL"}), nullptr);
+  EXPECT_EQ(registry.select({"allreduce", 1 << 20, false, 2}), nullptr);
+  EXPECT_EQ(registry.select({"allreduce", 1 << 20, true, 4}), nullptr);
+  EXPECT_EQ(registry.select({"allgather", 1 << 20, true, 2}), nullptr);
+}
+
+TEST(PlanRegistryTest, SelectsBySize) {
+  auto makePlan = [](const std::string& fileName) {
+    return std::make_shared<mscclpp::ExecutionPlan>("allreduce_pairs", getExecutionFilePath(fileName));
+  };
+  auto simplePlan = makePlan("allreduce.json");
+  auto packetPlan = makePlan("allreduce_packet.json");
+  auto tunedPlan = makePlan("allreduce.json");
+  mscclpp::PlanRegistry registry;
+  registry.registerPlan(simplePlan, {"allreduce", "Simple", true, 2, 0, std::numeric_limits<size_t>::max()});
+  registry.registerPlan(packetPlan, {"allreduce", "LL", true, 2, 1024, 1 << 20});
+  // Narrower ranges win over the ones they overlap.
+  registry.registerPlan(tunedPlan, {"allreduce", "Simple", true, 2, 3000, 5000});
+
+  auto select = [&](size_t size, const std::string& protocol = "") {
+    return registry.select({"allreduce", size, true, 2, protocol});
+  };
+  EXPECT_EQ(select(0), simplePlan);
+  EXPECT_EQ(select(1023), simplePlan);
+  EXPECT_EQ(select(1024), packetPlan);
+  EXPECT_EQ(select(2999), packetPlan);
+  EXPECT_EQ(select(3000), tunedPlan);
+  EXPECT_EQ(select(4999), tunedPlan);
+  EXPECT_EQ(select(5000), packetPlan);
+  EXPECT_EQ(select((1 << 20) - 1), packetPlan);
+  EXPECT_EQ(select(1 << 20), simplePlan);
+  EXPECT_EQ(select(std::numeric_limits<size_t>::max()), simplePlan);
+  EXPECT_EQ(select(4096, "Simple"), tunedPlan);
+  EXPECT_EQ(select(8192, "Simple"), simplePlan);
+  EXPECT_EQ(select(512, "LL"), nullptr);
+  EXPECT_EQ(select(8192, "LL"), packetPlan);
+
+  EXPECT_THROW(registry.registerPlan(simplePlan, {"allreduce", "Simple", true, 2, 10, 10}), mscclpp::Error);
+}
+
+TEST(PlanRegistryTest, ReloadsPlans) {
+  std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / ("mscclpp_plan_test_" + std::to_string(getpid()) + "_reload");
+  std::filesystem::create_directory(directory);
+  std::string path = (directory / "ring.json").string();
+  mscclpp::PlanGeneratorConfig config = {mscclpp::PlanAlgorithm::RingAllReduce, 4};
+  config.name = "ring";
+  mscclpp::writeExecutionPlan(config, path);
+  mscclpp::PlanRegistry registry;
+  ASSERT_EQ(registry.loadDirectory(directory.string()), 1u);
+  mscclpp::CollectiveDescriptor collective = {"allreduce", 1 << 20, false, 4};
+  std::shared_ptr<mscclpp::ExecutionPlan> original = registry.select(collective);
+  ASSERT_NE(original, nullptr);
+  EXPECT_EQ(original->version(), 0u);
+
+  // The reloaded plan is only selected once committed.
+  config.nChunks = 2;
+  mscclpp::writeExecutionPlan(config, path);
+  EXPECT_EQ(registry.reload(path).get(), 1u);
+  EXPECT_EQ(registry.select(collective), original);
+  EXPECT_EQ(registry.commitReloads(), 1u);
+  std::shared_ptr<mscclpp::ExecutionPlan> reloaded = registry.select(collective);
+  EXPECT_NE(reloaded, original);
+  EXPECT_EQ(reloaded->version(), 1u);
+  EXPECT_EQ(registry.plans().size(), 1u);
+  EXPECT_EQ(registry.commitReloads(), 0u);
+
+  // A plan that fails verification is not staged.
+  nlohmann::json invalid = nlohmann::json::parse(UNMATCHED_WAIT_PLAN);
+  invalid["collective"] = "allreduce";
+  std::ofstream(path) << invalid.dump();
+  EXPECT_THROW(registry.reload(path).get(), mscclpp::Error);
+  EXPECT_EQ(registry.commitReloads(), 0u);
+  EXPECT_EQ(registry.select(collective), reloaded);
+  std::filesystem::remove_all(directory);
+}
+
+TEST(PlanRegistryTest, WatchesDirectory) {
+  std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / ("mscclpp_plan_test_" + std::to_string(getpid()) + "_watch");
+  std::filesystem::create_directory(directory);
+  std::string path = (directory / "ring.json").string();
+  mscclpp::PlanGeneratorConfig config = {mscclpp::PlanAlgorithm::RingAllReduce, 4};
+  config.name = "ring";
+  mscclpp::writeExecutionPlan(config, path);
+  mscclpp::PlanRegistry registry;
+  registry.loadDirectory(directory.string());
+  registry.watchDirectory(directory.string(), std::chrono::milliseconds(10));
+
+  // A modified plan and a new one are both staged.
+  config.nChunks = 2;
+  mscclpp::writeExecutionPlan(config, path);
+  std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(1));
+  config = {mscclpp::PlanAlgorithm::RingAllGather, 4};
+  config.name = "ring_allgather";
+  mscclpp::writeExecutionPlan(config, (directory / "ring_allgather.json").string());
+  size_t committed = 0;
+  for (int i = 0; i < 1000 && committed < 2; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    committed += registry.commitReloads();
+  }
+  registry.stopWatching();
+  EXPECT_EQ(committed, 2u);
+  EXPECT_EQ(registry.select({"allreduce", 1 << 20, false, 4})->version(), 1u);
+  EXPECT_NE(registry.select({"allgather", 1 << 20, false, 4}), nullptr);
+  std::filesystem::remove_all(directory);
+}
+
+TEST(PlanGeneratorTest, GeneratesValidPlans) {
+  using mscclpp::PlanAlgorithm;
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("mscclpp_plan_test_" + std::to_string(getpid()) + "_generated.json"))
+                         .string();
+  // World size and ranks per node, including odd and non-power-of-two world sizes and a single node.
+  const std::vector<std::pair<int, int>> topologies = {{2, 0}, {3, 0}, {5, 0}, {6, 3}, {8, 4}, {12, 4}};
+  for (int algorithm = 0; algorithm <= int(PlanAlgorithm::PairwiseAllToAll); algorithm++) {
+    for (const auto& [worldSize, nRanksPerNode] : topologies) {
+      for (const std::string protocol : {"Simple", "LL"}) {
+        for (bool inPlace : {false, true}) {
+          if (PlanAlgorithm(algorithm) == PlanAlgorithm::PairwiseAllToAll && inPlace) continue;
+          mscclpp::PlanGeneratorConfig config = {PlanAlgorithm(algorithm), worldSize, nRanksPerNode, 2, protocol,
+                                                 inPlace};
+          std::string description = "algorithm " + std::to_string(algorithm) + ", " + std::to_string(worldSize) +
+                                    " ranks, " + std::to_string(nRanksPerNode) + " per node, " + protocol +
+                                    (inPlace ? ", in place" : "");
+          mscclpp::writeExecutionPlan(config, path);
+          nlohmann::json gpu = nlohmann::json::parse(std::ifstream(path))["gpus"][0];
+          size_t inputSize = 1024 * gpu["inputChunks"].get<size_t>();
+          size_t outputSize = gpu["outputChunks"] == 0 ? inputSize : 1024 * gpu["outputChunks"].get<size_t>();
+
+          mscclpp::ExecutionPlan plan(nlohmann::json::parse(std::ifstream(path))["name"], path);
+          for (const auto& issue : plan.verify(inputSize, outputSize)) {
+            ADD_FAILURE() << description << ": rank " << issue.rank << ", threadblock " << issue.threadblock
+                          << ", operation " << issue.operation << ": " << issue.message;
+          }
+          EXPECT_FALSE(plan.simulate(inputSize, outputSize).deadlocked) << description;
+        }
+      }
+    }
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(PlanGeneratorTest, WritesCompiledPlan) {
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("mscclpp_plan_test_" + std::to_string(getpid()) + "_generated.plan"))
+                         .string();
+  mscclpp::PlanGeneratorConfig config = {mscclpp::PlanAlgorithm::HierarchicalAllReduce, 8, 4};
+  config.name = "hierarchical";
+  mscclpp::writeExecutionPlan(config, path, true);
+  EXPECT_FALSE(std::filesystem::exists(path + ".json.tmp"));
+  EXPECT_TRUE(mscclpp::ExecutionPlan("hierarchical", path).verify(1 << 20, 1 << 20).empty());
+  std::filesystem::remove(path);
+}
+
+TEST(PlanGeneratorTest, RejectsInvalidConfig) {
+  using mscclpp::PlanAlgorithm;
+  EXPECT_THROW(mscclpp::generateExecutionPlan({PlanAlgorithm::RingAllReduce, 1}), mscclpp::Error);
+  EXPECT_THROW(mscclpp::generateExecutionPlan({PlanAlgorithm::HierarchicalAllReduce, 6, 4}), mscclpp::Error);
+  EXPECT_THROW(mscclpp::generateExecutionPlan({PlanAlgorithm::RingAllGather, 4, 0, 1, "LL128"}), mscclpp::Error);
+  EXPECT_THROW(mscclpp::generateExecutionPlan({PlanAlgorithm::PairwiseAllToAll, 4, 0, 1, "Simple", true}),
+               mscclpp::Error);
+}
+
+TEST(ExecutionPlanOffsetTest, ReduceScatter) {
+  // The input holds a block per rank and the output one block, so chunks 2 and 3 of the input are the second block.
+  std::string path = writeSingleOperationPlan(
+      "reduce_scatter", "reducescatter", 2, 4, 2,
+      {{"name", "copy"}, {"srcbuff", "i"}, {"srcoff", 2}, {"dstbuff", "o"}, {"dstoff", 0}, {"cnt", 2}});
+  mscclpp::ExecutionPlan plan("reduce_scatter", path);
+  auto impl = mscclpp::PlanAnalysis::instantiate(plan, 96, 48);
+  EXPECT_THROW(mscclpp::PlanAnalysis::instantiate(plan, 96, 64), mscclpp::Error);
+  std::filesystem::remove(path);
+
+  const mscclpp::Operation& op = impl->getOperations(0, 0)[0];
+  EXPECT_EQ(op.srcOffset, 48u);
+  EXPECT_EQ(op.dstOffset, 0u);
+  EXPECT_EQ(op.size, 48u);
+  EXPECT_EQ(impl->calcChunkLayout(0, 96, 48).blockSize, 48u);
+}
+
+TEST(ExecutionPlanOffsetTest, BroadcastWithoutInput) {
+  // Ranks other than the root may pass an empty input buffer.
+  std::string path = writeSingleOperationPlan(
+      "broadcast", "broadcast", 2, 1, 1,
+      {{"name", "copy"}, {"srcbuff", "s"}, {"srcoff", 0}, {"dstbuff", "o"}, {"dstoff", 0}, {"cnt", 1}});
+  mscclpp::ExecutionPlan plan("broadcast", path);
+  auto impl = mscclpp::PlanAnalysis::instantiate(plan, 0, 64);
+  std::filesystem::remove(path);
+
+  EXPECT_EQ(impl->getOperations(1, 0)[0].size, 64u);
+  EXPECT_EQ(impl->getScratchBufferSize(1, 0, 64), 64u);
+}
+
+TEST(ExecutionPlanOffsetTest, AllToAll) {
+  // Each rank's buffers hold a block per peer of two chunks each, so chunk 2 starts the block of rank 1 even though
+  // 96 bytes do not split into four aligned chunks of equal size.
+  std::string path = writeSingleOperationPlan(
+      "alltoall", "alltoall", 2, 4, 4,
+      {{"name", "copy"}, {"srcbuff", "i"}, {"srcoff", 2}, {"dstbuff", "o"}, {"dstoff", 2}, {"cnt", 1}});
+  std::string compiledPath = path + ".plan";
+  mscclpp::ExecutionPlan("alltoall", path).compile(compiledPath);
+  for (const std::string& planPath : {path, compiledPath}) {
+    auto impl = mscclpp::PlanAnalysis::instantiate(mscclpp::ExecutionPlan("alltoall", planPath), 96, 96);
+    const mscclpp::Operation& op = impl->getOperations(0, 0)[0];
+    EXPECT_EQ(impl->collective, "alltoall") << planPath;
+    EXPECT_EQ(op.srcOffset, 48u) << planPath;
+    EXPECT_EQ(op.dstOffset, 48u) << planPath;
+    EXPECT_EQ(op.size, 32u) << planPath;
+  }
+  std::filesystem::remove(path);
+  std::filesystem::remove(compiledPath);
+}
+
+TEST(ExecutionPlanTileTest, ReduceScatter) {
+  // Blocks of 96 bytes split into tiles of 32 bytes. A tile is instantiated as a message with blocks of 32 bytes, which
+  // are then moved to their place in the 96-byte blocks.
+  std::string path = writeSingleOperationPlan(
+      "reduce_scatter_tiles", "reducescatter", 2, 4, 2,
+      {{"name", "copy"}, {"srcbuff", "i"}, {"srcoff", 2}, {"dstbuff", "o"}, {"dstoff", 0}, {"cnt", 2}});
+  mscclpp::ExecutionPlan plan("reduce_scatter_tiles", path);
+  auto impl = mscclpp::PlanAnalysis::instantiate(plan, 192, 96);
+  std::filesystem::remove(path);
+
+  std::vector<mscclpp::ExecutionTile> tiles = impl->getTiles(0, 192, 96, 40);
+  ASSERT_EQ(tiles.size(), 3u);
+  EXPECT_EQ(tiles[2].offset, 64u);
+  EXPECT_EQ(tiles[2].size, 32u);
+  EXPECT_EQ(tiles[2].blockStride, 96u);
+  EXPECT_EQ(impl->getTiles(0, 192, 96, 96).size(), 1u);
+  EXPECT_THROW(impl->getTiles(0, 192, 96, 16), mscclpp::Error);
+  EXPECT_EQ(impl->getTileScratchBufferSize(0, 40), 16u);
+
+  impl->lightLoadExecutionPlan(64, 32, 0, 0, tiles[1]);
+  const mscclpp::Operation& op = impl->getOperations(0, 0)[0];
+  EXPECT_EQ(op.srcOffset, 96u + 32u);
+  EXPECT_EQ(op.dstOffset, 32u);
+  EXPECT_EQ(op.size, 32u);
+}
+
+TEST(ExecutionPlanTileTest, ScratchAndSpanningOperations) {
+  std::string path = writeSingleOperationPlan(
+      "allreduce_tiles", "allreduce", 2, 2, 2,
+      {{"name", "copy"}, {"srcbuff", "i"}, {"srcoff", 1}, {"dstbuff", "s"}, {"dstoff", 0}, {"cnt", 1}});
+  auto impl = mscclpp::PlanAnalysis::instantiate(mscclpp::ExecutionPlan("allreduce_tiles", path), 128, 128);
+  mscclpp::ExecutionTile tile = {64, 32, 128, 1024};
+  impl->lightLoadExecutionPlan(32, 32, 0, 0, tile);
+  EXPECT_EQ(impl->getOperations(0, 0)[0].srcOffset, 16u + 64u);
+  EXPECT_EQ(impl->getOperations(0, 0)[0].dstOffset, 1024u);
+  std::filesystem::remove(path);
+
+  // Chunks 1 and 2 of an allgather output are in different blocks, which are not adjacent in a tile.
+  path = writeSingleOperationPlan(
+      "allgather_tiles", "allgather", 2, 1, 2,
+      {{"name", "copy"}, {"srcbuff", "o"}, {"srcoff", 0}, {"dstbuff", "s"}, {"dstoff", 0}, {"cnt", 2}});
+  impl = mscclpp::PlanAnalysis::instantiate(mscclpp::ExecutionPlan("allgather_tiles", path), 64, 128);
+  EXPECT_THROW(impl->lightLoadExecutionPlan(32, 64, 0, 0, {32, 32, 64, 0}), mscclpp::Error);
+  std::filesystem::remove(path);
+}
+
+TEST(ExecutionPlanHostTest, AllReduceFloat16) {
+  // 2048 + 1 and 2048 + 3 are halfway between two float16 values and round to even, 0.5 + 0.25 is exact.
+  const std::vector<std::array<uint16_t, 3>> values = {{0x6800, 0x3c00, 0x6800}, {0x6800, 0x4200, 0x6802},
+                                                       {0x3800, 0x3400, 0x3a00}};
+  constexpr size_t count = 512;
+  for (const std::string fileName : {"allreduce.json", "allreduce_packet.json"}) {
+    std::vector<std::vector<uint16_t>> buffers(2, std::vector<uint16_t>(count));
+    for (size_t i = 0; i < count; i++) {
+      buffers[0][i] = values[i % values.size()][0];
+      buffers[1][i] = values[i % values.size()][1];
+    }
+    std::vector<void*> pointers = {buffers[0].data(), buffers[1].data()};
+    mscclpp::ExecutionPlan plan("allreduce_pairs", getExecutionFilePath(fileName));
+    plan.executeOnHost(pointers, pointers, count * sizeof(uint16_t), count * sizeof(uint16_t),
+                       mscclpp::DataType::FLOAT16);
+    for (int rank = 0; rank < 2; rank++) {
+      for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ(buffers[rank][i], values[i % values.size()][2]) << fileName << ", rank " << rank << ", element " << i;
+      }
+    }
+  }
+}
+
+TEST(ExecutionPlanHostTest, GeneratedPlans) {
+  using mscclpp::PlanAlgorithm;
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("mscclpp_plan_test_" + std::to_string(getpid()) + "_host.json"))
+                         .string();
+  // Small integers, so that bfloat16 sums are exact.
+  auto getValue = [](int rank, size_t i) { return float(rank * 8 + i % 8); };
+  auto toBfloat16 = [](float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return uint16_t(bits >> 16);
+  };
+  constexpr int nRanks = 4;
+  constexpr size_t count = 64;
+  for (PlanAlgorithm algorithm :
+       {PlanAlgorithm::HalvingDoublingAllReduce, PlanAlgorithm::BruckAllGather, PlanAlgorithm::PairwiseAllToAll}) {
+    for (const std::string protocol : {"Simple", "LL"}) {
+      mscclpp::writeExecutionPlan({algorithm, nRanks, 2, 2, protocol}, path);
+      size_t outputCount = algorithm == PlanAlgorithm::BruckAllGather ? nRanks * count : count;
+      std::vector<std::vector<uint16_t>> inputs(nRanks, std::vector<uint16_t>(count));
+      std::vector<std::vector<uint16_t>> outputs(nRanks, std::vector<uint16_t>(outputCount));
+      std::vector<void*> inputPointers, outputPointers;
+      for (int rank = 0; rank < nRanks; rank++) {
+        for (size_t i = 0; i < count; i++) {
+          inputs[rank][i] = toBfloat16(getValue(rank, i));
+        }
+        inputPointers.push_back(inputs[rank].data());
+        outputPointers.push_back(outputs[rank].data());
+      }
+      mscclpp::ExecutionPlan plan(nlohmann::json::parse(std::ifstream(path))["name"], path);
+      plan.executeOnHost(inputPointers, outputPointers, count * sizeof(uint16_t), outputCount * sizeof(uint16_t),
+                         mscclpp::DataType::BFLOAT16);
+
+      for (int rank = 0; rank < nRanks; rank++) {
+        for (size_t i = 0; i < outputCount; i++) {
+          float expected = 0;
+          if (algorithm == PlanAlgorithm::HalvingDoublingAllReduce) {
+            for (int peer = 0; peer < nRanks; peer++) expected += getValue(peer, i);
+          } else if (algorithm == PlanAlgorithm::BruckAllGather) {
+            expected = getValue(i / count, i % count);
+          } else {
+            size_t blockCount = count / nRanks;
+            expected = getValue(i / blockCount, rank * blockCount + i % blockCount);
+          }
+          ASSERT_EQ(outputs[rank][i], toBfloat16(expected))
+              << "algorithm " << int(algorithm) << ", " << protocol << ", rank " << rank << ", element " << i;
+        }
+      }
+    }
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(ExecutionPlanHostTest, ReduceOps) {
+  using mscclpp::ReduceOp;
+  std::string prefix = (std::filesystem::temp_directory_path() /
+                        ("mscclpp_plan_test_" + std::to_string(getpid()) + "_reduce_ops"))
+                           .string();
+  // The in-place plans keep partial sums in their input buffers.
+  std::vector<mscclpp::PlanGeneratorConfig> configs = {
+      {mscclpp::PlanAlgorithm::HalvingDoublingAllReduce, 4, 2, 2, "Simple"},
+      {mscclpp::PlanAlgorithm::HalvingDoublingAllReduce, 4, 2, 2, "Simple", true},
+      {mscclpp::PlanAlgorithm::RingAllReduce, 4, 2, 2, "Simple", true},
+      {mscclpp::PlanAlgorithm::RingAllReduce, 4, 2, 2, "LL"},
+      {mscclpp::PlanAlgorithm::DoubleBinaryTreeAllReduce, 4, 2, 2, "Simple"},
+      {mscclpp::PlanAlgorithm::HierarchicalAllReduce, 4, 2, 2, "LL", true}};
+  std::vector<std::string> generated;
+  for (const mscclpp::PlanGeneratorConfig& config : configs) {
+    generated.push_back(prefix + "_" + std::to_string(generated.size()) + ".json");
+    mscclpp::writeExecutionPlan(config, generated.back());
+  }
+  // Small integers, so that all results are exact.
+  auto getValue = [](int rank, size_t i) { return float(int((i * (2 * rank + 3) + rank) % 7) - 3); };
+  constexpr size_t count = 256;
+  std::vector<std::string> files = {getExecutionFilePath("allreduce.json"),
+                                    getExecutionFilePath("allreduce_packet.json")};
+  files.insert(files.end(), generated.begin(), generated.end());
+  // Compiled plans keep the final reduces.
+  std::string compiledPath = prefix + "_compiled.plan";
+  std::string treeName = nlohmann::json::parse(std::ifstream(generated[4]))["name"];
+  mscclpp::ExecutionPlan(treeName, generated[4]).compile(compiledPath);
+  files.push_back(compiledPath);
+  for (const std::string& file : files) {
+    std::string name = treeName;
+    int nRanks = 4;
+    if (file != compiledPath) {
+      nlohmann::json json = nlohmann::json::parse(std::ifstream(file));
+      name = json["name"];
+      nRanks = json["gpus"].size();
+    }
+    mscclpp::ExecutionPlan plan(name, file);
+    for (const mscclpp::Reduction& reduction :
+         std::vector<mscclpp::Reduction>{{ReduceOp::SUM},
+                                         {ReduceOp::PROD},
+                                         {ReduceOp::MAX},
+                                         {ReduceOp::MIN},
+                                         {ReduceOp::AVG},
+                                         {ReduceOp::PREMUL_SUM, 0.25},
+                                         {ReduceOp::PREMUL_SUM, 3}}) {
+      std::vector<std::vector<float>> buffers(nRanks, std::vector<float>(count));
+      std::vector<void*> pointers;
+      for (int rank = 0; rank < nRanks; rank++) {
+        for (size_t i = 0; i < count; i++) {
+          buffers[rank][i] = getValue(rank, i);
+        }
+        pointers.push_back(buffers[rank].data());
+      }
+      plan.executeOnHost(pointers, pointers, count * sizeof(float), count * sizeof(float),
+                         mscclpp::DataType::FLOAT32, reduction);
+      for (size_t i = 0; i < count; i++) {
+        float expected = getValue(0, i);
+        for (int peer = 1; peer < nRanks; peer++) {
+          float value = getValue(peer, i);
+          if (reduction.op == ReduceOp::PROD) {
+            expected *= value;
+          } else if (reduction.op == ReduceOp::MAX) {
+            expected = std::max(expected, value);
+          } else if (reduction.op == ReduceOp::MIN) {
+            expected = std::min(expected, value);
+          } else {
+            expected += value;
+          }
+        }
+        if (reduction.op == ReduceOp::AVG) {
+          expected /= nRanks;
+        } else if (reduction.op == ReduceOp::PREMUL_SUM) {
+          expected *= reduction.scalar;
+        }
+        for (int rank = 0; rank < nRanks; rank++) {
+          ASSERT_EQ(buffers[rank][i], expected)
+              << name << ", op " << int(reduction.op) << ", rank " << rank << ", element " << i;
+        }
+      }
+    }
+  }
+  // Integer averages would round every contribution to zero.
+  std::vector<std::vector<int32_t>> buffers(2, std::vector<int32_t>(count));
+  std::vector<void*> pointers = {buffers[0].data(), buffers[1].data()};
+  EXPECT_THROW(mscclpp::ExecutionPlan("allreduce_pairs", getExecutionFilePath("allreduce.json"))
+                   .executeOnHost(pointers, pointers, count * sizeof(int32_t), count * sizeof(int32_t),
+                                  mscclpp::DataType::INT32, {ReduceOp::AVG}),
+               mscclpp::Error);
+  // The host cannot read a factor from device memory.
+  float scalar = 2;
+  EXPECT_THROW(mscclpp::ExecutionPlan("allreduce_pairs", getExecutionFilePath("allreduce.json"))
+                   .executeOnHost(pointers, pointers, count * sizeof(int32_t), count * sizeof(int32_t),
+                                  mscclpp::DataType::FLOAT32, {ReduceOp::PREMUL_SUM, 1, &scalar}),
+               mscclpp::Error);
+  // Without final reduces, a plan has nowhere to multiply by the factor.
+  nlohmann::json unmarked = nlohmann::json::parse(std::ifstream(generated[0]));
+  for (auto& gpu : unmarked["gpus"]) {
+    for (auto& threadblock : gpu["threadblocks"]) {
+      for (auto& op : threadblock["ops"]) {
+        op.erase("final");
+      }
+    }
+  }
+  generated.push_back(prefix + "_unmarked.json");
+  std::ofstream(generated.back()) << unmarked.dump();
+  std::vector<std::vector<float>> floatBuffers(4, std::vector<float>(count));
+  std::vector<void*> floatPointers;
+  for (auto& buffer : floatBuffers) {
+    floatPointers.push_back(buffer.data());
+  }
+  mscclpp::ExecutionPlan unmarkedPlan(unmarked["name"], generated.back());
+  EXPECT_THROW(unmarkedPlan.executeOnHost(floatPointers, floatPointers, count * sizeof(float), count * sizeof(float),
+                                          mscclpp::DataType::FLOAT32, {ReduceOp::AVG}),
+               mscclpp::Error);
+  EXPECT_THROW(unmarkedPlan.executeOnHost(floatPointers, floatPointers, count * sizeof(float), count * sizeof(float),
+                                          mscclpp::DataType::FLOAT32, {ReduceOp::PREMUL_SUM, 2}),
+               mscclpp::Error);
+  EXPECT_NO_THROW(unmarkedPlan.executeOnHost(floatPointers, floatPointers, count * sizeof(float),
+                                             count * sizeof(float), mscclpp::DataType::FLOAT32, {ReduceOp::SUM}));
+  for (const std::string& file : generated) {
+    std::filesystem::remove(file);
+  }
+  std::filesystem::remove(compiledPath);
+}
+
+TEST(ExecutionPlanHostTest, DetectsDeadlock) {
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("mscclpp_plan_test_" + std::to_string(getpid()) + "_host_deadlock.json"))
+                         .string();
+  std::ofstream(path) << UNMATCHED_WAIT_PLAN;
+  std::vector<std::vector<char>> buffers(2, std::vector<char>(1024));
+  std::vector<void*> pointers = {buffers[0].data(), buffers[1].data()};
+  EXPECT_THROW(mscclpp::ExecutionPlan("unmatched_wait", path)
+                   .executeOnHost(pointers, pointers, 1024, 1024, mscclpp::DataType::FLOAT32),
+               mscclpp::Error);
+  std::filesystem::remove(path);
+}
+
+TEST(ExecutionPlanHostTest, LongPlans) {
+  // 128 operations and 32 channels per threadblock, more than a page of operations and the old channel limit of 16.
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("mscclpp_plan_test_" + std::to_string(getpid()) + "_long.json"))
+                         .string();
+  writePipelinedSendRecvPlan(path, 32);
+  mscclpp::ExecutionPlan plan("send_recv_pipelined", path);
+  constexpr size_t count = 4096;
+  for (const auto& issue : plan.verify(count * sizeof(int), count * sizeof(int))) {
+    ADD_FAILURE() << "rank " << issue.rank << ", threadblock " << issue.threadblock << ", operation "
+                  << issue.operation << ": " << issue.message;
+  }
+  std::vector<std::vector<int>> inputs(2, std::vector<int>(count));
+  std::vector<std::vector<int>> outputs(2, std::vector<int>(count));
+  for (int rank = 0; rank < 2; rank++) {
+    for (size_t i = 0; i < count; i++) inputs[rank][i] = rank * count + i;
+  }
+  plan.executeOnHost({inputs[0].data(), inputs[1].data()}, {outputs[0].data(), outputs[1].data()}, count * sizeof(int),
+                     count * sizeof(int), mscclpp::DataType::INT32);
+  for (int rank = 0; rank < 2; rank++) {
+    ASSERT_EQ(outputs[rank], inputs[1 - rank]) << "rank " << rank;
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(ExecutorExplainTest, CountsContextResources) {
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("mscclpp_plan_test_" + std::to_string(getpid()) + "_explain.json"))
+                         .string();
+  mscclpp::PlanGeneratorConfig config = {mscclpp::PlanAlgorithm::HierarchicalAllReduce, 8, 4};
+  config.name = "hierarchical";
+  mscclpp::writeExecutionPlan(config, path);
+  mscclpp::ExecutionPlan plan("hierarchical", path);
+
+  // Rank 5 is on the second node: a ring within its node over CUDA IPC, and a ring with rank 1 over IB.
+  mscclpp::ExecutionFootprint footprint = mscclpp::Executor::explain(5, 1 << 20, 1 << 20, plan, 4);
+  EXPECT_EQ(footprint.rank, 5);
+  EXPECT_EQ(footprint.connections.at("IPC"), 2u);
+  EXPECT_EQ(footprint.connections.at("IB1"), 1u);
+  EXPECT_GT(footprint.smChannels, 0u);
+  EXPECT_GT(footprint.proxyChannels, 0u);
+  EXPECT_EQ(footprint.smSemaphores, footprint.smChannels);
+  EXPECT_EQ(footprint.proxyThreads, 1u);
+  EXPECT_EQ(footprint.threadsPerBlock, 1024);
+  EXPECT_GT(footprint.threadblocks, 0);
+  EXPECT_GT(footprint.sharedMemPerBlock, 0u);
+  EXPECT_GT(footprint.scratchBufferSize, 0u);
+  EXPECT_GE(footprint.scratchBytesReserved, footprint.scratchBufferSize);
+  EXPECT_EQ(footprint.scratchBytesReserved & (footprint.scratchBytesReserved - 1), 0u);
+  EXPECT_EQ(footprint.tiles, 1u);
+  EXPECT_EQ(footprint.contextBytes, footprint.scratchBytesReserved + footprint.devicePlanBytes);
+
+  // On a single node every peer is connected over CUDA IPC and no proxy thread runs.
+  mscclpp::ExecutionFootprint singleNode = mscclpp::Executor::explain(5, 1 << 20, 1 << 20, plan, 8);
+  EXPECT_EQ(singleNode.connections.count("IB1"), 0u);
+  EXPECT_EQ(singleNode.connections.at("IPC"), 3u);
+
+  // Tiles bound the scratch buffer and add a device plan per tile.
+  mscclpp::ExecutorConfig tiled;
+  tiled.tileSize = 1 << 14;
+  mscclpp::ExecutionFootprint tiledFootprint = mscclpp::Executor::explain(5, 1 << 20, 1 << 20, plan, 4, tiled);
+  EXPECT_GT(tiledFootprint.tiles, 1u);
+  EXPECT_LT(tiledFootprint.scratchBufferSize, footprint.scratchBufferSize);
+  EXPECT_EQ(tiledFootprint.devicePlanBytes % (tiledFootprint.tiles + 1), 0u);
+  std::filesystem::remove(path);
+}
+
+TEST(ExecutionGroupTest, MergesDevicePlans) {
+  using mscclpp::OperationType;
+  std::vector<std::vector<mscclpp::Operation>> first = {
+      {makeChannelOperation(OperationType::SIGNAL, {0}), makeChannelOperation(OperationType::PUT, {1})}};
+  std::vector<std::vector<mscclpp::Operation>> second = {{makeChannelOperation(OperationType::PUT_PACKET, {0})},
+                                                          {makeChannelOperation(OperationType::SIGNAL, {0})}};
+  std::vector<char> firstBuffer = makeDevicePlanBuffer(first, 2, 'a');
+  std::vector<char> secondBuffer = makeDevicePlanBuffer(second, 1, 'b');
+  char input[64], output[64], scratch[256];
+  std::vector<mscclpp::ExecutionGroupPart> parts = {
+      {firstBuffer.data(), firstBuffer.size(), 1, {input, output, scratch, 128, 7}},
+      {secondBuffer.data(), secondBuffer.size(), 2, {input, output, scratch + 128, 128, 8}}};
+  std::vector<char> merged = mscclpp::mergeDeviceExecutionPlans(parts);
+
+  std::vector<std::pair<size_t, const std::vector<mscclpp::Operation>*>> threadblocks = {
+      {0, &first[0]}, {1, &second[0]}, {1, &second[1]}};
+  for (size_t threadblock = 0; threadblock < threadblocks.size(); threadblock++) {
+    const auto& [part, ops] = threadblocks[threadblock];
+    mscclpp::DeviceExecutionPlan header;
+    std::memcpy(&header, merged.data() + threadblock * sizeof(header), sizeof(header));
+    mscclpp::DeviceExecutionArgs args;
+    std::memcpy(&args, merged.data() + header.argsOffset, sizeof(args));
+    EXPECT_EQ(args.scratch, parts[part].args.scratch) << "threadblock " << threadblock;
+    EXPECT_EQ(args.flag, parts[part].args.flag) << "threadblock " << threadblock;
+    // The channel tables and operations of the threadblock moved along with their offsets.
+    EXPECT_EQ(merged[header.smChannelsOffset], part == 0 ? 'a' : 'b') << "threadblock " << threadblock;
+    EXPECT_EQ(header.proxyChannelsOffset - header.smChannelsOffset, header.nSmChannels * 16u);
+    std::vector<uint8_t> encoded(merged.begin() + header.operationsOffset,
+                                 merged.begin() + header.operationsOffset + header.operationsSize);
+    std::vector<mscclpp::Operation> decoded = mscclpp::decodeOperations(encoded, header.nOperations);
+    ASSERT_EQ(decoded.size(), ops->size());
+    for (size_t i = 0; i < decoded.size(); i++) {
+      EXPECT_EQ(std::memcmp(&decoded[i], &(*ops)[i], sizeof(mscclpp::Operation)), 0)
+          << "threadblock " << threadblock << ", operation " << i;
+    }
+  }
+
+  // Executions of a group run concurrently, so they must not share scratch memory.
+  parts[1].args.scratch = scratch + 64;
+  EXPECT_THROW(mscclpp::mergeDeviceExecutionPlans(parts), mscclpp::Error);
+  parts[1].args.scratch = scratch + 128;
+  // The second execution has a single channel per threadblock.
+  second[1][0] = makeChannelOperation(OperationType::SIGNAL, {1});
+  secondBuffer = makeDevicePlanBuffer(second, 1, 'b');
+  parts[1].buffer = secondBuffer.data();
+  EXPECT_THROW(mscclpp::mergeDeviceExecutionPlans(parts), mscclpp::Error);
+}
+
+INSTANTIATE_TEST_SUITE_P(ExecutionFiles, ExecutionPlanFileTest,
+                         ::testing::Values(std::make_pair("allreduce.json", "allreduce_pairs"),
+                                           std::make_pair("allreduce_packet.json", "allreduce_pairs"),
+                                           std::make_pair("sendrecv.json", "send_recv"),
+                                           std::make_pair("sendrecv_packet.json", "send_recv")),
+                         [](const auto& info) { return info.param.first.substr(0, info.param.first.find('.')); });
@@ -0,0 +1,105 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "sharded_cache.hpp"
+
+TEST(ShardedCacheTest, FindInsertErase) {
+  mscclpp::ShardedCache<int, int> cache;
+  EXPECT_EQ(cache.find(1), nullptr);
+  EXPECT_EQ(*cache.insert(1, std::make_shared<int>(10)), 10);
+  // The first value of a key is kept.
+  EXPECT_EQ(*cache.insert(1, std::make_shared<int>(11)), 10);
+  EXPECT_EQ(*cache.find(1), 10);
+  EXPECT_EQ(cache.size(), 1u);
+  std::shared_ptr<int> erased = cache.erase(1);
+  EXPECT_EQ(*erased, 10);
+  EXPECT_EQ(cache.erase(1), nullptr);
+  EXPECT_EQ(cache.find(1), nullptr);
+  EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(ShardedCacheTest, ConcurrentInsertsAgree) {
+  const int nThreads = 16;
+  const int nKeys = 1000;
+  mscclpp::ShardedCache<int, int> cache;
+  std::vector<std::vector<std::shared_ptr<int>>> results(nThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nThreads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int key = 0; key < nKeys; key++) {
+        results[t].push_back(cache.insert(key, std::make_shared<int>(t)));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(cache.size(), (size_t)nKeys);
+  for (int key = 0; key < nKeys; key++) {
+    for (int t = 1; t < nThreads; t++) {
+      EXPECT_EQ(results[t][key], results[0][key]);
+    }
+    EXPECT_EQ(cache.find(key), results[0][key]);
+  }
+}
+
+// Readers look up keys while writers keep inserting and erasing them, as executions do while contexts are set up and
+// evicted. A value found must be the one of its key and stay valid after it is erased.
+TEST(ShardedCacheTest, StressLookupsWhileInsertingAndErasing) {
+  const int nReaders = 12;
+  const int nWriters = 4;
+  const int nKeys = 64;
+  const int nIterations = 20000;
+  mscclpp::ShardedCache<int, std::vector<int>> cache;
+  std::atomic<bool> done{false};
+  std::atomic<int> mismatches{0};
+  std::atomic<uint64_t> hits{0};
+  std::vector<std::thread> threads;
+  for (int r = 0; r < nReaders; r++) {
+    threads.emplace_back([&, r]() {
+      unsigned int key = r;
+      while (!done) {
+        key = (key * 1103515245 + 12345) % nKeys;
+        std::shared_ptr<std::vector<int>> value = cache.find(key);
+        if (value == nullptr) continue;
+        hits++;
+        for (int element : *value) {
+          if (element != (int)key) mismatches++;
+        }
+      }
+    });
+  }
+  for (int w = 0; w < nWriters; w++) {
+    threads.emplace_back([&, w]() {
+      for (int i = 0; i < nIterations; i++) {
+        int key = (i * nWriters + w) % nKeys;
+        if (i % 3 == 2) {
+          cache.erase(key);
+        } else {
+          cache.insert(key, std::make_shared<std::vector<int>>(16, key));
+        }
+      }
+    });
+  }
+  for (int i = nReaders; i < nReaders + nWriters; i++) {
+    threads[i].join();
+  }
+  done = true;
+  for (int i = 0; i < nReaders; i++) {
+    threads[i].join();
+  }
+  EXPECT_EQ(mismatches, 0);
+  EXPECT_GT(hits, 0u);
+  size_t size = 0;
+  cache.forEach([&](int key, const std::shared_ptr<std::vector<int>>& value) {
+    size++;
+    EXPECT_EQ(value->front(), key);
+  });
+  EXPECT_EQ(size, cache.size());
+}
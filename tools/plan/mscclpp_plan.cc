@@ -0,0 +1,506 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Offline tool for execution plan files.
+//
+//   mscclpp_plan verify [--size BYTES]... [--output-size BYTES] [--name NAME] PLAN
+//   mscclpp_plan optimize --output OUTPUT [--name NAME] PLAN
+//   mscclpp_plan simulate [--size BYTES]... [--ranks-per-node N] [--timeline PATH] [--name NAME] PLAN
+//   mscclpp_plan run [--size BYTES]... [--output-size BYTES] [--name NAME] PLAN
+//   mscclpp_plan explain [--size BYTES]... [--output-size BYTES] [--rank RANK] [--ranks-per-node N]
+//                        [--tile-size BYTES] [--max-context-bytes BYTES] [--name NAME] PLAN
+//   mscclpp_plan generate --algorithm ALGORITHM --world-size N [--ranks-per-node N] [--chunks N] [--protocol LL]
+//                         [--in-place] [--compiled] [--name NAME] --output OUTPUT
+//
+// Sizes accept K, M and G suffixes. The output size defaults to the input size, or to the size the collective of the
+// plan implies for `run` and `explain`.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mscclpp/errors.hpp>
+#include <mscclpp/executor.hpp>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "execution_plan.hpp"
+#include "execution_plan_file.hpp"
+
+namespace {
+
+struct Options {
+  std::string command;
+  std::string planPath;
+  std::string name;
+  std::string outputPath;
+  std::vector<size_t> sizes;
+  size_t outputSize = 0;
+  std::string timelinePath;
+  mscclpp::SimulationConfig simulation;
+  mscclpp::ExecutorConfig executor;
+  int rank = -1;
+  mscclpp::PlanGeneratorConfig generator = {mscclpp::PlanAlgorithm::RingAllReduce, 0};
+  bool compiled = false;
+};
+
+const std::map<std::string, mscclpp::PlanAlgorithm> ALGORITHMS = {
+    {"ring_allreduce", mscclpp::PlanAlgorithm::RingAllReduce},
+    {"double_binary_tree_allreduce", mscclpp::PlanAlgorithm::DoubleBinaryTreeAllReduce},
+    {"halving_doubling_allreduce", mscclpp::PlanAlgorithm::HalvingDoublingAllReduce},
+    {"hierarchical_allreduce", mscclpp::PlanAlgorithm::HierarchicalAllReduce},
+    {"ring_allgather", mscclpp::PlanAlgorithm::RingAllGather},
+    {"bruck_allgather", mscclpp::PlanAlgorithm::BruckAllGather},
+    {"hierarchical_allgather", mscclpp::PlanAlgorithm::HierarchicalAllGather},
+    {"pairwise_alltoall", mscclpp::PlanAlgorithm::PairwiseAllToAll},
+};
+
+void printUsage(const char* program) {
+  std::cerr << "Usage: " << program << " <command> [options] PLAN\n"
+            << "       " << program << " generate [options]\n"
+            << "\n"
+            << "Commands:\n"
+            << "  verify    Check the plan for deadlocks, unmatched signals, out-of-bounds accesses, unenforced\n"
+            << "            dependencies and races between threadblocks\n"
+            << "  optimize  Fuse and remove operations, and write the result as a compiled plan\n"
+            << "  simulate  Predict the completion time of the plan and the utilization of its links\n"
+            << "  generate  Write a plan for a collective algorithm\n"
+            << "  run       Execute the plan on the host with int32 data and check the result of allreduce,\n"
+            << "            allgather, reducescatter and alltoall plans\n"
+            << "  explain   Report as JSON the connections, memories, semaphores, channels, proxy threads,\n"
+            << "            threadblocks, shared memory, scratch buffer and device plan bytes an executor sets up\n"
+            << "            for the plan on each rank, without GPUs\n"
+            << "\n"
+            << "Options:\n"
+            << "  --size BYTES          Input size to check, can be repeated (default: 1M)\n"
+            << "  --output-size BYTES   Output size (default: the input size)\n"
+            << "  --name NAME           Plan name (default: the name in the plan file)\n"
+            << "  --output, -o PATH     Output path of the compiled plan\n"
+            << "\n"
+            << "Simulation options (bandwidths in GB/s, latencies in microseconds):\n"
+            << "  --ranks-per-node N    Ranks per node (default: 8)\n"
+            << "  --intra-bw GBPS       Bandwidth between two GPUs of a node (default: 150)\n"
+            << "  --inter-bw GBPS       Network bandwidth between two GPUs of different nodes (default: 25)\n"
+            << "  --intra-latency US    Latency between two GPUs of a node (default: 1)\n"
+            << "  --inter-latency US    Network latency (default: 5)\n"
+            << "  --tb-bw GBPS          Memory throughput of a threadblock (default: 80)\n"
+            << "  --timeline PATH       Write the per-link utilization of the last size as CSV\n"
+            << "\n"
+            << "Explain options:\n"
+            << "  --rank RANK           Only report this rank (default: all ranks)\n"
+            << "  --ranks-per-node N    Ranks per node, ranks of different nodes connect over IB (default: 8)\n"
+            << "  --tile-size BYTES     ExecutorConfig::tileSize (default: 0)\n"
+            << "  --max-context-bytes BYTES\n"
+            << "                        Fail if the context of a rank needs more device memory\n"
+            << "\n"
+            << "Generation options:\n"
+            << "  --algorithm NAME      ring_allreduce, double_binary_tree_allreduce, halving_doubling_allreduce,\n"
+            << "                        hierarchical_allreduce, ring_allgather, bruck_allgather,\n"
+            << "                        hierarchical_allgather or pairwise_alltoall\n"
+            << "  --world-size N        Number of ranks\n"
+            << "  --ranks-per-node N    Ranks per node, ranks of different nodes use proxy channels (default: all\n"
+            << "                        ranks on one node)\n"
+            << "  --chunks N            Chunks per rank, see PlanGeneratorConfig::nChunks (default: 1)\n"
+            << "  --protocol NAME       Simple or LL (default: Simple)\n"
+            << "  --in-place            Generate an in-place plan\n"
+            << "  --compiled            Write the plan in the compiled format instead of JSON\n";
+}
+
+size_t parseSize(const std::string& str) {
+  size_t pos = 0;
+  size_t size = std::stoull(str, &pos);
+  std::string suffix = str.substr(pos);
+  if (suffix == "K" || suffix == "k") {
+    size <<= 10;
+  } else if (suffix == "M" || suffix == "m") {
+    size <<= 20;
+  } else if (suffix == "G" || suffix == "g") {
+    size <<= 30;
+  } else if (!suffix.empty()) {
+    throw std::invalid_argument("Invalid size " + str);
+  }
+  return size;
+}
+
+Options parseOptions(int argc, char* argv[]) {
+  if (argc < 2) {
+    throw std::invalid_argument("Missing command");
+  }
+  Options options;
+  options.command = argv[1];
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::invalid_argument("Missing value for " + arg);
+      }
+      return argv[++i];
+    };
+    if (arg == "--size") {
+      options.sizes.push_back(parseSize(value()));
+    } else if (arg == "--output-size") {
+      options.outputSize = parseSize(value());
+    } else if (arg == "--name") {
+      options.name = value();
+    } else if (arg == "--output" || arg == "-o") {
+      options.outputPath = value();
+    } else if (arg == "--timeline") {
+      options.timelinePath = value();
+    } else if (arg == "--ranks-per-node") {
+      options.simulation.nRanksPerNode = std::stoi(value());
+      options.generator.nRanksPerNode = options.simulation.nRanksPerNode;
+    } else if (arg == "--intra-bw") {
+      options.simulation.intraNodeBandwidth = std::stod(value());
+    } else if (arg == "--inter-bw") {
+      options.simulation.interNodeBandwidth = std::stod(value());
+    } else if (arg == "--intra-latency") {
+      options.simulation.intraNodeLatency = std::stod(value());
+    } else if (arg == "--inter-latency") {
+      options.simulation.interNodeLatency = std::stod(value());
+    } else if (arg == "--tb-bw") {
+      options.simulation.threadblockBandwidth = std::stod(value());
+    } else if (arg == "--rank") {
+      options.rank = std::stoi(value());
+    } else if (arg == "--tile-size") {
+      options.executor.tileSize = parseSize(value());
+    } else if (arg == "--max-context-bytes") {
+      options.executor.maxContextBytes = parseSize(value());
+    } else if (arg == "--algorithm") {
+      std::string name = value();
+      auto it = ALGORITHMS.find(name);
+      if (it == ALGORITHMS.end()) {
+        throw std::invalid_argument("Unknown algorithm " + name);
+      }
+      options.generator.algorithm = it->second;
+    } else if (arg == "--world-size") {
+      options.generator.worldSize = std::stoi(value());
+    } else if (arg == "--chunks") {
+      options.generator.nChunks = std::stoi(value());
+    } else if (arg == "--protocol") {
+      options.generator.protocol = value();
+    } else if (arg == "--in-place") {
+      options.generator.inPlace = true;
+    } else if (arg == "--compiled") {
+      options.compiled = true;
+    } else if (!arg.empty() && arg[0] == '-') {
+      throw std::invalid_argument("Unknown option " + arg);
+    } else if (options.planPath.empty()) {
+      options.planPath = arg;
+    } else {
+      throw std::invalid_argument("Unexpected argument " + arg);
+    }
+  }
+  if (options.command == "generate") {
+    if (!options.planPath.empty()) {
+      throw std::invalid_argument("Unexpected argument " + options.planPath);
+    }
+  } else if (options.planPath.empty()) {
+    throw std::invalid_argument("Missing plan file");
+  }
+  if (options.sizes.empty()) {
+    options.sizes.push_back(size_t(1) << 20);
+  }
+  return options;
+}
+
+std::string readPlanName(const std::string& path) {
+  if (mscclpp::ExecutionPlanFile::isCompiledPlan(path)) {
+    return mscclpp::ExecutionPlanFile(path).name();
+  }
+  std::ifstream file(path);
+  if (!file) {
+    throw std::invalid_argument("Cannot open " + path);
+  }
+  // Skip the ranks, only the name is needed.
+  auto skipGpus = [](int depth, nlohmann::json::parse_event_t event, nlohmann::json& parsed) {
+    return !(depth == 1 && event == nlohmann::json::parse_event_t::key && parsed == "gpus");
+  };
+  nlohmann::json plan = nlohmann::json::parse(file, skipGpus);
+  return plan.at("name").get<std::string>();
+}
+
+int verify(const Options& options) {
+  mscclpp::ExecutionPlan plan(options.name, options.planPath);
+  int nErrors = 0;
+  for (size_t inputSize : options.sizes) {
+    size_t outputSize = options.outputSize > 0 ? options.outputSize : inputSize;
+    std::vector<mscclpp::PlanIssue> issues = plan.verify(inputSize, outputSize);
+    std::cout << options.planPath << " (input " << inputSize << " bytes, output " << outputSize
+              << " bytes): " << (issues.empty() ? "OK" : std::to_string(issues.size()) + " issue(s)") << "\n";
+    for (const auto& issue : issues) {
+      bool isError = issue.severity == mscclpp::PlanIssue::Severity::Error;
+      nErrors += isError;
+      std::cout << "  " << (isError ? "error" : "warning");
+      if (issue.rank >= 0) std::cout << ": rank " << issue.rank;
+      if (issue.threadblock >= 0) std::cout << ", threadblock " << issue.threadblock;
+      if (issue.operation >= 0) std::cout << ", operation " << issue.operation;
+      std::cout << ": " << issue.message << "\n";
+    }
+  }
+  return nErrors > 0 ? 1 : 0;
+}
+
+int optimize(const Options& options) {
+  if (options.outputPath.empty()) {
+    throw std::invalid_argument("Missing --output");
+  }
+  mscclpp::ExecutionPlan plan(options.name, options.planPath);
+  mscclpp::PlanOptimizationStats stats = plan.optimize();
+  plan.compile(options.outputPath);
+  std::cout << options.planPath << ": " << stats.operationsBefore << " -> " << stats.operationsAfter
+            << " operations\n"
+            << "  barriers removed: " << stats.barriersRemoved << "\n"
+            << "  puts fused:       " << stats.putsFused << "\n"
+            << "  copies merged:    " << stats.copiesMerged << "\n";
+  return 0;
+}
+
+int simulate(const Options& options) {
+  mscclpp::ExecutionPlan plan(options.name, options.planPath);
+  mscclpp::SimulationResult result;
+  int status = 0;
+  mscclpp::SimulationConfig config = options.simulation;
+  for (size_t i = 0; i < options.sizes.size(); i++) {
+    size_t inputSize = options.sizes[i];
+    size_t outputSize = options.outputSize > 0 ? options.outputSize : inputSize;
+    // Only the timeline of the last size is written.
+    config.timeline = !options.timelinePath.empty() && i + 1 == options.sizes.size();
+    result = plan.simulate(inputSize, outputSize, config);
+    double busiest = 0;
+    for (const auto& link : result.links) {
+      if (link.type != "memory" && result.completionTime > 0) {
+        busiest = std::max(busiest, link.bytes / (link.bandwidth * 1e3 * result.completionTime));
+      }
+    }
+    std::printf("%s (input %zu bytes, output %zu bytes): %.2f us, algorithm bandwidth %.2f GB/s, "
+                "busiest link %.0f%%%s\n",
+                options.planPath.c_str(), inputSize, outputSize, result.completionTime,
+                result.completionTime > 0 ? inputSize / (result.completionTime * 1e3) : 0.0, busiest * 100,
+                result.deadlocked ? ", DEADLOCK" : "");
+    status |= result.deadlocked;
+  }
+  if (!options.timelinePath.empty()) {
+    std::ofstream timeline(options.timelinePath);
+    if (!timeline) {
+      throw std::invalid_argument("Cannot open " + options.timelinePath);
+    }
+    timeline << "time_us,src,dst,type,utilization\n";
+    for (const auto& link : result.links) {
+      for (size_t i = 0; i < link.utilization.size(); i++) {
+        timeline << i * result.timelineInterval << "," << link.src << "," << link.dst << "," << link.type << ","
+                 << link.utilization[i] << "\n";
+      }
+    }
+  }
+  return status;
+}
+
+// Input element i of rank r in `run`. Sums over thousands of ranks stay far from overflowing.
+int32_t getInputValue(int rank, size_t i) { return int32_t(rank * 1000 + i % 997); }
+
+// Output of `rank` for the inputs of all ranks, or an empty vector if the collective is not one `run` checks.
+std::vector<int32_t> getExpectedOutput(const std::string& collective, int rank,
+                                       const std::vector<std::vector<int32_t>>& inputs, size_t outputCount) {
+  int nRanks = inputs.size();
+  size_t inputCount = inputs[0].size();
+  std::vector<int32_t> expected(outputCount);
+  for (size_t i = 0; i < outputCount; i++) {
+    if (collective == "allreduce") {
+      for (int r = 0; r < nRanks; r++) expected[i] += inputs[r][i];
+    } else if (collective == "allgather") {
+      expected[i] = inputs[i / inputCount][i % inputCount];
+    } else if (collective == "reducescatter") {
+      for (int r = 0; r < nRanks; r++) expected[i] += inputs[r][rank * outputCount + i];
+    } else if (collective == "alltoall") {
+      size_t blockCount = outputCount / nRanks;
+      expected[i] = inputs[i / blockCount][rank * blockCount + i % blockCount];
+    } else {
+      return {};
+    }
+  }
+  return expected;
+}
+
+mscclpp::PlanInfo getPlanInfo(const std::string& path) {
+  if (mscclpp::ExecutionPlanFile::isCompiledPlan(path)) {
+    // Compiled plans do not record whether they are in place.
+    mscclpp::ExecutionPlanFile file(path);
+    mscclpp::PlanInfo info;
+    info.collective = file.collective();
+    info.worldSize = file.header().nRanks;
+    info.inPlace = false;
+    return info;
+  }
+  return mscclpp::readPlanInfo(path).second;
+}
+
+// The output size given with --output-size, or the one the collective of the plan implies.
+size_t getOutputSize(const Options& options, const mscclpp::PlanInfo& info, size_t inputSize) {
+  if (options.outputSize > 0) {
+    return options.outputSize;
+  }
+  return info.collective == "allgather"       ? inputSize * info.worldSize
+         : info.collective == "reducescatter" ? inputSize / info.worldSize
+                                              : inputSize;
+}
+
+int run(const Options& options) {
+  mscclpp::ExecutionPlan plan(options.name, options.planPath);
+  mscclpp::PlanInfo info = getPlanInfo(options.planPath);
+  int nRanks = info.worldSize;
+  int status = 0;
+  for (size_t inputSize : options.sizes) {
+    size_t outputSize = getOutputSize(options, info, inputSize);
+    size_t inputCount = inputSize / sizeof(int32_t);
+    size_t outputCount = outputSize / sizeof(int32_t);
+    // In-place plans get the input at the place of the rank's data in the output, or the other way round.
+    std::vector<std::vector<int32_t>> memory(nRanks);
+    std::vector<std::vector<int32_t>> inputData(nRanks, std::vector<int32_t>(inputCount));
+    std::vector<void*> inputs(nRanks), outputs(nRanks);
+    std::vector<size_t> inputOffsets(nRanks, 0), outputOffsets(nRanks, 0);
+    for (int rank = 0; rank < nRanks; rank++) {
+      for (size_t i = 0; i < inputCount; i++) inputData[rank][i] = getInputValue(rank, i);
+      if (info.inPlace && inputCount <= outputCount) {
+        memory[rank].resize(outputCount);
+        inputOffsets[rank] = info.collective == "allgather" ? rank * inputCount : 0;
+      } else if (info.inPlace) {
+        memory[rank].resize(inputCount);
+        outputOffsets[rank] = info.collective == "reducescatter" ? rank * outputCount : 0;
+      } else {
+        memory[rank].resize(inputCount + outputCount);
+        outputOffsets[rank] = inputCount;
+      }
+      std::copy(inputData[rank].begin(), inputData[rank].end(), memory[rank].begin() + inputOffsets[rank]);
+      inputs[rank] = memory[rank].data() + inputOffsets[rank];
+      outputs[rank] = memory[rank].data() + outputOffsets[rank];
+    }
+    plan.executeOnHost(inputs, outputs, inputSize, outputSize, mscclpp::DataType::INT32);
+
+    std::printf("%s (input %zu bytes, output %zu bytes): ", options.planPath.c_str(), inputSize, outputSize);
+    std::string result = "OK";
+    for (int rank = 0; rank < nRanks && result == "OK"; rank++) {
+      std::vector<int32_t> expected = getExpectedOutput(info.collective, rank, inputData, outputCount);
+      if (expected.empty()) {
+        result = "done, no reference for collective \"" + info.collective + "\"";
+        break;
+      }
+      const int32_t* output = memory[rank].data() + outputOffsets[rank];
+      for (size_t i = 0; i < outputCount; i++) {
+        if (output[i] != expected[i]) {
+          result = "MISMATCH on rank " + std::to_string(rank) + " at element " + std::to_string(i) + ": expected " +
+                   std::to_string(expected[i]) + ", got " + std::to_string(output[i]);
+          status = 1;
+          break;
+        }
+      }
+    }
+    std::printf("%s\n", result.c_str());
+  }
+  return status;
+}
+
+int explain(const Options& options) {
+  mscclpp::ExecutionPlan plan(options.name, options.planPath);
+  mscclpp::PlanInfo info = getPlanInfo(options.planPath);
+  if (options.rank >= info.worldSize) {
+    throw std::invalid_argument("Rank " + std::to_string(options.rank) + " is not in the plan of " +
+                                std::to_string(info.worldSize) + " ranks");
+  }
+  int status = 0;
+  nlohmann::json report = {{"plan", options.planPath},
+                           {"name", options.name},
+                           {"collective", info.collective},
+                           {"world_size", info.worldSize},
+                           {"ranks_per_node", options.simulation.nRanksPerNode},
+                           {"tile_size", options.executor.tileSize},
+                           {"executions", nlohmann::json::array()}};
+  for (size_t inputSize : options.sizes) {
+    size_t outputSize = getOutputSize(options, info, inputSize);
+    nlohmann::json ranks = nlohmann::json::array();
+    for (int rank = 0; rank < info.worldSize; rank++) {
+      if (options.rank >= 0 && rank != options.rank) continue;
+      mscclpp::ExecutionFootprint footprint = mscclpp::Executor::explain(
+          rank, inputSize, outputSize, plan, options.simulation.nRanksPerNode, options.executor);
+      bool overBudget = options.executor.maxContextBytes > 0 &&
+                        footprint.contextBytes > options.executor.maxContextBytes;
+      status |= overBudget;
+      ranks.push_back({{"rank", footprint.rank},
+                       {"connections", footprint.connections},
+                       {"registered_memories", footprint.registeredMemories},
+                       {"remote_memories", footprint.remoteMemories},
+                       {"sm_semaphores", footprint.smSemaphores},
+                       {"proxy_semaphores", footprint.proxySemaphores},
+                       {"sm_channels", footprint.smChannels},
+                       {"proxy_channels", footprint.proxyChannels},
+                       {"proxy_threads", footprint.proxyThreads},
+                       {"threadblocks", footprint.threadblocks},
+                       {"threads_per_block", footprint.threadsPerBlock},
+                       {"shared_mem_per_block", footprint.sharedMemPerBlock},
+                       {"scratch_buffer_size", footprint.scratchBufferSize},
+                       {"scratch_bytes_reserved", footprint.scratchBytesReserved},
+                       {"tiles", footprint.tiles},
+                       {"device_plan_bytes", footprint.devicePlanBytes},
+                       {"context_bytes", footprint.contextBytes},
+                       {"over_budget", overBudget}});
+    }
+    report["executions"].push_back({{"input_size", inputSize}, {"output_size", outputSize}, {"ranks", ranks}});
+  }
+  std::cout << report.dump(2) << "\n";
+  return status;
+}
+
+int generate(const Options& options) {
+  if (options.outputPath.empty()) {
+    throw std::invalid_argument("Missing --output");
+  }
+  mscclpp::PlanGeneratorConfig config = options.generator;
+  config.name = options.name;
+  mscclpp::writeExecutionPlan(config, options.outputPath, options.compiled);
+  std::cout << options.outputPath << ": " << config.worldSize << " ranks, " << config.protocol << "\n";
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  try {
+    options = parseOptions(argc, argv);
+    if (options.name.empty() && !options.planPath.empty()) {
+      options.name = readPlanName(options.planPath);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n\n";
+    printUsage(argv[0]);
+    return 2;
+  }
+  try {
+    if (options.command == "verify") {
+      return verify(options);
+    }
+    if (options.command == "optimize") {
+      return optimize(options);
+    }
+    if (options.command == "simulate") {
+      return simulate(options);
+    }
+    if (options.command == "explain") {
+      return explain(options);
+    }
+    if (options.command == "generate") {
+      return generate(options);
+    }
+    if (options.command == "run") {
+      return run(options);
+    }
+    std::cerr << "Unknown command " << options.command << "\n\n";
+    printUsage(argv[0]);
+    return 2;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+}